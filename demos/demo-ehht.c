@@ -7,7 +7,7 @@
 #include <stdlib.h>		/* malloc */
 #include <string.h>		/* strlen */
 #include <errno.h>		/* errno strerror */
-#include <stdint.h>		/* int32_t */
+#include <stdint.h>		/* int32_t uint64_t */
 
 #include "../src/ehht.h"
 #include "../tests/ehht-report.h"
@@ -19,22 +19,21 @@
 #define MAX_WORD_LEN 80
 #define WORD_SCANF_FMT "%79s"
 
-unsigned int leveldb_hash(const char *data, size_t len);
-unsigned int djb2_hash(const char *data, size_t len);
-unsigned int ehht_kr2_hashcode(const char *str, size_t str_len);
+uint64_t leveldb_hash(const char *data, size_t len);
+uint64_t djb2_hash(const char *data, size_t len);
 int32_t jumphash(uint64_t key, int32_t num_buckets);
 
 /* global for easy use of jumphash-ing */
 size_t num_buckets;
 
-unsigned int djb2_jump(const char *data, size_t len)
+uint64_t djb2_jump(const char *data, size_t len)
 {
 	return jumphash(djb2_hash(data, len), num_buckets);
 }
 
-unsigned int ehht_jump(const char *data, size_t len)
+uint64_t ehht_jump(const char *data, size_t len)
 {
-	return jumphash(ehht_kr2_hashcode(data, len), num_buckets);
+	return jumphash(ehht_wyhash_hashcode(data, len), num_buckets);
 }
 
 #define new_table(target, buckets, hash_pfunc) \
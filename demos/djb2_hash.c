@@ -5,6 +5,7 @@
 /* See Also: http://www.cse.yorku.ca/~oz/hash.html */
 
 #include <stddef.h>		/* size_t */
+#include <stdint.h>		/* uint64_t */
 
 #ifndef DJB2_HASH_SEED
 /*
@@ -23,7 +24,7 @@
 */
 #define DJB2_HASH_SEED 5381
 #endif /* DJB2_HASH_SEED */
-unsigned int djb2_hash(const char *data, size_t len)
+uint64_t djb2_hash(const char *data, size_t len)
 {
 	unsigned int hash;
 	size_t i;
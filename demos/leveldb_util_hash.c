@@ -38,6 +38,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <stddef.h>		/* size_t */
+#include <stdint.h>		/* uint64_t */
 
 /* https://github.com/google/leveldb/blob/master/util/coding.h#L58 */
 unsigned int leveldb_decode_fixed_32(const char *ptr)
@@ -55,7 +56,7 @@ unsigned int leveldb_decode_fixed_32(const char *ptr)
 const unsigned int leveldb_seed = 0xbc9f1d34;
 
 /* https://github.com/google/leveldb/blob/master/util/hash.cc#L18 */
-unsigned int leveldb_hash(const char *data, size_t n)
+uint64_t leveldb_hash(const char *data, size_t n)
 {
 	/* Similar to murmur hash */
 	const unsigned int m = 0xc6a4a793;
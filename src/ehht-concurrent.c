@@ -0,0 +1,895 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* ehht-concurrent.c: a lock-free read engine for a simple OO hashtable */
+/* Copyright (C) 2016, 2017, 2018, 2019, 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+/*
+  Chained buckets which many threads may read while one thread at a time
+  writes. Writers take the table's lock; get and has_key take none. A
+  writer fully builds an element before publishing it with a release
+  store of the link which points to it, and readers follow links with
+  acquire loads, thus a reader sees either the old chain or the new one.
+
+  An unlinked element may still be in use by a reader which found it
+  before it was unlinked, so it is not freed at once, but retired, as
+  are the old bucket arrays of a resize. Retired memory is reclaimed by
+  epochs: each reader, for the length of its lookup, announces the epoch
+  it started in, in one of the slots of struct ehht_epochs_s. Writers
+  advance the epoch, and free what was retired before the oldest epoch
+  announced. If every slot is taken, a reader takes the lock instead.
+
+  Resizing builds a complete new bucket array of copied elements, then
+  publishes it with a single store, thus readers are never blocked by a
+  resize, nor can they see an element half way between chains; the old
+  array and its elements are retired. This costs a second copy of the
+  elements while resizing, and a slot returned by ehht_entry does not
+  survive the resize. Writes through such a slot are not atomic, and so
+  should not be made while other threads read the key.
+
+  Without GCC style atomic builtins, or without threads, every reader
+  takes the lock.
+*/
+
+#include "ehht.h"
+#include "ehht-private.h"
+#include <stdint.h>		/* SIZE_MAX */
+#include <string.h>		/* memcpy memcmp */
+#include <assert.h>
+
+#ifndef EHHT_CC_RECLAIM_BATCH
+/* the number of retired elements which causes a reclaim */
+#define EHHT_CC_RECLAIM_BATCH 64
+#endif
+
+#ifndef EHHT_CC_LOADFACTOR
+#define EHHT_CC_LOADFACTOR 1.0
+#endif
+
+#ifndef EHHT_CC_MIN_BUCKETS
+#define EHHT_CC_MIN_BUCKETS 8
+#endif
+
+/* the key bytes are stored directly after the element */
+struct ehht_cc_element_s {
+	struct ehht_key_s key;
+	void *val;
+	struct ehht_cc_element_s *next;
+	/* once unlinked, the next element retired, and when */
+	struct ehht_cc_element_s *retired;
+	unsigned long retired_epoch;
+};
+
+/* the heads are stored directly after the struct */
+struct ehht_cc_buckets_s {
+	size_t num_buckets;
+	size_t mask;
+	struct ehht_cc_element_s **heads;
+	struct ehht_cc_buckets_s *retired;
+	unsigned long retired_epoch;
+};
+
+struct ehht_concurrent_s {
+	struct ehht_engine_s engine;
+	struct ehht_epochs_s epochs;
+	/* read without the lock */
+	struct ehht_cc_buckets_s *buckets;
+	size_t size;
+	/* the rest is only used with the lock held */
+	struct ehht_lock_s *lock;
+	double load_factor;
+	/* oldest first */
+	struct ehht_cc_element_s *retired;
+	struct ehht_cc_element_s *retired_last;
+	size_t num_retired;
+	struct ehht_cc_buckets_s *retired_buckets;
+};
+
+static struct ehht_concurrent_s *ehht_cc_get_table(struct ehht_s *this)
+{
+	return (struct ehht_concurrent_s *)this->data;
+}
+
+/* the bucket mask keeps only the low bits, so scramble them first */
+static size_t ehht_cc_bucket_num(const struct ehht_cc_buckets_s *buckets,
+				 uint64_t hashcode)
+{
+	hashcode ^= hashcode >> 33;
+	hashcode *= Ehht_u64(0xff51afd7UL, 0xed558ccdUL);
+	hashcode ^= hashcode >> 33;
+	return ((size_t)hashcode) & buckets->mask;
+}
+
+/* returns 0 if the power of two would not fit in a size_t */
+static size_t ehht_cc_round_up(size_t num_buckets)
+{
+	size_t n;
+
+	n = EHHT_CC_MIN_BUCKETS;
+	while (n < num_buckets) {
+		if (n > (SIZE_MAX / 2)) {
+			return 0;
+		}
+		n *= 2;
+	}
+	return n;
+}
+
+static struct ehht_cc_buckets_s *ehht_cc_alloc_buckets(struct ehht_concurrent_s
+						       *cc, size_t num_buckets)
+{
+	struct ehht_cc_buckets_s *buckets;
+	size_t i, size;
+
+	size = sizeof(struct ehht_cc_element_s *);
+	if (num_buckets == 0 || num_buckets >
+	    ((SIZE_MAX - sizeof(struct ehht_cc_buckets_s)) / size)) {
+		Ehht_failed_malloc(SIZE_MAX, "buckets");
+		return NULL;
+	}
+	size = sizeof(struct ehht_cc_buckets_s) + (size * num_buckets);
+	buckets = cc->engine.alloc(size, cc->engine.mem_context);
+	if (buckets == NULL) {
+		Ehht_failed_malloc(size, "buckets");
+		return NULL;
+	}
+	buckets->num_buckets = num_buckets;
+	buckets->mask = num_buckets - 1;
+	buckets->heads = (struct ehht_cc_element_s **)(buckets + 1);
+	buckets->retired = NULL;
+	buckets->retired_epoch = 0;
+	for (i = 0; i < num_buckets; ++i) {
+		buckets->heads[i] = NULL;
+	}
+	return buckets;
+}
+
+static struct ehht_cc_element_s *ehht_cc_alloc_element(struct ehht_concurrent_s
+						       *cc, const char *key,
+						       size_t key_len,
+						       uint64_t hashcode,
+						       void *val)
+{
+	struct ehht_cc_element_s *element;
+	char *key_copy;
+	size_t size;
+
+	size = sizeof(struct ehht_cc_element_s);
+	if (key_len >= (SIZE_MAX - size)) {
+		Ehht_failed_malloc(SIZE_MAX, "struct ehht_cc_element_s");
+		return NULL;
+	}
+	size += key_len + 1;
+	element = ehht_engine_entry_alloc(&cc->engine, size);
+	if (element == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_cc_element_s");
+		return NULL;
+	}
+	key_copy = (char *)(element + 1);
+	memcpy(key_copy, key, key_len);
+	key_copy[key_len] = '\0';
+
+	element->key.str = key_copy;
+	element->key.len = key_len;
+	element->key.hashcode = hashcode;
+	element->val = val;
+	element->next = NULL;
+	element->retired = NULL;
+	element->retired_epoch = 0;
+	return element;
+}
+
+/* returns the slot announcing the reader's epoch, or NULL if the lock was
+ * taken instead */
+static struct ehht_epoch_slot_s *ehht_cc_read_begin(struct ehht_concurrent_s
+						    *cc)
+{
+	struct ehht_epoch_slot_s *slot;
+
+	slot = ehht_epoch_enter(&cc->epochs);
+	if (slot == NULL) {
+		ehht_lock(cc->lock);
+	}
+	return slot;
+}
+
+static void ehht_cc_read_end(struct ehht_concurrent_s *cc,
+			     struct ehht_epoch_slot_s *slot)
+{
+	if (slot == NULL) {
+		ehht_unlock(cc->lock);
+		return;
+	}
+	ehht_epoch_exit(slot);
+}
+
+/* safe without the lock, between read_begin and read_end */
+static struct ehht_cc_element_s *ehht_cc_find(struct ehht_concurrent_s *cc,
+					      const char *key, size_t key_len,
+					      uint64_t hashcode)
+{
+	struct ehht_cc_buckets_s *buckets;
+	struct ehht_cc_element_s *element;
+
+	buckets = Ehht_load_acquire(&cc->buckets);
+	element = Ehht_load_acquire(buckets->heads +
+				    ehht_cc_bucket_num(buckets, hashcode));
+	while (element != NULL) {
+		if (element->key.hashcode == hashcode
+		    && element->key.len == key_len
+		    && memcmp(key, element->key.str, key_len) == 0) {
+			return element;
+		}
+		element = Ehht_load_acquire(&element->next);
+	}
+	return NULL;
+}
+
+/* with the lock held: frees what no reader can still see */
+static void ehht_cc_reclaim(struct ehht_concurrent_s *cc)
+{
+	struct ehht_cc_element_s *element;
+	struct ehht_cc_buckets_s *buckets, **link;
+	unsigned long oldest;
+
+	ehht_epoch_advance(&cc->epochs, &oldest);
+
+	while ((element = cc->retired) != NULL
+	       && element->retired_epoch < oldest) {
+		cc->retired = element->retired;
+		--(cc->num_retired);
+		ehht_engine_entry_free(&cc->engine, element);
+	}
+	if (cc->retired == NULL) {
+		cc->retired_last = NULL;
+	}
+
+	link = &cc->retired_buckets;
+	while ((buckets = *link) != NULL) {
+		if (buckets->retired_epoch < oldest) {
+			*link = buckets->retired;
+			cc->engine.free(buckets, cc->engine.mem_context);
+		} else {
+			link = &buckets->retired;
+		}
+	}
+}
+
+/* with the lock held, after the element has been unlinked */
+static void ehht_cc_retire(struct ehht_concurrent_s *cc,
+			   struct ehht_cc_element_s *element)
+{
+	element->retired = NULL;
+	element->retired_epoch = Ehht_load_relaxed(&cc->epochs.epoch);
+	if (cc->retired_last) {
+		cc->retired_last->retired = element;
+	} else {
+		cc->retired = element;
+	}
+	cc->retired_last = element;
+	++(cc->num_retired);
+}
+
+/* with the lock held, after the array has been replaced; the elements
+ * which are still linked from it are retired along with it */
+static void ehht_cc_retire_buckets(struct ehht_concurrent_s *cc,
+				   struct ehht_cc_buckets_s *buckets,
+				   int with_elements)
+{
+	struct ehht_cc_element_s *element;
+	size_t i;
+
+	if (with_elements) {
+		for (i = 0; i < buckets->num_buckets; ++i) {
+			for (element = buckets->heads[i]; element;
+			     element = element->next) {
+				ehht_cc_retire(cc, element);
+			}
+		}
+	}
+	buckets->retired_epoch = Ehht_load_relaxed(&cc->epochs.epoch);
+	buckets->retired = cc->retired_buckets;
+	cc->retired_buckets = buckets;
+	ehht_cc_reclaim(cc);
+}
+
+/* with the lock held: copies every element into a new array, which is
+ * then published in place of the old */
+static size_t ehht_cc_resize(struct ehht_concurrent_s *cc, size_t num_buckets)
+{
+	struct ehht_cc_buckets_s *old, *new;
+	struct ehht_cc_element_s *element, *copy, **head;
+	size_t i, j;
+
+	old = cc->buckets;
+	num_buckets = ehht_cc_round_up(num_buckets);
+	if (num_buckets == 0 || num_buckets == old->num_buckets) {
+		return old->num_buckets;
+	}
+	new = ehht_cc_alloc_buckets(cc, num_buckets);
+	if (new == NULL) {
+		return old->num_buckets;
+	}
+
+	for (i = 0; i < old->num_buckets; ++i) {
+		element = old->heads[i];
+		for (; element != NULL; element = element->next) {
+			copy = ehht_cc_alloc_element(cc, element->key.str,
+						     element->key.len,
+						     element->key.hashcode,
+						     element->val);
+			if (copy == NULL) {
+				for (j = 0; j < new->num_buckets; ++j) {
+					while ((copy = new->heads[j])) {
+						new->heads[j] = copy->next;
+						ehht_engine_entry_free(&cc->
+								       engine,
+								       copy);
+					}
+				}
+				cc->engine.free(new, cc->engine.mem_context);
+				return old->num_buckets;
+			}
+			head = new->heads +
+			    ehht_cc_bucket_num(new, copy->key.hashcode);
+			copy->next = *head;
+			*head = copy;
+		}
+	}
+
+	Ehht_store_release(&cc->buckets, new);
+	ehht_cc_retire_buckets(cc, old, 1);
+	return new->num_buckets;
+}
+
+static void *ehht_cc_get_hashed(struct ehht_s *this, const char *key,
+				size_t key_len, uint64_t hashcode)
+{
+	struct ehht_concurrent_s *cc;
+	struct ehht_epoch_slot_s *slot;
+	struct ehht_cc_element_s *element;
+	void *val;
+
+	cc = ehht_cc_get_table(this);
+
+	slot = ehht_cc_read_begin(cc);
+	element = ehht_cc_find(cc, key, key_len, hashcode);
+	val = (element == NULL) ? NULL : Ehht_load_acquire(&element->val);
+	ehht_cc_read_end(cc, slot);
+
+	return val;
+}
+
+static void *ehht_cc_get(struct ehht_s *this, const char *key, size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_cc_get_hashed(this, key, key_len, hashcode);
+}
+
+static int ehht_cc_has_key_hashed(struct ehht_s *this, const char *key,
+				  size_t key_len, uint64_t hashcode)
+{
+	struct ehht_concurrent_s *cc;
+	struct ehht_epoch_slot_s *slot;
+	int found;
+
+	cc = ehht_cc_get_table(this);
+
+	slot = ehht_cc_read_begin(cc);
+	found = (ehht_cc_find(cc, key, key_len, hashcode) != NULL);
+	ehht_cc_read_end(cc, slot);
+
+	return found;
+}
+
+static int ehht_cc_has_key(struct ehht_s *this, const char *key,
+			   size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_cc_has_key_hashed(this, key, key_len, hashcode);
+}
+
+/* with the lock held: grows if needed, then links a new element */
+static struct ehht_cc_element_s *ehht_cc_insert(struct ehht_concurrent_s *cc,
+						const char *key,
+						size_t key_len,
+						uint64_t hashcode, void *val)
+{
+	struct ehht_cc_element_s *element, **head;
+	struct ehht_cc_buckets_s *buckets;
+
+	buckets = cc->buckets;
+	if (cc->load_factor > 0.0
+	    && cc->size >= (buckets->num_buckets * cc->load_factor)
+	    && buckets->num_buckets <= (SIZE_MAX / 2)) {
+		ehht_cc_resize(cc, 2 * buckets->num_buckets);
+		buckets = cc->buckets;
+	}
+
+	element = ehht_cc_alloc_element(cc, key, key_len, hashcode, val);
+	if (element == NULL) {
+		return NULL;
+	}
+	head = buckets->heads + ehht_cc_bucket_num(buckets, hashcode);
+	element->next = *head;
+	Ehht_store_release(head, element);
+	Ehht_store_relaxed(&cc->size, cc->size + 1);
+	return element;
+}
+
+/* with the lock held */
+static struct ehht_cc_element_s *ehht_cc_locked_find(struct ehht_concurrent_s
+						     *cc, const char *key,
+						     size_t key_len,
+						     uint64_t hashcode)
+{
+	struct ehht_cc_element_s *element;
+
+	element = cc->buckets->heads[ehht_cc_bucket_num(cc->buckets,
+							hashcode)];
+	for (; element != NULL; element = element->next) {
+		if (element->key.hashcode == hashcode
+		    && element->key.len == key_len
+		    && memcmp(key, element->key.str, key_len) == 0) {
+			return element;
+		}
+	}
+	return NULL;
+}
+
+static void *ehht_cc_put_hashed(struct ehht_s *this, const char *key,
+				size_t key_len, uint64_t hashcode, void *val)
+{
+	struct ehht_concurrent_s *cc;
+	struct ehht_cc_element_s *element;
+	void *old_val;
+
+	cc = ehht_cc_get_table(this);
+
+	old_val = NULL;
+	ehht_lock(cc->lock);
+	element = ehht_cc_locked_find(cc, key, key_len, hashcode);
+	if (element != NULL) {
+		old_val = element->val;
+		Ehht_store_release(&element->val, val);
+	} else if (ehht_cc_insert(cc, key, key_len, hashcode, val) == NULL) {
+		fprintf(stderr, "%s:%d: ehht_put failed\n", __FILE__, __LINE__);
+	}
+	ehht_unlock(cc->lock);
+
+	return old_val;
+}
+
+static void *ehht_cc_put(struct ehht_s *this, const char *key, size_t key_len,
+			 void *val)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_cc_put_hashed(this, key, key_len, hashcode, val);
+}
+
+/* the slot is written without atomics, see above */
+static void **ehht_cc_entry_hashed(struct ehht_s *this, const char *key,
+				   size_t key_len, uint64_t hashcode,
+				   int *created)
+{
+	struct ehht_concurrent_s *cc;
+	struct ehht_cc_element_s *element;
+	int inserted;
+
+	cc = ehht_cc_get_table(this);
+
+	inserted = 0;
+	ehht_lock(cc->lock);
+	element = ehht_cc_locked_find(cc, key, key_len, hashcode);
+	if (element == NULL) {
+		element = ehht_cc_insert(cc, key, key_len, hashcode, NULL);
+		inserted = (element != NULL);
+	}
+	ehht_unlock(cc->lock);
+
+	if (created) {
+		*created = inserted;
+	}
+	return (element == NULL) ? NULL : &(element->val);
+}
+
+static void *ehht_cc_remove_hashed(struct ehht_s *this, const char *key,
+				   size_t key_len, uint64_t hashcode)
+{
+	struct ehht_concurrent_s *cc;
+	struct ehht_cc_element_s *element, **link;
+	size_t num_buckets;
+	void *old_val;
+
+	cc = ehht_cc_get_table(this);
+
+	old_val = NULL;
+	ehht_lock(cc->lock);
+	link = cc->buckets->heads + ehht_cc_bucket_num(cc->buckets, hashcode);
+	for (; (element = *link) != NULL; link = &(element->next)) {
+		if (element->key.hashcode == hashcode
+		    && element->key.len == key_len
+		    && memcmp(key, element->key.str, key_len) == 0) {
+			break;
+		}
+	}
+	if (element != NULL) {
+		old_val = element->val;
+		/* a reader on the element may still follow its next */
+		Ehht_store_release(link, element->next);
+		Ehht_store_relaxed(&cc->size, cc->size - 1);
+		ehht_cc_retire(cc, element);
+
+		num_buckets = cc->buckets->num_buckets;
+		if (ehht_engine_should_shrink(&cc->engine, cc->size,
+					      num_buckets, cc->load_factor)) {
+			ehht_cc_resize(cc, num_buckets / 2);
+		}
+		if (cc->num_retired >= EHHT_CC_RECLAIM_BATCH) {
+			ehht_cc_reclaim(cc);
+		}
+	}
+	ehht_unlock(cc->lock);
+
+	return old_val;
+}
+
+static void *ehht_cc_remove(struct ehht_s *this, const char *key,
+			    size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_cc_remove_hashed(this, key, key_len, hashcode);
+}
+
+static size_t ehht_cc_size(struct ehht_s *this)
+{
+	return Ehht_load_relaxed(&ehht_cc_get_table(this)->size);
+}
+
+/* an empty array replaces the old, which is retired with its elements */
+static void ehht_cc_clear(struct ehht_s *this)
+{
+	struct ehht_concurrent_s *cc;
+	struct ehht_cc_buckets_s *old, *new;
+	struct ehht_cc_element_s *element;
+	size_t i;
+
+	cc = ehht_cc_get_table(this);
+
+	ehht_lock(cc->lock);
+	old = cc->buckets;
+	new = ehht_cc_alloc_buckets(cc,
+				    ehht_cc_round_up(cc->engine.min_buckets));
+	if (new != NULL) {
+		Ehht_store_release(&cc->buckets, new);
+		ehht_cc_retire_buckets(cc, old, 1);
+	} else {
+		/* unlinked a bucket at a time, in place */
+		for (i = 0; i < old->num_buckets; ++i) {
+			element = old->heads[i];
+			Ehht_store_release(old->heads + i, NULL);
+			for (; element; element = element->next) {
+				ehht_cc_retire(cc, element);
+			}
+		}
+		ehht_cc_reclaim(cc);
+	}
+	Ehht_store_relaxed(&cc->size, 0);
+	ehht_unlock(cc->lock);
+}
+
+/* with the lock held, thus func must not call methods of the same table */
+static int ehht_cc_for_each(struct ehht_s *this, ehht_iterator_func func,
+			    void *context)
+{
+	struct ehht_concurrent_s *cc;
+	struct ehht_cc_element_s *element;
+	size_t i;
+	int end;
+
+	cc = ehht_cc_get_table(this);
+
+	end = 0;
+	ehht_lock(cc->lock);
+	for (i = 0; i < cc->buckets->num_buckets && !end; ++i) {
+		for (element = cc->buckets->heads[i]; element && !end;
+		     element = element->next) {
+			end = func(element->key, element->val, context);
+		}
+	}
+	ehht_unlock(cc->lock);
+
+	return end;
+}
+
+/* with the lock held throughout, for a consistent set of keys */
+static struct ehht_keys_s *ehht_cc_keys(struct ehht_s *this, int copy_keys)
+{
+	struct ehht_concurrent_s *cc;
+	struct ehht_keys_s *keys;
+	struct ehht_cc_element_s *element;
+	struct ehht_key_s *key;
+	char *key_copy;
+	size_t i, size;
+
+	cc = ehht_cc_get_table(this);
+
+	size = sizeof(struct ehht_keys_s);
+	keys = cc->engine.alloc(size, cc->engine.mem_context);
+	if (keys == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_keys_s");
+		return NULL;
+	}
+	keys->keys_copied = copy_keys;
+	keys->keys = NULL;
+	keys->len = 0;
+
+	ehht_lock(cc->lock);
+	size = sizeof(struct ehht_key_s) * cc->size;
+	if (size) {
+		keys->keys = cc->engine.alloc(size, cc->engine.mem_context);
+		if (keys->keys == NULL) {
+			Ehht_failed_malloc(size, "key list");
+			ehht_unlock(cc->lock);
+			cc->engine.free(keys, cc->engine.mem_context);
+			return NULL;
+		}
+	}
+	for (i = 0; i < cc->buckets->num_buckets; ++i) {
+		for (element = cc->buckets->heads[i]; element;
+		     element = element->next) {
+			key = keys->keys + keys->len;
+			*key = element->key;
+			if (copy_keys) {
+				size = element->key.len + 1;
+				key_copy = cc->engine.alloc(size,
+							    cc->engine.
+							    mem_context);
+				if (key_copy == NULL) {
+					Ehht_failed_malloc(size, "key copy");
+					ehht_unlock(cc->lock);
+					ehht_engine_free_keys(this, keys);
+					return NULL;
+				}
+				memcpy(key_copy, element->key.str, size);
+				key->str = key_copy;
+			}
+			++(keys->len);
+		}
+	}
+	ehht_unlock(cc->lock);
+
+	return keys;
+}
+
+static size_t ehht_cc_buckets_size(struct ehht_s *this)
+{
+	struct ehht_concurrent_s *cc;
+
+	cc = ehht_cc_get_table(this);
+	return Ehht_load_acquire(&cc->buckets)->num_buckets;
+}
+
+static size_t ehht_cc_buckets_resize(struct ehht_s *this, size_t num_buckets)
+{
+	struct ehht_concurrent_s *cc;
+
+	cc = ehht_cc_get_table(this);
+
+	ehht_lock(cc->lock);
+	num_buckets = ehht_cc_resize(cc, num_buckets);
+	ehht_unlock(cc->lock);
+
+	return num_buckets;
+}
+
+/* a factor of zero disables growth */
+static void ehht_cc_buckets_auto_resize_load_factor(struct ehht_s *this,
+						    double factor)
+{
+	struct ehht_concurrent_s *cc;
+
+	cc = ehht_cc_get_table(this);
+
+	ehht_lock(cc->lock);
+	cc->load_factor = (factor > 0.0) ? factor : 0.0;
+	ehht_unlock(cc->lock);
+}
+
+static size_t ehht_cc_bucket_for_key(struct ehht_s *this, const char *key,
+				     size_t key_len)
+{
+	struct ehht_concurrent_s *cc;
+
+	cc = ehht_cc_get_table(this);
+	return ehht_cc_bucket_num(Ehht_load_acquire(&cc->buckets),
+				  Ehht_hash(&cc->engine, key, key_len));
+}
+
+static size_t ehht_cc_reserve(struct ehht_s *this, size_t n_elements)
+{
+	struct ehht_concurrent_s *cc;
+	size_t num_buckets;
+
+	cc = ehht_cc_get_table(this);
+
+	ehht_lock(cc->lock);
+	num_buckets = cc->buckets->num_buckets;
+	if (cc->load_factor > 0.0) {
+		num_buckets = ehht_buckets_for_elements(n_elements,
+							cc->load_factor);
+	}
+	if (num_buckets > cc->buckets->num_buckets) {
+		ehht_cc_resize(cc, num_buckets);
+	}
+	num_buckets = cc->buckets->num_buckets;
+	ehht_unlock(cc->lock);
+
+	return num_buckets;
+}
+
+static size_t ehht_cc_shrink_to_fit(struct ehht_s *this)
+{
+	struct ehht_concurrent_s *cc;
+	size_t num_buckets;
+	double load_factor;
+
+	cc = ehht_cc_get_table(this);
+
+	ehht_lock(cc->lock);
+	load_factor = (cc->load_factor > 0.0) ? cc->load_factor
+	    : EHHT_CC_LOADFACTOR;
+	num_buckets = ehht_buckets_for_elements(cc->size, load_factor);
+	num_buckets = ehht_cc_round_up(num_buckets);
+	if (num_buckets && num_buckets < cc->buckets->num_buckets) {
+		ehht_cc_resize(cc, num_buckets);
+	}
+	num_buckets = cc->buckets->num_buckets;
+	ehht_unlock(cc->lock);
+
+	return num_buckets;
+}
+
+/* no other thread may be using the table */
+static void ehht_cc_free(struct ehht_s *this)
+{
+	struct ehht_concurrent_s *cc;
+	struct ehht_cc_element_s *element;
+	struct ehht_cc_buckets_s *buckets;
+	ehht_free_func free_func;
+	void *mem_context;
+	size_t i;
+
+	cc = ehht_cc_get_table(this);
+
+	free_func = cc->engine.free;
+	mem_context = cc->engine.mem_context;
+
+	for (i = 0; i < cc->buckets->num_buckets; ++i) {
+		while ((element = cc->buckets->heads[i]) != NULL) {
+			cc->buckets->heads[i] = element->next;
+			ehht_engine_entry_free(&cc->engine, element);
+		}
+	}
+	free_func(cc->buckets, mem_context);
+	while ((element = cc->retired) != NULL) {
+		cc->retired = element->retired;
+		ehht_engine_entry_free(&cc->engine, element);
+	}
+	while ((buckets = cc->retired_buckets) != NULL) {
+		cc->retired_buckets = buckets->retired;
+		free_func(buckets, mem_context);
+	}
+
+	ehht_lock_destroy(cc->lock, free_func, mem_context);
+	ehht_engine_release(&cc->engine);
+	free_func(cc, mem_context);
+	free_func(this, mem_context);
+}
+
+static const struct ehht_engine_ops_s ehht_concurrent_ops = {
+	ehht_cc_buckets_size,
+	ehht_cc_buckets_resize,
+	ehht_cc_buckets_auto_resize_load_factor,
+	ehht_cc_bucket_for_key,
+	ehht_cc_free,
+	ehht_cc_get_hashed,
+	ehht_cc_put_hashed,
+	ehht_cc_remove_hashed,
+	ehht_cc_has_key_hashed,
+	ehht_cc_entry_hashed,
+	NULL,
+	NULL,
+	NULL,
+	ehht_cc_reserve,
+	ehht_cc_shrink_to_fit,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+struct ehht_s *ehht_concurrent_new(const struct ehht_options_s *options)
+{
+	struct ehht_s *this;
+	struct ehht_concurrent_s *cc;
+	ehht_malloc_func mem_alloc;
+	ehht_free_func mem_free;
+	void *mem_context;
+	size_t size, num_buckets;
+
+	mem_alloc = options->alloc_func;
+	mem_free = options->free_func;
+	mem_context = options->mem_context;
+
+	size = sizeof(struct ehht_s);
+	this = mem_alloc(size, mem_context);
+	if (this == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_s");
+		return NULL;
+	}
+	this->get = ehht_cc_get;
+	this->put = ehht_cc_put;
+	this->remove = ehht_cc_remove;
+	this->size = ehht_cc_size;
+	this->clear = ehht_cc_clear;
+	this->for_each = ehht_cc_for_each;
+	this->has_key = ehht_cc_has_key;
+	this->keys = ehht_cc_keys;
+	this->free_keys = ehht_engine_free_keys;
+	this->to_string = ehht_engine_to_string;
+
+	size = sizeof(struct ehht_concurrent_s);
+	cc = mem_alloc(size, mem_context);
+	if (cc == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_concurrent_s");
+		mem_free(this, mem_context);
+		return NULL;
+	}
+	this->data = (void *)cc;
+
+	if (ehht_engine_init(&cc->engine, &ehht_concurrent_ops, options)) {
+		mem_free(cc, mem_context);
+		mem_free(this, mem_context);
+		return NULL;
+	}
+	ehht_epochs_init(&cc->epochs);
+	cc->size = 0;
+	cc->retired = NULL;
+	cc->retired_last = NULL;
+	cc->num_retired = 0;
+	cc->retired_buckets = NULL;
+	cc->load_factor = EHHT_CC_LOADFACTOR;
+	if (options->load_factor > 0.0) {
+		cc->load_factor = options->load_factor;
+	}
+	num_buckets = options->num_buckets;
+	if (options->expected_elements) {
+		size = ehht_buckets_for_elements(options->expected_elements,
+						 cc->load_factor);
+		if (size > num_buckets) {
+			num_buckets = size;
+		}
+	}
+	cc->buckets = ehht_cc_alloc_buckets(cc, ehht_cc_round_up(num_buckets));
+	cc->lock = ehht_lock_new(mem_alloc, mem_free, mem_context);
+	if (cc->buckets == NULL || cc->lock == NULL) {
+		if (cc->buckets) {
+			mem_free(cc->buckets, mem_context);
+		}
+		ehht_lock_destroy(cc->lock, mem_free, mem_context);
+		ehht_engine_release(&cc->engine);
+		mem_free(cc, mem_context);
+		mem_free(this, mem_context);
+		return NULL;
+	}
+
+	return this;
+}
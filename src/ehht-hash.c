@@ -0,0 +1,839 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* ehht-hash.c: hashing functions for a simple OO hashtable */
+/* Copyright (C) 2016, 2017, 2018, 2019, 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+/*
+  The default hash function reads the key eight bytes at a time and mixes
+  with 64x64->128 bit multiplies, producing a full 64 bit hashcode. The
+  older 32 bit functions remain available, their values widened.
+
+  The CRC32C and AES hash functions use the SSE4.2 crc32 and AES-NI
+  instructions if the CPU has them, checked once, else software versions
+  which compute identical results. Thus the hashcodes, and any bucket
+  layout derived from them, do not depend upon the machine.
+
+  SipHash takes a 128 bit key, which the table owns. Should a chain grow
+  suspiciously long, the chained engine may derive a new key from the
+  old and rehash, so that keys chosen to collide under one key do not
+  collide under the next.
+
+  A batch of keys hashed with kr2 is computed with AVX2, if the CPU has
+  it, as a sum of bytes times powers of 31 rather than a chain of
+  multiplies; the results are identical to the scalar function.
+*/
+
+#include "ehht.h"
+#include "ehht-private.h"
+#include <stdint.h>		/* uint32_t uint64_t */
+#include <limits.h>		/* CHAR_MIN */
+#include <string.h>		/* memset */
+#include <time.h>		/* time clock */
+
+#ifndef EHHT_HASH_SIMD
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EHHT_HASH_SIMD 1
+#else
+#define EHHT_HASH_SIMD 0
+#endif
+#endif
+
+#if EHHT_HASH_SIMD
+#include <immintrin.h>
+#endif
+
+#ifndef EHHT_HASH_INT128
+#if defined(__GNUC__) && defined(__SIZEOF_INT128__)
+#define EHHT_HASH_INT128 1
+#else
+#define EHHT_HASH_INT128 0
+#endif
+#endif
+
+#if EHHT_HASH_INT128
+__extension__ typedef unsigned __int128 ehht_u128;
+#endif
+
+#define Ehht_rotl32(x, r) (((x) << (r)) | ((x) >> (32 - (r))))
+
+#define EHHT_MURMUR3_C1 0xcc9e2d51UL
+#define EHHT_MURMUR3_C2 0x1b873593UL
+#define EHHT_MURMUR3_N 0xe6546b64UL
+#define EHHT_MURMUR3_F1 0x85ebca6bUL
+#define EHHT_MURMUR3_F2 0xc2b2ae35UL
+
+/* "This is not the best possible hash function,
+   but it is short and effective."
+   The C Programming Language, 2nd Edition */
+uint64_t ehht_kr2_hashcode(const char *data, size_t len)
+{
+	unsigned int hash;
+	size_t i;
+
+	hash = 0;
+	for (i = 0; i < len; ++i) {
+		hash *= 31;
+		hash += (unsigned int)data[i];
+	}
+
+	return hash;
+}
+
+/* murmur3 reads its blocks little-endian, regardless of the platform */
+static uint32_t ehht_load32le(const unsigned char *bytes)
+{
+	return ((uint32_t)bytes[0])
+	    | (((uint32_t)bytes[1]) << 8)
+	    | (((uint32_t)bytes[2]) << 16)
+	    | (((uint32_t)bytes[3]) << 24);
+}
+
+/* the 0 to 3 bytes after the last whole block */
+static uint32_t ehht_murmur3_tail(const unsigned char *bytes, size_t len)
+{
+	uint32_t k;
+	size_t i;
+
+	k = 0;
+	for (i = (len & 3); i > 0; --i) {
+		k = (k << 8) | bytes[(len & ~((size_t)3)) + i - 1];
+	}
+	return k;
+}
+
+static uint32_t ehht_murmur3_scramble(uint32_t k)
+{
+	k = (uint32_t)(k * EHHT_MURMUR3_C1);
+	k = Ehht_rotl32(k, 15);
+	return (uint32_t)(k * EHHT_MURMUR3_C2);
+}
+
+/* MurmurHash3_x86_32, by Austin Appleby, with a seed of zero
+ * https://github.com/aappleby/smhasher */
+uint64_t ehht_murmur3_hashcode(const char *data, size_t len)
+{
+	const unsigned char *bytes;
+	uint32_t h;
+	size_t i, blocks;
+
+	bytes = (const unsigned char *)data;
+	h = 0;
+	blocks = len / 4;
+	for (i = 0; i < blocks; ++i) {
+		h ^= ehht_murmur3_scramble(ehht_load32le(bytes + (4 * i)));
+		h = Ehht_rotl32(h, 13);
+		h = (uint32_t)((h * 5) + EHHT_MURMUR3_N);
+	}
+	h ^= ehht_murmur3_scramble(ehht_murmur3_tail(bytes, len));
+
+	h ^= (uint32_t)len;
+	h ^= h >> 16;
+	h = (uint32_t)(h * EHHT_MURMUR3_F1);
+	h ^= h >> 13;
+	h = (uint32_t)(h * EHHT_MURMUR3_F2);
+	h ^= h >> 16;
+
+	return (uint64_t)h;
+}
+
+static uint64_t ehht_load64le(const unsigned char *bytes)
+{
+	return ((uint64_t)ehht_load32le(bytes))
+	    | (((uint64_t)ehht_load32le(bytes + 4)) << 32);
+}
+
+/* the 1 to 3 bytes of a short key, as wyhash reads them */
+static uint64_t ehht_load3(const unsigned char *bytes, size_t len)
+{
+	return (((uint64_t)bytes[0]) << 16)
+	    | (((uint64_t)bytes[len >> 1]) << 8)
+	    | ((uint64_t)bytes[len - 1]);
+}
+
+/* the 128 bit product of *a and *b: the low half to *a, the high to *b */
+static void ehht_wymum(uint64_t *a, uint64_t *b)
+{
+#if EHHT_HASH_INT128
+	ehht_u128 r;
+
+	r = *a;
+	r *= *b;
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64);
+#else
+	uint64_t ha, hb, la, lb, rh, rm0, rm1, rl, t, lo, carry;
+
+	ha = *a >> 32;
+	hb = *b >> 32;
+	la = (uint32_t)*a;
+	lb = (uint32_t)*b;
+	rh = ha * hb;
+	rm0 = ha * lb;
+	rm1 = hb * la;
+	rl = la * lb;
+	t = rl + (rm0 << 32);
+	carry = (t < rl) ? 1 : 0;
+	lo = t + (rm1 << 32);
+	carry += (lo < t) ? 1 : 0;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+static uint64_t ehht_wymix(uint64_t a, uint64_t b)
+{
+	ehht_wymum(&a, &b);
+	return a ^ b;
+}
+
+#define EHHT_WYP0 Ehht_u64(0x2d358dccUL, 0xaa6c78a5UL)
+#define EHHT_WYP1 Ehht_u64(0x8bb84b93UL, 0x962eacc9UL)
+#define EHHT_WYP2 Ehht_u64(0x4b33a62eUL, 0xd433d4a3UL)
+#define EHHT_WYP3 Ehht_u64(0x4d5a2da5UL, 0x1de1aa47UL)
+
+/* wyhash "final version 4", by Wang Yi, with a seed of zero and the
+ * default secret; reads are little-endian regardless of the platform
+ * https://github.com/wangyi-fudan/wyhash */
+uint64_t ehht_wyhash_hashcode(const char *data, size_t len)
+{
+	const unsigned char *p;
+	uint64_t seed, see1, see2, a, b;
+	size_t i;
+
+	p = (const unsigned char *)data;
+	seed = ehht_wymix(EHHT_WYP0, EHHT_WYP1);
+	if (len <= 16) {
+		if (len >= 4) {
+			a = (((uint64_t)ehht_load32le(p)) << 32)
+			    | ehht_load32le(p + ((len >> 3) << 2));
+			b = (((uint64_t)ehht_load32le(p + len - 4)) << 32)
+			    | ehht_load32le(p + len - 4 - ((len >> 3) << 2));
+		} else if (len > 0) {
+			a = ehht_load3(p, len);
+			b = 0;
+		} else {
+			a = 0;
+			b = 0;
+		}
+	} else {
+		i = len;
+		if (i > 48) {
+			see1 = seed;
+			see2 = seed;
+			do {
+				seed = ehht_wymix(ehht_load64le(p) ^ EHHT_WYP1,
+						  ehht_load64le(p + 8) ^ seed);
+				see1 = ehht_wymix(ehht_load64le(p + 16)
+						  ^ EHHT_WYP2,
+						  ehht_load64le(p + 24) ^ see1);
+				see2 = ehht_wymix(ehht_load64le(p + 32)
+						  ^ EHHT_WYP3,
+						  ehht_load64le(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = ehht_wymix(ehht_load64le(p) ^ EHHT_WYP1,
+					  ehht_load64le(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = ehht_load64le(p + i - 16);
+		b = ehht_load64le(p + i - 8);
+	}
+	a ^= EHHT_WYP1;
+	b ^= seed;
+	ehht_wymum(&a, &b);
+	return ehht_wymix(a ^ EHHT_WYP0 ^ len, b ^ EHHT_WYP1);
+}
+
+/* CRC-32C (Castagnoli), reflected polynomial 0x82F63B78, as computed by
+ * the SSE4.2 crc32 instruction */
+static const uint32_t ehht_crc32c_table[256] = {
+	0x00000000UL, 0xf26b8303UL, 0xe13b70f7UL, 0x1350f3f4UL,
+	0xc79a971fUL, 0x35f1141cUL, 0x26a1e7e8UL, 0xd4ca64ebUL,
+	0x8ad958cfUL, 0x78b2dbccUL, 0x6be22838UL, 0x9989ab3bUL,
+	0x4d43cfd0UL, 0xbf284cd3UL, 0xac78bf27UL, 0x5e133c24UL,
+	0x105ec76fUL, 0xe235446cUL, 0xf165b798UL, 0x030e349bUL,
+	0xd7c45070UL, 0x25afd373UL, 0x36ff2087UL, 0xc494a384UL,
+	0x9a879fa0UL, 0x68ec1ca3UL, 0x7bbcef57UL, 0x89d76c54UL,
+	0x5d1d08bfUL, 0xaf768bbcUL, 0xbc267848UL, 0x4e4dfb4bUL,
+	0x20bd8edeUL, 0xd2d60dddUL, 0xc186fe29UL, 0x33ed7d2aUL,
+	0xe72719c1UL, 0x154c9ac2UL, 0x061c6936UL, 0xf477ea35UL,
+	0xaa64d611UL, 0x580f5512UL, 0x4b5fa6e6UL, 0xb93425e5UL,
+	0x6dfe410eUL, 0x9f95c20dUL, 0x8cc531f9UL, 0x7eaeb2faUL,
+	0x30e349b1UL, 0xc288cab2UL, 0xd1d83946UL, 0x23b3ba45UL,
+	0xf779deaeUL, 0x05125dadUL, 0x1642ae59UL, 0xe4292d5aUL,
+	0xba3a117eUL, 0x4851927dUL, 0x5b016189UL, 0xa96ae28aUL,
+	0x7da08661UL, 0x8fcb0562UL, 0x9c9bf696UL, 0x6ef07595UL,
+	0x417b1dbcUL, 0xb3109ebfUL, 0xa0406d4bUL, 0x522bee48UL,
+	0x86e18aa3UL, 0x748a09a0UL, 0x67dafa54UL, 0x95b17957UL,
+	0xcba24573UL, 0x39c9c670UL, 0x2a993584UL, 0xd8f2b687UL,
+	0x0c38d26cUL, 0xfe53516fUL, 0xed03a29bUL, 0x1f682198UL,
+	0x5125dad3UL, 0xa34e59d0UL, 0xb01eaa24UL, 0x42752927UL,
+	0x96bf4dccUL, 0x64d4cecfUL, 0x77843d3bUL, 0x85efbe38UL,
+	0xdbfc821cUL, 0x2997011fUL, 0x3ac7f2ebUL, 0xc8ac71e8UL,
+	0x1c661503UL, 0xee0d9600UL, 0xfd5d65f4UL, 0x0f36e6f7UL,
+	0x61c69362UL, 0x93ad1061UL, 0x80fde395UL, 0x72966096UL,
+	0xa65c047dUL, 0x5437877eUL, 0x4767748aUL, 0xb50cf789UL,
+	0xeb1fcbadUL, 0x197448aeUL, 0x0a24bb5aUL, 0xf84f3859UL,
+	0x2c855cb2UL, 0xdeeedfb1UL, 0xcdbe2c45UL, 0x3fd5af46UL,
+	0x7198540dUL, 0x83f3d70eUL, 0x90a324faUL, 0x62c8a7f9UL,
+	0xb602c312UL, 0x44694011UL, 0x5739b3e5UL, 0xa55230e6UL,
+	0xfb410cc2UL, 0x092a8fc1UL, 0x1a7a7c35UL, 0xe811ff36UL,
+	0x3cdb9bddUL, 0xceb018deUL, 0xdde0eb2aUL, 0x2f8b6829UL,
+	0x82f63b78UL, 0x709db87bUL, 0x63cd4b8fUL, 0x91a6c88cUL,
+	0x456cac67UL, 0xb7072f64UL, 0xa457dc90UL, 0x563c5f93UL,
+	0x082f63b7UL, 0xfa44e0b4UL, 0xe9141340UL, 0x1b7f9043UL,
+	0xcfb5f4a8UL, 0x3dde77abUL, 0x2e8e845fUL, 0xdce5075cUL,
+	0x92a8fc17UL, 0x60c37f14UL, 0x73938ce0UL, 0x81f80fe3UL,
+	0x55326b08UL, 0xa759e80bUL, 0xb4091bffUL, 0x466298fcUL,
+	0x1871a4d8UL, 0xea1a27dbUL, 0xf94ad42fUL, 0x0b21572cUL,
+	0xdfeb33c7UL, 0x2d80b0c4UL, 0x3ed04330UL, 0xccbbc033UL,
+	0xa24bb5a6UL, 0x502036a5UL, 0x4370c551UL, 0xb11b4652UL,
+	0x65d122b9UL, 0x97baa1baUL, 0x84ea524eUL, 0x7681d14dUL,
+	0x2892ed69UL, 0xdaf96e6aUL, 0xc9a99d9eUL, 0x3bc21e9dUL,
+	0xef087a76UL, 0x1d63f975UL, 0x0e330a81UL, 0xfc588982UL,
+	0xb21572c9UL, 0x407ef1caUL, 0x532e023eUL, 0xa145813dUL,
+	0x758fe5d6UL, 0x87e466d5UL, 0x94b49521UL, 0x66df1622UL,
+	0x38cc2a06UL, 0xcaa7a905UL, 0xd9f75af1UL, 0x2b9cd9f2UL,
+	0xff56bd19UL, 0x0d3d3e1aUL, 0x1e6dcdeeUL, 0xec064eedUL,
+	0xc38d26c4UL, 0x31e6a5c7UL, 0x22b65633UL, 0xd0ddd530UL,
+	0x0417b1dbUL, 0xf67c32d8UL, 0xe52cc12cUL, 0x1747422fUL,
+	0x49547e0bUL, 0xbb3ffd08UL, 0xa86f0efcUL, 0x5a048dffUL,
+	0x8ecee914UL, 0x7ca56a17UL, 0x6ff599e3UL, 0x9d9e1ae0UL,
+	0xd3d3e1abUL, 0x21b862a8UL, 0x32e8915cUL, 0xc083125fUL,
+	0x144976b4UL, 0xe622f5b7UL, 0xf5720643UL, 0x07198540UL,
+	0x590ab964UL, 0xab613a67UL, 0xb831c993UL, 0x4a5a4a90UL,
+	0x9e902e7bUL, 0x6cfbad78UL, 0x7fab5e8cUL, 0x8dc0dd8fUL,
+	0xe330a81aUL, 0x115b2b19UL, 0x020bd8edUL, 0xf0605beeUL,
+	0x24aa3f05UL, 0xd6c1bc06UL, 0xc5914ff2UL, 0x37faccf1UL,
+	0x69e9f0d5UL, 0x9b8273d6UL, 0x88d28022UL, 0x7ab90321UL,
+	0xae7367caUL, 0x5c18e4c9UL, 0x4f48173dUL, 0xbd23943eUL,
+	0xf36e6f75UL, 0x0105ec76UL, 0x12551f82UL, 0xe03e9c81UL,
+	0x34f4f86aUL, 0xc69f7b69UL, 0xd5cf889dUL, 0x27a40b9eUL,
+	0x79b737baUL, 0x8bdcb4b9UL, 0x988c474dUL, 0x6ae7c44eUL,
+	0xbe2da0a5UL, 0x4c4623a6UL, 0x5f16d052UL, 0xad7d5351UL
+};
+
+uint64_t ehht_crc32c_hashcode_portable(const char *data, size_t len)
+{
+	const unsigned char *bytes;
+	uint32_t crc;
+	size_t i;
+
+	bytes = (const unsigned char *)data;
+	crc = 0xFFFFFFFFUL;
+	for (i = 0; i < len; ++i) {
+		crc = ehht_crc32c_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return (uint64_t)(crc ^ 0xFFFFFFFFUL);
+}
+
+#define EHHT_AES_BLOCK 16
+
+static const unsigned char ehht_aes_sbox[256] = {
+	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5,
+	0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+	0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0,
+	0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+	0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc,
+	0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a,
+	0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+	0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0,
+	0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+	0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b,
+	0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85,
+	0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+	0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5,
+	0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+	0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17,
+	0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88,
+	0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+	0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c,
+	0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+	0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9,
+	0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6,
+	0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+	0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e,
+	0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+	0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94,
+	0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68,
+	0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+/* the initial state and two round keys: hex digits of pi */
+static const unsigned char ehht_aes_keys[3][EHHT_AES_BLOCK] = {
+	{ 0x24, 0x3f, 0x6a, 0x88, 0x85, 0xa3, 0x08, 0xd3,
+	 0x13, 0x19, 0x8a, 0x2e, 0x03, 0x70, 0x73, 0x44 },
+	{ 0xa4, 0x09, 0x38, 0x22, 0x29, 0x9f, 0x31, 0xd0,
+	 0x08, 0x2e, 0xfa, 0x98, 0xec, 0x4e, 0x6c, 0x89 },
+	{ 0x45, 0x28, 0x21, 0xe6, 0x38, 0xd0, 0x13, 0x77,
+	 0xbe, 0x54, 0x66, 0xcf, 0x34, 0xe9, 0x0c, 0x6c }
+};
+
+/* the initial state is the first key with the length mixed in */
+static void ehht_aes_init(unsigned char *state, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < EHHT_AES_BLOCK; ++i) {
+		state[i] = ehht_aes_keys[0][i];
+	}
+	for (i = 0; i < 8; ++i) {
+		state[i] ^= (unsigned char)(((uint64_t)len) >> (8 * i));
+	}
+}
+
+/* the 1 to 15 bytes after the last whole block, zero padded */
+static void ehht_aes_tail(unsigned char *block, const unsigned char *bytes,
+			  size_t rest)
+{
+	size_t i;
+
+	for (i = 0; i < EHHT_AES_BLOCK; ++i) {
+		block[i] = (i < rest) ? bytes[i] : 0;
+	}
+}
+
+static unsigned char ehht_xtime(unsigned char b)
+{
+	return (unsigned char)((b << 1) ^ ((b & 0x80) ? 0x1B : 0x00));
+}
+
+/* one AES encryption round, exactly as the AESENC instruction: ShiftRows,
+ * SubBytes, MixColumns, then xor with the round key; byte i of the block
+ * is row (i % 4) of column (i / 4) */
+static void ehht_aesenc(unsigned char *state, const unsigned char *key)
+{
+	unsigned char t[EHHT_AES_BLOCK];
+	unsigned char a0, a1, a2, a3, all;
+	size_t r, c;
+
+	for (c = 0; c < 4; ++c) {
+		for (r = 0; r < 4; ++r) {
+			t[(4 * c) + r] =
+			    ehht_aes_sbox[state[(4 * ((c + r) % 4)) + r]];
+		}
+	}
+	for (c = 0; c < 4; ++c) {
+		a0 = t[(4 * c)];
+		a1 = t[(4 * c) + 1];
+		a2 = t[(4 * c) + 2];
+		a3 = t[(4 * c) + 3];
+		all = (unsigned char)(a0 ^ a1 ^ a2 ^ a3);
+		state[(4 * c)] = a0 ^ all ^ ehht_xtime(a0 ^ a1);
+		state[(4 * c) + 1] = a1 ^ all ^ ehht_xtime(a1 ^ a2);
+		state[(4 * c) + 2] = a2 ^ all ^ ehht_xtime(a2 ^ a3);
+		state[(4 * c) + 3] = a3 ^ all ^ ehht_xtime(a3 ^ a0);
+	}
+	for (c = 0; c < EHHT_AES_BLOCK; ++c) {
+		state[c] ^= key[c];
+	}
+}
+
+static void ehht_aes_absorb(unsigned char *state, const unsigned char *block)
+{
+	size_t i;
+
+	for (i = 0; i < EHHT_AES_BLOCK; ++i) {
+		state[i] ^= block[i];
+	}
+	ehht_aesenc(state, ehht_aes_keys[1]);
+}
+
+/* each 16 byte block is xor-ed into the state and followed by one AES
+ * round; two more rounds diffuse the last block before folding */
+uint64_t ehht_aes_hashcode_portable(const char *data, size_t len)
+{
+	unsigned char state[EHHT_AES_BLOCK], block[EHHT_AES_BLOCK];
+	const unsigned char *bytes;
+	size_t i;
+
+	bytes = (const unsigned char *)data;
+	ehht_aes_init(state, len);
+	for (i = 0; (i + EHHT_AES_BLOCK) <= len; i += EHHT_AES_BLOCK) {
+		ehht_aes_absorb(state, bytes + i);
+	}
+	if (i < len) {
+		ehht_aes_tail(block, bytes + i, len - i);
+		ehht_aes_absorb(state, block);
+	}
+	ehht_aesenc(state, ehht_aes_keys[2]);
+	ehht_aesenc(state, ehht_aes_keys[1]);
+	return ehht_load64le(state) ^ ehht_load64le(state + 8);
+}
+
+#define Ehht_rotl64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static void ehht_sipround(uint64_t *v)
+{
+	v[0] += v[1];
+	v[1] = Ehht_rotl64(v[1], 13);
+	v[1] ^= v[0];
+	v[0] = Ehht_rotl64(v[0], 32);
+	v[2] += v[3];
+	v[3] = Ehht_rotl64(v[3], 16);
+	v[3] ^= v[2];
+	v[0] += v[3];
+	v[3] = Ehht_rotl64(v[3], 21);
+	v[3] ^= v[0];
+	v[2] += v[1];
+	v[1] = Ehht_rotl64(v[1], 17);
+	v[1] ^= v[2];
+	v[2] = Ehht_rotl64(v[2], 32);
+}
+
+static void ehht_sipcompress(uint64_t *v, uint64_t m)
+{
+	v[3] ^= m;
+	ehht_sipround(v);
+	ehht_sipround(v);
+	v[0] ^= m;
+}
+
+/* SipHash-2-4, with the 128 bit key taken as two little-endian words
+ * https://131002.net/siphash/ */
+uint64_t ehht_siphash_hashcode(const char *data, size_t len,
+			       const struct ehht_hash_seed_s *seed)
+{
+	const unsigned char *bytes;
+	uint64_t v[4], last;
+	size_t i, blocks;
+
+	bytes = (const unsigned char *)data;
+	v[0] = seed->k0 ^ Ehht_u64(0x736f6d65UL, 0x70736575UL);
+	v[1] = seed->k1 ^ Ehht_u64(0x646f7261UL, 0x6e646f6dUL);
+	v[2] = seed->k0 ^ Ehht_u64(0x6c796765UL, 0x6e657261UL);
+	v[3] = seed->k1 ^ Ehht_u64(0x74656462UL, 0x79746573UL);
+
+	blocks = len / 8;
+	for (i = 0; i < blocks; ++i) {
+		ehht_sipcompress(v, ehht_load64le(bytes + (8 * i)));
+	}
+	bytes += 8 * blocks;
+	last = ((uint64_t)len) << 56;
+	for (i = (len & 7); i > 0; --i) {
+		last |= ((uint64_t)bytes[i - 1]) << (8 * (i - 1));
+	}
+	ehht_sipcompress(v, last);
+
+	v[2] ^= 0xFF;
+	ehht_sipround(v);
+	ehht_sipround(v);
+	ehht_sipround(v);
+	ehht_sipround(v);
+	return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+/* not a secure random source: a new seed is unpredictable only to the
+ * extent that the old one was, so callers who face untrusted input from
+ * the start should supply a hash_seed from a secure source */
+void ehht_hash_seed_next(struct ehht_hash_seed_s *seed)
+{
+	static unsigned long counter = 0;
+	struct ehht_seed_entropy_s {
+		time_t now;
+		clock_t ticks;
+		const void *where;
+		unsigned long count;
+	} entropy;
+	struct ehht_hash_seed_s old;
+
+	/* the padding is hashed, too, and must not be uninitialized */
+	memset(&entropy, 0x00, sizeof(entropy));
+	entropy.now = time(NULL);
+	entropy.ticks = clock();
+	entropy.where = (const void *)seed;
+	/* shards of a table may reseed at once, each under its own lock */
+	entropy.count = Ehht_fetch_add(&counter, 1UL) + 1UL;
+
+	old = *seed;
+	seed->k0 = ehht_siphash_hashcode((const char *)&entropy,
+					 sizeof(entropy), &old);
+	old.k0 = ~old.k0;
+	seed->k1 = ehht_siphash_hashcode((const char *)&entropy,
+					 sizeof(entropy), &old);
+}
+
+#if EHHT_HASH_SIMD
+__attribute__((target("sse4.2")))
+static uint64_t ehht_crc32c_hashcode_sse42(const char *data, size_t len)
+{
+	const unsigned char *bytes;
+	uint32_t crc;
+	size_t i;
+#if defined(__x86_64__)
+	uint64_t crc64;
+#endif
+
+	bytes = (const unsigned char *)data;
+	crc = 0xFFFFFFFFUL;
+	i = 0;
+#if defined(__x86_64__)
+	crc64 = crc;
+	for (; (i + 8) <= len; i += 8) {
+		crc64 = _mm_crc32_u64(crc64, ehht_load64le(bytes + i));
+	}
+	crc = (uint32_t)crc64;
+#endif
+	for (; (i + 4) <= len; i += 4) {
+		crc = _mm_crc32_u32(crc, ehht_load32le(bytes + i));
+	}
+	for (; i < len; ++i) {
+		crc = _mm_crc32_u8(crc, bytes[i]);
+	}
+	return (uint64_t)(crc ^ 0xFFFFFFFFUL);
+}
+
+__attribute__((target("aes")))
+static uint64_t ehht_aes_hashcode_aesni(const char *data, size_t len)
+{
+	unsigned char block[EHHT_AES_BLOCK];
+	const unsigned char *bytes;
+	__m128i state, key1, key2;
+	size_t i;
+
+	bytes = (const unsigned char *)data;
+	ehht_aes_init(block, len);
+	state = _mm_loadu_si128((const __m128i *)block);
+	key1 = _mm_loadu_si128((const __m128i *)ehht_aes_keys[1]);
+	key2 = _mm_loadu_si128((const __m128i *)ehht_aes_keys[2]);
+	for (i = 0; (i + EHHT_AES_BLOCK) <= len; i += EHHT_AES_BLOCK) {
+		state = _mm_xor_si128(state,
+				      _mm_loadu_si128((const __m128i *)
+						      (bytes + i)));
+		state = _mm_aesenc_si128(state, key1);
+	}
+	if (i < len) {
+		ehht_aes_tail(block, bytes + i, len - i);
+		state = _mm_xor_si128(state,
+				      _mm_loadu_si128((const __m128i *)block));
+		state = _mm_aesenc_si128(state, key1);
+	}
+	state = _mm_aesenc_si128(state, key2);
+	state = _mm_aesenc_si128(state, key1);
+	_mm_storeu_si128((__m128i *)block, state);
+	return ehht_load64le(block) ^ ehht_load64le(block + 8);
+}
+
+/*
+  kr2 is the sum of each byte times 31^(bytes after it), thus a block of
+  bytes may be multiplied by a vector of powers and summed, without the
+  chain of multiplies of the scalar loop. ehht_kr2_powers[m] is
+  31^(31 - m), thus 31^(len - 1 - i) for byte i of a block of len bytes
+  is at (32 - len + i); past 31^0, the zeros may be read for lanes whose
+  byte is zero. No byte past the key is read: a short key is
+  loaded as two overlapping words, the bytes of the second already in the
+  first masked to zero by ehht_kr2_mask, as is the overlap of the last
+  block of a long key.
+*/
+static const uint32_t ehht_kr2_powers[40] = {
+	0x88303fdfUL, 0x14e8c841UL, 0x00acab9fUL, 0x294fe481UL,
+	0xf0d1075fUL, 0x395110c1UL, 0x01d9531fUL, 0x84304d01UL,
+	0xfc018edfUL, 0x4a319941UL, 0x8685ba9fUL, 0x0c98f581UL,
+	0xe7a1d65fUL, 0xcdaa61c1UL, 0xc491e21fUL, 0x50a9de01UL,
+	0xe191dddfUL, 0x59db6a41UL, 0xe1ddc99fUL, 0xee830681UL,
+	0x07b1a55fUL, 0x94e4b2c1UL, 0xf449711fUL, 0x94446f01UL,
+	0x67e12cdfUL, 0x34e63b41UL, 0x01b4d89fUL, 0x000e1781UL,
+	0x0000745fUL, 0x000003c1UL, 0x0000001fUL, 0x00000001UL,
+	0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/* from (16 + n - width), the last n of width bytes are kept */
+static const unsigned char ehht_kr2_mask[32] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+/* the bytes are widened as a char is, by the scalar loop */
+#if CHAR_MIN < 0
+#define Ehht_widen_epi8(v) _mm256_cvtepi8_epi32(v)
+#else
+#define Ehht_widen_epi8(v) _mm256_cvtepu8_epi32(v)
+#endif
+
+__attribute__((target("avx2")))
+static uint32_t ehht_kr2_sum8_avx2(__m128i bytes, const uint32_t *powers)
+{
+	__m256i v;
+	__m128i half;
+
+	v = _mm256_mullo_epi32(Ehht_widen_epi8(bytes),
+			       _mm256_loadu_si256((const __m256i *)powers));
+	half = _mm_add_epi32(_mm256_castsi256_si128(v),
+			     _mm256_extracti128_si256(v, 1));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+	return (uint32_t)_mm_cvtsi128_si32(half);
+}
+
+__attribute__((target("avx2")))
+static __m128i ehht_kr2_load_avx2(const char *data, size_t width, size_t n)
+{
+	__m128i bytes, mask;
+
+	if (width == 4) {
+		bytes = _mm_cvtsi32_si128((int)
+					  ehht_load32le((const unsigned char *)
+							data));
+	} else if (width == 8) {
+		bytes = _mm_loadl_epi64((const __m128i *)data);
+	} else {
+		bytes = _mm_loadu_si128((const __m128i *)data);
+	}
+	mask = _mm_loadu_si128((const __m128i *)
+			       (ehht_kr2_mask + 16 + n - width));
+	return _mm_and_si128(bytes, mask);
+}
+
+__attribute__((target("avx2")))
+static uint32_t ehht_kr2_hashcode_avx2(const char *data, size_t len)
+{
+	__m128i block;
+	uint32_t hash;
+	size_t i, w;
+
+	if (len < 4) {
+		hash = 0;
+		for (i = 0; i < len; ++i) {
+			hash = (hash * 31) + (unsigned int)data[i];
+		}
+		return hash;
+	}
+	if (len < 16) {
+		/* bytes [0, w) then the last (len - w) of [len - w, len) */
+		w = (len < 8) ? 4 : 8;
+		hash = ehht_kr2_sum8_avx2(ehht_kr2_load_avx2(data, w, w),
+					  ehht_kr2_powers + (32 - len));
+		if (w == 4) {
+			hash += ehht_kr2_sum8_avx2(ehht_kr2_load_avx2
+						   (data + len - 4, 4, len - 4),
+						   ehht_kr2_powers + 28);
+		} else {
+			hash += ehht_kr2_sum8_avx2(ehht_kr2_load_avx2
+						   (data + len - 8, 8, len - 8),
+						   ehht_kr2_powers + 24);
+		}
+		return hash;
+	}
+
+	hash = 0;
+	for (i = 0; (i + 16) <= len; i += 16) {
+		block = _mm_loadu_si128((const __m128i *)(data + i));
+		hash = (hash * ehht_kr2_powers[15])
+		    + ehht_kr2_sum8_avx2(block, ehht_kr2_powers + 16)
+		    + ehht_kr2_sum8_avx2(_mm_srli_si128(block, 8),
+					 ehht_kr2_powers + 24);
+	}
+	if (i < len) {
+		/* the last 16 bytes, those already summed masked to zero */
+		w = len - i;
+		block = ehht_kr2_load_avx2(data + len - 16, 16, w);
+		hash = (hash * ehht_kr2_powers[31 - w])
+		    + ehht_kr2_sum8_avx2(block, ehht_kr2_powers + 16)
+		    + ehht_kr2_sum8_avx2(_mm_srli_si128(block, 8),
+					 ehht_kr2_powers + 24);
+	}
+	return hash;
+}
+
+__attribute__((target("avx2")))
+static void ehht_kr2_hash_many_avx2(const char **keys, const size_t *key_lens,
+				    uint64_t *hashcodes, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		hashcodes[i] = ehht_kr2_hashcode_avx2(keys[i], key_lens[i]);
+	}
+}
+
+#define EHHT_CPU_SSE42 0x01
+#define EHHT_CPU_AES 0x02
+#define EHHT_CPU_AVX2 0x04
+
+static int ehht_hash_cpu_features(void)
+{
+	static int features = -1;
+
+	if (features < 0) {
+		__builtin_cpu_init();
+		features = 0;
+		if (__builtin_cpu_supports("sse4.2")) {
+			features |= EHHT_CPU_SSE42;
+		}
+		if (__builtin_cpu_supports("aes")) {
+			features |= EHHT_CPU_AES;
+		}
+		if (__builtin_cpu_supports("avx2")) {
+			features |= EHHT_CPU_AVX2;
+		}
+	}
+	return features;
+}
+
+#endif /* EHHT_HASH_SIMD */
+
+ehht_hash_func ehht_hash_resolve(ehht_hash_func hash_func)
+{
+#if EHHT_HASH_SIMD
+	/* settled as each table is built, thus never first probed by two
+	 * worker threads of ehht_build_parallel at once */
+	(void)ehht_hash_cpu_features();
+#endif
+	if (hash_func == ehht_crc32c_hashcode) {
+#if EHHT_HASH_SIMD
+		if (ehht_hash_cpu_features() & EHHT_CPU_SSE42) {
+			return ehht_crc32c_hashcode_sse42;
+		}
+#endif
+		return ehht_crc32c_hashcode_portable;
+	}
+	if (hash_func == ehht_aes_hashcode) {
+#if EHHT_HASH_SIMD
+		if (ehht_hash_cpu_features() & EHHT_CPU_AES) {
+			return ehht_aes_hashcode_aesni;
+		}
+#endif
+		return ehht_aes_hashcode_portable;
+	}
+	return hash_func;
+}
+
+uint64_t ehht_crc32c_hashcode(const char *data, size_t len)
+{
+	return ehht_hash_resolve(ehht_crc32c_hashcode)(data, len);
+}
+
+uint64_t ehht_aes_hashcode(const char *data, size_t len)
+{
+	return ehht_hash_resolve(ehht_aes_hashcode)(data, len);
+}
+
+/* kr2 has a vector kernel for the batch; other functions are called
+ * once per key */
+void ehht_hash_many(ehht_hash_func hash_func, const char **keys,
+		    const size_t *key_lens, uint64_t *hashcodes, size_t n)
+{
+	size_t i;
+
+#if EHHT_HASH_SIMD
+	if (hash_func == ehht_kr2_hashcode
+	    && (ehht_hash_cpu_features() & EHHT_CPU_AVX2)) {
+		ehht_kr2_hash_many_avx2(keys, key_lens, hashcodes, n);
+		return;
+	}
+#endif
+	for (i = 0; i < n; ++i) {
+		hashcodes[i] = hash_func(keys[i], key_lens[i]);
+	}
+}
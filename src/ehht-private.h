@@ -0,0 +1,357 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* ehht-private.h: internals shared by the ehht storage engines */
+/* Copyright (C) 2016, 2017, 2018, 2019, 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#ifndef EHHT_PRIVATE_H
+#define EHHT_PRIVATE_H
+
+#include "ehht.h"
+#include <stdio.h>		/* fprintf */
+
+#ifndef EHHT_DEFAULT_BUCKETS
+#define EHHT_DEFAULT_BUCKETS 64
+#endif
+
+#ifndef EHHT_DEFAULT_RESIZE_LOADFACTOR
+/* we split when we collide and we have a load factor over 0.667 */
+/* https://github.com/Perl/perl5/blob/blead/hv.c#L37 */
+#define EHHT_DEFAULT_RESIZE_LOADFACTOR (2.0/3.0)
+#endif
+
+#ifndef EHHT_DEFAULT_RESIZE_CHAIN_LEN
+/* the chain length which causes growth, for EHHT_RESIZE_CHAIN_LENGTH */
+#define EHHT_DEFAULT_RESIZE_CHAIN_LEN 8
+#endif
+
+#ifndef EHHT_DEFAULT_RESIZE_PROBES
+/* the mean elements visited per lookup which causes growth, for
+ * EHHT_RESIZE_PROBE_COUNT and the starting point of EHHT_RESIZE_AUTO_TUNE */
+#define EHHT_DEFAULT_RESIZE_PROBES 2.0
+#endif
+
+#ifndef EHHT_RESIZE_MIN_LOADFACTOR
+/* long chains or long probes only grow a table at least this loaded; a
+ * hash which puts many keys in one bucket is not helped by more buckets */
+#define EHHT_RESIZE_MIN_LOADFACTOR 0.5
+#endif
+
+#ifndef EHHT_RESIZE_WINDOW
+/* the number of lookups over which the mean probe count is measured */
+#define EHHT_RESIZE_WINDOW 128
+#endif
+
+#ifndef EHHT_DEBUG
+#ifdef NDEBUG
+#define EHHT_DEBUG 0
+#else
+#define EHHT_DEBUG 1
+#endif
+#endif
+
+#define Ehht_failed_malloc(bytes, thing) do { \
+	if (EHHT_DEBUG) { \
+		fprintf(stderr, \
+			"%s:%d: could not allocate %lu bytes for %s\n", \
+			__FILE__, __LINE__, (unsigned long)(bytes), thing); \
+	} } while (0)
+
+/* 64-bit constants without relying upon C99 "ULL" literals */
+#define Ehht_u64(hi, lo) ((((uint64_t)(hi)) << 32) | ((uint64_t)(lo)))
+
+#ifndef EHHT_DEFAULT_MAX_CHAIN_LEN
+/* the longest chain Perl's hv.c tolerated before rehashing */
+#define EHHT_DEFAULT_MAX_CHAIN_LEN 14
+#endif
+
+#ifndef EHHT_TREEIFY_THRESHOLD
+/* a chain longer than this is indexed by a balanced tree, 0 disables */
+#define EHHT_TREEIFY_THRESHOLD 8
+#endif
+
+#ifndef EHHT_UNTREEIFY_THRESHOLD
+/* a tree with fewer elements than this reverts to a plain chain */
+#define EHHT_UNTREEIFY_THRESHOLD 6
+#endif
+
+#ifndef EHHT_GET_MANY_GROUP
+/* the number of lookups in flight at once in get_many */
+#define EHHT_GET_MANY_GROUP 16
+#endif
+
+#ifndef EHHT_PUT_MANY_GROUP
+/* the number of keys hashed, then ordered by bucket, at once in put_many */
+#define EHHT_PUT_MANY_GROUP 1024
+#endif
+
+#ifndef EHHT_MAX_THREADS
+/* the most worker threads a parallel operation will use */
+#define EHHT_MAX_THREADS 256
+#endif
+
+#ifndef EHHT_BUILD_MIN_PER_THREAD
+/* ehht_build_parallel starts no more threads than give each this many
+ * keys, as fewer are not worth the cost of starting a thread */
+#define EHHT_BUILD_MIN_PER_THREAD 1024
+#endif
+
+#ifndef Ehht_prefetch
+#ifdef __GNUC__
+#define Ehht_prefetch(addr) __builtin_prefetch(addr)
+#else
+#define Ehht_prefetch(addr) ((void)(addr))
+#endif
+#endif
+
+/*
+  LCOV_EXCL_LINE - Lines containing this marker will be excluded.
+  LCOV_EXCL_START - Marks the beginning of an excluded section.
+		    The current line is part of this section.
+  LCOV_EXCL_STOP - Marks the end of an excluded section.
+		   The current line not part of this section.
+*/
+
+/* the "friend" functions, as implemented by each engine */
+struct ehht_engine_ops_s {
+	size_t (*buckets_size)(struct ehht_s *table);
+	size_t (*buckets_resize)(struct ehht_s *table, size_t num_buckets);
+	void (*buckets_auto_resize_load_factor)(struct ehht_s *table,
+						double factor);
+	size_t (*bucket_for_key)(struct ehht_s *table, const char *key,
+				 size_t key_len);
+	void (*free)(struct ehht_s *table);
+
+	/* the hashcode was computed by the table's hash_func; these may be
+	 * NULL, in which case the plain methods are called instead */
+	void *(*get_hashed)(struct ehht_s *table, const char *key,
+			    size_t key_len, uint64_t hashcode);
+	void *(*put_hashed)(struct ehht_s *table, const char *key,
+			    size_t key_len, uint64_t hashcode, void *val);
+	void *(*remove_hashed)(struct ehht_s *table, const char *key,
+			       size_t key_len, uint64_t hashcode);
+	int (*has_key_hashed)(struct ehht_s *table, const char *key,
+			      size_t key_len, uint64_t hashcode);
+
+	/* finds or inserts the key, returns its value slot; not optional */
+	void **(*entry_hashed)(struct ehht_s *table, const char *key,
+			       size_t key_len, uint64_t hashcode,
+			       int *created);
+
+	/* may be NULL, in which case get is called for each key */
+	void (*get_many)(struct ehht_s *table, const char **keys,
+			 const size_t *key_lens, void **vals, size_t n);
+
+	/* may be NULL, in which case only the size and number of buckets
+	 * are reported */
+	void (*stats)(struct ehht_s *table, struct ehht_stats_s *stats);
+	void (*stats_reset)(struct ehht_s *table);
+
+	/* grows to fit n_elements at the current load factor */
+	size_t (*reserve)(struct ehht_s *table, size_t n_elements);
+	/* shrinks to fit the current size at the current load factor */
+	size_t (*shrink_to_fit)(struct ehht_s *table);
+
+	/* may be NULL, in which case the table is reserved and put_hashed
+	 * is called for each key */
+	void (*put_many)(struct ehht_s *table, const char **keys,
+			 const size_t *key_lens, void **vals, size_t n);
+
+	/* the table is new, empty, and reserved for n elements; this puts
+	 * the keys using num_threads threads; may be NULL, in which case
+	 * put_many is called instead */
+	void (*put_parallel)(struct ehht_s *table, const char **keys,
+			     const size_t *key_lens, void **vals, size_t n,
+			     size_t num_threads);
+
+	/* may be NULL, if the engine has only its own growth rule */
+	void (*resize_policy)(struct ehht_s *table,
+			      const struct ehht_resize_policy_s *policy);
+
+	/* may be NULL, if the engine's own shrink_load_factor is enough */
+	void (*buckets_auto_shrink_load_factor)(struct ehht_s *table,
+						double factor);
+};
+
+struct ehht_slab_s;
+
+/* the private "data" of every engine must begin with this struct */
+struct ehht_engine_s {
+	const struct ehht_engine_ops_s *ops;
+	ehht_hash_func hash_func;
+	/* if not NULL, used rather than hash_func */
+	ehht_seeded_hash_func seeded_hash_func;
+	struct ehht_hash_seed_s seed;
+	ehht_malloc_func alloc;
+	ehht_free_func free;
+	/* may be NULL */
+	ehht_realloc_func realloc;
+	void *mem_context;
+	/* NULL unless options->slab_page_size was set */
+	struct ehht_slab_s *slab;
+	/* zero, or the load below which the table shrinks */
+	double shrink_load_factor;
+	/* automatic shrinking stops at the size requested at construction */
+	size_t min_buckets;
+};
+
+#define Ehht_engine(this) ((struct ehht_engine_s *)((this)->data))
+
+/* the hashcode of the key, as computed by the engine's hash function */
+#define Ehht_hash(engine, key, key_len) \
+	((engine)->seeded_hash_func \
+	 ? (engine)->seeded_hash_func(key, key_len, &((engine)->seed)) \
+	 : (engine)->hash_func(key, key_len))
+
+/* returns non-zero if the engine could not be initialized */
+int ehht_engine_init(struct ehht_engine_s *engine,
+		     const struct ehht_engine_ops_s *ops,
+		     const struct ehht_options_s *options);
+void ehht_engine_release(struct ehht_engine_s *engine);
+
+/* hashcodes[i] = Ehht_hash(engine, keys[i], key_lens[i]), for i in [0, n) */
+void ehht_engine_hash_many(struct ehht_engine_s *engine, const char **keys,
+			   const size_t *key_lens, uint64_t *hashcodes,
+			   size_t n);
+
+/* storage for the entries (elements, key copies) of the table */
+void *ehht_engine_entry_alloc(struct ehht_engine_s *engine, size_t size);
+void ehht_engine_entry_free(struct ehht_engine_s *engine, void *ptr);
+
+struct ehht_slab_s *ehht_slab_new(size_t page_size, ehht_malloc_func alloc,
+				  ehht_free_func free, void *mem_context);
+void *ehht_slab_alloc(struct ehht_slab_s *slab, size_t size);
+void ehht_slab_free(struct ehht_slab_s *slab, void *ptr);
+void ehht_slab_destroy(struct ehht_slab_s *slab);
+
+/* returns the kernel which computes hash_func on this CPU: for the CRC32C
+ * and AES hashes, the hardware or software version, else hash_func */
+ehht_hash_func ehht_hash_resolve(ehht_hash_func hash_func);
+
+/* replaces the seed with a new one, derived from the old seed, the clock,
+ * and the address of the seed */
+void ehht_hash_seed_next(struct ehht_hash_seed_s *seed);
+
+/* the software versions, exposed for testing against the hardware */
+uint64_t ehht_crc32c_hashcode_portable(const char *data, size_t len);
+uint64_t ehht_aes_hashcode_portable(const char *data, size_t len);
+
+/* hashcodes[i] = hash_func(keys[i], key_lens[i]), for i in [0, n) */
+void ehht_hash_many(ehht_hash_func hash_func, const char **keys,
+		    const size_t *key_lens, uint64_t *hashcodes, size_t n);
+
+/* the fewest buckets which hold n_elements without exceeding load_factor */
+size_t ehht_buckets_for_elements(size_t n_elements, double load_factor);
+
+/* non-zero if the load has fallen below the engine's low-water mark; the
+ * mark is held to a quarter of the grow_load_factor (if non-zero), so that
+ * halving the buckets leaves the load under half the point of growth */
+int ehht_engine_should_shrink(const struct ehht_engine_s *engine, size_t size,
+			      size_t num_buckets, double grow_load_factor);
+
+/* the number of CPUs online, at most EHHT_MAX_THREADS, or 1 if unknown */
+size_t ehht_threads_online(void);
+
+typedef void (*ehht_thread_func)(void *context, size_t thread_num);
+
+/* calls func(context, i) for i in [0, num_threads), each on its own thread
+ * where possible, and returns once all have returned; num_threads must be
+ * at most EHHT_MAX_THREADS */
+void ehht_threads_run(size_t num_threads, ehht_thread_func func,
+		      void *context);
+
+struct ehht_lock_s;
+
+/* returns NULL if the lock could not be allocated or initialized */
+struct ehht_lock_s *ehht_lock_new(ehht_malloc_func alloc, ehht_free_func free,
+				  void *mem_context);
+void ehht_lock_destroy(struct ehht_lock_s *lock, ehht_free_func free,
+		       void *mem_context);
+void ehht_lock(struct ehht_lock_s *lock);
+void ehht_unlock(struct ehht_lock_s *lock);
+
+#ifndef EHHT_ATOMICS
+#if defined(__GNUC__) && defined(__ATOMIC_ACQUIRE)
+#define EHHT_ATOMICS 1
+#else
+#define EHHT_ATOMICS 0
+#endif
+#endif
+
+/* GCC style atomic builtins; without them, plain accesses which must be
+ * protected by a lock */
+#if EHHT_ATOMICS
+#define Ehht_load_acquire(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define Ehht_load_relaxed(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define Ehht_store_release(ptr, val) \
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#define Ehht_store_relaxed(ptr, val) \
+	__atomic_store_n(ptr, val, __ATOMIC_RELAXED)
+/* a read-modify-write, thus it reads the latest value */
+#define Ehht_fetch_add(ptr, val) \
+	__atomic_fetch_add(ptr, val, __ATOMIC_SEQ_CST)
+/* non-zero if *ptr was *expected and is now desired, else *expected is
+ * set to *ptr, with acquire, thus may be followed */
+#define Ehht_cas(ptr, expected, desired) \
+	__atomic_compare_exchange_n(ptr, expected, desired, 0, \
+				    __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)
+#else
+#define Ehht_load_acquire(ptr) (*(ptr))
+#define Ehht_load_relaxed(ptr) (*(ptr))
+#define Ehht_store_release(ptr, val) (*(ptr) = (val))
+#define Ehht_store_relaxed(ptr, val) (*(ptr) = (val))
+#define Ehht_fetch_add(ptr, val) ((*(ptr) += (val)) - (val))
+#define Ehht_cas(ptr, expected, desired) \
+	((*(ptr) == *(expected)) ? ((*(ptr) = (desired)), 1) \
+	 : ((*(expected) = *(ptr)), 0))
+#endif
+
+#ifndef EHHT_EPOCH_SLOTS
+/* the number of threads which may be within an epoch at once; must be a
+ * power of two */
+#define EHHT_EPOCH_SLOTS 64
+#endif
+
+#ifndef EHHT_CACHE_LINE
+#define EHHT_CACHE_LINE 64
+#endif
+
+/* zero, or the epoch in which the thread holding the slot entered */
+struct ehht_epoch_slot_s {
+	unsigned long epoch;
+	unsigned char pad[EHHT_CACHE_LINE - sizeof(unsigned long)];
+};
+
+/* epoch-based reclamation: memory unlinked from a structure is retired
+ * rather than freed, and freed once no thread which entered before it
+ * was unlinked remains */
+struct ehht_epochs_s {
+	struct ehht_epoch_slot_s slots[EHHT_EPOCH_SLOTS];
+	unsigned long epoch;
+};
+
+void ehht_epochs_init(struct ehht_epochs_s *epochs);
+
+/* returns the slot which marks the caller as within the current epoch,
+ * or NULL if all are taken (or there are no atomics) */
+struct ehht_epoch_slot_s *ehht_epoch_enter(struct ehht_epochs_s *epochs);
+void ehht_epoch_exit(struct ehht_epoch_slot_s *slot);
+
+/* moves to the next epoch, and returns the epoch before; memory unlinked
+ * before the call may be freed once its epoch is less than *oldest */
+unsigned long ehht_epoch_advance(struct ehht_epochs_s *epochs,
+				 unsigned long *oldest);
+
+/* engine-neutral methods, built upon the other methods of the table */
+struct ehht_keys_s *ehht_engine_keys(struct ehht_s *table, int copy_keys);
+void ehht_engine_free_keys(struct ehht_s *table, struct ehht_keys_s *keys);
+size_t ehht_engine_to_string(struct ehht_s *table, char *buf, size_t buf_len);
+
+/* engine constructors: options have already had defaults applied */
+struct ehht_s *ehht_robin_hood_new(const struct ehht_options_s *options);
+struct ehht_s *ehht_swiss_new(const struct ehht_options_s *options);
+/* options->shards is over one; the shards are made with options->engine */
+struct ehht_s *ehht_sharded_new(const struct ehht_options_s *options);
+struct ehht_s *ehht_concurrent_new(const struct ehht_options_s *options);
+struct ehht_s *ehht_split_ordered_new(const struct ehht_options_s *options);
+
+#endif /* EHHT_PRIVATE_H */
@@ -0,0 +1,633 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* ehht-robin-hood.c: an open-addressing engine for a simple OO hashtable */
+/* Copyright (C) 2016, 2017, 2018, 2019, 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+/*
+  Robin Hood hashing: on insert, an entry which is further from its home
+  slot than the resident entry takes the slot, and the resident moves on.
+  This keeps probe sequence lengths short and even, allows a lookup to stop
+  as soon as it sees an entry closer to home than itself, and allows remove
+  to shift the following entries back rather than leaving tombstones.
+  https://cs.uwaterloo.ca/research/tr/1986/CS-86-14.pdf
+*/
+
+#include "ehht.h"
+#include "ehht-private.h"
+#include <stdint.h>		/* SIZE_MAX */
+#include <string.h>		/* memcpy memcmp */
+#include <assert.h>
+
+#ifndef EHHT_ROBIN_HOOD_LOADFACTOR
+#define EHHT_ROBIN_HOOD_LOADFACTOR 0.875
+#endif
+
+#ifndef EHHT_ROBIN_HOOD_MIN_SLOTS
+#define EHHT_ROBIN_HOOD_MIN_SLOTS 8
+#endif
+
+struct ehht_rh_slot_s {
+	struct ehht_key_s key;
+	void *val;
+	/* probe sequence length plus one, zero marks an empty slot */
+	size_t psl;
+};
+
+struct ehht_robin_hood_s {
+	struct ehht_engine_s engine;
+	size_t num_slots;
+	size_t mask;
+	struct ehht_rh_slot_s *slots;
+	size_t size;
+	double max_load_factor;
+};
+
+static struct ehht_robin_hood_s *ehht_rh_get_table(struct ehht_s *this)
+{
+	return (struct ehht_robin_hood_s *)this->data;
+}
+
+/* the slot mask keeps only the low bits, so scramble them first */
+static size_t ehht_rh_home(uint64_t hashcode, size_t mask)
+{
+	hashcode ^= hashcode >> 30;
+	hashcode *= Ehht_u64(0xbf58476dUL, 0x1ce4e5b9UL);
+	hashcode ^= hashcode >> 27;
+	hashcode *= Ehht_u64(0x94d049bbUL, 0x133111ebUL);
+	hashcode ^= hashcode >> 31;
+	return ((size_t)hashcode) & mask;
+}
+
+/* returns 0 if the power of two would not fit in a size_t */
+static size_t ehht_rh_round_up(size_t num_slots)
+{
+	size_t n;
+
+	n = EHHT_ROBIN_HOOD_MIN_SLOTS;
+	while (n < num_slots) {
+		if (n > (SIZE_MAX / 2)) {
+			return 0;
+		}
+		n *= 2;
+	}
+	return n;
+}
+
+static struct ehht_rh_slot_s *ehht_rh_alloc_slots(struct ehht_robin_hood_s
+						  *rh, size_t num_slots)
+{
+	struct ehht_rh_slot_s *slots;
+	size_t i, size;
+
+	if (num_slots > (SIZE_MAX / sizeof(struct ehht_rh_slot_s))) {
+		Ehht_failed_malloc(SIZE_MAX, "slots");
+		return NULL;
+	}
+	size = sizeof(struct ehht_rh_slot_s) * num_slots;
+	slots = rh->engine.alloc(size, rh->engine.mem_context);
+	if (slots == NULL) {
+		Ehht_failed_malloc(size, "slots");
+		return NULL;
+	}
+	for (i = 0; i < num_slots; ++i) {
+		slots[i].key.str = NULL;
+		slots[i].key.len = 0;
+		slots[i].key.hashcode = 0;
+		slots[i].val = NULL;
+		slots[i].psl = 0;
+	}
+	return slots;
+}
+
+/* returns the slot index, or num_slots if the key is not present */
+static size_t ehht_rh_find(struct ehht_robin_hood_s *rh, const char *key,
+			   size_t key_len, uint64_t hashcode)
+{
+	struct ehht_rh_slot_s *slot;
+	size_t i, psl;
+
+	i = ehht_rh_home(hashcode, rh->mask);
+	for (psl = 1; psl <= rh->num_slots; ++psl) {
+		slot = rh->slots + i;
+		/* empty, or a "richer" entry than we would be: not here */
+		if (slot->psl < psl) {
+			return rh->num_slots;
+		}
+		if (slot->key.hashcode == hashcode && slot->key.len == key_len
+		    && memcmp(key, slot->key.str, key_len) == 0) {
+			return i;
+		}
+		i = (i + 1) & rh->mask;
+	}
+	return rh->num_slots;
+}
+
+/* there must be at least one empty slot
+ * returns the index where the entry landed */
+static size_t ehht_rh_place(struct ehht_rh_slot_s *slots, size_t mask,
+			    struct ehht_rh_slot_s entry)
+{
+	struct ehht_rh_slot_s tmp;
+	size_t i, placed;
+
+	placed = mask + 1;
+	entry.psl = 1;
+	i = ehht_rh_home(entry.key.hashcode, mask);
+	for (;;) {
+		if (slots[i].psl == 0) {
+			slots[i] = entry;
+			return (placed > mask) ? i : placed;
+		}
+		if (slots[i].psl < entry.psl) {
+			tmp = slots[i];
+			slots[i] = entry;
+			entry = tmp;
+			if (placed > mask) {
+				placed = i;
+			}
+		}
+		i = (i + 1) & mask;
+		++entry.psl;
+	}
+}
+
+/* backward-shift deletion: no tombstones are left behind */
+static void ehht_rh_vacate(struct ehht_robin_hood_s *rh, size_t i)
+{
+	size_t next;
+
+	next = (i + 1) & rh->mask;
+	while (rh->slots[next].psl > 1) {
+		rh->slots[i] = rh->slots[next];
+		--(rh->slots[i].psl);
+		i = next;
+		next = (i + 1) & rh->mask;
+	}
+	rh->slots[i].key.str = NULL;
+	rh->slots[i].val = NULL;
+	rh->slots[i].psl = 0;
+}
+
+static size_t ehht_rh_buckets_resize(struct ehht_s *this, size_t num_slots)
+{
+	struct ehht_robin_hood_s *rh;
+	struct ehht_rh_slot_s *new_slots;
+	size_t i, new_mask;
+
+	rh = ehht_rh_get_table(this);
+
+	if (num_slots == 0) {
+		num_slots = rh->num_slots * 2;
+	}
+	num_slots = ehht_rh_round_up(num_slots);
+	if (num_slots == 0 || num_slots < rh->size) {
+		return rh->num_slots;
+	}
+
+	new_slots = ehht_rh_alloc_slots(rh, num_slots);
+	if (new_slots == NULL) {
+		return rh->num_slots;
+	}
+
+	new_mask = num_slots - 1;
+	for (i = 0; i < rh->num_slots; ++i) {
+		if (rh->slots[i].psl) {
+			ehht_rh_place(new_slots, new_mask, rh->slots[i]);
+		}
+	}
+
+	rh->engine.free(rh->slots, rh->engine.mem_context);
+	rh->slots = new_slots;
+	rh->num_slots = num_slots;
+	rh->mask = new_mask;
+
+	return num_slots;
+}
+
+/* once the load falls below the low-water mark, shrinks toward num_slots,
+ * but not below the number asked for at construction */
+static void ehht_rh_auto_shrink(struct ehht_s *this, size_t num_slots)
+{
+	struct ehht_robin_hood_s *rh;
+
+	rh = ehht_rh_get_table(this);
+
+	if (!ehht_engine_should_shrink(&rh->engine, rh->size, rh->num_slots,
+				       rh->max_load_factor)) {
+		return;
+	}
+	if (num_slots < rh->engine.min_buckets) {
+		num_slots = rh->engine.min_buckets;
+	}
+	num_slots = ehht_rh_round_up(num_slots);
+	if (num_slots && num_slots < rh->num_slots) {
+		ehht_rh_buckets_resize(this, num_slots);
+	}
+}
+
+static void *ehht_rh_get_hashed(struct ehht_s *this, const char *key,
+				size_t key_len, uint64_t hashcode)
+{
+	struct ehht_robin_hood_s *rh;
+	size_t i;
+
+	rh = ehht_rh_get_table(this);
+
+	i = ehht_rh_find(rh, key, key_len, hashcode);
+
+	return (i == rh->num_slots) ? NULL : rh->slots[i].val;
+}
+
+static void *ehht_rh_get(struct ehht_s *this, const char *key, size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_rh_get_hashed(this, key, key_len, hashcode);
+}
+
+/* hash the group and prefetch each home slot, then probe */
+static void ehht_rh_get_many(struct ehht_s *this, const char **keys,
+			     const size_t *key_lens, void **vals, size_t n)
+{
+	struct ehht_robin_hood_s *rh;
+	uint64_t hashcodes[EHHT_GET_MANY_GROUP];
+	size_t i, j, group;
+
+	rh = ehht_rh_get_table(this);
+
+	for (; n; n -= group, keys += group, key_lens += group, vals += group) {
+		group = (n < EHHT_GET_MANY_GROUP) ? n : EHHT_GET_MANY_GROUP;
+		ehht_engine_hash_many(&rh->engine, keys, key_lens,
+				      hashcodes, group);
+		for (i = 0; i < group; ++i) {
+			j = ehht_rh_home(hashcodes[i], rh->mask);
+			Ehht_prefetch(rh->slots + j);
+		}
+		for (i = 0; i < group; ++i) {
+			j = ehht_rh_find(rh, keys[i], key_lens[i],
+					 hashcodes[i]);
+			vals[i] = (j == rh->num_slots) ? NULL
+			    : rh->slots[j].val;
+		}
+	}
+}
+
+static int ehht_rh_has_key_hashed(struct ehht_s *this, const char *key,
+				  size_t key_len, uint64_t hashcode)
+{
+	struct ehht_robin_hood_s *rh;
+
+	rh = ehht_rh_get_table(this);
+
+	return (ehht_rh_find(rh, key, key_len, hashcode) == rh->num_slots)
+	    ? 0 : 1;
+}
+
+static int ehht_rh_has_key(struct ehht_s *this, const char *key, size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_rh_has_key_hashed(this, key, key_len, hashcode);
+}
+
+/* the key must not already be present
+ * returns the index where the entry landed, or num_slots on failure */
+static size_t ehht_rh_insert(struct ehht_s *this, const char *key,
+			     size_t key_len, uint64_t hashcode, void *val)
+{
+	struct ehht_robin_hood_s *rh;
+	struct ehht_rh_slot_s entry;
+	char *key_copy;
+	size_t i, size;
+
+	rh = ehht_rh_get_table(this);
+
+	if ((rh->size + 1) > (rh->num_slots * rh->max_load_factor)) {
+		ehht_rh_buckets_resize(this, 0);
+	}
+	if ((rh->size + 1) > rh->num_slots) {
+		fprintf(stderr, "%s:%d: ehht_put failed\n", __FILE__, __LINE__);
+		return rh->num_slots;
+	}
+
+	size = key_len + 1;
+	key_copy = ehht_engine_entry_alloc(&rh->engine, size);
+	if (!key_copy) {
+		Ehht_failed_malloc(size, "key copy");
+		fprintf(stderr, "%s:%d: ehht_put failed\n", __FILE__, __LINE__);
+		return rh->num_slots;
+	}
+	memcpy(key_copy, key, key_len);
+	key_copy[key_len] = '\0';
+
+	entry.key.str = key_copy;
+	entry.key.len = key_len;
+	entry.key.hashcode = hashcode;
+	entry.val = val;
+	entry.psl = 1;
+	i = ehht_rh_place(rh->slots, rh->mask, entry);
+	++(rh->size);
+
+	return i;
+}
+
+static void *ehht_rh_put_hashed(struct ehht_s *this, const char *key,
+				size_t key_len, uint64_t hashcode,
+				void *val)
+{
+	struct ehht_robin_hood_s *rh;
+	void *old_val;
+	size_t i;
+
+	rh = ehht_rh_get_table(this);
+
+	i = ehht_rh_find(rh, key, key_len, hashcode);
+	if (i != rh->num_slots) {
+		old_val = rh->slots[i].val;
+		rh->slots[i].val = val;
+		return old_val;
+	}
+
+	ehht_rh_insert(this, key, key_len, hashcode, val);
+	return NULL;
+}
+
+static void **ehht_rh_entry_hashed(struct ehht_s *this, const char *key,
+				   size_t key_len, uint64_t hashcode,
+				   int *created)
+{
+	struct ehht_robin_hood_s *rh;
+	size_t i;
+	int inserted;
+
+	rh = ehht_rh_get_table(this);
+
+	inserted = 0;
+	i = ehht_rh_find(rh, key, key_len, hashcode);
+	if (i == rh->num_slots) {
+		i = ehht_rh_insert(this, key, key_len, hashcode, NULL);
+		if (i == rh->num_slots) {
+			return NULL;
+		}
+		inserted = 1;
+	}
+	if (created) {
+		*created = inserted;
+	}
+	return &(rh->slots[i].val);
+}
+
+static void *ehht_rh_put(struct ehht_s *this, const char *key, size_t key_len,
+			 void *val)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_rh_put_hashed(this, key, key_len, hashcode, val);
+}
+
+static void *ehht_rh_remove_hashed(struct ehht_s *this, const char *key,
+				   size_t key_len, uint64_t hashcode)
+{
+	struct ehht_robin_hood_s *rh;
+	void *old_val;
+	size_t i;
+
+	rh = ehht_rh_get_table(this);
+
+	i = ehht_rh_find(rh, key, key_len, hashcode);
+	if (i == rh->num_slots) {
+		return NULL;
+	}
+
+	old_val = rh->slots[i].val;
+	ehht_engine_entry_free(&rh->engine, (char *)rh->slots[i].key.str);
+	ehht_rh_vacate(rh, i);
+	--(rh->size);
+
+	ehht_rh_auto_shrink(this, rh->num_slots / 2);
+
+	return old_val;
+}
+
+static void *ehht_rh_remove(struct ehht_s *this, const char *key,
+			    size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_rh_remove_hashed(this, key, key_len, hashcode);
+}
+
+static size_t ehht_rh_size(struct ehht_s *this)
+{
+	return ehht_rh_get_table(this)->size;
+}
+
+static void ehht_rh_clear_slots(struct ehht_robin_hood_s *rh)
+{
+	size_t i;
+
+	for (i = 0; i < rh->num_slots; ++i) {
+		if (rh->slots[i].psl) {
+			ehht_engine_entry_free(&rh->engine,
+					       (char *)rh->slots[i].key.str);
+			rh->slots[i].key.str = NULL;
+			rh->slots[i].val = NULL;
+			rh->slots[i].psl = 0;
+		}
+	}
+	rh->size = 0;
+}
+
+static void ehht_rh_clear(struct ehht_s *this)
+{
+	ehht_rh_clear_slots(ehht_rh_get_table(this));
+	ehht_rh_auto_shrink(this, 0);
+}
+
+static int ehht_rh_for_each(struct ehht_s *this, ehht_iterator_func func,
+			    void *context)
+{
+	struct ehht_robin_hood_s *rh;
+	size_t i;
+	int end;
+
+	rh = ehht_rh_get_table(this);
+
+	end = 0;
+	for (i = 0; i < rh->num_slots && !end; ++i) {
+		if (rh->slots[i].psl) {
+			end = (*func) (rh->slots[i].key, rh->slots[i].val,
+				       context);
+		}
+	}
+	return end;
+}
+
+static size_t ehht_rh_buckets_size(struct ehht_s *this)
+{
+	return ehht_rh_get_table(this)->num_slots;
+}
+
+/* the table is always grown once full, even if factor is 0.0 */
+static void ehht_rh_buckets_auto_resize_load_factor(struct ehht_s *this,
+						    double factor)
+{
+	struct ehht_robin_hood_s *rh;
+
+	rh = ehht_rh_get_table(this);
+	rh->max_load_factor = (factor <= 0.0 || factor > 1.0) ? 1.0 : factor;
+}
+
+static size_t ehht_rh_reserve(struct ehht_s *this, size_t n_elements)
+{
+	struct ehht_robin_hood_s *rh;
+	size_t num_slots;
+
+	rh = ehht_rh_get_table(this);
+	num_slots = ehht_buckets_for_elements(n_elements, rh->max_load_factor);
+	if (num_slots > rh->num_slots) {
+		return ehht_rh_buckets_resize(this, num_slots);
+	}
+	return rh->num_slots;
+}
+
+static size_t ehht_rh_shrink_to_fit(struct ehht_s *this)
+{
+	struct ehht_robin_hood_s *rh;
+	size_t num_slots;
+
+	rh = ehht_rh_get_table(this);
+	num_slots = ehht_buckets_for_elements(rh->size, rh->max_load_factor);
+	num_slots = ehht_rh_round_up(num_slots);
+	if (num_slots && num_slots < rh->num_slots) {
+		return ehht_rh_buckets_resize(this, num_slots);
+	}
+	return rh->num_slots;
+}
+
+static size_t ehht_rh_bucket_for_key(struct ehht_s *this, const char *key,
+				     size_t key_len)
+{
+	struct ehht_robin_hood_s *rh;
+
+	rh = ehht_rh_get_table(this);
+	return ehht_rh_home(Ehht_hash(&rh->engine, key, key_len), rh->mask);
+}
+
+static void ehht_rh_free(struct ehht_s *this)
+{
+	struct ehht_robin_hood_s *rh;
+	ehht_free_func free_func;
+	void *mem_context;
+
+	rh = ehht_rh_get_table(this);
+
+	ehht_rh_clear_slots(rh);
+
+	free_func = rh->engine.free;
+	mem_context = rh->engine.mem_context;
+
+	ehht_engine_release(&rh->engine);
+	free_func(rh->slots, mem_context);
+	free_func(rh, mem_context);
+	free_func(this, mem_context);
+}
+
+static const struct ehht_engine_ops_s ehht_robin_hood_ops = {
+	ehht_rh_buckets_size,
+	ehht_rh_buckets_resize,
+	ehht_rh_buckets_auto_resize_load_factor,
+	ehht_rh_bucket_for_key,
+	ehht_rh_free,
+	ehht_rh_get_hashed,
+	ehht_rh_put_hashed,
+	ehht_rh_remove_hashed,
+	ehht_rh_has_key_hashed,
+	ehht_rh_entry_hashed,
+	ehht_rh_get_many,
+	NULL,
+	NULL,
+	ehht_rh_reserve,
+	ehht_rh_shrink_to_fit,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+struct ehht_s *ehht_robin_hood_new(const struct ehht_options_s *options)
+{
+	struct ehht_s *this;
+	struct ehht_robin_hood_s *rh;
+	ehht_malloc_func mem_alloc;
+	ehht_free_func mem_free;
+	void *mem_context;
+	size_t size, num_slots;
+
+	mem_alloc = options->alloc_func;
+	mem_free = options->free_func;
+	mem_context = options->mem_context;
+
+	size = sizeof(struct ehht_s);
+	this = mem_alloc(size, mem_context);
+	if (this == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_s");
+		return NULL;
+	}
+	this->get = ehht_rh_get;
+	this->put = ehht_rh_put;
+	this->remove = ehht_rh_remove;
+	this->size = ehht_rh_size;
+	this->clear = ehht_rh_clear;
+	this->for_each = ehht_rh_for_each;
+	this->has_key = ehht_rh_has_key;
+	this->keys = ehht_engine_keys;
+	this->free_keys = ehht_engine_free_keys;
+	this->to_string = ehht_engine_to_string;
+
+	size = sizeof(struct ehht_robin_hood_s);
+	rh = mem_alloc(size, mem_context);
+	if (rh == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_robin_hood_s");
+		mem_free(this, mem_context);
+		return NULL;
+	}
+	this->data = (void *)rh;
+
+	if (ehht_engine_init(&rh->engine, &ehht_robin_hood_ops, options)) {
+		mem_free(rh, mem_context);
+		mem_free(this, mem_context);
+		return NULL;
+	}
+
+	rh->max_load_factor = EHHT_ROBIN_HOOD_LOADFACTOR;
+	if (options->load_factor > 0.0) {
+		ehht_rh_buckets_auto_resize_load_factor(this,
+							options->load_factor);
+	}
+	num_slots = options->num_buckets;
+	if (options->expected_elements) {
+		size = ehht_buckets_for_elements(options->expected_elements,
+						 rh->max_load_factor);
+		if (size > num_slots) {
+			num_slots = size;
+		}
+	}
+	rh->num_slots = ehht_rh_round_up(num_slots);
+	rh->mask = rh->num_slots - 1;
+	rh->size = 0;
+	rh->slots = (rh->num_slots) ? ehht_rh_alloc_slots(rh, rh->num_slots)
+	    : NULL;
+	if (rh->slots == NULL) {
+		ehht_engine_release(&rh->engine);
+		mem_free(rh, mem_context);
+		mem_free(this, mem_context);
+		return NULL;
+	}
+
+	return this;
+}
@@ -0,0 +1,723 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* ehht-sharded.c: a lock-per-shard table for a simple OO hashtable */
+/* Copyright (C) 2016, 2017, 2018, 2019, 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+/*
+  A sharded table is a power of two of ordinary tables, the shards, each
+  with its own lock. The top bits of the (mixed) hashcode choose a shard,
+  thus threads working on different keys seldom wait for one another,
+  and each shard grows and shrinks on its own, holding only its own lock.
+  Without a seeded hash, the hashcode which chose the shard is passed on
+  to the shard's hashed methods, so each key is hashed once; a shard with
+  a seeded hash may choose a new seed, so the shard hashes again.
+
+  The locks are exclusive rather than reader-writer locks, as even a get
+  updates the statistics of a chained shard, and may move an element to
+  the front of its chain or move buckets of an incremental rehash.
+
+  Methods which visit every shard (size, clear, for_each, stats, and the
+  resizing "friend" functions) take the locks one shard at a time, thus
+  see each shard at a different moment; only keys holds all of the locks
+  at once, and so returns a consistent snapshot. A for_each function must
+  not call methods of the same table, as the shard's lock is held.
+*/
+
+#include "ehht.h"
+#include "ehht-private.h"
+#include <stdint.h>		/* SIZE_MAX */
+#include <string.h>		/* memcpy */
+#include <assert.h>
+
+#ifndef EHHT_MAX_SHARDS
+#define EHHT_MAX_SHARDS 4096
+#endif
+
+struct ehht_shard_s {
+	struct ehht_lock_s *lock;
+	struct ehht_s *table;
+};
+
+struct ehht_sharded_s {
+	struct ehht_engine_s engine;
+	size_t num_shards;
+	/* the mixed hashcode is shifted right by this to give the shard */
+	unsigned shift;
+	/* non-zero if the shards accept this table's hashcodes */
+	int pass_hashcodes;
+	struct ehht_shard_s *shards;
+};
+
+static struct ehht_sharded_s *ehht_sharded_get_table(struct ehht_s *this)
+{
+	return (struct ehht_sharded_s *)this->data;
+}
+
+/* a 32 bit hash widened to 64 has no top bits of its own, so mix first */
+static struct ehht_shard_s *ehht_shard_for(struct ehht_sharded_s *sharded,
+					   uint64_t hashcode)
+{
+	hashcode *= Ehht_u64(0x9e3779b9UL, 0x7f4a7c15UL);
+	return sharded->shards + (size_t)(hashcode >> sharded->shift);
+}
+
+/* the share of n for each shard, rounded up */
+static size_t ehht_shard_share(struct ehht_sharded_s *sharded, size_t n)
+{
+	return (n / sharded->num_shards) + ((n % sharded->num_shards) != 0);
+}
+
+static void *ehht_sharded_get_hashed(struct ehht_s *this, const char *key,
+				     size_t key_len, uint64_t hashcode)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	void *val;
+
+	sharded = ehht_sharded_get_table(this);
+	shard = ehht_shard_for(sharded, hashcode);
+
+	ehht_lock(shard->lock);
+	if (sharded->pass_hashcodes) {
+		val = ehht_get_hashed(shard->table, key, key_len, hashcode);
+	} else {
+		val = shard->table->get(shard->table, key, key_len);
+	}
+	ehht_unlock(shard->lock);
+	return val;
+}
+
+static void *ehht_sharded_get(struct ehht_s *this, const char *key,
+			      size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_sharded_get_hashed(this, key, key_len, hashcode);
+}
+
+static void *ehht_sharded_put_hashed(struct ehht_s *this, const char *key,
+				     size_t key_len, uint64_t hashcode,
+				     void *val)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	void *old_val;
+
+	sharded = ehht_sharded_get_table(this);
+	shard = ehht_shard_for(sharded, hashcode);
+
+	ehht_lock(shard->lock);
+	if (sharded->pass_hashcodes) {
+		old_val = ehht_put_hashed(shard->table, key, key_len, hashcode,
+					  val);
+	} else {
+		old_val = shard->table->put(shard->table, key, key_len, val);
+	}
+	ehht_unlock(shard->lock);
+	return old_val;
+}
+
+static void *ehht_sharded_put(struct ehht_s *this, const char *key,
+			      size_t key_len, void *val)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_sharded_put_hashed(this, key, key_len, hashcode, val);
+}
+
+static void *ehht_sharded_remove_hashed(struct ehht_s *this, const char *key,
+					size_t key_len, uint64_t hashcode)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	void *old_val;
+
+	sharded = ehht_sharded_get_table(this);
+	shard = ehht_shard_for(sharded, hashcode);
+
+	ehht_lock(shard->lock);
+	if (sharded->pass_hashcodes) {
+		old_val = ehht_remove_hashed(shard->table, key, key_len,
+					     hashcode);
+	} else {
+		old_val = shard->table->remove(shard->table, key, key_len);
+	}
+	ehht_unlock(shard->lock);
+	return old_val;
+}
+
+static void *ehht_sharded_remove(struct ehht_s *this, const char *key,
+				 size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_sharded_remove_hashed(this, key, key_len, hashcode);
+}
+
+static int ehht_sharded_has_key_hashed(struct ehht_s *this, const char *key,
+				       size_t key_len, uint64_t hashcode)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	int has_key;
+
+	sharded = ehht_sharded_get_table(this);
+	shard = ehht_shard_for(sharded, hashcode);
+
+	ehht_lock(shard->lock);
+	if (sharded->pass_hashcodes) {
+		has_key = ehht_has_key_hashed(shard->table, key, key_len,
+					      hashcode);
+	} else {
+		has_key = shard->table->has_key(shard->table, key, key_len);
+	}
+	ehht_unlock(shard->lock);
+	return has_key;
+}
+
+static int ehht_sharded_has_key(struct ehht_s *this, const char *key,
+				size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_sharded_has_key_hashed(this, key, key_len, hashcode);
+}
+
+/* the slot is only safe to use while no other thread modifies the shard */
+static void **ehht_sharded_entry_hashed(struct ehht_s *this, const char *key,
+					size_t key_len, uint64_t hashcode,
+					int *created)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	void **slot;
+
+	sharded = ehht_sharded_get_table(this);
+	shard = ehht_shard_for(sharded, hashcode);
+
+	ehht_lock(shard->lock);
+	if (sharded->pass_hashcodes) {
+		slot = ehht_entry_hashed(shard->table, key, key_len, hashcode,
+					 created);
+	} else {
+		slot = ehht_entry(shard->table, key, key_len, created);
+	}
+	ehht_unlock(shard->lock);
+	return slot;
+}
+
+static size_t ehht_sharded_size(struct ehht_s *this)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	size_t i, size;
+
+	sharded = ehht_sharded_get_table(this);
+
+	size = 0;
+	for (i = 0; i < sharded->num_shards; ++i) {
+		shard = sharded->shards + i;
+		ehht_lock(shard->lock);
+		size += shard->table->size(shard->table);
+		ehht_unlock(shard->lock);
+	}
+	return size;
+}
+
+static void ehht_sharded_clear(struct ehht_s *this)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	size_t i;
+
+	sharded = ehht_sharded_get_table(this);
+
+	for (i = 0; i < sharded->num_shards; ++i) {
+		shard = sharded->shards + i;
+		ehht_lock(shard->lock);
+		shard->table->clear(shard->table);
+		ehht_unlock(shard->lock);
+	}
+}
+
+struct ehht_sharded_each_s {
+	struct ehht_sharded_s *sharded;
+	ehht_iterator_func func;
+	void *context;
+};
+
+/* with a seeded hash, the shard's hashcodes are not this table's */
+static int ehht_sharded_each(struct ehht_key_s each_key, void *each_val,
+			     void *context)
+{
+	struct ehht_sharded_each_s *each;
+
+	each = (struct ehht_sharded_each_s *)context;
+	if (!each->sharded->pass_hashcodes) {
+		each_key.hashcode = Ehht_hash(&each->sharded->engine,
+					      each_key.str, each_key.len);
+	}
+	return each->func(each_key, each_val, each->context);
+}
+
+static int ehht_sharded_for_each(struct ehht_s *this, ehht_iterator_func func,
+				 void *context)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	struct ehht_sharded_each_s each;
+	size_t i;
+	int end;
+
+	sharded = ehht_sharded_get_table(this);
+	each.sharded = sharded;
+	each.func = func;
+	each.context = context;
+
+	end = 0;
+	for (i = 0; i < sharded->num_shards && !end; ++i) {
+		shard = sharded->shards + i;
+		ehht_lock(shard->lock);
+		end = shard->table->for_each(shard->table, ehht_sharded_each,
+					     &each);
+		ehht_unlock(shard->lock);
+	}
+	return end;
+}
+
+struct ehht_sharded_keys_s {
+	struct ehht_sharded_s *sharded;
+	struct ehht_keys_s *keys;
+	size_t pos;
+};
+
+static int ehht_sharded_fill_keys(struct ehht_key_s each_key, void *each_val,
+				  void *context)
+{
+	struct ehht_sharded_keys_s *fill;
+	struct ehht_engine_s *engine;
+	char *key_copy;
+
+	(void)each_val;
+	fill = (struct ehht_sharded_keys_s *)context;
+	engine = &fill->sharded->engine;
+
+	assert(fill->pos < fill->keys->len);
+	if (fill->keys->keys_copied) {
+		key_copy = engine->alloc(each_key.len + 1, engine->mem_context);
+		if (!key_copy) {
+			Ehht_failed_malloc(each_key.len + 1, "key copy");
+			return 1;
+		}
+		memcpy(key_copy, each_key.str, each_key.len + 1);
+		each_key.str = key_copy;
+	}
+	if (!fill->sharded->pass_hashcodes) {
+		each_key.hashcode = Ehht_hash(engine, each_key.str,
+					      each_key.len);
+	}
+	fill->keys->keys[fill->pos++] = each_key;
+	return 0;
+}
+
+/* all of the shards are locked at once, for a consistent set of keys */
+static struct ehht_keys_s *ehht_sharded_keys(struct ehht_s *this,
+					     int copy_keys)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_sharded_keys_s fill;
+	struct ehht_shard_s *shard;
+	struct ehht_engine_s *engine;
+	size_t i, len, size;
+
+	sharded = ehht_sharded_get_table(this);
+	engine = &sharded->engine;
+
+	size = sizeof(struct ehht_keys_s);
+	fill.sharded = sharded;
+	fill.pos = 0;
+	fill.keys = engine->alloc(size, engine->mem_context);
+	if (!fill.keys) {
+		Ehht_failed_malloc(size, "struct ehht_keys_s");
+		return NULL;
+	}
+	fill.keys->keys_copied = copy_keys;
+	fill.keys->keys = NULL;
+
+	len = 0;
+	for (i = 0; i < sharded->num_shards; ++i) {
+		shard = sharded->shards + i;
+		ehht_lock(shard->lock);
+		len += shard->table->size(shard->table);
+	}
+	fill.keys->len = len;
+
+	size = sizeof(struct ehht_key_s) * len;
+	if (size) {
+		fill.keys->keys = engine->alloc(size, engine->mem_context);
+		if (!fill.keys->keys) {
+			Ehht_failed_malloc(size, "key list");
+		}
+	}
+	for (i = 0; i < sharded->num_shards; ++i) {
+		shard = sharded->shards + i;
+		if (fill.keys->keys && fill.pos < len) {
+			shard->table->for_each(shard->table,
+					       ehht_sharded_fill_keys, &fill);
+		}
+		ehht_unlock(shard->lock);
+	}
+
+	if (size && (!fill.keys->keys || fill.pos < len)) {
+		/* as many as were copied are freed */
+		fill.keys->len = fill.pos;
+		ehht_engine_free_keys(this, fill.keys);
+		return NULL;
+	}
+	return fill.keys;
+}
+
+static size_t ehht_sharded_buckets_size(struct ehht_s *this)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	size_t i, num_buckets;
+
+	sharded = ehht_sharded_get_table(this);
+
+	num_buckets = 0;
+	for (i = 0; i < sharded->num_shards; ++i) {
+		shard = sharded->shards + i;
+		ehht_lock(shard->lock);
+		num_buckets += ehht_buckets_size(shard->table);
+		ehht_unlock(shard->lock);
+	}
+	return num_buckets;
+}
+
+/* the buckets are shared out evenly among the shards */
+static size_t ehht_sharded_buckets_resize(struct ehht_s *this,
+					  size_t num_buckets)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	size_t i, share, total;
+
+	sharded = ehht_sharded_get_table(this);
+	share = ehht_shard_share(sharded, num_buckets);
+
+	total = 0;
+	for (i = 0; i < sharded->num_shards; ++i) {
+		shard = sharded->shards + i;
+		ehht_lock(shard->lock);
+		total += ehht_buckets_resize(shard->table, share);
+		ehht_unlock(shard->lock);
+	}
+	return total;
+}
+
+static void ehht_sharded_buckets_auto_resize_load_factor(struct ehht_s *this,
+							 double factor)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	size_t i;
+
+	sharded = ehht_sharded_get_table(this);
+
+	for (i = 0; i < sharded->num_shards; ++i) {
+		shard = sharded->shards + i;
+		ehht_lock(shard->lock);
+		ehht_buckets_auto_resize_load_factor(shard->table, factor);
+		ehht_unlock(shard->lock);
+	}
+}
+
+static void ehht_sharded_buckets_auto_shrink_load_factor(struct ehht_s *this,
+							 double factor)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	size_t i;
+
+	sharded = ehht_sharded_get_table(this);
+
+	for (i = 0; i < sharded->num_shards; ++i) {
+		shard = sharded->shards + i;
+		ehht_lock(shard->lock);
+		ehht_buckets_auto_shrink_load_factor(shard->table, factor);
+		ehht_unlock(shard->lock);
+	}
+}
+
+/* the buckets of the shards, numbered one shard after another */
+static size_t ehht_sharded_bucket_for_key(struct ehht_s *this,
+					  const char *key, size_t key_len)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard, *key_shard;
+	size_t bucket_num;
+
+	sharded = ehht_sharded_get_table(this);
+	key_shard = ehht_shard_for(sharded,
+				   Ehht_hash(&sharded->engine, key, key_len));
+
+	bucket_num = 0;
+	for (shard = sharded->shards; shard != key_shard; ++shard) {
+		ehht_lock(shard->lock);
+		bucket_num += ehht_buckets_size(shard->table);
+		ehht_unlock(shard->lock);
+	}
+	ehht_lock(shard->lock);
+	bucket_num += ehht_bucket_for_key(shard->table, key, key_len);
+	ehht_unlock(shard->lock);
+	return bucket_num;
+}
+
+static void ehht_sharded_stats(struct ehht_s *this, struct ehht_stats_s *stats)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	struct ehht_stats_s each;
+	size_t i;
+
+	sharded = ehht_sharded_get_table(this);
+
+	memset(stats, 0x00, sizeof(struct ehht_stats_s));
+	for (i = 0; i < sharded->num_shards; ++i) {
+		shard = sharded->shards + i;
+		ehht_lock(shard->lock);
+		ehht_stats(shard->table, &each);
+		ehht_unlock(shard->lock);
+
+		stats->size += each.size;
+		stats->num_buckets += each.num_buckets;
+		stats->used_buckets += each.used_buckets;
+		if (each.longest_chain > stats->longest_chain) {
+			stats->longest_chain = each.longest_chain;
+		}
+		stats->lookups += each.lookups;
+		stats->hits += each.hits;
+		stats->visited += each.visited;
+		stats->early_misses += each.early_misses;
+		stats->moves_to_front += each.moves_to_front;
+		stats->fingerprint_misses += each.fingerprint_misses;
+	}
+}
+
+static void ehht_sharded_stats_reset(struct ehht_s *this)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	size_t i;
+
+	sharded = ehht_sharded_get_table(this);
+
+	for (i = 0; i < sharded->num_shards; ++i) {
+		shard = sharded->shards + i;
+		ehht_lock(shard->lock);
+		ehht_stats_reset(shard->table);
+		ehht_unlock(shard->lock);
+	}
+}
+
+/* the keys will not spread perfectly evenly, so each shard is given an
+ * eighth more than its share */
+static size_t ehht_sharded_reserve(struct ehht_s *this, size_t n_elements)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	size_t i, share, total;
+
+	sharded = ehht_sharded_get_table(this);
+	share = ehht_shard_share(sharded, n_elements);
+	share += share / 8;
+
+	total = 0;
+	for (i = 0; i < sharded->num_shards; ++i) {
+		shard = sharded->shards + i;
+		ehht_lock(shard->lock);
+		total += ehht_reserve(shard->table, share);
+		ehht_unlock(shard->lock);
+	}
+	return total;
+}
+
+static size_t ehht_sharded_shrink_to_fit(struct ehht_s *this)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	size_t i, total;
+
+	sharded = ehht_sharded_get_table(this);
+
+	total = 0;
+	for (i = 0; i < sharded->num_shards; ++i) {
+		shard = sharded->shards + i;
+		ehht_lock(shard->lock);
+		total += ehht_shrink_to_fit(shard->table);
+		ehht_unlock(shard->lock);
+	}
+	return total;
+}
+
+static void ehht_sharded_resize_policy(struct ehht_s *this,
+				       const struct ehht_resize_policy_s
+				       *policy)
+{
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	size_t i;
+
+	sharded = ehht_sharded_get_table(this);
+
+	for (i = 0; i < sharded->num_shards; ++i) {
+		shard = sharded->shards + i;
+		ehht_lock(shard->lock);
+		ehht_buckets_resize_policy(shard->table, policy);
+		ehht_unlock(shard->lock);
+	}
+}
+
+static void ehht_sharded_free(struct ehht_s *this)
+{
+	struct ehht_sharded_s *sharded;
+	ehht_free_func free_func;
+	void *mem_context;
+	size_t i;
+
+	sharded = ehht_sharded_get_table(this);
+
+	free_func = sharded->engine.free;
+	mem_context = sharded->engine.mem_context;
+
+	for (i = 0; i < sharded->num_shards; ++i) {
+		ehht_free(sharded->shards[i].table);
+		ehht_lock_destroy(sharded->shards[i].lock, free_func,
+				  mem_context);
+	}
+	ehht_engine_release(&sharded->engine);
+	free_func(sharded->shards, mem_context);
+	free_func(sharded, mem_context);
+	free_func(this, mem_context);
+}
+
+static const struct ehht_engine_ops_s ehht_sharded_ops = {
+	ehht_sharded_buckets_size,
+	ehht_sharded_buckets_resize,
+	ehht_sharded_buckets_auto_resize_load_factor,
+	ehht_sharded_bucket_for_key,
+	ehht_sharded_free,
+	ehht_sharded_get_hashed,
+	ehht_sharded_put_hashed,
+	ehht_sharded_remove_hashed,
+	ehht_sharded_has_key_hashed,
+	ehht_sharded_entry_hashed,
+	NULL,
+	ehht_sharded_stats,
+	ehht_sharded_stats_reset,
+	ehht_sharded_reserve,
+	ehht_sharded_shrink_to_fit,
+	NULL,
+	NULL,
+	ehht_sharded_resize_policy,
+	ehht_sharded_buckets_auto_shrink_load_factor
+};
+
+struct ehht_s *ehht_sharded_new(const struct ehht_options_s *options)
+{
+	struct ehht_s *this;
+	struct ehht_sharded_s *sharded;
+	struct ehht_shard_s *shard;
+	struct ehht_options_s shard_opts;
+	ehht_malloc_func mem_alloc;
+	ehht_free_func mem_free;
+	void *mem_context;
+	size_t i, size, num_shards;
+	unsigned bits;
+
+	mem_alloc = options->alloc_func;
+	mem_free = options->free_func;
+	mem_context = options->mem_context;
+
+	num_shards = 2;
+	for (bits = 1; num_shards < options->shards
+	     && num_shards < EHHT_MAX_SHARDS; ++bits) {
+		num_shards *= 2;
+	}
+
+	size = sizeof(struct ehht_s);
+	this = mem_alloc(size, mem_context);
+	if (this == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_s");
+		return NULL;
+	}
+	this->get = ehht_sharded_get;
+	this->put = ehht_sharded_put;
+	this->remove = ehht_sharded_remove;
+	this->size = ehht_sharded_size;
+	this->clear = ehht_sharded_clear;
+	this->for_each = ehht_sharded_for_each;
+	this->has_key = ehht_sharded_has_key;
+	this->keys = ehht_sharded_keys;
+	this->free_keys = ehht_engine_free_keys;
+	this->to_string = ehht_engine_to_string;
+
+	size = sizeof(struct ehht_sharded_s);
+	sharded = mem_alloc(size, mem_context);
+	if (sharded == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_sharded_s");
+		mem_free(this, mem_context);
+		return NULL;
+	}
+	this->data = (void *)sharded;
+
+	/* the entries are in the shards, thus so is any slab */
+	shard_opts = *options;
+	shard_opts.slab_page_size = 0;
+	if (ehht_engine_init(&sharded->engine, &ehht_sharded_ops,
+			     &shard_opts)) {
+		mem_free(sharded, mem_context);
+		mem_free(this, mem_context);
+		return NULL;
+	}
+	sharded->num_shards = num_shards;
+	sharded->shift = 64 - bits;
+	sharded->pass_hashcodes = (options->seeded_hash_func == NULL);
+
+	size = sizeof(struct ehht_shard_s) * num_shards;
+	sharded->shards = mem_alloc(size, mem_context);
+	if (sharded->shards == NULL) {
+		Ehht_failed_malloc(size, "shards");
+		ehht_engine_release(&sharded->engine);
+		mem_free(sharded, mem_context);
+		mem_free(this, mem_context);
+		return NULL;
+	}
+
+	shard_opts = *options;
+	shard_opts.shards = 0;
+	shard_opts.num_buckets = ehht_shard_share(sharded,
+						  options->num_buckets);
+	size = ehht_shard_share(sharded, options->expected_elements);
+	shard_opts.expected_elements = size + (size / 8);
+	for (i = 0; i < num_shards; ++i) {
+		shard = sharded->shards + i;
+		shard->table = NULL;
+		shard->lock = ehht_lock_new(mem_alloc, mem_free, mem_context);
+		if (shard->lock != NULL) {
+			shard->table = ehht_new_options(&shard_opts);
+		}
+		if (shard->table == NULL) {
+			sharded->num_shards = i + 1;
+			ehht_sharded_free(this);
+			return NULL;
+		}
+	}
+
+	return this;
+}
@@ -0,0 +1,267 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* ehht-slab.c: a per-table slab allocator for a simple OO hashtable */
+/* Copyright (C) 2016, 2017, 2018, 2019, 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+/*
+  Entries are carved from pages obtained from the table's allocator.
+  Each page serves a single size class, and each chunk is preceded by a
+  header which points back to its page. Freed chunks go on their page's
+  free list, and are handed out again before any new page is requested.
+  A page with no chunks in use is given back to the table's allocator,
+  except for one spare page kept to avoid thrashing at a page boundary.
+  Requests larger than the biggest size class go straight to the table's
+  allocator, with a NULL page in their header.
+*/
+
+#include "ehht.h"
+#include "ehht-private.h"
+#include <stdint.h>		/* SIZE_MAX */
+#include <assert.h>
+
+#ifndef EHHT_SLAB_CLASS_BYTES
+#define EHHT_SLAB_CLASS_BYTES 16
+#endif
+
+#ifndef EHHT_SLAB_CLASSES
+#define EHHT_SLAB_CLASSES 32
+#endif
+
+struct ehht_slab_page_s;
+
+union ehht_slab_header_u {
+	struct ehht_slab_page_s *page;
+	/* unused members, present to align the payload which follows */
+	void *ptr;
+	double d;
+	long l;
+};
+
+struct ehht_slab_free_s {
+	struct ehht_slab_free_s *next;
+};
+
+struct ehht_slab_page_s {
+	/* pages of a class are either on the partial or full list */
+	struct ehht_slab_page_s *prev;
+	struct ehht_slab_page_s *next;
+	struct ehht_slab_free_s *free_list;
+	unsigned char *unused;
+	size_t unused_chunks;
+	size_t in_use;
+	size_t klass;
+	/* unused member, present to align the first chunk */
+	union ehht_slab_header_u align;
+};
+
+struct ehht_slab_class_s {
+	struct ehht_slab_page_s *partial;
+	struct ehht_slab_page_s *full;
+};
+
+struct ehht_slab_s {
+	ehht_malloc_func alloc;
+	ehht_free_func free;
+	void *mem_context;
+	size_t page_size;
+	struct ehht_slab_page_s *spare;
+	struct ehht_slab_class_s classes[EHHT_SLAB_CLASSES];
+};
+
+static size_t ehht_slab_chunk_size(size_t klass)
+{
+	return sizeof(union ehht_slab_header_u)
+	    + ((klass + 1) * EHHT_SLAB_CLASS_BYTES);
+}
+
+static void ehht_slab_unlink(struct ehht_slab_page_s **list,
+			     struct ehht_slab_page_s *page)
+{
+	if (page->prev) {
+		page->prev->next = page->next;
+	} else {
+		*list = page->next;
+	}
+	if (page->next) {
+		page->next->prev = page->prev;
+	}
+	page->prev = NULL;
+	page->next = NULL;
+}
+
+static void ehht_slab_push(struct ehht_slab_page_s **list,
+			   struct ehht_slab_page_s *page)
+{
+	page->prev = NULL;
+	page->next = *list;
+	if (*list) {
+		(*list)->prev = page;
+	}
+	*list = page;
+}
+
+static struct ehht_slab_page_s *ehht_slab_new_page(struct ehht_slab_s *slab,
+						   size_t klass)
+{
+	struct ehht_slab_page_s *page;
+
+	if (slab->spare) {
+		page = slab->spare;
+		slab->spare = NULL;
+	} else {
+		page = slab->alloc(slab->page_size, slab->mem_context);
+		if (page == NULL) {
+			Ehht_failed_malloc(slab->page_size, "slab page");
+			return NULL;
+		}
+	}
+	page->prev = NULL;
+	page->next = NULL;
+	page->free_list = NULL;
+	page->unused = (unsigned char *)(page + 1);
+	page->unused_chunks = (slab->page_size - sizeof(*page))
+	    / ehht_slab_chunk_size(klass);
+	page->in_use = 0;
+	page->klass = klass;
+	return page;
+}
+
+void *ehht_slab_alloc(struct ehht_slab_s *slab, size_t size)
+{
+	struct ehht_slab_class_s *cls;
+	struct ehht_slab_page_s *page;
+	union ehht_slab_header_u *header;
+	size_t klass;
+
+	klass = (size == 0) ? 0 : ((size - 1) / EHHT_SLAB_CLASS_BYTES);
+	if (klass >= EHHT_SLAB_CLASSES
+	    || (ehht_slab_chunk_size(klass) + sizeof(*page)) >
+	    slab->page_size) {
+		if (size > (SIZE_MAX - sizeof(*header))) {
+			return NULL;
+		}
+		header = slab->alloc(sizeof(*header) + size, slab->mem_context);
+		if (header == NULL) {
+			return NULL;
+		}
+		header->page = NULL;
+		return (void *)(header + 1);
+	}
+
+	cls = slab->classes + klass;
+	page = cls->partial;
+	if (page == NULL) {
+		page = ehht_slab_new_page(slab, klass);
+		if (page == NULL) {
+			return NULL;
+		}
+		ehht_slab_push(&cls->partial, page);
+	}
+
+	if (page->free_list) {
+		header = ((union ehht_slab_header_u *)page->free_list) - 1;
+		page->free_list = page->free_list->next;
+	} else {
+		assert(page->unused_chunks > 0);
+		header = (union ehht_slab_header_u *)page->unused;
+		page->unused += ehht_slab_chunk_size(klass);
+		--(page->unused_chunks);
+	}
+	header->page = page;
+	++(page->in_use);
+
+	if (page->free_list == NULL && page->unused_chunks == 0) {
+		ehht_slab_unlink(&cls->partial, page);
+		ehht_slab_push(&cls->full, page);
+	}
+
+	return (void *)(header + 1);
+}
+
+void ehht_slab_free(struct ehht_slab_s *slab, void *ptr)
+{
+	struct ehht_slab_class_s *cls;
+	struct ehht_slab_page_s *page;
+	union ehht_slab_header_u *header;
+	struct ehht_slab_free_s *chunk;
+
+	if (ptr == NULL) {
+		return;
+	}
+
+	header = ((union ehht_slab_header_u *)ptr) - 1;
+	page = header->page;
+	if (page == NULL) {
+		slab->free(header, slab->mem_context);
+		return;
+	}
+
+	cls = slab->classes + page->klass;
+	if (page->free_list == NULL && page->unused_chunks == 0) {
+		ehht_slab_unlink(&cls->full, page);
+		ehht_slab_push(&cls->partial, page);
+	}
+
+	chunk = (struct ehht_slab_free_s *)ptr;
+	chunk->next = page->free_list;
+	page->free_list = chunk;
+	--(page->in_use);
+
+	if (page->in_use == 0) {
+		ehht_slab_unlink(&cls->partial, page);
+		if (slab->spare == NULL) {
+			slab->spare = page;
+		} else {
+			slab->free(page, slab->mem_context);
+		}
+	}
+}
+
+struct ehht_slab_s *ehht_slab_new(size_t page_size, ehht_malloc_func alloc,
+				  ehht_free_func free, void *mem_context)
+{
+	struct ehht_slab_s *slab;
+	size_t i, size;
+
+	size = sizeof(struct ehht_slab_s);
+	slab = alloc(size, mem_context);
+	if (slab == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_slab_s");
+		return NULL;
+	}
+	slab->alloc = alloc;
+	slab->free = free;
+	slab->mem_context = mem_context;
+	slab->page_size = page_size;
+	slab->spare = NULL;
+	for (i = 0; i < EHHT_SLAB_CLASSES; ++i) {
+		slab->classes[i].partial = NULL;
+		slab->classes[i].full = NULL;
+	}
+	return slab;
+}
+
+/* any chunks still in use are released along with their pages */
+void ehht_slab_destroy(struct ehht_slab_s *slab)
+{
+	struct ehht_slab_page_s *page;
+	size_t i;
+
+	if (slab == NULL) {
+		return;
+	}
+	for (i = 0; i < EHHT_SLAB_CLASSES; ++i) {
+		while ((page = slab->classes[i].partial) != NULL) {
+			slab->classes[i].partial = page->next;
+			slab->free(page, slab->mem_context);
+		}
+		while ((page = slab->classes[i].full) != NULL) {
+			slab->classes[i].full = page->next;
+			slab->free(page, slab->mem_context);
+		}
+	}
+	if (slab->spare) {
+		slab->free(slab->spare, slab->mem_context);
+	}
+	slab->free(slab, slab->mem_context);
+}
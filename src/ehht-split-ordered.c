@@ -0,0 +1,1128 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* ehht-split-ordered.c: a lock-free engine for a simple OO hashtable */
+/* Copyright (C) 2016, 2017, 2018, 2019, 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+/*
+  Split-ordered lists, after Shalev and Shavit: every element is in one
+  lock-free linked list, sorted by the bit-reversed hashcode, and the
+  buckets are only shortcuts into the list. As bucket b holds the keys
+  whose hashcodes end in the bits of b, and reversing the bits puts the
+  keys of each bucket together, in the same place whatever the number of
+  buckets, growing the table moves no elements: it only doubles the
+  number of buckets, and each new bucket is created when first used, by
+  linking a "dummy" node into the list, after the dummy of its parent
+  (the bucket with the highest bit of b cleared).
+
+  The list is that of Harris and Michael: a node is deleted by setting
+  the low bit of its next pointer, which stops any other thread linking
+  after it, then unlinked by whichever thread next passes it. So that a
+  put of an existing key is never lost to a concurrent remove, a remove
+  first swaps the node's value for a tombstone, and a put only replaces
+  a value which is not the tombstone. Nodes which share a bit-reversed
+  hashcode are in order of full hashcode, then key, thus each key has
+  one place in the list.
+
+  The buckets are in segments which double in size, so that a segment,
+  once allocated, is never moved. Unlinked nodes are retired, and freed
+  by epochs (see struct ehht_epochs_s): the retired nodes are gathered
+  by one thread at a time, which advances the epoch, and frees those no
+  thread could still see. A thread which finds no free epoch slot, or
+  any thread where there are no atomics, takes the table's lock instead,
+  as does the thread gathering the retired nodes.
+
+  The entries are allocated by whichever thread puts them, thus the
+  alloc_func and free_func must be thread safe; the slab is not used.
+*/
+
+#include "ehht.h"
+#include "ehht-private.h"
+#include <stdint.h>		/* SIZE_MAX */
+#include <string.h>		/* memcpy memcmp */
+#include <limits.h>		/* CHAR_BIT */
+#include <assert.h>
+
+#ifndef EHHT_SO_LOADFACTOR
+#define EHHT_SO_LOADFACTOR 1.0
+#endif
+
+#ifndef EHHT_SO_MIN_BUCKETS
+#define EHHT_SO_MIN_BUCKETS 8
+#endif
+
+#ifndef EHHT_SO_RECLAIM_BATCH
+/* the number of retired nodes which causes a reclaim */
+#define EHHT_SO_RECLAIM_BATCH 64
+#endif
+
+/* the first segment holds 2^EHHT_SO_SEGMENT0_BITS buckets, and each after
+ * as many as all before it */
+#define EHHT_SO_SEGMENT0_BITS 6
+#define EHHT_SO_SEGMENT0 (((size_t)1) << EHHT_SO_SEGMENT0_BITS)
+#define EHHT_SO_SEGMENTS \
+	((sizeof(size_t) * CHAR_BIT) - EHHT_SO_SEGMENT0_BITS)
+#define EHHT_SO_MAX_BUCKETS (((size_t)1) << ((sizeof(size_t) * CHAR_BIT) - 1))
+
+/* the key bytes of an element are stored directly after the node; a dummy
+ * node has a NULL key.str, and the bucket number as its hashcode */
+struct ehht_so_node_s {
+	/* the bit-reversed hashcode: odd for elements, even for dummies */
+	uint64_t so_key;
+	struct ehht_key_s key;
+	void *val;
+	/* the low bit is set once the node is deleted */
+	struct ehht_so_node_s *next;
+	/* once unlinked, the next node retired, and when */
+	struct ehht_so_node_s *retired;
+	unsigned long retired_epoch;
+};
+
+struct ehht_so_table_s {
+	struct ehht_engine_s engine;
+	struct ehht_epochs_s epochs;
+	/* the dummy of bucket 0, the start of the list */
+	struct ehht_so_node_s head;
+	struct ehht_so_node_s **segments[EHHT_SO_SEGMENTS];
+	size_t num_buckets;
+	size_t size;
+	double load_factor;
+	/* a stack of nodes retired since the last reclaim */
+	struct ehht_so_node_s *retired;
+	size_t num_retired;
+	struct ehht_lock_s *lock;
+	/* under the lock: the gathered nodes, oldest first */
+	struct ehht_so_node_s *limbo;
+	struct ehht_so_node_s *limbo_last;
+};
+
+/* what is being looked for: key is NULL for a dummy */
+struct ehht_so_target_s {
+	uint64_t so_key;
+	uint64_t hashcode;
+	const char *key;
+	size_t key_len;
+};
+
+/* the value of an element which is being removed */
+static char ehht_so_tombstone;
+#define EHHT_SO_TOMBSTONE ((void *)&ehht_so_tombstone)
+
+#define Ehht_so_is_marked(node) (((size_t)(node)) & 1)
+#define Ehht_so_marked(node) \
+	((struct ehht_so_node_s *)(((size_t)(node)) | 1))
+#define Ehht_so_unmarked(node) \
+	((struct ehht_so_node_s *)(((size_t)(node)) & ~((size_t)1)))
+
+#if EHHT_ATOMICS
+#define Ehht_so_load_factor(table, factor) \
+	__atomic_load(&(table)->load_factor, factor, __ATOMIC_RELAXED)
+#define Ehht_so_set_load_factor(table, factor) \
+	__atomic_store(&(table)->load_factor, factor, __ATOMIC_RELAXED)
+#else
+#define Ehht_so_load_factor(table, factor) (*(factor) = (table)->load_factor)
+#define Ehht_so_set_load_factor(table, factor) \
+	((table)->load_factor = *(factor))
+#endif
+
+static struct ehht_so_table_s *ehht_so_get_table(struct ehht_s *this)
+{
+	return (struct ehht_so_table_s *)this->data;
+}
+
+static uint64_t ehht_so_reverse(uint64_t x)
+{
+	x = ((x >> 1) & Ehht_u64(0x55555555UL, 0x55555555UL))
+	    | ((x & Ehht_u64(0x55555555UL, 0x55555555UL)) << 1);
+	x = ((x >> 2) & Ehht_u64(0x33333333UL, 0x33333333UL))
+	    | ((x & Ehht_u64(0x33333333UL, 0x33333333UL)) << 2);
+	x = ((x >> 4) & Ehht_u64(0x0F0F0F0FUL, 0x0F0F0F0FUL))
+	    | ((x & Ehht_u64(0x0F0F0F0FUL, 0x0F0F0F0FUL)) << 4);
+	x = ((x >> 8) & Ehht_u64(0x00FF00FFUL, 0x00FF00FFUL))
+	    | ((x & Ehht_u64(0x00FF00FFUL, 0x00FF00FFUL)) << 8);
+	x = ((x >> 16) & Ehht_u64(0x0000FFFFUL, 0x0000FFFFUL))
+	    | ((x & Ehht_u64(0x0000FFFFUL, 0x0000FFFFUL)) << 16);
+	return (x >> 32) | (x << 32);
+}
+
+static size_t ehht_so_floor_log2(size_t n)
+{
+	size_t log, shift;
+
+	log = 0;
+	for (shift = (sizeof(size_t) * CHAR_BIT) / 2; shift; shift /= 2) {
+		if (n >> shift) {
+			n >>= shift;
+			log += shift;
+		}
+	}
+	return log;
+}
+
+/* a power of two, at least EHHT_SO_MIN_BUCKETS, at most the maximum */
+static size_t ehht_so_round_up(size_t num_buckets)
+{
+	size_t n;
+
+	if (num_buckets >= EHHT_SO_MAX_BUCKETS) {
+		return EHHT_SO_MAX_BUCKETS;
+	}
+	n = EHHT_SO_MIN_BUCKETS;
+	while (n < num_buckets) {
+		n *= 2;
+	}
+	return n;
+}
+
+static void ehht_so_target_init(struct ehht_so_target_s *target,
+				const char *key, size_t key_len,
+				uint64_t hashcode)
+{
+	target->so_key = ehht_so_reverse(hashcode) | 1;
+	target->hashcode = hashcode;
+	target->key = key;
+	target->key_len = key_len;
+}
+
+static int ehht_so_compare(const struct ehht_so_node_s *node,
+			   const struct ehht_so_target_s *target)
+{
+	if (node->so_key != target->so_key) {
+		return (node->so_key < target->so_key) ? -1 : 1;
+	}
+	if ((node->so_key & 1) == 0) {
+		/* each bucket has but one dummy */
+		return 0;
+	}
+	if (node->key.hashcode != target->hashcode) {
+		return (node->key.hashcode < target->hashcode) ? -1 : 1;
+	}
+	if (node->key.len != target->key_len) {
+		return (node->key.len < target->key_len) ? -1 : 1;
+	}
+	return memcmp(node->key.str, target->key, target->key_len);
+}
+
+/* returns the slot which marks the thread as within an epoch, or NULL if
+ * the lock was taken instead */
+static struct ehht_epoch_slot_s *ehht_so_enter(struct ehht_so_table_s *table)
+{
+	struct ehht_epoch_slot_s *slot;
+
+	slot = ehht_epoch_enter(&table->epochs);
+	if (slot == NULL) {
+		ehht_lock(table->lock);
+	}
+	return slot;
+}
+
+/* frees the retired nodes which no thread can still see */
+static void ehht_so_reclaim(struct ehht_so_table_s *table)
+{
+	struct ehht_so_node_s *node, *gathered, *empty;
+	unsigned long before, oldest;
+	size_t num_gathered;
+
+	ehht_lock(table->lock);
+
+	empty = NULL;
+	gathered = Ehht_load_relaxed(&table->retired);
+	while (!Ehht_cas(&table->retired, &gathered, empty)) {
+		/* retry with the new top of the stack */ ;
+	}
+	/* each was unlinked before it was gathered, thus before the advance */
+	before = ehht_epoch_advance(&table->epochs, &oldest);
+	num_gathered = 0;
+	while ((node = gathered) != NULL) {
+		gathered = node->retired;
+		node->retired = NULL;
+		node->retired_epoch = before;
+		if (table->limbo_last) {
+			table->limbo_last->retired = node;
+		} else {
+			table->limbo = node;
+		}
+		table->limbo_last = node;
+		++num_gathered;
+	}
+	(void)Ehht_fetch_add(&table->num_retired, ((size_t)0) - num_gathered);
+
+	while ((node = table->limbo) != NULL && node->retired_epoch < oldest) {
+		table->limbo = node->retired;
+		ehht_engine_entry_free(&table->engine, node);
+	}
+	if (table->limbo == NULL) {
+		table->limbo_last = NULL;
+	}
+
+	ehht_unlock(table->lock);
+}
+
+static void ehht_so_leave(struct ehht_so_table_s *table,
+			  struct ehht_epoch_slot_s *slot)
+{
+	if (slot == NULL) {
+		ehht_unlock(table->lock);
+	} else {
+		ehht_epoch_exit(slot);
+	}
+	if (Ehht_load_relaxed(&table->num_retired) >= EHHT_SO_RECLAIM_BATCH) {
+		ehht_so_reclaim(table);
+	}
+}
+
+/* once unlinked */
+static void ehht_so_retire(struct ehht_so_table_s *table,
+			   struct ehht_so_node_s *node)
+{
+	struct ehht_so_node_s *top;
+
+	top = Ehht_load_relaxed(&table->retired);
+	do {
+		node->retired = top;
+	} while (!Ehht_cas(&table->retired, &top, node));
+	(void)Ehht_fetch_add(&table->num_retired, 1);
+}
+
+/* sets the low bit of the node's next, after which nothing may be linked
+ * after it */
+static void ehht_so_mark(struct ehht_so_node_s *node)
+{
+	struct ehht_so_node_s *next;
+
+	next = Ehht_load_acquire(&node->next);
+	while (!Ehht_so_is_marked(next)
+	       && !Ehht_cas(&node->next, &next, Ehht_so_marked(next))) {
+		/* retry with the new next */ ;
+	}
+}
+
+/* returns non-zero if a live node equal to the target follows start, in
+ * *cur, else *cur is the first greater node, or NULL; *prev is the link to
+ * *cur. Deleted nodes which are passed are unlinked. */
+static int ehht_so_find(struct ehht_so_table_s *table,
+			struct ehht_so_node_s *start,
+			const struct ehht_so_target_s *target,
+			struct ehht_so_node_s ***prev,
+			struct ehht_so_node_s **cur)
+{
+	struct ehht_so_node_s *node, *next, *expected;
+	int cmp, restart;
+
+	do {
+		restart = 0;
+		cmp = 1;
+		*prev = &start->next;
+		node = Ehht_load_acquire(*prev);
+		while (node != NULL) {
+			next = Ehht_load_acquire(&node->next);
+			if (Ehht_so_is_marked(next)) {
+				next = Ehht_so_unmarked(next);
+				expected = node;
+				if (!Ehht_cas(*prev, &expected, next)) {
+					restart = 1;
+					break;
+				}
+				ehht_so_retire(table, node);
+				node = next;
+				continue;
+			}
+			cmp = ehht_so_compare(node, target);
+			if (cmp == 0 && (node->so_key & 1)
+			    && (Ehht_load_acquire(&node->val)
+				== EHHT_SO_TOMBSTONE)) {
+				/* a remove is under way: help it along */
+				ehht_so_mark(node);
+				continue;
+			}
+			if (cmp >= 0) {
+				break;
+			}
+			*prev = &node->next;
+			node = next;
+		}
+	} while (restart);
+
+	*cur = node;
+	return node != NULL && cmp == 0;
+}
+
+static struct ehht_so_node_s *ehht_so_alloc_node(struct ehht_so_table_s *table,
+						 const char *key,
+						 size_t key_len,
+						 uint64_t hashcode,
+						 uint64_t so_key, void *val)
+{
+	struct ehht_so_node_s *node;
+	char *key_copy;
+	size_t size;
+
+	size = sizeof(struct ehht_so_node_s);
+	if (key != NULL) {
+		if (key_len >= (SIZE_MAX - size)) {
+			Ehht_failed_malloc(SIZE_MAX, "struct ehht_so_node_s");
+			return NULL;
+		}
+		size += key_len + 1;
+	}
+	node = ehht_engine_entry_alloc(&table->engine, size);
+	if (node == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_so_node_s");
+		return NULL;
+	}
+	key_copy = NULL;
+	if (key != NULL) {
+		key_copy = (char *)(node + 1);
+		memcpy(key_copy, key, key_len);
+		key_copy[key_len] = '\0';
+	}
+	node->so_key = so_key;
+	node->key.str = key_copy;
+	node->key.len = key_len;
+	node->key.hashcode = hashcode;
+	node->val = val;
+	node->next = NULL;
+	node->retired = NULL;
+	node->retired_epoch = 0;
+	return node;
+}
+
+/* returns the cell of the bucket, allocating its segment if need be, or
+ * NULL if the segment could not be allocated */
+static struct ehht_so_node_s **ehht_so_bucket_cell(struct ehht_so_table_s
+						   *table, size_t bucket)
+{
+	struct ehht_so_node_s **segment, **expected;
+	size_t seg, len, i, size;
+
+	if (bucket < EHHT_SO_SEGMENT0) {
+		seg = 0;
+		len = EHHT_SO_SEGMENT0;
+	} else {
+		seg = ehht_so_floor_log2(bucket) - EHHT_SO_SEGMENT0_BITS + 1;
+		len = ((size_t)1) << (seg + EHHT_SO_SEGMENT0_BITS - 1);
+	}
+	segment = Ehht_load_acquire(table->segments + seg);
+	if (segment == NULL) {
+		size = sizeof(struct ehht_so_node_s *) * len;
+		segment = table->engine.alloc(size, table->engine.mem_context);
+		if (segment == NULL) {
+			Ehht_failed_malloc(size, "bucket segment");
+			return NULL;
+		}
+		for (i = 0; i < len; ++i) {
+			segment[i] = NULL;
+		}
+		expected = NULL;
+		if (!Ehht_cas(table->segments + seg, &expected, segment)) {
+			table->engine.free(segment, table->engine.mem_context);
+			segment = expected;
+		}
+	}
+	return segment + ((seg == 0) ? bucket : bucket - len);
+}
+
+/* returns the dummy of the bucket, linking it into the list if need be;
+ * should that fail, the dummy of the nearest ancestor, which also precedes
+ * the bucket's keys */
+static struct ehht_so_node_s *ehht_so_bucket(struct ehht_so_table_s *table,
+					     size_t bucket)
+{
+	struct ehht_so_node_s **cell, **prev, *dummy, *parent, *cur, *expected;
+	struct ehht_so_target_s target;
+	size_t highest_bit;
+
+	cell = ehht_so_bucket_cell(table, bucket);
+	if (cell != NULL) {
+		dummy = Ehht_load_acquire(cell);
+		if (dummy != NULL) {
+			return dummy;
+		}
+	}
+	if (bucket == 0) {
+		return &table->head;
+	}
+	highest_bit = ((size_t)1) << ehht_so_floor_log2(bucket);
+	parent = ehht_so_bucket(table, bucket ^ highest_bit);
+	if (cell == NULL) {
+		return parent;
+	}
+
+	target.so_key = ehht_so_reverse((uint64_t)bucket);
+	target.hashcode = (uint64_t)bucket;
+	target.key = NULL;
+	target.key_len = 0;
+	dummy = NULL;
+	for (;;) {
+		if (ehht_so_find(table, parent, &target, &prev, &cur)) {
+			/* another thread linked it first */
+			if (dummy != NULL) {
+				ehht_engine_entry_free(&table->engine, dummy);
+			}
+			dummy = cur;
+			break;
+		}
+		if (dummy == NULL) {
+			dummy = ehht_so_alloc_node(table, NULL, 0,
+						   target.hashcode,
+						   target.so_key, NULL);
+			if (dummy == NULL) {
+				return parent;
+			}
+		}
+		dummy->next = cur;
+		expected = cur;
+		if (Ehht_cas(prev, &expected, dummy)) {
+			break;
+		}
+	}
+	Ehht_store_release(cell, dummy);
+	return dummy;
+}
+
+static struct ehht_so_node_s *ehht_so_start(struct ehht_so_table_s *table,
+					    uint64_t hashcode)
+{
+	size_t num_buckets;
+
+	num_buckets = Ehht_load_acquire(&table->num_buckets);
+	return ehht_so_bucket(table, ((size_t)hashcode) & (num_buckets - 1));
+}
+
+/* doubles the buckets if the table is now over its load factor */
+static void ehht_so_grow(struct ehht_so_table_s *table, size_t size)
+{
+	size_t num_buckets;
+	double load_factor;
+
+	Ehht_so_load_factor(table, &load_factor);
+	num_buckets = Ehht_load_relaxed(&table->num_buckets);
+	if (load_factor > 0.0 && size > (num_buckets * load_factor)
+	    && num_buckets < EHHT_SO_MAX_BUCKETS) {
+		/* if another thread changed the number, let it be */
+		(void)Ehht_cas(&table->num_buckets, &num_buckets,
+			       2 * num_buckets);
+	}
+}
+
+static void ehht_so_shrink(struct ehht_so_table_s *table, size_t size)
+{
+	size_t num_buckets;
+	double load_factor;
+
+	Ehht_so_load_factor(table, &load_factor);
+	num_buckets = Ehht_load_relaxed(&table->num_buckets);
+	if (num_buckets > EHHT_SO_MIN_BUCKETS
+	    && ehht_engine_should_shrink(&table->engine, size, num_buckets,
+					 load_factor)) {
+		(void)Ehht_cas(&table->num_buckets, &num_buckets,
+			       num_buckets / 2);
+	}
+}
+
+/* within an epoch: returns the node of the key, inserted with val if the
+ * key was not present, or NULL if it could not be allocated */
+static struct ehht_so_node_s *ehht_so_insert(struct ehht_so_table_s *table,
+					     const struct ehht_so_target_s
+					     *target, void *val, int replace,
+					     void **old_val, int *inserted)
+{
+	struct ehht_so_node_s *start, **prev, *cur, *node, *expected;
+	void *old;
+
+	*old_val = NULL;
+	*inserted = 0;
+	start = ehht_so_start(table, target->hashcode);
+	node = NULL;
+	for (;;) {
+		if (ehht_so_find(table, start, target, &prev, &cur)) {
+			old = Ehht_load_acquire(&cur->val);
+			if (old == EHHT_SO_TOMBSTONE) {
+				continue;
+			}
+			if (!replace || Ehht_cas(&cur->val, &old, val)) {
+				*old_val = old;
+				break;
+			}
+			continue;
+		}
+		if (node == NULL) {
+			node = ehht_so_alloc_node(table, target->key,
+						  target->key_len,
+						  target->hashcode,
+						  target->so_key, val);
+			if (node == NULL) {
+				return NULL;
+			}
+		}
+		node->next = cur;
+		expected = cur;
+		if (Ehht_cas(prev, &expected, node)) {
+			*inserted = 1;
+			break;
+		}
+	}
+	if (node != NULL && !*inserted) {
+		/* never linked, thus never seen */
+		ehht_engine_entry_free(&table->engine, node);
+	}
+	if (*inserted) {
+		ehht_so_grow(table, Ehht_fetch_add(&table->size, 1) + 1);
+		return node;
+	}
+	return cur;
+}
+
+/* within an epoch: returns non-zero if the key was removed */
+static int ehht_so_delete(struct ehht_so_table_s *table,
+			  const struct ehht_so_target_s *target, void **old_val)
+{
+	struct ehht_so_node_s *start, **prev, *cur, *next, *expected;
+	void *old;
+
+	*old_val = NULL;
+	start = ehht_so_start(table, target->hashcode);
+	while (ehht_so_find(table, start, target, &prev, &cur)) {
+		old = Ehht_load_acquire(&cur->val);
+		if (old == EHHT_SO_TOMBSTONE
+		    || !Ehht_cas(&cur->val, &old, EHHT_SO_TOMBSTONE)) {
+			continue;
+		}
+		*old_val = old;
+		ehht_so_mark(cur);
+		next = Ehht_so_unmarked(Ehht_load_acquire(&cur->next));
+		expected = cur;
+		if (Ehht_cas(prev, &expected, next)) {
+			ehht_so_retire(table, cur);
+		} else {
+			/* unlinked in passing */
+			ehht_so_find(table, start, target, &prev, &cur);
+		}
+		ehht_so_shrink(table,
+			       Ehht_fetch_add(&table->size, ((size_t)0) - 1) -
+			       1);
+		return 1;
+	}
+	return 0;
+}
+
+static void *ehht_so_get_hashed(struct ehht_s *this, const char *key,
+				size_t key_len, uint64_t hashcode)
+{
+	struct ehht_so_table_s *table;
+	struct ehht_epoch_slot_s *slot;
+	struct ehht_so_target_s target;
+	struct ehht_so_node_s *start, **prev, *cur;
+	void *val;
+
+	table = ehht_so_get_table(this);
+	ehht_so_target_init(&target, key, key_len, hashcode);
+
+	val = NULL;
+	slot = ehht_so_enter(table);
+	start = ehht_so_start(table, hashcode);
+	if (ehht_so_find(table, start, &target, &prev, &cur)) {
+		val = Ehht_load_acquire(&cur->val);
+		if (val == EHHT_SO_TOMBSTONE) {
+			val = NULL;
+		}
+	}
+	ehht_so_leave(table, slot);
+
+	return val;
+}
+
+static void *ehht_so_get(struct ehht_s *this, const char *key, size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_so_get_hashed(this, key, key_len, hashcode);
+}
+
+static int ehht_so_has_key_hashed(struct ehht_s *this, const char *key,
+				  size_t key_len, uint64_t hashcode)
+{
+	struct ehht_so_table_s *table;
+	struct ehht_epoch_slot_s *slot;
+	struct ehht_so_target_s target;
+	struct ehht_so_node_s *start, **prev, *cur;
+	int found;
+
+	table = ehht_so_get_table(this);
+	ehht_so_target_init(&target, key, key_len, hashcode);
+
+	slot = ehht_so_enter(table);
+	start = ehht_so_start(table, hashcode);
+	found = ehht_so_find(table, start, &target, &prev, &cur);
+	ehht_so_leave(table, slot);
+
+	return found;
+}
+
+static int ehht_so_has_key(struct ehht_s *this, const char *key,
+			   size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_so_has_key_hashed(this, key, key_len, hashcode);
+}
+
+static void *ehht_so_put_hashed(struct ehht_s *this, const char *key,
+				size_t key_len, uint64_t hashcode, void *val)
+{
+	struct ehht_so_table_s *table;
+	struct ehht_epoch_slot_s *slot;
+	struct ehht_so_target_s target;
+	struct ehht_so_node_s *node;
+	void *old_val;
+	int inserted;
+
+	table = ehht_so_get_table(this);
+	ehht_so_target_init(&target, key, key_len, hashcode);
+
+	slot = ehht_so_enter(table);
+	node = ehht_so_insert(table, &target, val, 1, &old_val, &inserted);
+	ehht_so_leave(table, slot);
+
+	if (node == NULL) {
+		fprintf(stderr, "%s:%d: ehht_put failed\n", __FILE__, __LINE__);
+	}
+	return old_val;
+}
+
+static void *ehht_so_put(struct ehht_s *this, const char *key, size_t key_len,
+			 void *val)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_so_put_hashed(this, key, key_len, hashcode, val);
+}
+
+/* writes through the slot are not atomic: they must not race with a
+ * remove of the key */
+static void **ehht_so_entry_hashed(struct ehht_s *this, const char *key,
+				   size_t key_len, uint64_t hashcode,
+				   int *created)
+{
+	struct ehht_so_table_s *table;
+	struct ehht_epoch_slot_s *slot;
+	struct ehht_so_target_s target;
+	struct ehht_so_node_s *node;
+	void *old_val;
+	int inserted;
+
+	table = ehht_so_get_table(this);
+	ehht_so_target_init(&target, key, key_len, hashcode);
+
+	slot = ehht_so_enter(table);
+	node = ehht_so_insert(table, &target, NULL, 0, &old_val, &inserted);
+	ehht_so_leave(table, slot);
+
+	if (created) {
+		*created = inserted;
+	}
+	return (node == NULL) ? NULL : &(node->val);
+}
+
+static void *ehht_so_remove_hashed(struct ehht_s *this, const char *key,
+				   size_t key_len, uint64_t hashcode)
+{
+	struct ehht_so_table_s *table;
+	struct ehht_epoch_slot_s *slot;
+	struct ehht_so_target_s target;
+	void *old_val;
+
+	table = ehht_so_get_table(this);
+	ehht_so_target_init(&target, key, key_len, hashcode);
+
+	slot = ehht_so_enter(table);
+	ehht_so_delete(table, &target, &old_val);
+	ehht_so_leave(table, slot);
+
+	return old_val;
+}
+
+static void *ehht_so_remove(struct ehht_s *this, const char *key,
+			    size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_so_remove_hashed(this, key, key_len, hashcode);
+}
+
+static size_t ehht_so_size(struct ehht_s *this)
+{
+	return Ehht_load_relaxed(&ehht_so_get_table(this)->size);
+}
+
+/* within an epoch: the first live element after node, or NULL */
+static struct ehht_so_node_s *ehht_so_next_element(struct ehht_so_node_s
+						   *node, void **val)
+{
+	for (;;) {
+		node = Ehht_so_unmarked(Ehht_load_acquire(&node->next));
+		if (node == NULL) {
+			return NULL;
+		}
+		if (node->so_key & 1) {
+			*val = Ehht_load_acquire(&node->val);
+			if (*val != EHHT_SO_TOMBSTONE) {
+				return node;
+			}
+		}
+	}
+}
+
+/* removes each element in turn; not atomic, elements put meanwhile may
+ * survive */
+static void ehht_so_clear(struct ehht_s *this)
+{
+	struct ehht_so_table_s *table;
+	struct ehht_epoch_slot_s *slot;
+	struct ehht_so_target_s target;
+	struct ehht_so_node_s *node;
+	void *val;
+
+	table = ehht_so_get_table(this);
+
+	slot = ehht_so_enter(table);
+	node = &table->head;
+	while ((node = ehht_so_next_element(node, &val)) != NULL) {
+		ehht_so_target_init(&target, node->key.str, node->key.len,
+				    node->key.hashcode);
+		ehht_so_delete(table, &target, &val);
+	}
+	ehht_so_leave(table, slot);
+}
+
+/* within an epoch, or the lock, thus func must not call methods of the
+ * same table; elements put or removed meanwhile may or may not be seen */
+static int ehht_so_for_each(struct ehht_s *this, ehht_iterator_func func,
+			    void *context)
+{
+	struct ehht_so_table_s *table;
+	struct ehht_epoch_slot_s *slot;
+	struct ehht_so_node_s *node;
+	void *val;
+	int end;
+
+	table = ehht_so_get_table(this);
+
+	end = 0;
+	slot = ehht_so_enter(table);
+	node = &table->head;
+	while (!end && (node = ehht_so_next_element(node, &val)) != NULL) {
+		end = func(node->key, val, context);
+	}
+	ehht_so_leave(table, slot);
+
+	return end;
+}
+
+static struct ehht_keys_s *ehht_so_keys(struct ehht_s *this, int copy_keys)
+{
+	struct ehht_so_table_s *table;
+	struct ehht_epoch_slot_s *slot;
+	struct ehht_keys_s *keys;
+	struct ehht_so_node_s *node;
+	struct ehht_key_s *key;
+	char *key_copy;
+	size_t count, size;
+	void *val;
+
+	table = ehht_so_get_table(this);
+
+	size = sizeof(struct ehht_keys_s);
+	keys = table->engine.alloc(size, table->engine.mem_context);
+	if (keys == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_keys_s");
+		return NULL;
+	}
+	keys->keys_copied = copy_keys;
+	keys->keys = NULL;
+	keys->len = 0;
+
+	slot = ehht_so_enter(table);
+	count = 0;
+	node = &table->head;
+	while ((node = ehht_so_next_element(node, &val)) != NULL) {
+		++count;
+	}
+	size = sizeof(struct ehht_key_s) * count;
+	if (size) {
+		keys->keys = table->engine.alloc(size,
+						 table->engine.mem_context);
+		if (keys->keys == NULL) {
+			Ehht_failed_malloc(size, "key list");
+			ehht_so_leave(table, slot);
+			table->engine.free(keys, table->engine.mem_context);
+			return NULL;
+		}
+	}
+	/* elements put since the count are left out */
+	node = &table->head;
+	while (keys->len < count
+	       && (node = ehht_so_next_element(node, &val)) != NULL) {
+		key = keys->keys + keys->len;
+		*key = node->key;
+		if (copy_keys) {
+			size = node->key.len + 1;
+			key_copy = table->engine.alloc(size,
+						       table->engine.
+						       mem_context);
+			if (key_copy == NULL) {
+				Ehht_failed_malloc(size, "key copy");
+				ehht_so_leave(table, slot);
+				ehht_engine_free_keys(this, keys);
+				return NULL;
+			}
+			memcpy(key_copy, node->key.str, size);
+			key->str = key_copy;
+		}
+		++(keys->len);
+	}
+	ehht_so_leave(table, slot);
+
+	return keys;
+}
+
+static size_t ehht_so_buckets_size(struct ehht_s *this)
+{
+	return Ehht_load_relaxed(&ehht_so_get_table(this)->num_buckets);
+}
+
+/* no element moves: new buckets are made as they are first used, and the
+ * dummies of the buckets given up stay in the list */
+static size_t ehht_so_buckets_resize(struct ehht_s *this, size_t num_buckets)
+{
+	struct ehht_so_table_s *table;
+
+	table = ehht_so_get_table(this);
+	num_buckets = ehht_so_round_up(num_buckets);
+	Ehht_store_release(&table->num_buckets, num_buckets);
+	return num_buckets;
+}
+
+/* a factor of zero disables growth */
+static void ehht_so_buckets_auto_resize_load_factor(struct ehht_s *this,
+						    double factor)
+{
+	if (factor < 0.0) {
+		factor = 0.0;
+	}
+	Ehht_so_set_load_factor(ehht_so_get_table(this), &factor);
+}
+
+static size_t ehht_so_bucket_for_key(struct ehht_s *this, const char *key,
+				     size_t key_len)
+{
+	struct ehht_so_table_s *table;
+	uint64_t hashcode;
+
+	table = ehht_so_get_table(this);
+	hashcode = Ehht_hash(&table->engine, key, key_len);
+	return ((size_t)hashcode) & (Ehht_load_acquire(&table->num_buckets)
+				     - 1);
+}
+
+static size_t ehht_so_reserve(struct ehht_s *this, size_t n_elements)
+{
+	struct ehht_so_table_s *table;
+	size_t num_buckets, wanted;
+	double load_factor;
+
+	table = ehht_so_get_table(this);
+
+	Ehht_so_load_factor(table, &load_factor);
+	num_buckets = Ehht_load_relaxed(&table->num_buckets);
+	if (load_factor <= 0.0) {
+		return num_buckets;
+	}
+	wanted = ehht_buckets_for_elements(n_elements, load_factor);
+	wanted = ehht_so_round_up(wanted);
+	while (wanted > num_buckets
+	       && !Ehht_cas(&table->num_buckets, &num_buckets, wanted)) {
+		/* retry with the new number */ ;
+	}
+	return (wanted > num_buckets) ? wanted : num_buckets;
+}
+
+static size_t ehht_so_shrink_to_fit(struct ehht_s *this)
+{
+	struct ehht_so_table_s *table;
+	size_t num_buckets, wanted;
+	double load_factor;
+
+	table = ehht_so_get_table(this);
+
+	Ehht_so_load_factor(table, &load_factor);
+	if (load_factor <= 0.0) {
+		load_factor = EHHT_SO_LOADFACTOR;
+	}
+	wanted = ehht_buckets_for_elements(Ehht_load_relaxed(&table->size),
+					   load_factor);
+	wanted = ehht_so_round_up(wanted);
+	num_buckets = Ehht_load_relaxed(&table->num_buckets);
+	if (wanted < num_buckets
+	    && Ehht_cas(&table->num_buckets, &num_buckets, wanted)) {
+		return wanted;
+	}
+	return num_buckets;
+}
+
+static void ehht_so_free_list(struct ehht_so_table_s *table,
+			      struct ehht_so_node_s *node, int retired)
+{
+	struct ehht_so_node_s *next;
+
+	while (node != NULL) {
+		next = retired ? node->retired : Ehht_so_unmarked(node->next);
+		ehht_engine_entry_free(&table->engine, node);
+		node = next;
+	}
+}
+
+/* no other thread may be using the table */
+static void ehht_so_free(struct ehht_s *this)
+{
+	struct ehht_so_table_s *table;
+	ehht_free_func free_func;
+	void *mem_context;
+	size_t i;
+
+	table = ehht_so_get_table(this);
+
+	free_func = table->engine.free;
+	mem_context = table->engine.mem_context;
+
+	ehht_so_free_list(table, Ehht_so_unmarked(table->head.next), 0);
+	ehht_so_free_list(table, table->retired, 1);
+	ehht_so_free_list(table, table->limbo, 1);
+	for (i = 0; i < EHHT_SO_SEGMENTS; ++i) {
+		if (table->segments[i]) {
+			free_func(table->segments[i], mem_context);
+		}
+	}
+
+	ehht_lock_destroy(table->lock, free_func, mem_context);
+	ehht_engine_release(&table->engine);
+	free_func(table, mem_context);
+	free_func(this, mem_context);
+}
+
+static const struct ehht_engine_ops_s ehht_split_ordered_ops = {
+	ehht_so_buckets_size,
+	ehht_so_buckets_resize,
+	ehht_so_buckets_auto_resize_load_factor,
+	ehht_so_bucket_for_key,
+	ehht_so_free,
+	ehht_so_get_hashed,
+	ehht_so_put_hashed,
+	ehht_so_remove_hashed,
+	ehht_so_has_key_hashed,
+	ehht_so_entry_hashed,
+	NULL,
+	NULL,
+	NULL,
+	ehht_so_reserve,
+	ehht_so_shrink_to_fit,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+struct ehht_s *ehht_split_ordered_new(const struct ehht_options_s *options)
+{
+	struct ehht_s *this;
+	struct ehht_so_table_s *table;
+	struct ehht_options_s opts;
+	ehht_malloc_func mem_alloc;
+	ehht_free_func mem_free;
+	void *mem_context;
+	size_t i, size, num_buckets;
+
+	mem_alloc = options->alloc_func;
+	mem_free = options->free_func;
+	mem_context = options->mem_context;
+
+	size = sizeof(struct ehht_s);
+	this = mem_alloc(size, mem_context);
+	if (this == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_s");
+		return NULL;
+	}
+	this->get = ehht_so_get;
+	this->put = ehht_so_put;
+	this->remove = ehht_so_remove;
+	this->size = ehht_so_size;
+	this->clear = ehht_so_clear;
+	this->for_each = ehht_so_for_each;
+	this->has_key = ehht_so_has_key;
+	this->keys = ehht_so_keys;
+	this->free_keys = ehht_engine_free_keys;
+	this->to_string = ehht_engine_to_string;
+
+	size = sizeof(struct ehht_so_table_s);
+	table = mem_alloc(size, mem_context);
+	if (table == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_so_table_s");
+		mem_free(this, mem_context);
+		return NULL;
+	}
+	this->data = (void *)table;
+
+	/* the slab is not thread safe */
+	opts = *options;
+	opts.slab_page_size = 0;
+	if (ehht_engine_init(&table->engine, &ehht_split_ordered_ops, &opts)) {
+		mem_free(table, mem_context);
+		mem_free(this, mem_context);
+		return NULL;
+	}
+	ehht_epochs_init(&table->epochs);
+	table->head.so_key = 0;
+	table->head.key.str = NULL;
+	table->head.key.len = 0;
+	table->head.key.hashcode = 0;
+	table->head.val = NULL;
+	table->head.next = NULL;
+	table->head.retired = NULL;
+	table->head.retired_epoch = 0;
+	for (i = 0; i < EHHT_SO_SEGMENTS; ++i) {
+		table->segments[i] = NULL;
+	}
+	table->size = 0;
+	table->retired = NULL;
+	table->num_retired = 0;
+	table->limbo = NULL;
+	table->limbo_last = NULL;
+	table->load_factor = EHHT_SO_LOADFACTOR;
+	if (options->load_factor > 0.0) {
+		table->load_factor = options->load_factor;
+	}
+	num_buckets = options->num_buckets;
+	if (options->expected_elements) {
+		size = ehht_buckets_for_elements(options->expected_elements,
+						 table->load_factor);
+		if (size > num_buckets) {
+			num_buckets = size;
+		}
+	}
+	table->num_buckets = ehht_so_round_up(num_buckets);
+
+	table->lock = ehht_lock_new(mem_alloc, mem_free, mem_context);
+	if (table->lock == NULL || ehht_so_bucket_cell(table, 0) == NULL) {
+		ehht_lock_destroy(table->lock, mem_free, mem_context);
+		ehht_engine_release(&table->engine);
+		mem_free(table, mem_context);
+		mem_free(this, mem_context);
+		return NULL;
+	}
+	table->segments[0][0] = &table->head;
+
+	return this;
+}
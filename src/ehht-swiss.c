@@ -0,0 +1,839 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* ehht-swiss.c: a control-byte probing engine for a simple OO hashtable */
+/* Copyright (C) 2016, 2017, 2018, 2019, 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+/*
+  In the style of the "Swiss tables" of abseil: beside the slot array is
+  an array of control bytes, one per slot. A full slot's control byte is
+  seven bits of the key's hash, thus a single SIMD compare can test a
+  whole window of slots for a possible match before any key is touched.
+  Windows are scanned linearly and a window with an empty slot ends a
+  probe, so the same table may be read with any window width.
+  https://abseil.io/about/design/swisstables
+*/
+
+#include "ehht.h"
+#include "ehht-private.h"
+#include <stdint.h>		/* SIZE_MAX */
+#include <string.h>		/* memcpy memcmp */
+#include <assert.h>
+
+#ifndef EHHT_SWISS_SIMD
+#if defined(__GNUC__) && (defined(__x86_64__) \
+	|| (defined(__i386__) && defined(__SSE2__)))
+#define EHHT_SWISS_SIMD 1
+#else
+#define EHHT_SWISS_SIMD 0
+#endif
+#endif
+
+#if EHHT_SWISS_SIMD
+#include <immintrin.h>
+#endif
+
+#ifndef EHHT_SWISS_LOADFACTOR
+#define EHHT_SWISS_LOADFACTOR 0.875
+#endif
+
+/* the widest window of any kernel, also the minimum number of slots */
+#define EHHT_SWISS_WINDOW_MAX 32
+
+#define EHHT_SWISS_EMPTY 0x80
+#define EHHT_SWISS_DELETED 0xFE
+
+/* each returns a bitmask where bit i is set if ctrl[i] matches */
+struct ehht_swiss_kernel_s {
+	size_t width;
+	unsigned long (*match)(const unsigned char *ctrl, unsigned char tag);
+	unsigned long (*match_empty)(const unsigned char *ctrl);
+	/* empty or deleted */
+	unsigned long (*match_free)(const unsigned char *ctrl);
+};
+
+struct ehht_swiss_slot_s {
+	struct ehht_key_s key;
+	void *val;
+};
+
+struct ehht_swiss_s {
+	struct ehht_engine_s engine;
+	const struct ehht_swiss_kernel_s *kernel;
+	size_t num_slots;
+	size_t mask;
+	/* the control bytes follow the slots in the same allocation */
+	struct ehht_swiss_slot_s *slots;
+	unsigned char *ctrl;
+	size_t size;
+	size_t deleted;
+	double max_load_factor;
+};
+
+#if !EHHT_SWISS_SIMD
+static unsigned long ehht_swiss_portable_match(const unsigned char *ctrl,
+					       unsigned char tag)
+{
+	unsigned long bits;
+	size_t i;
+
+	bits = 0;
+	for (i = 0; i < 16; ++i) {
+		if (ctrl[i] == tag) {
+			bits |= (1UL << i);
+		}
+	}
+	return bits;
+}
+
+static unsigned long ehht_swiss_portable_match_empty(const unsigned char *ctrl)
+{
+	return ehht_swiss_portable_match(ctrl, EHHT_SWISS_EMPTY);
+}
+
+static unsigned long ehht_swiss_portable_match_free(const unsigned char *ctrl)
+{
+	unsigned long bits;
+	size_t i;
+
+	bits = 0;
+	for (i = 0; i < 16; ++i) {
+		if (ctrl[i] & 0x80) {
+			bits |= (1UL << i);
+		}
+	}
+	return bits;
+}
+
+static const struct ehht_swiss_kernel_s ehht_swiss_portable = {
+	16,
+	ehht_swiss_portable_match,
+	ehht_swiss_portable_match_empty,
+	ehht_swiss_portable_match_free
+};
+#else /* EHHT_SWISS_SIMD */
+static unsigned long ehht_swiss_sse2_match(const unsigned char *ctrl,
+					   unsigned char tag)
+{
+	__m128i window;
+
+	window = _mm_loadu_si128((const __m128i *)ctrl);
+	return (unsigned long)(unsigned)
+	    _mm_movemask_epi8(_mm_cmpeq_epi8(window, _mm_set1_epi8((char)tag)));
+}
+
+static unsigned long ehht_swiss_sse2_match_empty(const unsigned char *ctrl)
+{
+	return ehht_swiss_sse2_match(ctrl, EHHT_SWISS_EMPTY);
+}
+
+static unsigned long ehht_swiss_sse2_match_free(const unsigned char *ctrl)
+{
+	__m128i window;
+
+	window = _mm_loadu_si128((const __m128i *)ctrl);
+	return (unsigned long)(unsigned)_mm_movemask_epi8(window);
+}
+
+static const struct ehht_swiss_kernel_s ehht_swiss_sse2 = {
+	16,
+	ehht_swiss_sse2_match,
+	ehht_swiss_sse2_match_empty,
+	ehht_swiss_sse2_match_free
+};
+
+__attribute__((target("avx2")))
+static unsigned long ehht_swiss_avx2_match(const unsigned char *ctrl,
+					   unsigned char tag)
+{
+	__m256i window;
+
+	window = _mm256_loadu_si256((const __m256i *)ctrl);
+	return (unsigned long)(unsigned)
+	    _mm256_movemask_epi8(_mm256_cmpeq_epi8
+				 (window, _mm256_set1_epi8((char)tag)));
+}
+
+__attribute__((target("avx2")))
+static unsigned long ehht_swiss_avx2_match_empty(const unsigned char *ctrl)
+{
+	return ehht_swiss_avx2_match(ctrl, EHHT_SWISS_EMPTY);
+}
+
+__attribute__((target("avx2")))
+static unsigned long ehht_swiss_avx2_match_free(const unsigned char *ctrl)
+{
+	__m256i window;
+
+	window = _mm256_loadu_si256((const __m256i *)ctrl);
+	return (unsigned long)(unsigned)_mm256_movemask_epi8(window);
+}
+
+static const struct ehht_swiss_kernel_s ehht_swiss_avx2 = {
+	32,
+	ehht_swiss_avx2_match,
+	ehht_swiss_avx2_match_empty,
+	ehht_swiss_avx2_match_free
+};
+#endif /* EHHT_SWISS_SIMD */
+
+static const struct ehht_swiss_kernel_s *ehht_swiss_pick_kernel(void)
+{
+#if EHHT_SWISS_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return &ehht_swiss_avx2;
+	}
+	return &ehht_swiss_sse2;
+#else
+	return &ehht_swiss_portable;
+#endif
+}
+
+static size_t ehht_swiss_lowest_bit(unsigned long bits)
+{
+#ifdef __GNUC__
+	return (size_t)__builtin_ctzl(bits);
+#else
+	size_t i;
+
+	for (i = 0; !(bits & 1UL); ++i) {
+		bits >>= 1;
+	}
+	return i;
+#endif
+}
+
+static struct ehht_swiss_s *ehht_swiss_get_table(struct ehht_s *this)
+{
+	return (struct ehht_swiss_s *)this->data;
+}
+
+/* the low seven bits of the scrambled hash are the tag, the rest home */
+static uint64_t ehht_swiss_mix(uint64_t hashcode)
+{
+	hashcode ^= hashcode >> 30;
+	hashcode *= Ehht_u64(0xbf58476dUL, 0x1ce4e5b9UL);
+	hashcode ^= hashcode >> 27;
+	hashcode *= Ehht_u64(0x94d049bbUL, 0x133111ebUL);
+	hashcode ^= hashcode >> 31;
+	return hashcode;
+}
+
+static unsigned char ehht_swiss_tag(uint64_t mixed)
+{
+	return (unsigned char)(mixed & 0x7F);
+}
+
+static size_t ehht_swiss_home(uint64_t mixed, size_t mask)
+{
+	return ((size_t)(mixed >> 7)) & mask;
+}
+
+static void ehht_swiss_set_ctrl(struct ehht_swiss_s *sw, size_t i,
+				unsigned char c)
+{
+	sw->ctrl[i] = c;
+	/* the first window's worth of bytes are cloned after the end,
+	 * thus a window may always be loaded from any slot */
+	if (i < EHHT_SWISS_WINDOW_MAX) {
+		sw->ctrl[sw->num_slots + i] = c;
+	}
+}
+
+/* returns 0 if the power of two would not fit in a size_t */
+static size_t ehht_swiss_round_up(size_t num_slots)
+{
+	size_t n;
+
+	n = EHHT_SWISS_WINDOW_MAX;
+	while (n < num_slots) {
+		if (n > (SIZE_MAX / 2)) {
+			return 0;
+		}
+		n *= 2;
+	}
+	return n;
+}
+
+static int ehht_swiss_alloc_slots(struct ehht_swiss_s *sw, size_t num_slots,
+				  struct ehht_swiss_slot_s **slots,
+				  unsigned char **ctrl)
+{
+	size_t i, size, per_slot;
+
+	per_slot = sizeof(struct ehht_swiss_slot_s) + 1;
+	if (num_slots > ((SIZE_MAX - EHHT_SWISS_WINDOW_MAX) / per_slot)) {
+		Ehht_failed_malloc(SIZE_MAX, "slots");
+		return 1;
+	}
+	size = (per_slot * num_slots) + EHHT_SWISS_WINDOW_MAX;
+	*slots = sw->engine.alloc(size, sw->engine.mem_context);
+	if (*slots == NULL) {
+		Ehht_failed_malloc(size, "slots");
+		return 1;
+	}
+	*ctrl = (unsigned char *)((*slots) + num_slots);
+	for (i = 0; i < num_slots + EHHT_SWISS_WINDOW_MAX; ++i) {
+		(*ctrl)[i] = EHHT_SWISS_EMPTY;
+	}
+	return 0;
+}
+
+/* returns the slot index, or num_slots if the key is not present */
+static size_t ehht_swiss_find(struct ehht_swiss_s *sw, const char *key,
+			      size_t key_len, uint64_t hashcode)
+{
+	const struct ehht_swiss_kernel_s *kernel;
+	struct ehht_swiss_slot_s *slot;
+	unsigned long bits;
+	uint64_t mixed;
+	unsigned char tag;
+	size_t pos, i, scanned;
+
+	kernel = sw->kernel;
+	mixed = ehht_swiss_mix(hashcode);
+	tag = ehht_swiss_tag(mixed);
+	pos = ehht_swiss_home(mixed, sw->mask);
+	for (scanned = 0; scanned < sw->num_slots; scanned += kernel->width) {
+		bits = kernel->match(sw->ctrl + pos, tag);
+		while (bits) {
+			i = (pos + ehht_swiss_lowest_bit(bits)) & sw->mask;
+			slot = sw->slots + i;
+			if (slot->key.hashcode == hashcode
+			    && slot->key.len == key_len
+			    && memcmp(key, slot->key.str, key_len) == 0) {
+				return i;
+			}
+			bits &= (bits - 1);
+		}
+		if (kernel->match_empty(sw->ctrl + pos)) {
+			return sw->num_slots;
+		}
+		pos = (pos + kernel->width) & sw->mask;
+	}
+	return sw->num_slots;
+}
+
+/* there must be at least one free slot */
+static size_t ehht_swiss_find_free(struct ehht_swiss_s *sw, uint64_t mixed)
+{
+	unsigned long bits;
+	size_t pos;
+
+	pos = ehht_swiss_home(mixed, sw->mask);
+	for (;;) {
+		bits = sw->kernel->match_free(sw->ctrl + pos);
+		if (bits) {
+			return (pos + ehht_swiss_lowest_bit(bits)) & sw->mask;
+		}
+		pos = (pos + sw->kernel->width) & sw->mask;
+	}
+}
+
+static size_t ehht_swiss_buckets_resize(struct ehht_s *this, size_t num_slots)
+{
+	struct ehht_swiss_s *sw;
+	struct ehht_swiss_slot_s *old_slots;
+	unsigned char *old_ctrl;
+	size_t i, j, old_num_slots;
+	uint64_t mixed;
+
+	sw = ehht_swiss_get_table(this);
+
+	if (num_slots == 0) {
+		num_slots = sw->num_slots * 2;
+	}
+	num_slots = ehht_swiss_round_up(num_slots);
+	if (num_slots == 0 || num_slots <= sw->size) {
+		return sw->num_slots;
+	}
+
+	old_slots = sw->slots;
+	old_ctrl = sw->ctrl;
+	old_num_slots = sw->num_slots;
+	if (ehht_swiss_alloc_slots(sw, num_slots, &sw->slots, &sw->ctrl)) {
+		sw->slots = old_slots;
+		sw->ctrl = old_ctrl;
+		return sw->num_slots;
+	}
+	sw->num_slots = num_slots;
+	sw->mask = num_slots - 1;
+	sw->deleted = 0;
+
+	for (i = 0; i < old_num_slots; ++i) {
+		if (!(old_ctrl[i] & 0x80)) {
+			mixed = ehht_swiss_mix(old_slots[i].key.hashcode);
+			j = ehht_swiss_find_free(sw, mixed);
+			ehht_swiss_set_ctrl(sw, j, ehht_swiss_tag(mixed));
+			sw->slots[j] = old_slots[i];
+		}
+	}
+
+	sw->engine.free(old_slots, sw->engine.mem_context);
+
+	return num_slots;
+}
+
+/* once the load falls below the low-water mark, shrinks toward num_slots,
+ * but not below the number asked for at construction */
+static void ehht_swiss_auto_shrink(struct ehht_s *this, size_t num_slots)
+{
+	struct ehht_swiss_s *sw;
+
+	sw = ehht_swiss_get_table(this);
+
+	if (!ehht_engine_should_shrink(&sw->engine, sw->size, sw->num_slots,
+				       sw->max_load_factor)) {
+		return;
+	}
+	if (num_slots < sw->engine.min_buckets) {
+		num_slots = sw->engine.min_buckets;
+	}
+	num_slots = ehht_swiss_round_up(num_slots);
+	if (num_slots && num_slots < sw->num_slots) {
+		ehht_swiss_buckets_resize(this, num_slots);
+	}
+}
+
+static void *ehht_swiss_get_hashed(struct ehht_s *this, const char *key,
+				   size_t key_len, uint64_t hashcode)
+{
+	struct ehht_swiss_s *sw;
+	size_t i;
+
+	sw = ehht_swiss_get_table(this);
+
+	i = ehht_swiss_find(sw, key, key_len, hashcode);
+
+	return (i == sw->num_slots) ? NULL : sw->slots[i].val;
+}
+
+static void *ehht_swiss_get(struct ehht_s *this, const char *key,
+			    size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_swiss_get_hashed(this, key, key_len, hashcode);
+}
+
+/* hash the group and prefetch each home window and slot, then probe */
+static void ehht_swiss_get_many(struct ehht_s *this, const char **keys,
+				const size_t *key_lens, void **vals, size_t n)
+{
+	struct ehht_swiss_s *sw;
+	uint64_t hashcodes[EHHT_GET_MANY_GROUP];
+	size_t i, j, group;
+
+	sw = ehht_swiss_get_table(this);
+
+	for (; n; n -= group, keys += group, key_lens += group, vals += group) {
+		group = (n < EHHT_GET_MANY_GROUP) ? n : EHHT_GET_MANY_GROUP;
+		ehht_engine_hash_many(&sw->engine, keys, key_lens,
+				      hashcodes, group);
+		for (i = 0; i < group; ++i) {
+			j = ehht_swiss_home(ehht_swiss_mix(hashcodes[i]),
+					    sw->mask);
+			Ehht_prefetch(sw->ctrl + j);
+			Ehht_prefetch(sw->slots + j);
+		}
+		for (i = 0; i < group; ++i) {
+			j = ehht_swiss_find(sw, keys[i], key_lens[i],
+					    hashcodes[i]);
+			vals[i] = (j == sw->num_slots) ? NULL
+			    : sw->slots[j].val;
+		}
+	}
+}
+
+static int ehht_swiss_has_key_hashed(struct ehht_s *this, const char *key,
+				     size_t key_len, uint64_t hashcode)
+{
+	struct ehht_swiss_s *sw;
+
+	sw = ehht_swiss_get_table(this);
+
+	return (ehht_swiss_find(sw, key, key_len, hashcode) == sw->num_slots)
+	    ? 0 : 1;
+}
+
+static int ehht_swiss_has_key(struct ehht_s *this, const char *key,
+			      size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_swiss_has_key_hashed(this, key, key_len, hashcode);
+}
+
+/* the key must not already be present
+ * returns the index of the new entry, or num_slots on failure */
+static size_t ehht_swiss_insert(struct ehht_s *this, const char *key,
+				size_t key_len, uint64_t hashcode,
+				void *val)
+{
+	struct ehht_swiss_s *sw;
+	uint64_t mixed;
+	char *key_copy;
+	size_t i, size, used;
+
+	sw = ehht_swiss_get_table(this);
+
+	/* tombstones count against the load, as they lengthen probes */
+	used = sw->size + sw->deleted + 1;
+	if (used > (sw->num_slots * sw->max_load_factor)
+	    || used >= sw->num_slots) {
+		if ((sw->size + 1) >
+		    (sw->num_slots * sw->max_load_factor / 2)) {
+			ehht_swiss_buckets_resize(this, 0);
+		} else {
+			/* mostly tombstones: rehash at the same size */
+			ehht_swiss_buckets_resize(this, sw->num_slots);
+		}
+	}
+	if ((sw->size + sw->deleted + 1) >= sw->num_slots) {
+		fprintf(stderr, "%s:%d: ehht_put failed\n", __FILE__, __LINE__);
+		return sw->num_slots;
+	}
+
+	size = key_len + 1;
+	key_copy = ehht_engine_entry_alloc(&sw->engine, size);
+	if (!key_copy) {
+		Ehht_failed_malloc(size, "key copy");
+		fprintf(stderr, "%s:%d: ehht_put failed\n", __FILE__, __LINE__);
+		return sw->num_slots;
+	}
+	memcpy(key_copy, key, key_len);
+	key_copy[key_len] = '\0';
+
+	mixed = ehht_swiss_mix(hashcode);
+	i = ehht_swiss_find_free(sw, mixed);
+	if (sw->ctrl[i] == EHHT_SWISS_DELETED) {
+		--(sw->deleted);
+	}
+	ehht_swiss_set_ctrl(sw, i, ehht_swiss_tag(mixed));
+	sw->slots[i].key.str = key_copy;
+	sw->slots[i].key.len = key_len;
+	sw->slots[i].key.hashcode = hashcode;
+	sw->slots[i].val = val;
+	++(sw->size);
+
+	return i;
+}
+
+static void *ehht_swiss_put_hashed(struct ehht_s *this, const char *key,
+				   size_t key_len, uint64_t hashcode,
+				   void *val)
+{
+	struct ehht_swiss_s *sw;
+	void *old_val;
+	size_t i;
+
+	sw = ehht_swiss_get_table(this);
+
+	i = ehht_swiss_find(sw, key, key_len, hashcode);
+	if (i != sw->num_slots) {
+		old_val = sw->slots[i].val;
+		sw->slots[i].val = val;
+		return old_val;
+	}
+
+	ehht_swiss_insert(this, key, key_len, hashcode, val);
+	return NULL;
+}
+
+static void **ehht_swiss_entry_hashed(struct ehht_s *this, const char *key,
+				      size_t key_len, uint64_t hashcode,
+				      int *created)
+{
+	struct ehht_swiss_s *sw;
+	size_t i;
+	int inserted;
+
+	sw = ehht_swiss_get_table(this);
+
+	inserted = 0;
+	i = ehht_swiss_find(sw, key, key_len, hashcode);
+	if (i == sw->num_slots) {
+		i = ehht_swiss_insert(this, key, key_len, hashcode, NULL);
+		if (i == sw->num_slots) {
+			return NULL;
+		}
+		inserted = 1;
+	}
+	if (created) {
+		*created = inserted;
+	}
+	return &(sw->slots[i].val);
+}
+
+static void *ehht_swiss_put(struct ehht_s *this, const char *key,
+			    size_t key_len, void *val)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_swiss_put_hashed(this, key, key_len, hashcode, val);
+}
+
+static void *ehht_swiss_remove_hashed(struct ehht_s *this, const char *key,
+				      size_t key_len, uint64_t hashcode)
+{
+	struct ehht_swiss_s *sw;
+	void *old_val;
+	size_t i;
+
+	sw = ehht_swiss_get_table(this);
+
+	i = ehht_swiss_find(sw, key, key_len, hashcode);
+	if (i == sw->num_slots) {
+		return NULL;
+	}
+
+	old_val = sw->slots[i].val;
+	ehht_engine_entry_free(&sw->engine, (char *)sw->slots[i].key.str);
+	sw->slots[i].key.str = NULL;
+	sw->slots[i].val = NULL;
+
+	/* if the next slot has never been used, then no probe sequence
+	 * has passed through this slot and it may simply be empty */
+	if (sw->ctrl[(i + 1) & sw->mask] == EHHT_SWISS_EMPTY) {
+		ehht_swiss_set_ctrl(sw, i, EHHT_SWISS_EMPTY);
+	} else {
+		ehht_swiss_set_ctrl(sw, i, EHHT_SWISS_DELETED);
+		++(sw->deleted);
+	}
+	--(sw->size);
+
+	ehht_swiss_auto_shrink(this, sw->num_slots / 2);
+
+	return old_val;
+}
+
+static void *ehht_swiss_remove(struct ehht_s *this, const char *key,
+			       size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_swiss_remove_hashed(this, key, key_len, hashcode);
+}
+
+static size_t ehht_swiss_size(struct ehht_s *this)
+{
+	return ehht_swiss_get_table(this)->size;
+}
+
+static void ehht_swiss_clear_slots(struct ehht_swiss_s *sw)
+{
+	size_t i;
+
+	for (i = 0; i < sw->num_slots; ++i) {
+		if (!(sw->ctrl[i] & 0x80)) {
+			ehht_engine_entry_free(&sw->engine,
+					       (char *)sw->slots[i].key.str);
+			sw->slots[i].key.str = NULL;
+			sw->slots[i].val = NULL;
+		}
+	}
+	for (i = 0; i < sw->num_slots + EHHT_SWISS_WINDOW_MAX; ++i) {
+		sw->ctrl[i] = EHHT_SWISS_EMPTY;
+	}
+	sw->size = 0;
+	sw->deleted = 0;
+}
+
+static void ehht_swiss_clear(struct ehht_s *this)
+{
+	ehht_swiss_clear_slots(ehht_swiss_get_table(this));
+	ehht_swiss_auto_shrink(this, 0);
+}
+
+static int ehht_swiss_for_each(struct ehht_s *this, ehht_iterator_func func,
+			       void *context)
+{
+	struct ehht_swiss_s *sw;
+	size_t i;
+	int end;
+
+	sw = ehht_swiss_get_table(this);
+
+	end = 0;
+	for (i = 0; i < sw->num_slots && !end; ++i) {
+		if (!(sw->ctrl[i] & 0x80)) {
+			end = (*func) (sw->slots[i].key, sw->slots[i].val,
+				       context);
+		}
+	}
+	return end;
+}
+
+static size_t ehht_swiss_buckets_size(struct ehht_s *this)
+{
+	return ehht_swiss_get_table(this)->num_slots;
+}
+
+/* the table is always grown once full, even if factor is 0.0 */
+static void ehht_swiss_buckets_auto_resize_load_factor(struct ehht_s *this,
+						       double factor)
+{
+	struct ehht_swiss_s *sw;
+
+	sw = ehht_swiss_get_table(this);
+	sw->max_load_factor = (factor <= 0.0 || factor > 1.0) ? 1.0 : factor;
+}
+
+static size_t ehht_swiss_reserve(struct ehht_s *this, size_t n_elements)
+{
+	struct ehht_swiss_s *sw;
+	size_t num_slots;
+
+	sw = ehht_swiss_get_table(this);
+	num_slots = ehht_buckets_for_elements(n_elements, sw->max_load_factor);
+	if (num_slots > sw->num_slots) {
+		return ehht_swiss_buckets_resize(this, num_slots);
+	}
+	return sw->num_slots;
+}
+
+static size_t ehht_swiss_shrink_to_fit(struct ehht_s *this)
+{
+	struct ehht_swiss_s *sw;
+	size_t num_slots;
+
+	sw = ehht_swiss_get_table(this);
+	num_slots = ehht_buckets_for_elements(sw->size, sw->max_load_factor);
+	num_slots = ehht_swiss_round_up(num_slots);
+	if (num_slots && num_slots < sw->num_slots) {
+		return ehht_swiss_buckets_resize(this, num_slots);
+	}
+	return sw->num_slots;
+}
+
+static size_t ehht_swiss_bucket_for_key(struct ehht_s *this, const char *key,
+					size_t key_len)
+{
+	struct ehht_swiss_s *sw;
+	uint64_t mixed;
+
+	sw = ehht_swiss_get_table(this);
+	mixed = ehht_swiss_mix(Ehht_hash(&sw->engine, key, key_len));
+	return ehht_swiss_home(mixed, sw->mask);
+}
+
+static void ehht_swiss_free(struct ehht_s *this)
+{
+	struct ehht_swiss_s *sw;
+	ehht_free_func free_func;
+	void *mem_context;
+
+	sw = ehht_swiss_get_table(this);
+
+	ehht_swiss_clear_slots(sw);
+
+	free_func = sw->engine.free;
+	mem_context = sw->engine.mem_context;
+
+	ehht_engine_release(&sw->engine);
+	free_func(sw->slots, mem_context);
+	free_func(sw, mem_context);
+	free_func(this, mem_context);
+}
+
+static const struct ehht_engine_ops_s ehht_swiss_ops = {
+	ehht_swiss_buckets_size,
+	ehht_swiss_buckets_resize,
+	ehht_swiss_buckets_auto_resize_load_factor,
+	ehht_swiss_bucket_for_key,
+	ehht_swiss_free,
+	ehht_swiss_get_hashed,
+	ehht_swiss_put_hashed,
+	ehht_swiss_remove_hashed,
+	ehht_swiss_has_key_hashed,
+	ehht_swiss_entry_hashed,
+	ehht_swiss_get_many,
+	NULL,
+	NULL,
+	ehht_swiss_reserve,
+	ehht_swiss_shrink_to_fit,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+struct ehht_s *ehht_swiss_new(const struct ehht_options_s *options)
+{
+	struct ehht_s *this;
+	struct ehht_swiss_s *sw;
+	ehht_malloc_func mem_alloc;
+	ehht_free_func mem_free;
+	void *mem_context;
+	size_t size, num_slots;
+
+	mem_alloc = options->alloc_func;
+	mem_free = options->free_func;
+	mem_context = options->mem_context;
+
+	size = sizeof(struct ehht_s);
+	this = mem_alloc(size, mem_context);
+	if (this == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_s");
+		return NULL;
+	}
+	this->get = ehht_swiss_get;
+	this->put = ehht_swiss_put;
+	this->remove = ehht_swiss_remove;
+	this->size = ehht_swiss_size;
+	this->clear = ehht_swiss_clear;
+	this->for_each = ehht_swiss_for_each;
+	this->has_key = ehht_swiss_has_key;
+	this->keys = ehht_engine_keys;
+	this->free_keys = ehht_engine_free_keys;
+	this->to_string = ehht_engine_to_string;
+
+	size = sizeof(struct ehht_swiss_s);
+	sw = mem_alloc(size, mem_context);
+	if (sw == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_swiss_s");
+		mem_free(this, mem_context);
+		return NULL;
+	}
+	this->data = (void *)sw;
+
+	if (ehht_engine_init(&sw->engine, &ehht_swiss_ops, options)) {
+		mem_free(sw, mem_context);
+		mem_free(this, mem_context);
+		return NULL;
+	}
+
+	sw->kernel = ehht_swiss_pick_kernel();
+	sw->size = 0;
+	sw->deleted = 0;
+	sw->max_load_factor = EHHT_SWISS_LOADFACTOR;
+	if (options->load_factor > 0.0) {
+		ehht_swiss_buckets_auto_resize_load_factor(this, options->
+							   load_factor);
+	}
+
+	num_slots = options->num_buckets;
+	if (options->expected_elements) {
+		size = ehht_buckets_for_elements(options->expected_elements,
+						 sw->max_load_factor);
+		if (size > num_slots) {
+			num_slots = size;
+		}
+	}
+	num_slots = ehht_swiss_round_up(num_slots);
+	if (num_slots == 0
+	    || ehht_swiss_alloc_slots(sw, num_slots, &sw->slots, &sw->ctrl)) {
+		ehht_engine_release(&sw->engine);
+		mem_free(sw, mem_context);
+		mem_free(this, mem_context);
+		return NULL;
+	}
+	sw->num_slots = num_slots;
+	sw->mask = num_slots - 1;
+
+	return this;
+}
@@ -0,0 +1,256 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* ehht-thread.c: threads and locks for a simple OO hashtable */
+/* Copyright (C) 2016, 2017, 2018, 2019, 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+/*
+  A minimal fork-join runner: each call starts the workers, and returns
+  once they have all finished, thus the phases of a parallel operation
+  are separated by the joins, with no other synchronization. The calling
+  thread runs the first share of the work itself. Where POSIX threads are
+  not available, or a thread cannot be started, the share is run by the
+  calling thread instead, so the results are the same, only slower.
+
+  The locks are plain mutexes; without threads they do nothing.
+
+  The epochs let readers go without locks: a thread announces the epoch
+  it entered in one of EHHT_EPOCH_SLOTS slots, chosen by the address of
+  its stack, so that threads tend to keep to their own cache line. The
+  slots are read by read-modify-writes, thus a thread either is seen in
+  its slot, or sees everything done before its slot was read.
+*/
+
+#include "ehht.h"
+#include "ehht-private.h"
+#include <assert.h>
+
+#ifndef EHHT_THREADS
+#if defined(__unix__) || defined(__APPLE__)
+#define EHHT_THREADS 1
+#else
+#define EHHT_THREADS 0
+#endif
+#endif
+
+#if EHHT_THREADS
+#include <pthread.h>
+#include <unistd.h>		/* sysconf */
+#endif
+
+size_t ehht_threads_online(void)
+{
+#if EHHT_THREADS && defined(_SC_NPROCESSORS_ONLN)
+	long cpus;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus > 1) {
+		return (cpus > EHHT_MAX_THREADS) ? EHHT_MAX_THREADS
+		    : (size_t)cpus;
+	}
+#endif
+	return 1;
+}
+
+#if EHHT_THREADS
+struct ehht_lock_s {
+	pthread_mutex_t mutex;
+};
+
+struct ehht_lock_s *ehht_lock_new(ehht_malloc_func alloc, ehht_free_func free,
+				  void *mem_context)
+{
+	struct ehht_lock_s *lock;
+
+	lock = alloc(sizeof(struct ehht_lock_s), mem_context);
+	if (lock == NULL) {
+		Ehht_failed_malloc(sizeof(struct ehht_lock_s), "lock");
+		return NULL;
+	}
+	if (pthread_mutex_init(&lock->mutex, NULL) != 0) {
+		if (EHHT_DEBUG) {
+			fprintf(stderr, "%s:%d: pthread_mutex_init failed\n",
+				__FILE__, __LINE__);
+		}
+		free(lock, mem_context);
+		return NULL;
+	}
+	return lock;
+}
+
+void ehht_lock_destroy(struct ehht_lock_s *lock, ehht_free_func free,
+		       void *mem_context)
+{
+	if (lock == NULL) {
+		return;
+	}
+	pthread_mutex_destroy(&lock->mutex);
+	free(lock, mem_context);
+}
+
+void ehht_lock(struct ehht_lock_s *lock)
+{
+	pthread_mutex_lock(&lock->mutex);
+}
+
+void ehht_unlock(struct ehht_lock_s *lock)
+{
+	pthread_mutex_unlock(&lock->mutex);
+}
+
+struct ehht_thread_s {
+	ehht_thread_func func;
+	void *context;
+	size_t thread_num;
+};
+
+static void *ehht_thread_start(void *arg)
+{
+	struct ehht_thread_s *thread;
+
+	thread = (struct ehht_thread_s *)arg;
+	thread->func(thread->context, thread->thread_num);
+	return NULL;
+}
+
+void ehht_threads_run(size_t num_threads, ehht_thread_func func,
+		      void *context)
+{
+	struct ehht_thread_s threads[EHHT_MAX_THREADS];
+	pthread_t ids[EHHT_MAX_THREADS];
+	int started[EHHT_MAX_THREADS];
+	size_t i;
+
+	assert(num_threads <= EHHT_MAX_THREADS);
+	for (i = 1; i < num_threads; ++i) {
+		threads[i].func = func;
+		threads[i].context = context;
+		threads[i].thread_num = i;
+		started[i] = (pthread_create(ids + i, NULL, ehht_thread_start,
+					     threads + i) == 0);
+		if (!started[i]) {
+			func(context, i);
+		}
+	}
+	if (num_threads) {
+		func(context, 0);
+	}
+	for (i = 1; i < num_threads; ++i) {
+		if (started[i]) {
+			pthread_join(ids[i], NULL);
+		}
+	}
+}
+#else
+struct ehht_lock_s {
+	int unused;
+};
+
+struct ehht_lock_s *ehht_lock_new(ehht_malloc_func alloc, ehht_free_func free,
+				  void *mem_context)
+{
+	struct ehht_lock_s *lock;
+
+	lock = alloc(sizeof(struct ehht_lock_s), mem_context);
+	if (lock == NULL) {
+		Ehht_failed_malloc(sizeof(struct ehht_lock_s), "lock");
+	}
+	(void)free;
+	return lock;
+}
+
+void ehht_lock_destroy(struct ehht_lock_s *lock, ehht_free_func free,
+		       void *mem_context)
+{
+	if (lock != NULL) {
+		free(lock, mem_context);
+	}
+}
+
+void ehht_lock(struct ehht_lock_s *lock)
+{
+	(void)lock;
+}
+
+void ehht_unlock(struct ehht_lock_s *lock)
+{
+	(void)lock;
+}
+
+void ehht_threads_run(size_t num_threads, ehht_thread_func func,
+		      void *context)
+{
+	size_t i;
+
+	for (i = 0; i < num_threads; ++i) {
+		func(context, i);
+	}
+}
+#endif /* EHHT_THREADS */
+
+void ehht_epochs_init(struct ehht_epochs_s *epochs)
+{
+	size_t i;
+
+	for (i = 0; i < EHHT_EPOCH_SLOTS; ++i) {
+		epochs->slots[i].epoch = 0;
+	}
+	epochs->epoch = 1;
+}
+
+#if EHHT_ATOMICS
+/* a different starting slot for each thread's stack */
+static size_t ehht_epoch_slot_hint(void)
+{
+	char here;
+	uint64_t mixed;
+
+	mixed = ((uint64_t)(size_t)&here) * Ehht_u64(0x9e3779b9UL,
+						     0x7f4a7c15UL);
+	return (size_t)(mixed >> 40);
+}
+#endif
+
+struct ehht_epoch_slot_s *ehht_epoch_enter(struct ehht_epochs_s *epochs)
+{
+#if EHHT_ATOMICS
+	struct ehht_epoch_slot_s *slot;
+	unsigned long epoch, expected;
+	size_t i, hint;
+
+	hint = ehht_epoch_slot_hint();
+	epoch = Ehht_load_acquire(&epochs->epoch);
+	for (i = 0; i < EHHT_EPOCH_SLOTS; ++i) {
+		slot = epochs->slots + ((hint + i) & (EHHT_EPOCH_SLOTS - 1));
+		expected = 0;
+		if (Ehht_load_relaxed(&slot->epoch) == 0
+		    && Ehht_cas(&slot->epoch, &expected, epoch)) {
+			return slot;
+		}
+	}
+#else
+	(void)epochs;
+#endif
+	return NULL;
+}
+
+void ehht_epoch_exit(struct ehht_epoch_slot_s *slot)
+{
+	Ehht_store_release(&slot->epoch, 0UL);
+}
+
+unsigned long ehht_epoch_advance(struct ehht_epochs_s *epochs,
+				 unsigned long *oldest)
+{
+	unsigned long before, epoch;
+	size_t i;
+
+	before = Ehht_fetch_add(&epochs->epoch, 1UL);
+	*oldest = before + 1;
+	for (i = 0; i < EHHT_EPOCH_SLOTS; ++i) {
+		epoch = Ehht_fetch_add(&epochs->slots[i].epoch, 0UL);
+		if (epoch && epoch < *oldest) {
+			*oldest = epoch;
+		}
+	}
+	return before;
+}
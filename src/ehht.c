@@ -4,44 +4,15 @@
 /* https://github.com/ericherman/libehht */
 
 #include "ehht.h"
-#include <stdlib.h>		/* malloc calloc */
+#include "ehht-private.h"
+#include <stdlib.h>		/* malloc calloc qsort */
+#include <stdint.h>		/* SIZE_MAX */
 #include <string.h>		/* memcpy memcmp */
 #include <stdio.h>		/* fprintf */
 #include <assert.h>
 
-#ifndef EHHT_DEFAULT_BUCKETS
-#define EHHT_DEFAULT_BUCKETS 64
-#endif
-
-#ifndef EHHT_DEFAULT_RESIZE_LOADFACTOR
-/* we split when we collide and we have a load factor over 0.667 */
-/* https://github.com/Perl/perl5/blob/blead/hv.c#L37 */
-#define EHHT_DEFAULT_RESIZE_LOADFACTOR (2.0/3.0)
-#endif
-
-#ifndef EHHT_DEBUG
-#ifdef NDEBUG
-#define EHHT_DEBUG 0
-#else
-#define EHHT_DEBUG 1
-#endif
-#endif
-
-#define Ehht_failed_malloc(bytes, thing) do { \
-	if (EHHT_DEBUG) { \
-		fprintf(stderr, \
-			"%s:%d: could not allocate %lu bytes for %s\n", \
-			__FILE__, __LINE__, (unsigned long)(bytes), thing); \
-	} } while (0)
-
-/*
-  LCOV_EXCL_LINE - Lines containing this marker will be excluded.
-  LCOV_EXCL_START - Marks the beginning of an excluded section.
-		    The current line is part of this section.
-  LCOV_EXCL_STOP - Marks the end of an excluded section.
-		   The current line not part of this section.
-*/
-
+/* the key bytes are stored directly after the element, in the same
+ * allocation: key.str points just past the end of the struct */
 struct ehht_element_s {
 	struct ehht_key_s key;
 	void *val;
@@ -49,16 +20,60 @@ struct ehht_element_s {
 };
 
 struct ehht_table_s {
+	struct ehht_engine_s engine;
 	size_t num_buckets;
 	struct ehht_element_s **buckets;
 	size_t size;
-	ehht_hash_func hash_func;
-	ehht_malloc_func alloc;
-	ehht_free_func free;
-	void *mem_context;
 	double collision_load_factor;
+	/* while growing incrementally, the buckets not yet moved */
+	struct ehht_element_s **old_buckets;
+	size_t old_num_buckets;
+	size_t migrate_pos;
+	enum ehht_bucket_index bucket_index;
+	/* for EHHT_BUCKET_INDEX_PRIME, the reciprocals of the bucket counts */
+	uint64_t index_magic;
+	uint64_t old_index_magic;
+	size_t rehash_buckets_per_op;
+	/* with a seeded hash, a longer chain causes a reseed and rehash */
+	size_t max_chain_len;
+	/* the size at the last reseed: at most one reseed per doubling */
+	size_t reseed_size;
+	/* NULL, or per bucket, NULL or the index of a long chain */
+	struct ehht_tree_s **trees;
+	enum ehht_chain_order chain_order;
+	/* non-zero during for_each, when chains must not be reordered */
+	int iterating;
+	/* NULL, or per bucket, the OR of ehht_fingerprint of each hashcode
+	 * in the chain; old_fingerprints pairs with old_buckets */
+	uint16_t *fingerprints;
+	uint16_t *old_fingerprints;
+	/* only the counters are kept up to date */
+	struct ehht_stats_s stats;
+	/* when and by how much to grow, with the defaults applied */
+	struct ehht_resize_policy_s resize_policy;
+	/* the probe count which causes growth, which auto-tuning moves */
+	double probe_threshold;
+	/* EHHT_RESIZE_AUTO_TUNE: the mean probe count which caused the last
+	 * growth, or zero once the growth has been judged */
+	double probes_before_growth;
+	/* the stats counters at the start of the current window */
+	unsigned long window_lookups;
+	unsigned long window_visited;
 };
 
+static size_t ehht_chained_buckets_resize(struct ehht_s *this,
+					  size_t num_buckets);
+static void ehht_rehash_start(struct ehht_table_s *table,
+			      size_t num_buckets);
+static void ehht_trees_drop(struct ehht_table_s *table);
+static struct ehht_element_s *ehht_chained_insert(struct ehht_s *this,
+						  const char *key,
+						  size_t key_len,
+						  uint64_t hashcode,
+						  void *val);
+static void ehht_chained_auto_shrink(struct ehht_table_s *table,
+				     size_t num_buckets);
+
 static void ehht_set_table(struct ehht_s *this, struct ehht_table_s *table)
 {
 	this->data = (void *)table;
@@ -72,20 +87,14 @@ static struct ehht_table_s *ehht_get_table(struct ehht_s *this)
 static void ehht_free_element(struct ehht_table_s *table,
 			      struct ehht_element_s *element)
 {
-	struct ehht_key_s key;
-
-	key = element->key;
-	table->free((char *)key.str, table->mem_context);
-	table->free(element, table->mem_context);
+	ehht_engine_entry_free(&table->engine, element);
 }
 
-static void ehht_clear(struct ehht_s *this)
+static void ehht_clear_elements(struct ehht_table_s *table)
 {
-	struct ehht_table_s *table;
 	size_t i;
 
-	table = ehht_get_table(this);
-
+	ehht_trees_drop(table);
 	for (i = 0; i < table->num_buckets; ++i) {
 		struct ehht_element_s *element;
 		while ((element = table->buckets[i]) != NULL) {
@@ -93,555 +102,2782 @@ static void ehht_clear(struct ehht_s *this)
 			ehht_free_element(table, element);
 		}
 	}
+	if (table->old_buckets) {
+		for (i = table->migrate_pos; i < table->old_num_buckets; ++i) {
+			struct ehht_element_s *element;
+			while ((element = table->old_buckets[i]) != NULL) {
+				table->old_buckets[i] = element->next;
+				ehht_free_element(table, element);
+			}
+		}
+		table->engine.free(table->old_buckets,
+				   table->engine.mem_context);
+		table->old_buckets = NULL;
+		table->old_num_buckets = 0;
+		table->migrate_pos = 0;
+		if (table->old_fingerprints) {
+			table->engine.free(table->old_fingerprints,
+					   table->engine.mem_context);
+			table->old_fingerprints = NULL;
+		}
+	}
+	if (table->fingerprints) {
+		for (i = 0; i < table->num_buckets; ++i) {
+			table->fingerprints[i] = 0;
+		}
+	}
 	table->size = 0;
 }
 
-static size_t ehht_bucket_for_hashcode(unsigned int hashcode,
-				       size_t num_buckets)
-{
-	return (size_t)(hashcode % num_buckets);
-}
-
-size_t ehht_bucket_for_key(struct ehht_s *this, const char *key, size_t key_len)
+static void ehht_clear(struct ehht_s *this)
 {
 	struct ehht_table_s *table;
-	unsigned int hashcode;
 
 	table = ehht_get_table(this);
-	hashcode = table->hash_func(key, key_len);
 
-	return ehht_bucket_for_hashcode(hashcode, table->num_buckets);
+	ehht_clear_elements(table);
+	ehht_chained_auto_shrink(table, 0);
 }
 
-static struct ehht_element_s *ehht_alloc_element(struct ehht_table_s *table,
-						 const char *key,
-						 size_t key_len,
-						 unsigned int hashcode,
-						 void *val)
+/* primes, each roughly double the one before, far from powers of two */
+static const unsigned long ehht_primes[] = {
+	5UL, 11UL, 23UL, 53UL, 97UL, 193UL, 389UL, 769UL, 1543UL, 3079UL,
+	6151UL, 12289UL, 24593UL, 49157UL, 98317UL, 196613UL, 393241UL,
+	786433UL, 1572869UL, 3145739UL, 6291469UL, 12582917UL, 25165843UL,
+	50331653UL, 100663319UL, 201326611UL, 402653189UL, 805306457UL,
+	1610612741UL, 3221225473UL
+};
+
+#define Ehht_u32_limit(n) ((n) <= (size_t)0xFFFFFFFFUL)
+
+/* rounds num_buckets up to a count which the bucket_index can use */
+static size_t ehht_index_num_buckets(enum ehht_bucket_index bucket_index,
+				     size_t num_buckets)
 {
-	char *key_copy;
-	struct ehht_element_s *element;
-	size_t size;
+	size_t i, rounded;
 
-	size = sizeof(struct ehht_element_s);
-	element = table->alloc(size, table->mem_context);
-	if (element == NULL) {
-		Ehht_failed_malloc(size, "struct ehht_element_s");
-		return NULL;
+	switch (bucket_index) {
+	case EHHT_BUCKET_INDEX_MASK:
+		for (rounded = 2; rounded && rounded < num_buckets;) {
+			rounded *= 2;
+		}
+		return rounded ? rounded : num_buckets;
+	case EHHT_BUCKET_INDEX_PRIME:
+		for (i = 0; i < (sizeof(ehht_primes) / sizeof(ehht_primes[0]));
+		     ++i) {
+			if (ehht_primes[i] >= num_buckets) {
+				return (size_t)ehht_primes[i];
+			}
+		}
+		break;
+	case EHHT_BUCKET_INDEX_MODULO:
+	case EHHT_BUCKET_INDEX_FASTRANGE:
+		break;
 	}
+	return num_buckets;
+}
 
-	size = key_len + 1;
-	assert(size > 0);
-	key_copy = table->alloc(size, table->mem_context);
-	if (!key_copy) {
-		Ehht_failed_malloc(size, "key copy");
-		ehht_free_element(table, element);
-		return NULL;
+/* Lemire's fastmod: for a divisor below 2^32, the remainder of any 32 bit
+ * value is found with multiplications by the reciprocal, M = 2^64/d + 1 */
+static uint64_t ehht_index_magic(enum ehht_bucket_index bucket_index,
+				 size_t num_buckets)
+{
+	if (bucket_index != EHHT_BUCKET_INDEX_PRIME
+	    || !Ehht_u32_limit(num_buckets)) {
+		return 0;
 	}
-	memcpy(key_copy, key, key_len);
-	key_copy[key_len] = '\0';
+	return (Ehht_u64(0xFFFFFFFFUL, 0xFFFFFFFFUL) / num_buckets) + 1;
+}
 
-	element->key.str = key_copy;
-	element->key.len = key_len;
-	element->key.hashcode = hashcode;
-	element->val = val;
-	element->next = NULL;
+/* the high 64 bits of a * b, for b below 2^32 */
+static uint64_t ehht_mulhi_u32(uint64_t a, uint64_t b)
+{
+	uint64_t hi, lo;
 
-	++(table->size);
+	hi = (a >> 32) * b;
+	lo = (a & 0xFFFFFFFFUL) * b;
+	return (hi + (lo >> 32)) >> 32;
+}
 
-	return element;
+static uint32_t ehht_fold32(uint64_t hashcode)
+{
+	return ((uint32_t)(hashcode >> 32)) ^ ((uint32_t)hashcode);
 }
 
-/* "This is not the best possible hash function,
-   but it is short and effective."
-   The C Programming Language, 2nd Edition */
-unsigned int ehht_kr2_hashcode(const char *data, size_t len)
+/* a power of two mask keeps only the low bits, so first mix the high
+ * bits down, for the sake of hash functions with weak low bits */
+static uint64_t ehht_index_mix(uint64_t hashcode)
 {
-	unsigned int hash;
-	size_t i;
+	hashcode ^= hashcode >> 32;
+	hashcode *= Ehht_u64(0x9e3779b9UL, 0x7f4a7c15UL);
+	return hashcode ^ (hashcode >> 32);
+}
 
-	hash = 0;
-	for (i = 0; i < len; ++i) {
-		hash *= 31;
-		hash += (unsigned int)data[i];
+static size_t ehht_bucket_for_hashcode(const struct ehht_table_s *table,
+				       uint64_t hashcode, size_t num_buckets,
+				       uint64_t magic)
+{
+	switch (table->bucket_index) {
+	case EHHT_BUCKET_INDEX_MASK:
+		return (size_t)(ehht_index_mix(hashcode) & (num_buckets - 1));
+	case EHHT_BUCKET_INDEX_FASTRANGE:
+		if (Ehht_u32_limit(num_buckets)) {
+			return (size_t)((((uint64_t)ehht_fold32(hashcode))
+					 * num_buckets) >> 32);
+		}
+		break;
+	case EHHT_BUCKET_INDEX_PRIME:
+		if (magic) {
+			return (size_t)ehht_mulhi_u32(magic
+						      * ehht_fold32(hashcode),
+						      num_buckets);
+		}
+		break;
+	case EHHT_BUCKET_INDEX_MODULO:
+		break;
 	}
+	return (size_t)(hashcode % num_buckets);
+}
 
-	return hash;
+static size_t ehht_bucket_num(const struct ehht_table_s *table,
+			      uint64_t hashcode)
+{
+	return ehht_bucket_for_hashcode(table, hashcode, table->num_buckets,
+					table->index_magic);
 }
 
-static struct ehht_element_s *ehht_get_element(struct ehht_table_s *table,
-					       const char *key, size_t key_len)
+static size_t ehht_old_bucket_num(const struct ehht_table_s *table,
+				  uint64_t hashcode)
 {
-	struct ehht_element_s *element;
-	unsigned int hashcode;
-	size_t bucket_num;
+	return ehht_bucket_for_hashcode(table, hashcode,
+					table->old_num_buckets,
+					table->old_index_magic);
+}
 
-	hashcode = table->hash_func(key, key_len);
-	bucket_num = ehht_bucket_for_hashcode(hashcode, table->num_buckets);
+/* returns the head of the chain which holds (or would hold) the hashcode */
+static struct ehht_element_s **ehht_chain_for_hashcode(struct ehht_table_s
+						       *table,
+						       uint64_t hashcode)
+{
+	size_t bucket_num;
 
-	element = table->buckets[bucket_num];
-	while (element != NULL) {
-		if (element->key.len == key_len) {
-			if (memcmp(key, element->key.str, key_len) == 0) {
-				return element;
-			}
+	if (table->old_buckets) {
+		bucket_num = ehht_old_bucket_num(table, hashcode);
+		if (bucket_num >= table->migrate_pos) {
+			return table->old_buckets + bucket_num;
 		}
-		element = element->next;
 	}
-	return NULL;
+	bucket_num = ehht_bucket_num(table, hashcode);
+	return table->buckets + bucket_num;
 }
 
-static void *ehht_get(struct ehht_s *this, const char *key, size_t key_len)
+/*
+  A bucket fingerprint has one of 16 bits set for each element in the
+  chain, chosen by a multiplicative mix of the hashcode, so that the bit
+  does not follow from the bucket under any bucket index. A lookup whose
+  bit is clear is a miss, and as the fingerprints are one quarter of the
+  size of the buckets, they are more often in cache. Inserts set bits;
+  removals recompute the fingerprint from what is left of the chain.
+*/
+static uint16_t ehht_fingerprint(uint64_t hashcode)
 {
-	struct ehht_table_s *table;
-	struct ehht_element_s *element;
+	uint32_t mixed;
 
-	table = ehht_get_table(this);
+	mixed = (uint32_t)(ehht_fold32(hashcode) * 0x9e3779b1UL);
+	return (uint16_t)(1U << (mixed >> 28));
+}
 
-	element = ehht_get_element(table, key, key_len);
-	return (element == NULL) ? NULL : element->val;
+static uint16_t ehht_chain_fingerprint(const struct ehht_element_s *element)
+{
+	uint16_t fingerprint;
+
+	for (fingerprint = 0; element; element = element->next) {
+		fingerprint |= ehht_fingerprint(element->key.hashcode);
+	}
+	return fingerprint;
 }
 
-static void *ehht_put(struct ehht_s *this, const char *key, size_t key_len,
-		      void *val)
+/* as ehht_chain_for_hashcode, or NULL if fingerprints are not kept */
+static uint16_t *ehht_fingerprint_for_hashcode(struct ehht_table_s *table,
+					       uint64_t hashcode)
 {
-	struct ehht_table_s *table;
-	struct ehht_element_s *element;
-	void *old_val;
-	unsigned int hashcode, collision;
 	size_t bucket_num;
 
-	table = ehht_get_table(this);
+	if (table->fingerprints == NULL) {
+		return NULL;
+	}
+	if (table->old_buckets) {
+		bucket_num = ehht_old_bucket_num(table, hashcode);
+		if (bucket_num >= table->migrate_pos) {
+			return table->old_fingerprints + bucket_num;
+		}
+	}
+	bucket_num = ehht_bucket_num(table, hashcode);
+	return table->fingerprints + bucket_num;
+}
 
-	element = ehht_get_element(table, key, key_len);
-	old_val = (element == NULL) ? NULL : element->val;
+/* returns non-zero, and counts the lookup, if the key is surely absent */
+static int ehht_fingerprint_rejects(struct ehht_table_s *table,
+				    uint64_t hashcode)
+{
+	uint16_t *fingerprint;
 
-	if (element != NULL) {
-		element->val = val;
-		return old_val;
+	fingerprint = ehht_fingerprint_for_hashcode(table, hashcode);
+	if (fingerprint == NULL
+	    || ((*fingerprint) & ehht_fingerprint(hashcode))) {
+		return 0;
 	}
+	++(table->stats.lookups);
+	++(table->stats.fingerprint_misses);
+	return 1;
+}
 
-	hashcode = table->hash_func(key, key_len);
-	bucket_num = ehht_bucket_for_hashcode(hashcode, table->num_buckets);
-	collision = (table->buckets[bucket_num] == NULL) ? 0 : 1;
-	if (collision && table->collision_load_factor > 0.0) {
-		if (table->size >=
-		    (table->num_buckets * table->collision_load_factor)) {
-			ehht_buckets_resize(this, 0);
-		}
-	}
+static uint16_t *ehht_alloc_fingerprints(struct ehht_table_s *table,
+					 size_t num_buckets)
+{
+	uint16_t *fingerprints;
+	size_t i, size;
 
-	element = ehht_alloc_element(table, key, key_len, hashcode, val);
-	if (!element) {
-		fprintf(stderr, "%s:%d: ehht_put failed\n", __FILE__, __LINE__);
-		/* should this exit? set errno? something other than stderr? */
+	size = sizeof(uint16_t) * num_buckets;
+	fingerprints = table->engine.alloc(size, table->engine.mem_context);
+	if (fingerprints == NULL) {
+		Ehht_failed_malloc(size, "fingerprints");
 		return NULL;
 	}
+	for (i = 0; i < num_buckets; ++i) {
+		fingerprints[i] = 0;
+	}
+	return fingerprints;
+}
 
-	bucket_num = ehht_bucket_for_hashcode(hashcode, table->num_buckets);
-	element->next = table->buckets[bucket_num];
-	table->buckets[bucket_num] = element;
+/* after the chains have been rebuilt wholesale */
+static void ehht_fingerprints_rebuild(struct ehht_table_s *table)
+{
+	size_t i;
 
-	return NULL;
+	if (table->fingerprints == NULL) {
+		return;
+	}
+	assert(table->old_buckets == NULL);
+	for (i = 0; i < table->num_buckets; ++i) {
+		table->fingerprints[i] =
+		    ehht_chain_fingerprint(table->buckets[i]);
+	}
 }
 
-static void *ehht_remove(struct ehht_s *this, const char *key, size_t key_len)
+/* links the element into the chain where the chain order requires,
+ * returns the link which now points to the element */
+static struct ehht_element_s **ehht_chain_link(struct ehht_table_s *table,
+					       struct ehht_element_s **link,
+					       struct ehht_element_s *element)
+{
+	if (table->chain_order == EHHT_CHAIN_ORDER_SORTED) {
+		while (*link && (*link)->key.hashcode < element->key.hashcode) {
+			link = &((*link)->next);
+		}
+	}
+	element->next = *link;
+	*link = element;
+	return link;
+}
+
+/* moves up to "steps" of the old buckets into the new bucket array */
+static void ehht_rehash_steps(struct ehht_table_s *table, size_t steps)
 {
-	struct ehht_table_s *table;
 	struct ehht_element_s *element;
-	struct ehht_element_s **ptr_to_element;
-	void *old_val;
-	unsigned int hashcode;
 	size_t bucket_num;
 
+	while (table->old_buckets && steps--) {
+		while ((element = table->old_buckets[table->migrate_pos])) {
+			table->old_buckets[table->migrate_pos] = element->next;
+			bucket_num = ehht_bucket_num(table,
+						     element->key.hashcode);
+			ehht_chain_link(table, table->buckets + bucket_num,
+					element);
+			if (table->fingerprints) {
+				table->fingerprints[bucket_num] |=
+				    ehht_fingerprint(element->key.hashcode);
+			}
+		}
+		if (++(table->migrate_pos) == table->old_num_buckets) {
+			table->engine.free(table->old_buckets,
+					   table->engine.mem_context);
+			table->old_buckets = NULL;
+			table->old_num_buckets = 0;
+			table->migrate_pos = 0;
+			if (table->old_fingerprints) {
+				table->engine.free(table->old_fingerprints,
+						   table->engine.mem_context);
+				table->old_fingerprints = NULL;
+			}
+		}
+	}
+}
+
+static void ehht_rehash_finish(struct ehht_table_s *table)
+{
+	ehht_rehash_steps(table, table->old_num_buckets);
+}
+
+static size_t ehht_chained_bucket_for_key(struct ehht_s *this, const char *key,
+					  size_t key_len)
+{
+	struct ehht_table_s *table;
+	uint64_t hashcode;
+
 	table = ehht_get_table(this);
+	hashcode = Ehht_hash(&table->engine, key, key_len);
+
+	return ehht_bucket_num(table, hashcode);
+}
 
-	element = ehht_get_element(table, key, key_len);
+/* touches nothing of the table but the allocator, nor counts the element,
+ * thus the workers of ehht_build_parallel may call it at once */
+static struct ehht_element_s *ehht_new_element(struct ehht_table_s *table,
+					       const char *key,
+					       size_t key_len,
+					       uint64_t hashcode, void *val)
+{
+	char *key_copy;
+	struct ehht_element_s *element;
+	size_t size;
+
+	size = sizeof(struct ehht_element_s);
+	if (key_len >= (SIZE_MAX - size)) {
+		Ehht_failed_malloc(SIZE_MAX, "struct ehht_element_s");
+		return NULL;
+	}
+	size += key_len + 1;
+	element = ehht_engine_entry_alloc(&table->engine, size);
 	if (element == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_element_s");
 		return NULL;
 	}
 
-	old_val = element->val;
+	key_copy = (char *)(element + 1);
+	memcpy(key_copy, key, key_len);
+	key_copy[key_len] = '\0';
 
-	hashcode = table->hash_func(key, key_len);
-	bucket_num = ehht_bucket_for_hashcode(hashcode, table->num_buckets);
+	element->key.str = key_copy;
+	element->key.len = key_len;
+	element->key.hashcode = hashcode;
+	element->val = val;
+	element->next = NULL;
 
-	/* find what points to this element */
-	ptr_to_element = &(table->buckets[bucket_num]);
-	while (*ptr_to_element != element) {
-		ptr_to_element = &((*ptr_to_element)->next);
-	}
-	/* make that point to the next element */
-	*ptr_to_element = element->next;
+	return element;
+}
 
-	--(table->size);
-	ehht_free_element(table, element);
+static struct ehht_element_s *ehht_alloc_element(struct ehht_table_s *table,
+						 const char *key,
+						 size_t key_len,
+						 uint64_t hashcode,
+						 void *val)
+{
+	struct ehht_element_s *element;
 
-	return old_val;
+	element = ehht_new_element(table, key, key_len, hashcode, val);
+	if (element != NULL) {
+		++(table->size);
+	}
+	return element;
 }
 
-static int ehht_for_each(struct ehht_s *this,
-			 int (*func)(struct ehht_key_s each_key,
-				     void *each_val, void *context),
-			 void *context)
-{
-	struct ehht_table_s *table;
-	size_t i, end;
+/*
+  A chain which grows beyond EHHT_TREEIFY_THRESHOLD is indexed by an AVL
+  tree ordered by (hashcode, key bytes), as Java's HashMap does, so that
+  a poor hash function costs O(log n) per lookup rather than O(n). The
+  chain itself remains intact: iteration, resizing, and rehashing walk
+  the chains as always, and simply discard the trees, which are rebuilt
+  as inserts find chains which are still long. Each tree node records
+  the link which points to its element, so that removal need not walk
+  the chain to find the element before.
+*/
+
+struct ehht_tree_node_s {
 	struct ehht_element_s *element;
+	/* the bucket head or "next" which points to the element */
+	struct ehht_element_s **link;
+	struct ehht_tree_node_s *left;
+	struct ehht_tree_node_s *right;
+	int height;
+};
 
-	table = ehht_get_table(this);
+struct ehht_tree_s {
+	struct ehht_tree_node_s *root;
+	size_t count;
+};
 
-	end = 0;
-	for (i = 0; i < table->num_buckets && !end; ++i) {
-		for (element = table->buckets[i]; element != NULL;
-		     element = element->next) {
-			end = (*func) (element->key, element->val, context);
-		}
+static int ehht_tree_cmp(uint64_t hashcode, const char *key, size_t key_len,
+			 const struct ehht_element_s *element)
+{
+	size_t len;
+	int c;
+
+	if (hashcode != element->key.hashcode) {
+		return (hashcode < element->key.hashcode) ? -1 : 1;
 	}
+	len = (key_len < element->key.len) ? key_len : element->key.len;
+	c = memcmp(key, element->key.str, len);
+	if (c != 0 || key_len == element->key.len) {
+		return c;
+	}
+	return (key_len < element->key.len) ? -1 : 1;
+}
 
-	return end;
+static int ehht_tree_height(const struct ehht_tree_node_s *node)
+{
+	return node ? node->height : 0;
 }
 
-static size_t ehht_size(struct ehht_s *this)
+static struct ehht_tree_node_s *ehht_tree_fix_height(struct ehht_tree_node_s
+						     *node)
 {
-	struct ehht_table_s *table;
+	int left, right;
 
-	table = ehht_get_table(this);
-	return table->size;
+	left = ehht_tree_height(node->left);
+	right = ehht_tree_height(node->right);
+	node->height = 1 + ((left > right) ? left : right);
+	return node;
 }
 
-struct ehht_str_buf_s {
-	char *buf;
-	size_t buf_len;
-	size_t buf_pos;
-};
-
-static int ehht_to_string_each(struct ehht_key_s key, void *each_val,
-			       void *context)
+static struct ehht_tree_node_s *ehht_tree_rotate_right(struct ehht_tree_node_s
+						       *node)
 {
+	struct ehht_tree_node_s *pivot;
 
-	struct ehht_str_buf_s *str_buf;
-	char *buf;
-	const char *fmt;
-	size_t bytes_to_write;
-	int bytes_written;
+	pivot = node->left;
+	node->left = pivot->right;
+	pivot->right = ehht_tree_fix_height(node);
+	return ehht_tree_fix_height(pivot);
+}
 
-	str_buf = (struct ehht_str_buf_s *)context;
-	buf = str_buf->buf + str_buf->buf_pos;
+static struct ehht_tree_node_s *ehht_tree_rotate_left(struct ehht_tree_node_s
+						      *node)
+{
+	struct ehht_tree_node_s *pivot;
 
-	fmt = "'%s' => %p, ";
-	bytes_to_write = key.len + (__WORDSIZE / 4) + strlen(fmt);
-	if (str_buf->buf_len < (str_buf->buf_pos + bytes_to_write)) {
-		return -1;
-	}
+	pivot = node->right;
+	node->right = pivot->left;
+	pivot->left = ehht_tree_fix_height(node);
+	return ehht_tree_fix_height(pivot);
+}
 
-	bytes_written = sprintf(buf, fmt, key.len ? key.str : "", each_val);
-	if (bytes_written > 0) {
-		str_buf->buf_pos += ((unsigned int)bytes_written);
+static struct ehht_tree_node_s *ehht_tree_balance(struct ehht_tree_node_s
+						  *node)
+{
+	int balance;
+
+	ehht_tree_fix_height(node);
+	balance = ehht_tree_height(node->left) - ehht_tree_height(node->right);
+	if (balance > 1) {
+		if (ehht_tree_height(node->left->left) <
+		    ehht_tree_height(node->left->right)) {
+			node->left = ehht_tree_rotate_left(node->left);
+		}
+		return ehht_tree_rotate_right(node);
 	}
-
-	return 0;
+	if (balance < -1) {
+		if (ehht_tree_height(node->right->right) <
+		    ehht_tree_height(node->right->left)) {
+			node->right = ehht_tree_rotate_right(node->right);
+		}
+		return ehht_tree_rotate_left(node);
+	}
+	return node;
 }
 
-static size_t ehht_to_string(struct ehht_s *this, char *buf, size_t buf_len)
+static struct ehht_tree_node_s *ehht_tree_insert(struct ehht_tree_node_s *root,
+						 struct ehht_tree_node_s *node)
 {
-	struct ehht_str_buf_s str_buf;
-	int bytes_written;
-
-	str_buf.buf = buf;
-	str_buf.buf_len = buf_len;
-	str_buf.buf_pos = 0;
+	const struct ehht_key_s *key;
 
-	bytes_written = sprintf(buf, "{ ");
-	if (bytes_written > 0) {
-		str_buf.buf_pos += ((unsigned int)bytes_written);
+	if (root == NULL) {
+		return node;
 	}
-	ehht_for_each(this, ehht_to_string_each, &str_buf);
-	bytes_written = sprintf(str_buf.buf + str_buf.buf_pos, "}");
-	if (bytes_written > 0) {
-		str_buf.buf_pos += ((unsigned int)bytes_written);
+	key = &(node->element->key);
+	if (ehht_tree_cmp(key->hashcode, key->str, key->len,
+			  root->element) < 0) {
+		root->left = ehht_tree_insert(root->left, node);
+	} else {
+		root->right = ehht_tree_insert(root->right, node);
 	}
-	return str_buf.buf_pos;
+	return ehht_tree_balance(root);
 }
 
-size_t ehht_buckets_resize(struct ehht_s *this, size_t num_buckets)
+static struct ehht_tree_node_s *ehht_tree_find(struct ehht_tree_node_s *node,
+					       const char *key, size_t key_len,
+					       uint64_t hashcode)
 {
-	size_t i, old_num_buckets, new_bucket_num, size;
-	struct ehht_table_s *table;
-	struct ehht_element_s **new_buckets, **old_buckets;
-
-	table = ehht_get_table(this);
+	int c;
 
-	if (num_buckets == 0) {
+	while (node != NULL) {
+		c = ehht_tree_cmp(hashcode, key, key_len, node->element);
+		if (c == 0) {
+			return node;
+		}
+		node = (c < 0) ? node->left : node->right;
+	}
+	return NULL;
+}
+
+static struct ehht_tree_node_s *ehht_tree_unlink_min(struct ehht_tree_node_s
+						     *node,
+						     struct ehht_tree_node_s
+						     **min)
+{
+	if (node->left == NULL) {
+		*min = node;
+		return node->right;
+	}
+	node->left = ehht_tree_unlink_min(node->left, min);
+	return ehht_tree_balance(node);
+}
+
+/* the element must be in the tree */
+static struct ehht_tree_node_s *ehht_tree_unlink(struct ehht_tree_node_s *root,
+						 const struct ehht_element_s
+						 *element,
+						 struct ehht_tree_node_s
+						 **unlinked)
+{
+	struct ehht_tree_node_s *min;
+	const struct ehht_key_s *key;
+	int c;
+
+	key = &(element->key);
+	c = ehht_tree_cmp(key->hashcode, key->str, key->len, root->element);
+	if (c < 0) {
+		root->left = ehht_tree_unlink(root->left, element, unlinked);
+	} else if (c > 0) {
+		root->right = ehht_tree_unlink(root->right, element, unlinked);
+	} else {
+		*unlinked = root;
+		if (root->right == NULL) {
+			return root->left;
+		}
+		root->right = ehht_tree_unlink_min(root->right, &min);
+		min->left = root->left;
+		min->right = root->right;
+		root = min;
+	}
+	return ehht_tree_balance(root);
+}
+
+static void ehht_tree_free_nodes(struct ehht_table_s *table,
+				 struct ehht_tree_node_s *node)
+{
+	if (node != NULL) {
+		ehht_tree_free_nodes(table, node->left);
+		ehht_tree_free_nodes(table, node->right);
+		ehht_engine_entry_free(&table->engine, node);
+	}
+}
+
+/* discards the index of the bucket, the chain is unaffected */
+static void ehht_tree_drop(struct ehht_table_s *table, size_t bucket_num)
+{
+	struct ehht_tree_s *tree;
+
+	tree = table->trees[bucket_num];
+	if (tree != NULL) {
+		ehht_tree_free_nodes(table, tree->root);
+		table->engine.free(tree, table->engine.mem_context);
+		table->trees[bucket_num] = NULL;
+	}
+}
+
+static void ehht_trees_drop(struct ehht_table_s *table)
+{
+	size_t i;
+
+	if (table->trees == NULL) {
+		return;
+	}
+	for (i = 0; i < table->num_buckets; ++i) {
+		ehht_tree_drop(table, i);
+	}
+	table->engine.free(table->trees, table->engine.mem_context);
+	table->trees = NULL;
+}
+
+/* trees only exist while no incremental rehash is in progress, thus the
+ * chain is always in table->buckets */
+static struct ehht_tree_s *ehht_tree_for_chain(struct ehht_table_s *table,
+					       struct ehht_element_s **chain)
+{
+	if (table->trees == NULL) {
+		return NULL;
+	}
+	assert(table->old_buckets == NULL);
+	return table->trees[chain - table->buckets];
+}
+
+static int ehht_tree_add(struct ehht_table_s *table, struct ehht_tree_s *tree,
+			 struct ehht_element_s **link)
+{
+	struct ehht_tree_node_s *node;
+
+	node = ehht_engine_entry_alloc(&table->engine, sizeof(*node));
+	if (node == NULL) {
+		Ehht_failed_malloc(sizeof(*node), "struct ehht_tree_node_s");
+		return 1;
+	}
+	node->element = *link;
+	node->link = link;
+	node->left = NULL;
+	node->right = NULL;
+	node->height = 1;
+	tree->root = ehht_tree_insert(tree->root, node);
+	++(tree->count);
+	return 0;
+}
+
+/* on failure to allocate, the chain is simply left as a list */
+static void ehht_treeify(struct ehht_table_s *table, size_t bucket_num)
+{
+	struct ehht_element_s **link;
+	struct ehht_tree_s *tree;
+	size_t i, size;
+
+	if (table->trees == NULL) {
+		size = sizeof(struct ehht_tree_s *) * table->num_buckets;
+		table->trees = table->engine.alloc(size,
+						   table->engine.mem_context);
+		if (table->trees == NULL) {
+			Ehht_failed_malloc(size, "trees");
+			return;
+		}
+		for (i = 0; i < table->num_buckets; ++i) {
+			table->trees[i] = NULL;
+		}
+	}
+
+	size = sizeof(struct ehht_tree_s);
+	tree = table->engine.alloc(size, table->engine.mem_context);
+	if (tree == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_tree_s");
+		return;
+	}
+	tree->root = NULL;
+	tree->count = 0;
+	table->trees[bucket_num] = tree;
+
+	for (link = table->buckets + bucket_num; *link; link = &(*link)->next) {
+		if (ehht_tree_add(table, tree, link)) {
+			ehht_tree_drop(table, bucket_num);
+			return;
+		}
+	}
+}
+
+/* only chains which are long for the load are worth indexing: with a fair
+ * hash and a high load factor many chains exceed the threshold, yet almost
+ * none are four times the mean; if every chain is long, the table needs
+ * more buckets, not trees */
+static int ehht_chain_too_long(struct ehht_table_s *table, size_t len)
+{
+	return EHHT_TREEIFY_THRESHOLD > 0 && len > EHHT_TREEIFY_THRESHOLD
+	    && len > (4 * (table->size / table->num_buckets));
+}
+
+/* the element was just linked into the chain at "link" */
+static void ehht_tree_after_insert(struct ehht_table_s *table,
+				   struct ehht_element_s **chain,
+				   struct ehht_element_s **link)
+{
+	struct ehht_tree_node_s *next_node;
+	struct ehht_element_s *element, *next;
+	struct ehht_tree_s *tree;
+	size_t bucket_num, len;
+
+	if (EHHT_TREEIFY_THRESHOLD == 0 || table->old_buckets) {
+		return;
+	}
+	bucket_num = chain - table->buckets;
+	tree = ehht_tree_for_chain(table, chain);
+	if (tree == NULL) {
+		len = 0;
+		for (element = *chain; element; element = element->next) {
+			++len;
+		}
+		if (ehht_chain_too_long(table, len)) {
+			ehht_treeify(table, bucket_num);
+		}
+		return;
+	}
+
+	element = *link;
+	next = element->next;
+	if (next) {
+		next_node = ehht_tree_find(tree->root, next->key.str,
+					   next->key.len, next->key.hashcode);
+		next_node->link = &(element->next);
+	}
+	if (ehht_tree_add(table, tree, link)) {
+		ehht_tree_drop(table, bucket_num);
+	}
+}
+
+/* unlinks the element from both the tree and the chain */
+static struct ehht_element_s *ehht_tree_remove(struct ehht_table_s *table,
+					       struct ehht_element_s **chain,
+					       struct ehht_tree_s *tree,
+					       const char *key, size_t key_len,
+					       uint64_t hashcode)
+{
+	struct ehht_tree_node_s *node, *next_node;
+	struct ehht_element_s *element, *next;
+
+	node = ehht_tree_find(tree->root, key, key_len, hashcode);
+	if (node == NULL) {
+		return NULL;
+	}
+	element = node->element;
+	next = element->next;
+	*(node->link) = next;
+	if (next) {
+		next_node = ehht_tree_find(tree->root, next->key.str,
+					   next->key.len, next->key.hashcode);
+		next_node->link = node->link;
+	}
+	tree->root = ehht_tree_unlink(tree->root, element, &node);
+	ehht_engine_entry_free(&table->engine, node);
+	if (--(tree->count) < EHHT_UNTREEIFY_THRESHOLD) {
+		ehht_tree_drop(table, chain - table->buckets);
+	}
+	return element;
+}
+
+/* returns the link which points to the matching element, or NULL if the
+ * key is not present; the key bytes are only compared if the hashcodes
+ * are equal, and a sorted chain is only walked up to the hashcode */
+static struct ehht_element_s **ehht_walk_chain(struct ehht_table_s *table,
+					       struct ehht_element_s **link,
+					       const char *key, size_t key_len,
+					       uint64_t hashcode)
+{
+	struct ehht_element_s *element;
+	unsigned long visited;
+	int sorted;
+
+	sorted = (table->chain_order == EHHT_CHAIN_ORDER_SORTED);
+	++(table->stats.lookups);
+	for (visited = 0; (element = *link) != NULL; ++visited) {
+		if (element->key.hashcode == hashcode) {
+			if (element->key.len == key_len
+			    && memcmp(key, element->key.str, key_len) == 0) {
+				table->stats.visited += visited + 1;
+				++(table->stats.hits);
+				return link;
+			}
+		} else if (sorted && element->key.hashcode > hashcode) {
+			table->stats.visited += visited + 1;
+			++(table->stats.early_misses);
+			return NULL;
+		}
+		link = &(element->next);
+	}
+	table->stats.visited += visited;
+	return NULL;
+}
+
+static struct ehht_element_s *ehht_chain_find(struct ehht_table_s *table,
+					       struct ehht_element_s **chain,
+					       const char *key, size_t key_len,
+					       uint64_t hashcode)
+{
+	struct ehht_tree_node_s *node;
+	struct ehht_tree_s *tree;
+	struct ehht_element_s **link, *element;
+
+	tree = ehht_tree_for_chain(table, chain);
+	if (tree != NULL) {
+		++(table->stats.lookups);
+		node = ehht_tree_find(tree->root, key, key_len, hashcode);
+		if (node == NULL) {
+			return NULL;
+		}
+		++(table->stats.hits);
+		return node->element;
+	}
+	link = ehht_walk_chain(table, chain, key, key_len, hashcode);
+	if (link == NULL) {
+		return NULL;
+	}
+	element = *link;
+	if (table->chain_order == EHHT_CHAIN_ORDER_MOVE_TO_FRONT
+	    && link != chain && !table->iterating) {
+		*link = element->next;
+		element->next = *chain;
+		*chain = element;
+		++(table->stats.moves_to_front);
+	}
+	return element;
+}
+
+static struct ehht_element_s *ehht_find_element(struct ehht_table_s *table,
+						const char *key,
+						size_t key_len,
+						uint64_t hashcode)
+{
+	ehht_rehash_steps(table, table->rehash_buckets_per_op);
+
+	if (ehht_fingerprint_rejects(table, hashcode)) {
+		return NULL;
+	}
+	return ehht_chain_find(table, ehht_chain_for_hashcode(table, hashcode),
+			       key, key_len, hashcode);
+}
+
+static void *ehht_chained_get_hashed(struct ehht_s *this, const char *key,
+				     size_t key_len, uint64_t hashcode)
+{
+	struct ehht_table_s *table;
+	struct ehht_element_s *element;
+
+	table = ehht_get_table(this);
+
+	element = ehht_find_element(table, key, key_len, hashcode);
+	return (element == NULL) ? NULL : element->val;
+}
+
+static void *ehht_get(struct ehht_s *this, const char *key, size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_chained_get_hashed(this, key, key_len, hashcode);
+}
+
+/* lookups are done in groups: first all of the hashing, prefetching the
+ * bucket heads, then prefetching the first elements, and only then the
+ * chain walks, so that the memory accesses of the group overlap */
+static void ehht_chained_get_many(struct ehht_s *this, const char **keys,
+				  const size_t *key_lens, void **vals,
+				  size_t n)
+{
+	struct ehht_table_s *table;
+	struct ehht_element_s **links[EHHT_GET_MANY_GROUP];
+	struct ehht_element_s *element;
+	uint64_t hashcodes[EHHT_GET_MANY_GROUP];
+	size_t i, group;
+
+	table = ehht_get_table(this);
+
+	for (; n; n -= group, keys += group, key_lens += group, vals += group) {
+		group = (n < EHHT_GET_MANY_GROUP) ? n : EHHT_GET_MANY_GROUP;
+
+		ehht_rehash_steps(table, group * table->rehash_buckets_per_op);
+
+		ehht_engine_hash_many(&table->engine, keys, key_lens,
+				      hashcodes, group);
+		for (i = 0; i < group; ++i) {
+			links[i] = ehht_chain_for_hashcode(table, hashcodes[i]);
+			Ehht_prefetch(links[i]);
+		}
+		for (i = 0; i < group; ++i) {
+			if (*links[i] != NULL) {
+				Ehht_prefetch(*links[i]);
+			}
+		}
+		for (i = 0; i < group; ++i) {
+			if (ehht_fingerprint_rejects(table, hashcodes[i])) {
+				vals[i] = NULL;
+				continue;
+			}
+			element = ehht_chain_find(table, links[i], keys[i],
+						  key_lens[i], hashcodes[i]);
+			vals[i] = (element == NULL) ? NULL : element->val;
+		}
+	}
+}
+
+struct ehht_put_order_s {
+	size_t bucket_num;
+	size_t i;
+};
+
+/* by bucket, then by position, so that a repeated key's last put wins */
+static int ehht_put_order_cmp(const void *a, const void *b)
+{
+	const struct ehht_put_order_s *x, *y;
+
+	x = (const struct ehht_put_order_s *)a;
+	y = (const struct ehht_put_order_s *)b;
+	if (x->bucket_num != y->bucket_num) {
+		return (x->bucket_num < y->bucket_num) ? -1 : 1;
+	}
+	return (x->i < y->i) ? -1 : ((x->i > y->i) ? 1 : 0);
+}
+
+/* each group is hashed, then sorted by bucket, thus the chains are
+ * visited (and the elements allocated) in bucket order */
+static void ehht_chained_put_many(struct ehht_s *this, const char **keys,
+				  const size_t *key_lens, void **vals,
+				  size_t n)
+{
+	struct ehht_table_s *table;
+	struct ehht_put_order_s *order;
+	struct ehht_element_s *element;
+	struct ehht_hash_seed_s seed;
+	uint64_t *hashcodes;
+	size_t i, j, k, group, size;
+
+	table = ehht_get_table(this);
+
+	group = (n < EHHT_PUT_MANY_GROUP) ? n : EHHT_PUT_MANY_GROUP;
+	size = group * (sizeof(struct ehht_put_order_s) + sizeof(uint64_t));
+	order = table->engine.alloc(size, table->engine.mem_context);
+	if (order == NULL) {
+		Ehht_failed_malloc(size, "put_many order");
+		for (i = 0; i < n; ++i) {
+			this->put(this, keys[i], key_lens[i], vals[i]);
+		}
+		return;
+	}
+	hashcodes = (uint64_t *)(order + group);
+
+	for (; n; n -= group, keys += group, key_lens += group, vals += group) {
+		group = (n < EHHT_PUT_MANY_GROUP) ? n : EHHT_PUT_MANY_GROUP;
+
+		ehht_engine_hash_many(&table->engine, keys, key_lens,
+				      hashcodes, group);
+		for (i = 0; i < group; ++i) {
+			order[i].bucket_num =
+			    ehht_bucket_num(table, hashcodes[i]);
+			order[i].i = i;
+		}
+		qsort(order, group, sizeof(struct ehht_put_order_s),
+		      ehht_put_order_cmp);
+
+		seed = table->engine.seed;
+		for (j = 0; j < group; ++j) {
+			i = order[j].i;
+			element = ehht_find_element(table, keys[i], key_lens[i],
+						    hashcodes[i]);
+			if (element != NULL) {
+				element->val = vals[i];
+				continue;
+			}
+			ehht_chained_insert(this, keys[i], key_lens[i],
+					    hashcodes[i], vals[i]);
+			if (table->engine.seed.k0 == seed.k0
+			    && table->engine.seed.k1 == seed.k1) {
+				continue;
+			}
+			/* the insert caused a reseed, thus the hashcodes of
+			 * the rest of the group are stale */
+			seed = table->engine.seed;
+			for (k = j + 1; k < group; ++k) {
+				i = order[k].i;
+				hashcodes[i] =
+				    Ehht_hash(&table->engine, keys[i],
+					      key_lens[i]);
+				order[k].bucket_num =
+				    ehht_bucket_num(table, hashcodes[i]);
+			}
+			qsort(order + j + 1, group - (j + 1),
+			      sizeof(struct ehht_put_order_s),
+			      ehht_put_order_cmp);
+		}
+	}
+
+	table->engine.free(order, table->engine.mem_context);
+}
+
+/* chooses a new seed and rehashes every element; the elements stay
+ * where they are in memory, only their chains change */
+static void ehht_chained_reseed(struct ehht_table_s *table)
+{
+	struct ehht_element_s *all, *element;
+	size_t i, bucket_num;
+
+	ehht_rehash_finish(table);
+	ehht_trees_drop(table);
+
+	all = NULL;
+	for (i = 0; i < table->num_buckets; ++i) {
+		while ((element = table->buckets[i]) != NULL) {
+			table->buckets[i] = element->next;
+			element->next = all;
+			all = element;
+		}
+	}
+
+	ehht_hash_seed_next(&table->engine.seed);
+
+	while ((element = all) != NULL) {
+		all = element->next;
+		element->key.hashcode =
+		    Ehht_hash(&table->engine, element->key.str,
+			      element->key.len);
+		bucket_num = ehht_bucket_num(table, element->key.hashcode);
+		ehht_chain_link(table, table->buckets + bucket_num, element);
+	}
+	ehht_fingerprints_rebuild(table);
+	table->reseed_size = table->size;
+}
+
+/* a chain much longer than the load explains suggests keys chosen to
+ * collide; like Perl's hv.c, respond by changing the seed */
+static void ehht_chained_check_chain(struct ehht_table_s *table,
+				     struct ehht_element_s *chain)
+{
+	size_t len;
+
+	if (table->engine.seeded_hash_func == NULL
+	    || table->size < (2 * table->reseed_size)) {
+		return;
+	}
+	for (len = 0; chain && len <= table->max_chain_len; ++len) {
+		chain = chain->next;
+	}
+	if (len > table->max_chain_len
+	    && len > (2 * (table->size / table->num_buckets))) {
+		ehht_chained_reseed(table);
+	}
+}
+
+/*
+  ehht_build_parallel fills a new table in three phases, each split over
+  the threads. First each thread hashes its share of the keys, counting
+  how many fall in each thread's range of buckets. With the counts summed
+  into offsets, each thread then scatters the positions of its keys into
+  those ranges. Last, each thread links the elements of its own range of
+  buckets: as no two threads touch the same chain, no locks are taken,
+  and as each range holds its keys in their original order, a repeated
+  key takes its last value, as with put.
+*/
+
+struct ehht_build_part_s {
+	size_t added;
+	/* the longest chain made, and its bucket */
+	size_t longest;
+	size_t longest_bucket;
+};
+
+struct ehht_build_s {
+	struct ehht_table_s *table;
+	const char **keys;
+	const size_t *key_lens;
+	void **vals;
+	size_t n;
+	size_t num_threads;
+	/* the size of each thread's share of the keys, and of the buckets */
+	size_t keys_per_thread;
+	size_t buckets_per_thread;
+	uint64_t *hashcodes;
+	/* counts[t * num_threads + p]: the keys of thread t's share which
+	 * fall in the buckets of thread p; then, their offsets in order */
+	size_t *counts;
+	/* the positions of the keys, grouped by range of buckets */
+	size_t *order;
+	struct ehht_build_part_s *parts;
+};
+
+static void ehht_build_share(const struct ehht_build_s *build,
+			     size_t thread_num, size_t *begin, size_t *end)
+{
+	*begin = build->keys_per_thread * thread_num;
+	if (*begin > build->n) {
+		*begin = build->n;
+	}
+	*end = ((build->n - *begin) < build->keys_per_thread)
+	    ? build->n : (*begin + build->keys_per_thread);
+}
+
+static size_t ehht_build_part_num(const struct ehht_build_s *build,
+				  uint64_t hashcode)
+{
+	return ehht_bucket_num(build->table, hashcode)
+	    / build->buckets_per_thread;
+}
+
+static void ehht_build_hash(void *context, size_t thread_num)
+{
+	struct ehht_build_s *build;
+	size_t *counts;
+	size_t i, begin, end;
+
+	build = (struct ehht_build_s *)context;
+	ehht_build_share(build, thread_num, &begin, &end);
+
+	ehht_engine_hash_many(&build->table->engine, build->keys + begin,
+			      build->key_lens + begin,
+			      build->hashcodes + begin, end - begin);
+	counts = build->counts + (thread_num * build->num_threads);
+	for (i = begin; i < end; ++i) {
+		++counts[ehht_build_part_num(build, build->hashcodes[i])];
+	}
+}
+
+static void ehht_build_scatter(void *context, size_t thread_num)
+{
+	struct ehht_build_s *build;
+	size_t *offsets;
+	size_t i, p, begin, end;
+
+	build = (struct ehht_build_s *)context;
+	ehht_build_share(build, thread_num, &begin, &end);
+
+	offsets = build->counts + (thread_num * build->num_threads);
+	for (i = begin; i < end; ++i) {
+		p = ehht_build_part_num(build, build->hashcodes[i]);
+		build->order[offsets[p]++] = i;
+	}
+}
+
+static void ehht_build_link(void *context, size_t thread_num)
+{
+	struct ehht_build_s *build;
+	struct ehht_build_part_s *part;
+	struct ehht_table_s *table;
+	struct ehht_element_s **chain, *element;
+	const size_t *ends;
+	size_t i, j, begin, end, bucket_num, len;
+	uint64_t hashcode;
+
+	build = (struct ehht_build_s *)context;
+	table = build->table;
+	part = build->parts + thread_num;
+
+	/* once scattered, the last thread's offsets are the ends */
+	ends = build->counts + ((build->num_threads - 1) * build->num_threads);
+	begin = thread_num ? ends[thread_num - 1] : 0;
+	end = ends[thread_num];
+
+	part->added = 0;
+	part->longest = 0;
+	part->longest_bucket = 0;
+	for (j = begin; j < end; ++j) {
+		i = build->order[j];
+		hashcode = build->hashcodes[i];
+		bucket_num = ehht_bucket_num(table, hashcode);
+		chain = table->buckets + bucket_num;
+		for (len = 0, element = *chain; element; ++len) {
+			if (element->key.hashcode == hashcode
+			    && element->key.len == build->key_lens[i]
+			    && memcmp(build->keys[i], element->key.str,
+				      element->key.len) == 0) {
+				break;
+			}
+			element = element->next;
+		}
+		if (element != NULL) {
+			element->val = build->vals[i];
+			continue;
+		}
+		element = ehht_new_element(table, build->keys[i],
+					   build->key_lens[i], hashcode,
+					   build->vals[i]);
+		if (element == NULL) {
+			fprintf(stderr, "%s:%d: ehht_put failed\n", __FILE__,
+				__LINE__);
+			continue;
+		}
+		ehht_chain_link(table, chain, element);
+		if (table->fingerprints) {
+			table->fingerprints[bucket_num] |=
+			    ehht_fingerprint(hashcode);
+		}
+		++(part->added);
+		if (len + 1 > part->longest) {
+			part->longest = len + 1;
+			part->longest_bucket = bucket_num;
+		}
+	}
+}
+
+/* indexes each chain which is long for the load, as inserts would have */
+static void ehht_build_treeify(struct ehht_table_s *table)
+{
+	struct ehht_element_s *element;
+	size_t i, len;
+
+	if (EHHT_TREEIFY_THRESHOLD == 0) {
+		return;
+	}
+	for (i = 0; i < table->num_buckets; ++i) {
+		len = 0;
+		for (element = table->buckets[i]; element;
+		     element = element->next) {
+			++len;
+		}
+		if (ehht_chain_too_long(table, len)) {
+			ehht_treeify(table, i);
+		}
+	}
+}
+
+static void ehht_chained_put_parallel(struct ehht_s *this, const char **keys,
+				      const size_t *key_lens, void **vals,
+				      size_t n, size_t num_threads)
+{
+	struct ehht_table_s *table;
+	struct ehht_build_s build;
+	size_t i, p, t, offset, count, size, longest, longest_bucket;
+	void *mem_context;
+
+	table = ehht_get_table(this);
+	mem_context = table->engine.mem_context;
+	ehht_rehash_finish(table);
+
+	if (num_threads > table->num_buckets) {
+		num_threads = table->num_buckets;
+	}
+	size = SIZE_MAX;
+	build.hashcodes = NULL;
+	if (n < ((SIZE_MAX / 2) / (sizeof(uint64_t) + sizeof(size_t)))) {
+		size = ((sizeof(uint64_t) + sizeof(size_t)) * n)
+		    + (sizeof(size_t) * num_threads * num_threads)
+		    + (sizeof(struct ehht_build_part_s) * num_threads);
+		build.hashcodes = table->engine.alloc(size, mem_context);
+	}
+	if (build.hashcodes == NULL) {
+		Ehht_failed_malloc(size, "put_parallel scratch");
+		ehht_chained_put_many(this, keys, key_lens, vals, n);
+		return;
+	}
+	build.order = (size_t *)(build.hashcodes + n);
+	build.counts = build.order + n;
+	build.parts = (struct ehht_build_part_s *)(build.counts
+						   + (num_threads
+						      * num_threads));
+	for (i = 0; i < (num_threads * num_threads); ++i) {
+		build.counts[i] = 0;
+	}
+	build.table = table;
+	build.keys = keys;
+	build.key_lens = key_lens;
+	build.vals = vals;
+	build.n = n;
+	build.num_threads = num_threads;
+	build.keys_per_thread = (n / num_threads) + ((n % num_threads) != 0);
+	build.buckets_per_thread = (table->num_buckets / num_threads)
+	    + ((table->num_buckets % num_threads) != 0);
+
+	ehht_threads_run(num_threads, ehht_build_hash, &build);
+
+	offset = 0;
+	for (p = 0; p < num_threads; ++p) {
+		for (t = 0; t < num_threads; ++t) {
+			count = build.counts[(t * num_threads) + p];
+			build.counts[(t * num_threads) + p] = offset;
+			offset += count;
+		}
+	}
+	ehht_threads_run(num_threads, ehht_build_scatter, &build);
+
+	ehht_threads_run(num_threads, ehht_build_link, &build);
+
+	longest = 0;
+	longest_bucket = 0;
+	for (t = 0; t < num_threads; ++t) {
+		table->size += build.parts[t].added;
+		if (build.parts[t].longest > longest) {
+			longest = build.parts[t].longest;
+			longest_bucket = build.parts[t].longest_bucket;
+		}
+	}
+	table->engine.free(build.hashcodes, mem_context);
+
+	if (longest > EHHT_TREEIFY_THRESHOLD
+	    || longest > table->max_chain_len) {
+		ehht_chained_check_chain(table, table->buckets[longest_bucket]);
+		ehht_build_treeify(table);
+	}
+}
+
+/* the bucket count after one step of growth */
+static size_t ehht_grown_num_buckets(const struct ehht_table_s *table)
+{
+	size_t num_buckets;
+	double grown;
+
+	grown = table->num_buckets * table->resize_policy.growth_factor;
+	num_buckets = (grown >= (double)SIZE_MAX) ? SIZE_MAX : (size_t)grown;
+	if (num_buckets <= table->num_buckets) {
+		num_buckets = table->num_buckets + 1;
+	}
+	return num_buckets;
+}
+
+/* the mean elements visited per lookup, once a window of lookups has
+ * passed (which starts the next window), else -1.0 */
+static double ehht_window_probes(struct ehht_table_s *table)
+{
+	unsigned long lookups, visited;
+
+	lookups = table->stats.lookups - table->window_lookups;
+	if (lookups < EHHT_RESIZE_WINDOW) {
+		return -1.0;
+	}
+	visited = table->stats.visited - table->window_visited;
+	table->window_lookups = table->stats.lookups;
+	table->window_visited = table->stats.visited;
+	return ((double)visited) / lookups;
+}
+
+/* growth which did not shorten the probes points to collisions which more
+ * buckets will not fix, so the threshold is raised; while the probes stay
+ * well under it, it relaxes back toward the threshold asked for */
+static void ehht_tune_probes(struct ehht_table_s *table, double probes)
+{
+	if (table->probes_before_growth > 0.0) {
+		if (probes > (0.9 * table->probes_before_growth)) {
+			table->probe_threshold *= 1.5;
+		}
+		table->probes_before_growth = 0.0;
+	} else if (probes < (table->probe_threshold / 4)
+		   && table->probe_threshold > table->resize_policy.threshold) {
+		table->probe_threshold /= 1.5;
+		if (table->probe_threshold < table->resize_policy.threshold) {
+			table->probe_threshold = table->resize_policy.threshold;
+		}
+	}
+}
+
+/* the number of buckets to grow to before an element joins the chain, or
+ * zero if the resize_policy does not call for growth */
+static size_t ehht_chained_grow_to(struct ehht_table_s *table,
+				   struct ehht_element_s *chain)
+{
+	struct ehht_resize_policy_s *policy;
+	struct ehht_resize_info_s info;
+	int loaded;
+	double probes;
+	size_t len;
+
+	policy = &table->resize_policy;
+	if (table->collision_load_factor <= 0.0) {
+		return 0;
+	}
+	loaded = table->size >= (table->num_buckets *
+				 EHHT_RESIZE_MIN_LOADFACTOR);
+
+	switch (policy->trigger) {
+	case EHHT_RESIZE_LOAD_FACTOR:
+		if (chain == NULL || table->size <
+		    (table->num_buckets * table->collision_load_factor)) {
+			return 0;
+		}
+		break;
+	case EHHT_RESIZE_CHAIN_LENGTH:
+		for (len = 0; chain && len < policy->threshold; ++len) {
+			chain = chain->next;
+		}
+		if (!loaded || len < policy->threshold) {
+			return 0;
+		}
+		break;
+	case EHHT_RESIZE_PROBE_COUNT:
+	case EHHT_RESIZE_AUTO_TUNE:
+		probes = ehht_window_probes(table);
+		if (probes < 0.0) {
+			return 0;
+		}
+		if (policy->trigger == EHHT_RESIZE_AUTO_TUNE) {
+			ehht_tune_probes(table, probes);
+		}
+		if (!loaded || probes <= table->probe_threshold) {
+			return 0;
+		}
+		table->probes_before_growth = probes;
+		break;
+	case EHHT_RESIZE_CUSTOM:
+		info.size = table->size;
+		info.num_buckets = table->num_buckets;
+		for (len = 0; chain; ++len) {
+			chain = chain->next;
+		}
+		info.chain_len = len;
+		info.lookups = table->stats.lookups - table->window_lookups;
+		info.visited = table->stats.visited - table->window_visited;
+		return policy->resize_func(&info, policy->resize_context);
+	}
+	return ehht_grown_num_buckets(table);
+}
+
+static void ehht_chained_grow(struct ehht_s *this, size_t num_buckets)
+{
+	struct ehht_table_s *table;
+	size_t old_num_buckets;
+
+	table = ehht_get_table(this);
+
+	old_num_buckets = table->num_buckets;
+	if (table->resize_policy.max_buckets
+	    && num_buckets > table->resize_policy.max_buckets) {
+		num_buckets = table->resize_policy.max_buckets;
+	}
+	if (num_buckets <= old_num_buckets) {
+		return;
+	}
+	if (table->rehash_buckets_per_op) {
+		ehht_rehash_start(table, num_buckets);
+	} else {
+		ehht_chained_buckets_resize(this, num_buckets);
+	}
+	if (table->num_buckets == old_num_buckets
+	    && table->resize_policy.trigger == EHHT_RESIZE_AUTO_TUNE) {
+		/* memory is short, so grow less eagerly */
+		table->probe_threshold *= 1.5;
+		table->probes_before_growth = 0.0;
+	}
+	table->window_lookups = table->stats.lookups;
+	table->window_visited = table->stats.visited;
+}
+
+/* the key must not already be present */
+static struct ehht_element_s *ehht_chained_insert(struct ehht_s *this,
+						  const char *key,
+						  size_t key_len,
+						  uint64_t hashcode,
+						  void *val)
+{
+	struct ehht_table_s *table;
+	struct ehht_element_s *element, **chain, **link;
+	uint16_t *fingerprint;
+	size_t num_buckets;
+
+	table = ehht_get_table(this);
+
+	num_buckets = ehht_chained_grow_to(table,
+					   *ehht_chain_for_hashcode(table,
+								    hashcode));
+	if (num_buckets) {
+		ehht_chained_grow(this, num_buckets);
+	}
+
+	element = ehht_alloc_element(table, key, key_len, hashcode, val);
+	if (!element) {
+		fprintf(stderr, "%s:%d: ehht_put failed\n", __FILE__, __LINE__);
+		/* should this exit? set errno? something other than stderr? */
+		return NULL;
+	}
+
+	chain = ehht_chain_for_hashcode(table, hashcode);
+	link = ehht_chain_link(table, chain, element);
+	fingerprint = ehht_fingerprint_for_hashcode(table, hashcode);
+	if (fingerprint) {
+		*fingerprint |= ehht_fingerprint(hashcode);
+	}
+
+	ehht_tree_after_insert(table, chain, link);
+	ehht_chained_check_chain(table, *chain);
+
+	return element;
+}
+
+static void *ehht_chained_put_hashed(struct ehht_s *this, const char *key,
+				     size_t key_len, uint64_t hashcode,
+				     void *val)
+{
+	struct ehht_table_s *table;
+	struct ehht_element_s *element;
+	void *old_val;
+
+	table = ehht_get_table(this);
+
+	element = ehht_find_element(table, key, key_len, hashcode);
+	if (element != NULL) {
+		old_val = element->val;
+		element->val = val;
+		return old_val;
+	}
+
+	ehht_chained_insert(this, key, key_len, hashcode, val);
+	return NULL;
+}
+
+static void **ehht_chained_entry_hashed(struct ehht_s *this, const char *key,
+					size_t key_len, uint64_t hashcode,
+					int *created)
+{
+	struct ehht_table_s *table;
+	struct ehht_element_s *element;
+
+	table = ehht_get_table(this);
+
+	element = ehht_find_element(table, key, key_len, hashcode);
+	if (element == NULL) {
+		element = ehht_chained_insert(this, key, key_len, hashcode,
+					      NULL);
+		if (element == NULL) {
+			return NULL;
+		}
+		if (created) {
+			*created = 1;
+		}
+	} else if (created) {
+		*created = 0;
+	}
+	return &(element->val);
+}
+
+static void *ehht_put(struct ehht_s *this, const char *key, size_t key_len,
+		      void *val)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_chained_put_hashed(this, key, key_len, hashcode, val);
+}
+
+static void *ehht_chained_remove_hashed(struct ehht_s *this, const char *key,
+					size_t key_len, uint64_t hashcode)
+{
+	struct ehht_table_s *table;
+	struct ehht_element_s *element, **chain;
+	struct ehht_element_s **ptr_to_element;
+	struct ehht_tree_s *tree;
+	uint16_t *fingerprint;
+	void *old_val;
+
+	table = ehht_get_table(this);
+
+	ehht_rehash_steps(table, table->rehash_buckets_per_op);
+	if (ehht_fingerprint_rejects(table, hashcode)) {
+		return NULL;
+	}
+	chain = ehht_chain_for_hashcode(table, hashcode);
+	tree = ehht_tree_for_chain(table, chain);
+	if (tree != NULL) {
+		++(table->stats.lookups);
+		element = ehht_tree_remove(table, chain, tree, key, key_len,
+					   hashcode);
+		if (element == NULL) {
+			return NULL;
+		}
+		++(table->stats.hits);
+	} else {
+		/* find what points to this element */
+		ptr_to_element = ehht_walk_chain(table, chain, key, key_len,
+						 hashcode);
+		if (ptr_to_element == NULL) {
+			return NULL;
+		}
+		element = *ptr_to_element;
+
+		/* make that point to the next element */
+		*ptr_to_element = element->next;
+	}
+	fingerprint = ehht_fingerprint_for_hashcode(table, hashcode);
+	if (fingerprint) {
+		*fingerprint = ehht_chain_fingerprint(*chain);
+	}
+
+	old_val = element->val;
+
+	--(table->size);
+	ehht_free_element(table, element);
+
+	/* the primes roughly double, so a third rounds up to the one before */
+	ehht_chained_auto_shrink(table, table->num_buckets /
+				 ((table->bucket_index ==
+				   EHHT_BUCKET_INDEX_PRIME) ? 3 : 2));
+
+	return old_val;
+}
+
+static void *ehht_remove(struct ehht_s *this, const char *key, size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_chained_remove_hashed(this, key, key_len, hashcode);
+}
+
+static int ehht_for_each(struct ehht_s *this,
+			 int (*func)(struct ehht_key_s each_key,
+				     void *each_val, void *context),
+			 void *context)
+{
+	struct ehht_table_s *table;
+	size_t i, end;
+	int was_iterating;
+	struct ehht_element_s *element;
+
+	table = ehht_get_table(this);
+
+	/* a get from the callback would move elements from the old buckets
+	 * into buckets which may have already been visited */
+	ehht_rehash_finish(table);
+
+	/* nor may a get move an element to the front of its chain */
+	was_iterating = table->iterating;
+	table->iterating = 1;
+
+	end = 0;
+	for (i = 0; i < table->num_buckets && !end; ++i) {
+		for (element = table->buckets[i]; element != NULL && !end;
+		     element = element->next) {
+			end = (*func) (element->key, element->val, context);
+		}
+	}
+
+	table->iterating = was_iterating;
+
+	return end;
+}
+
+static size_t ehht_size(struct ehht_s *this)
+{
+	struct ehht_table_s *table;
+
+	table = ehht_get_table(this);
+	return table->size;
+}
+
+struct ehht_str_buf_s {
+	char *buf;
+	size_t buf_len;
+	size_t buf_pos;
+};
+
+static int ehht_to_string_each(struct ehht_key_s key, void *each_val,
+			       void *context)
+{
+
+	struct ehht_str_buf_s *str_buf;
+	char *buf;
+	const char *fmt;
+	size_t bytes_to_write;
+	int bytes_written;
+
+	str_buf = (struct ehht_str_buf_s *)context;
+	buf = str_buf->buf + str_buf->buf_pos;
+
+	fmt = "'%s' => %p, ";
+	bytes_to_write = key.len + (__WORDSIZE / 4) + strlen(fmt);
+	if (str_buf->buf_len < (str_buf->buf_pos + bytes_to_write)) {
+		return -1;
+	}
+
+	bytes_written = sprintf(buf, fmt, key.len ? key.str : "", each_val);
+	if (bytes_written > 0) {
+		str_buf->buf_pos += ((unsigned int)bytes_written);
+	}
+
+	return 0;
+}
+
+size_t ehht_engine_to_string(struct ehht_s *this, char *buf, size_t buf_len)
+{
+	struct ehht_str_buf_s str_buf;
+	int bytes_written;
+
+	str_buf.buf = buf;
+	str_buf.buf_len = buf_len;
+	str_buf.buf_pos = 0;
+
+	bytes_written = sprintf(buf, "{ ");
+	if (bytes_written > 0) {
+		str_buf.buf_pos += ((unsigned int)bytes_written);
+	}
+	this->for_each(this, ehht_to_string_each, &str_buf);
+	bytes_written = sprintf(str_buf.buf + str_buf.buf_pos, "}");
+	if (bytes_written > 0) {
+		str_buf.buf_pos += ((unsigned int)bytes_written);
+	}
+	return str_buf.buf_pos;
+}
+
+static struct ehht_element_s **ehht_alloc_buckets(struct ehht_table_s *table,
+						  size_t num_buckets)
+{
+	struct ehht_element_s **buckets;
+	size_t i, size;
+
+	size = sizeof(struct ehht_element_s *) * num_buckets;
+	assert(size > 0);
+	buckets = table->engine.alloc(size, table->engine.mem_context);
+	if (buckets == NULL) {
+		Ehht_failed_malloc(size, "buckets");
+		return NULL;
+	}
+	for (i = 0; i < num_buckets; ++i) {
+		buckets[i] = NULL;
+	}
+	return buckets;
+}
+
+/* swaps in a bucket array twice the size, the old buckets are then moved
+ * a few at a time by ehht_rehash_steps */
+static void ehht_rehash_start(struct ehht_table_s *table, size_t num_buckets)
+{
+	struct ehht_element_s **new_buckets;
+	uint16_t *fingerprints;
+
+	ehht_rehash_finish(table);
+
+	num_buckets = ehht_index_num_buckets(table->bucket_index, num_buckets);
+	new_buckets = ehht_alloc_buckets(table, num_buckets);
+	if (new_buckets == NULL) {
+		return;
+	}
+	if (table->fingerprints) {
+		fingerprints = ehht_alloc_fingerprints(table, num_buckets);
+		if (fingerprints == NULL) {
+			table->engine.free(new_buckets,
+					   table->engine.mem_context);
+			return;
+		}
+		table->old_fingerprints = table->fingerprints;
+		table->fingerprints = fingerprints;
+	}
+	ehht_trees_drop(table);
+	table->old_buckets = table->buckets;
+	table->old_num_buckets = table->num_buckets;
+	table->old_index_magic = table->index_magic;
+	table->migrate_pos = 0;
+	table->buckets = new_buckets;
+	table->num_buckets = num_buckets;
+	table->index_magic = ehht_index_magic(table->bucket_index,
+					      num_buckets);
+}
+
+/* when doubling, (hashcode % 2n) is either (hashcode % n) or that plus n,
+ * thus each chain splits in two without needing a second bucket array;
+ * the same holds for a power of two mask, but not for the other indexes */
+static size_t ehht_buckets_double_in_place(struct ehht_table_s *table)
+{
+	struct ehht_element_s **buckets, **from, **to, *element;
+	uint16_t *fingerprints;
+	size_t i, old_num_buckets, num_buckets, size;
+
+	old_num_buckets = table->num_buckets;
+	if (old_num_buckets > (SIZE_MAX / 2 / sizeof(*buckets))) {
+		Ehht_failed_malloc(SIZE_MAX, "buckets");
+		return old_num_buckets;
+	}
+	num_buckets = 2 * old_num_buckets;
+	/* first, as a larger fingerprint array is harmless if the buckets
+	 * then fail to grow */
+	if (table->fingerprints) {
+		size = sizeof(uint16_t) * num_buckets;
+		fingerprints = table->engine.realloc(table->fingerprints, size,
+						     table->engine.mem_context);
+		if (fingerprints == NULL) {
+			Ehht_failed_malloc(size, "fingerprints");
+			return old_num_buckets;
+		}
+		table->fingerprints = fingerprints;
+	}
+	size = sizeof(*buckets) * num_buckets;
+	buckets = table->engine.realloc(table->buckets, size,
+					table->engine.mem_context);
+	if (buckets == NULL) {
+		Ehht_failed_malloc(size, "buckets");
+		return old_num_buckets;
+	}
+
+	for (i = 0; i < old_num_buckets; ++i) {
+		from = buckets + i;
+		to = buckets + old_num_buckets + i;
+		while ((element = *from) != NULL) {
+			if (ehht_bucket_for_hashcode(table,
+						     element->key.hashcode,
+						     num_buckets, 0) == i) {
+				from = &(element->next);
+			} else {
+				*from = element->next;
+				*to = element;
+				to = &(element->next);
+			}
+		}
+		*to = NULL;
+	}
+	table->buckets = buckets;
+	table->num_buckets = num_buckets;
+	ehht_fingerprints_rebuild(table);
+
+	return num_buckets;
+}
+
+static size_t ehht_buckets_move(struct ehht_table_s *table,
+				size_t num_buckets)
+{
+	size_t i, old_num_buckets, new_bucket_num;
+	struct ehht_element_s **new_buckets, **old_buckets;
+	uint16_t *fingerprints;
+	uint64_t magic;
+
+	if (num_buckets == 0) {
 		num_buckets = table->num_buckets * 2;
 	}
-	assert(num_buckets > 1);
+	num_buckets = ehht_index_num_buckets(table->bucket_index, num_buckets);
+	assert(num_buckets > 1);
+	if (table->engine.realloc && num_buckets == 2 * table->num_buckets
+	    && (table->bucket_index == EHHT_BUCKET_INDEX_MODULO
+		|| table->bucket_index == EHHT_BUCKET_INDEX_MASK)) {
+		return ehht_buckets_double_in_place(table);
+	}
+	magic = ehht_index_magic(table->bucket_index, num_buckets);
+	new_buckets = ehht_alloc_buckets(table, num_buckets);
+	if (new_buckets == NULL) {
+		return table->num_buckets;
+	}
+	fingerprints = NULL;
+	if (table->fingerprints) {
+		fingerprints = ehht_alloc_fingerprints(table, num_buckets);
+		if (fingerprints == NULL) {
+			table->engine.free(new_buckets,
+					   table->engine.mem_context);
+			return table->num_buckets;
+		}
+	}
+
+	old_num_buckets = table->num_buckets;
+	old_buckets = table->buckets;
+	for (i = 0; i < old_num_buckets; ++i) {
+		struct ehht_element_s *element;
+		while ((element = old_buckets[i]) != NULL) {
+			old_buckets[i] = element->next;
+			new_bucket_num =
+			    ehht_bucket_for_hashcode(table,
+						     element->key.hashcode,
+						     num_buckets, magic);
+			ehht_chain_link(table, new_buckets + new_bucket_num,
+					element);
+		}
+	}
+	table->buckets = new_buckets;
+	table->num_buckets = num_buckets;
+	table->index_magic = magic;
+	if (fingerprints) {
+		table->engine.free(table->fingerprints,
+				   table->engine.mem_context);
+		table->fingerprints = fingerprints;
+		ehht_fingerprints_rebuild(table);
+	}
+
+	table->engine.free(old_buckets, table->engine.mem_context);
+	return num_buckets;
+}
+
+static size_t ehht_chained_buckets_resize(struct ehht_s *this,
+					  size_t num_buckets)
+{
+	struct ehht_table_s *table;
+
+	table = ehht_get_table(this);
+
+	/* an explicit resize does not leave a migration half done */
+	ehht_rehash_finish(table);
+
+	ehht_trees_drop(table);
+
+	return ehht_buckets_move(table, num_buckets);
+}
+
+/* once the load falls below the low-water mark, shrinks toward num_buckets,
+ * but not below the number asked for at construction */
+static void ehht_chained_auto_shrink(struct ehht_table_s *table,
+				     size_t num_buckets)
+{
+	if (table->old_buckets
+	    || !ehht_engine_should_shrink(&table->engine, table->size,
+					  table->num_buckets,
+					  table->collision_load_factor)) {
+		return;
+	}
+	if (num_buckets < table->engine.min_buckets) {
+		num_buckets = table->engine.min_buckets;
+	}
+	num_buckets = ehht_index_num_buckets(table->bucket_index, num_buckets);
+	if (num_buckets > 1 && num_buckets < table->num_buckets) {
+		ehht_trees_drop(table);
+		ehht_buckets_move(table, num_buckets);
+	}
+}
+
+static size_t ehht_chained_buckets_size(struct ehht_s *this)
+{
+	struct ehht_table_s *table;
+
+	table = ehht_get_table(this);
+	return table->num_buckets;
+}
+
+struct ehht_keys_foreach_context_s {
+	struct ehht_s *ehht;
+	struct ehht_keys_s *keys;
+	size_t pos;
+};
+
+static int ehht_fill_keys_each(struct ehht_key_s key, void *each_val,
+			       void *context)
+{
+	struct ehht_keys_foreach_context_s *fe_ctx;
+	struct ehht_s *ehht;
+
+	fe_ctx = (struct ehht_keys_foreach_context_s *)context;
+	ehht = fe_ctx->ehht;
+
+	assert(each_val == ehht->get(ehht, key.str, key.len));
+	assert(fe_ctx->pos < fe_ctx->keys->len);
+
+	if (fe_ctx->pos >= fe_ctx->keys->len) {
+		return 1;
+	}
+
+	if (fe_ctx->keys->keys_copied) {
+		struct ehht_engine_s *engine;
+		size_t size;
+		char *key_copy;
+
+		engine = Ehht_engine(ehht);
+		size = sizeof(char *) * (key.len + 1);
+		assert(size > 0);
+		key_copy = engine->alloc(size, engine->mem_context);
+		if (!key_copy) {
+			Ehht_failed_malloc(size, "key copy");
+			return 1;
+		}
+		memcpy(key_copy, key.str, key.len + 1);
+		fe_ctx->keys->keys[fe_ctx->pos].str = key_copy;
+		fe_ctx->keys->keys[fe_ctx->pos].len = key.len;
+		fe_ctx->keys->keys[fe_ctx->pos].hashcode = key.hashcode;
+	} else {
+		fe_ctx->keys->keys[fe_ctx->pos] = key;
+	}
+
+	++fe_ctx->pos;
+
+	return 0;
+}
+
+static int ehht_chained_has_key_hashed(struct ehht_s *this, const char *key,
+				       size_t key_len, uint64_t hashcode)
+{
+	struct ehht_table_s *table;
+	struct ehht_element_s *element;
+
+	table = ehht_get_table(this);
+
+	element = ehht_find_element(table, key, key_len, hashcode);
+	return (element == NULL) ? 0 : 1;
+}
+
+static int ehht_has_key(struct ehht_s *this, const char *key, size_t key_len)
+{
+	uint64_t hashcode;
+
+	hashcode = Ehht_hash(Ehht_engine(this), key, key_len);
+	return ehht_chained_has_key_hashed(this, key, key_len, hashcode);
+}
+
+struct ehht_keys_s *ehht_engine_keys(struct ehht_s *this, int copy_keys)
+{
+	struct ehht_engine_s *engine;
+	struct ehht_keys_foreach_context_s fe_ctx;
+	size_t size;
+
+	engine = Ehht_engine(this);
+
+	fe_ctx.ehht = this;
+
+	size = sizeof(struct ehht_keys_s);
+	fe_ctx.keys = engine->alloc(size, engine->mem_context);
+	if (!fe_ctx.keys) {
+		Ehht_failed_malloc(size, "struct ehht_keys_s");
+		return NULL;
+	}
+	fe_ctx.pos = 0;
+	fe_ctx.keys->len = this->size(this);
+	fe_ctx.keys->keys_copied = copy_keys;
+
+	size = sizeof(struct ehht_key_s) * fe_ctx.keys->len;
+	if (size == 0) {
+		fe_ctx.keys->keys = NULL;
+	} else {
+		fe_ctx.keys->keys = engine->alloc(size, engine->mem_context);
+		if (!fe_ctx.keys->keys) {
+			Ehht_failed_malloc(size, "key list");
+			engine->free(fe_ctx.keys, engine->mem_context);
+			return NULL;
+		}
+
+		this->for_each(this, ehht_fill_keys_each, &fe_ctx);
+	}
+
+	return fe_ctx.keys;
+}
+
+void ehht_engine_free_keys(struct ehht_s *this, struct ehht_keys_s *keys)
+{
+	struct ehht_engine_s *engine;
+
+	engine = Ehht_engine(this);
+	if (keys->keys_copied) {
+		size_t i;
+		for (i = 0; i < keys->len; ++i) {
+			engine->free((void *)keys->keys[i].str,
+				     engine->mem_context);
+		}
+	}
+	if (keys->keys) {
+		engine->free(keys->keys, engine->mem_context);
+	}
+	engine->free(keys, engine->mem_context);
+}
+
+static void *ehht_malloc(size_t size, void *context)
+{
+	assert(context == NULL);
+	return malloc(size);
+}
+
+static void ehht_mem_free(void *ptr, void *context)
+{
+	assert(context == NULL);
+	free(ptr);
+}
+
+static void *ehht_realloc(void *ptr, size_t size, void *context)
+{
+	assert(context == NULL);
+	return realloc(ptr, size);
+}
+
+static void ehht_chained_buckets_auto_resize_load_factor(struct ehht_s *this,
+							 double factor)
+{
+	struct ehht_table_s *table;
+
+	table = ehht_get_table(this);
+	table->collision_load_factor = factor;
+}
+
+static void ehht_chained_free(struct ehht_s *this)
+{
+	struct ehht_table_s *table;
+	ehht_free_func free_func;
+	void *mem_context;
+
+	table = ehht_get_table(this);
+
+	ehht_clear_elements(table);
+
+	free_func = table->engine.free;
+	mem_context = table->engine.mem_context;
+
+	ehht_engine_release(&table->engine);
+	if (table->fingerprints) {
+		free_func(table->fingerprints, mem_context);
+	}
+	free_func(table->buckets, mem_context);
+	free_func(table, mem_context);
+	free_func(this, mem_context);
+}
+
+static void ehht_chained_stats_reset(struct ehht_s *this)
+{
+	struct ehht_table_s *table;
+
+	table = ehht_get_table(this);
+
+	table->stats.lookups = 0;
+	table->stats.hits = 0;
+	table->stats.visited = 0;
+	table->stats.early_misses = 0;
+	table->stats.moves_to_front = 0;
+	table->stats.fingerprint_misses = 0;
+	table->window_lookups = 0;
+	table->window_visited = 0;
+}
+
+static void ehht_chain_stats(struct ehht_element_s **buckets, size_t len,
+			     struct ehht_stats_s *stats)
+{
+	struct ehht_element_s *element;
+	size_t i, chain_len;
+
+	for (i = 0; i < len; ++i) {
+		chain_len = 0;
+		for (element = buckets[i]; element; element = element->next) {
+			++chain_len;
+		}
+		if (chain_len) {
+			++(stats->used_buckets);
+		}
+		if (chain_len > stats->longest_chain) {
+			stats->longest_chain = chain_len;
+		}
+	}
+}
+
+static void ehht_chained_stats(struct ehht_s *this, struct ehht_stats_s *stats)
+{
+	struct ehht_table_s *table;
+
+	table = ehht_get_table(this);
+
+	*stats = table->stats;
+	stats->size = table->size;
+	stats->num_buckets = table->num_buckets;
+	stats->used_buckets = 0;
+	stats->longest_chain = 0;
+	ehht_chain_stats(table->buckets, table->num_buckets, stats);
+	if (table->old_buckets) {
+		ehht_chain_stats(table->old_buckets + table->migrate_pos,
+				 table->old_num_buckets - table->migrate_pos,
+				 stats);
+	}
+}
+
+static size_t ehht_chained_reserve(struct ehht_s *this, size_t n_elements)
+{
+	struct ehht_table_s *table;
+	size_t num_buckets;
+	double factor;
+
+	table = ehht_get_table(this);
+
+	factor = table->collision_load_factor;
+	if (factor <= 0.0) {
+		factor = EHHT_DEFAULT_RESIZE_LOADFACTOR;
+	}
+	num_buckets = ehht_buckets_for_elements(n_elements, factor);
+	if (num_buckets > table->num_buckets) {
+		return ehht_chained_buckets_resize(this, num_buckets);
+	}
+	return table->num_buckets;
+}
+
+static size_t ehht_chained_shrink_to_fit(struct ehht_s *this)
+{
+	struct ehht_table_s *table;
+	size_t num_buckets;
+	double factor;
+
+	table = ehht_get_table(this);
+
+	factor = table->collision_load_factor;
+	if (factor <= 0.0) {
+		factor = EHHT_DEFAULT_RESIZE_LOADFACTOR;
+	}
+	num_buckets = ehht_buckets_for_elements(table->size, factor);
+	if (num_buckets < 2) {
+		num_buckets = 2;
+	}
+	num_buckets = ehht_index_num_buckets(table->bucket_index, num_buckets);
+	if (num_buckets < table->num_buckets) {
+		return ehht_chained_buckets_resize(this, num_buckets);
+	}
+	return table->num_buckets;
+}
+
+static void ehht_chained_resize_policy(struct ehht_s *this,
+				       const struct ehht_resize_policy_s
+				       *policy)
+{
+	struct ehht_table_s *table;
+	struct ehht_resize_policy_s *own;
+
+	table = ehht_get_table(this);
+
+	own = &table->resize_policy;
+	*own = *policy;
+	if (own->trigger == EHHT_RESIZE_CUSTOM && own->resize_func == NULL) {
+		own->trigger = EHHT_RESIZE_LOAD_FACTOR;
+	}
+	if (own->growth_factor <= 1.0) {
+		own->growth_factor = 2.0;
+	}
+	if (own->threshold <= 0.0) {
+		own->threshold = (own->trigger == EHHT_RESIZE_CHAIN_LENGTH)
+		    ? EHHT_DEFAULT_RESIZE_CHAIN_LEN
+		    : EHHT_DEFAULT_RESIZE_PROBES;
+	}
+	table->probe_threshold = own->threshold;
+	table->probes_before_growth = 0.0;
+	table->window_lookups = table->stats.lookups;
+	table->window_visited = table->stats.visited;
+}
+
+static const struct ehht_engine_ops_s ehht_chained_ops = {
+	ehht_chained_buckets_size,
+	ehht_chained_buckets_resize,
+	ehht_chained_buckets_auto_resize_load_factor,
+	ehht_chained_bucket_for_key,
+	ehht_chained_free,
+	ehht_chained_get_hashed,
+	ehht_chained_put_hashed,
+	ehht_chained_remove_hashed,
+	ehht_chained_has_key_hashed,
+	ehht_chained_entry_hashed,
+	ehht_chained_get_many,
+	ehht_chained_stats,
+	ehht_chained_stats_reset,
+	ehht_chained_reserve,
+	ehht_chained_shrink_to_fit,
+	ehht_chained_put_many,
+	ehht_chained_put_parallel,
+	ehht_chained_resize_policy,
+	NULL
+};
+
+static struct ehht_s *ehht_chained_new(const struct ehht_options_s *options)
+{
+	struct ehht_s *this;
+	struct ehht_table_s *table;
+	ehht_malloc_func mem_alloc;
+	ehht_free_func mem_free;
+	void *mem_context;
+	size_t i, num_buckets, size;
+
+	num_buckets = options->num_buckets;
+	mem_alloc = options->alloc_func;
+	mem_free = options->free_func;
+	mem_context = options->mem_context;
+
+	size = sizeof(struct ehht_s);
+	this = mem_alloc(size, mem_context);
+	if (this == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_s");
+		return NULL;
+	}
+	this->get = ehht_get;
+	this->put = ehht_put;
+	this->remove = ehht_remove;
+	this->size = ehht_size;
+	this->clear = ehht_clear;
+	this->for_each = ehht_for_each;
+	this->has_key = ehht_has_key;
+	this->keys = ehht_engine_keys;
+	this->free_keys = ehht_engine_free_keys;
+	this->to_string = ehht_engine_to_string;
+
+	size = sizeof(struct ehht_table_s);
+	table = mem_alloc(size, mem_context);
+	if (table == NULL) {
+		Ehht_failed_malloc(size, "struct ehht_table_s");
+		mem_free(this, mem_context);
+		return NULL;
+	}
+	ehht_set_table(this, table);
+
+	if (ehht_engine_init(&table->engine, &ehht_chained_ops, options)) {
+		mem_free(table, mem_context);
+		mem_free(this, mem_context);
+		return NULL;
+	}
+
+	table->collision_load_factor = EHHT_DEFAULT_RESIZE_LOADFACTOR;
+	if (options->load_factor > 0.0) {
+		table->collision_load_factor = options->load_factor;
+	}
+	if (options->expected_elements) {
+		size = ehht_buckets_for_elements(options->expected_elements,
+						 table->collision_load_factor);
+		if (size > num_buckets) {
+			num_buckets = size;
+		}
+	}
+	table->bucket_index = options->bucket_index;
+	num_buckets = ehht_index_num_buckets(table->bucket_index, num_buckets);
+	table->num_buckets = num_buckets;
+	table->index_magic = ehht_index_magic(table->bucket_index, num_buckets);
+	table->old_index_magic = 0;
 	size = sizeof(struct ehht_element_s *) * num_buckets;
-	assert(size > 0);
-	new_buckets = table->alloc(size, table->mem_context);
-	if (new_buckets == NULL) {
+	table->buckets = mem_alloc(size, mem_context);
+	if (table->buckets == NULL) {
 		Ehht_failed_malloc(size, "buckets");
-		return table->num_buckets;
+		ehht_engine_release(&table->engine);
+		mem_free(table, mem_context);
+		mem_free(this, mem_context);
+		return NULL;
 	}
 	for (i = 0; i < num_buckets; ++i) {
-		new_buckets[i] = NULL;
+		table->buckets[i] = NULL;
 	}
-
-	old_num_buckets = table->num_buckets;
-	old_buckets = table->buckets;
-	for (i = 0; i < old_num_buckets; ++i) {
-		struct ehht_element_s *element;
-		while ((element = old_buckets[i]) != NULL) {
-			old_buckets[i] = element->next;
-			new_bucket_num =
-			    ehht_bucket_for_hashcode(element->key.hashcode,
-						     num_buckets);
-			element->next = new_buckets[new_bucket_num];
-			new_buckets[new_bucket_num] = element;
+	table->fingerprints = NULL;
+	table->old_fingerprints = NULL;
+	if (options->bucket_fingerprints) {
+		table->fingerprints = ehht_alloc_fingerprints(table,
+							      num_buckets);
+		if (table->fingerprints == NULL) {
+			mem_free(table->buckets, mem_context);
+			ehht_engine_release(&table->engine);
+			mem_free(table, mem_context);
+			mem_free(this, mem_context);
+			return NULL;
 		}
 	}
-	table->buckets = new_buckets;
-	table->num_buckets = num_buckets;
+	table->size = 0;
+	table->old_buckets = NULL;
+	table->old_num_buckets = 0;
+	table->migrate_pos = 0;
+	table->rehash_buckets_per_op = options->rehash_buckets_per_op;
+	table->max_chain_len = options->max_chain_len;
+	if (table->max_chain_len == 0) {
+		table->max_chain_len = EHHT_DEFAULT_MAX_CHAIN_LEN;
+	}
+	table->reseed_size = 0;
+	table->trees = NULL;
+	table->chain_order = options->chain_order;
+	table->iterating = 0;
+	ehht_chained_stats_reset(this);
+	ehht_chained_resize_policy(this, &options->resize_policy);
 
-	table->free(old_buckets, table->mem_context);
-	return num_buckets;
+	return this;
 }
 
-size_t ehht_buckets_size(struct ehht_s *this)
+struct ehht_s *ehht_new(void)
 {
-	struct ehht_table_s *table;
+	return ehht_new_custom(0, NULL, NULL, NULL, NULL);
+}
 
-	table = ehht_get_table(this);
-	return table->num_buckets;
+struct ehht_s *ehht_new_custom(size_t num_buckets, ehht_hash_func hash_func,
+			       ehht_malloc_func mem_alloc,
+			       ehht_free_func mem_free, void *mem_context)
+{
+	struct ehht_options_s options;
+
+	ehht_options_init(&options);
+	options.num_buckets = num_buckets;
+	options.hash_func = hash_func;
+	options.alloc_func = mem_alloc;
+	options.free_func = mem_free;
+	options.mem_context = mem_context;
+
+	return ehht_new_options(&options);
 }
 
-struct ehht_keys_foreach_context_s {
-	struct ehht_s *ehht;
-	struct ehht_keys_s *keys;
-	size_t pos;
-};
+void ehht_options_init(struct ehht_options_s *options)
+{
+	options->engine = EHHT_ENGINE_CHAINED;
+	options->num_buckets = 0;
+	options->hash_func = NULL;
+	options->alloc_func = NULL;
+	options->free_func = NULL;
+	options->mem_context = NULL;
+	options->realloc_func = NULL;
+	options->slab_page_size = 0;
+	options->rehash_buckets_per_op = 0;
+	options->seeded_hash_func = NULL;
+	options->hash_seed.k0 = 0;
+	options->hash_seed.k1 = 0;
+	options->max_chain_len = 0;
+	options->chain_order = EHHT_CHAIN_ORDER_INSERTED;
+	options->bucket_fingerprints = 0;
+	options->bucket_index = EHHT_BUCKET_INDEX_MODULO;
+	options->load_factor = 0.0;
+	options->expected_elements = 0;
+	options->shrink_load_factor = 0.0;
+	options->resize_policy.trigger = EHHT_RESIZE_LOAD_FACTOR;
+	options->resize_policy.growth_factor = 0.0;
+	options->resize_policy.threshold = 0.0;
+	options->resize_policy.max_buckets = 0;
+	options->resize_policy.resize_func = NULL;
+	options->resize_policy.resize_context = NULL;
+	options->shards = 0;
+}
 
-static int ehht_fill_keys_each(struct ehht_key_s key, void *each_val,
-			       void *context)
+size_t ehht_buckets_for_elements(size_t n_elements, double load_factor)
 {
-	struct ehht_keys_foreach_context_s *fe_ctx;
-	struct ehht_s *ehht;
+	double buckets;
 
-	fe_ctx = (struct ehht_keys_foreach_context_s *)context;
-	ehht = fe_ctx->ehht;
+	buckets = (n_elements / load_factor) + 1.0;
+	if (buckets >= (double)SIZE_MAX) {
+		return SIZE_MAX;
+	}
+	return (size_t)buckets;
+}
 
-	assert(each_val == ehht->get(ehht, key.str, key.len));
-	assert(fe_ctx->pos < fe_ctx->keys->len);
+int ehht_engine_should_shrink(const struct ehht_engine_s *engine, size_t size,
+			      size_t num_buckets, double grow_load_factor)
+{
+	double low_water;
 
-	if (fe_ctx->pos >= fe_ctx->keys->len) {
-		return 1;
+	low_water = engine->shrink_load_factor;
+	if (grow_load_factor > 0.0 && low_water > (grow_load_factor / 4)) {
+		low_water = grow_load_factor / 4;
 	}
+	return low_water > 0.0 && num_buckets > engine->min_buckets
+	    && size < (num_buckets * low_water);
+}
 
-	if (fe_ctx->keys->keys_copied) {
-		struct ehht_table_s *table;
-		size_t size;
-		char *key_copy;
+int ehht_engine_init(struct ehht_engine_s *engine,
+		     const struct ehht_engine_ops_s *ops,
+		     const struct ehht_options_s *options)
+{
+	engine->ops = ops;
+	engine->hash_func = options->hash_func;
+	engine->seeded_hash_func = options->seeded_hash_func;
+	engine->seed = options->hash_seed;
+	if (engine->seeded_hash_func && engine->seed.k0 == 0
+	    && engine->seed.k1 == 0) {
+		ehht_hash_seed_next(&engine->seed);
+	}
+	engine->alloc = options->alloc_func;
+	engine->free = options->free_func;
+	engine->realloc = options->realloc_func;
+	engine->mem_context = options->mem_context;
+	engine->slab = NULL;
+	engine->shrink_load_factor = 0.0;
+	if (options->shrink_load_factor > 0.0) {
+		engine->shrink_load_factor = options->shrink_load_factor;
+	}
+	engine->min_buckets = options->num_buckets;
 
-		table = ehht_get_table(ehht);
-		size = sizeof(char *) * (key.len + 1);
-		assert(size > 0);
-		key_copy = table->alloc(size, table->mem_context);
-		if (!key_copy) {
-			Ehht_failed_malloc(size, "key copy");
+	if (options->slab_page_size) {
+		engine->slab = ehht_slab_new(options->slab_page_size,
+					     engine->alloc, engine->free,
+					     engine->mem_context);
+		if (engine->slab == NULL) {
 			return 1;
 		}
-		memcpy(key_copy, key.str, key.len + 1);
-		fe_ctx->keys->keys[fe_ctx->pos].str = key_copy;
-		fe_ctx->keys->keys[fe_ctx->pos].len = key.len;
-		fe_ctx->keys->keys[fe_ctx->pos].hashcode = key.hashcode;
+	}
+	return 0;
+}
+
+void ehht_engine_release(struct ehht_engine_s *engine)
+{
+	ehht_slab_destroy(engine->slab);
+	engine->slab = NULL;
+}
+
+void ehht_engine_hash_many(struct ehht_engine_s *engine, const char **keys,
+			   const size_t *key_lens, uint64_t *hashcodes,
+			   size_t n)
+{
+	size_t i;
+
+	if (engine->seeded_hash_func == NULL) {
+		ehht_hash_many(engine->hash_func, keys, key_lens, hashcodes, n);
+		return;
+	}
+	for (i = 0; i < n; ++i) {
+		hashcodes[i] = engine->seeded_hash_func(keys[i], key_lens[i],
+							&engine->seed);
+	}
+}
+
+void *ehht_engine_entry_alloc(struct ehht_engine_s *engine, size_t size)
+{
+	if (engine->slab) {
+		return ehht_slab_alloc(engine->slab, size);
+	}
+	return engine->alloc(size, engine->mem_context);
+}
+
+void ehht_engine_entry_free(struct ehht_engine_s *engine, void *ptr)
+{
+	if (engine->slab) {
+		ehht_slab_free(engine->slab, ptr);
 	} else {
-		fe_ctx->keys->keys[fe_ctx->pos] = key;
+		engine->free(ptr, engine->mem_context);
 	}
+}
 
-	++fe_ctx->pos;
+struct ehht_s *ehht_new_options(const struct ehht_options_s *options)
+{
+	struct ehht_options_s opts;
 
-	return 0;
+	if (options == NULL) {
+		ehht_options_init(&opts);
+	} else {
+		opts = *options;
+	}
+
+	if (opts.num_buckets == 0) {
+		opts.num_buckets = EHHT_DEFAULT_BUCKETS;
+	}
+	if (opts.hash_func == NULL) {
+		opts.hash_func = ehht_wyhash_hashcode;
+	}
+	/* pick the hardware or software kernel once, as the table is built */
+	opts.hash_func = ehht_hash_resolve(opts.hash_func);
+	/* realloc must pair with the allocator, so only default it along
+	 * with the allocator */
+	if (opts.realloc_func == NULL && opts.alloc_func == NULL
+	    && opts.free_func == NULL) {
+		opts.realloc_func = ehht_realloc;
+	}
+	if (opts.alloc_func == NULL) {
+		opts.alloc_func = ehht_malloc;
+	}
+	if (opts.free_func == NULL) {
+		opts.free_func = ehht_mem_free;
+	}
+
+	if (opts.shards > 1 && opts.engine != EHHT_ENGINE_CONCURRENT
+	    && opts.engine != EHHT_ENGINE_SPLIT_ORDERED) {
+		return ehht_sharded_new(&opts);
+	}
+
+	switch (opts.engine) {
+	case EHHT_ENGINE_CHAINED:
+		return ehht_chained_new(&opts);
+	case EHHT_ENGINE_ROBIN_HOOD:
+		return ehht_robin_hood_new(&opts);
+	case EHHT_ENGINE_SWISS:
+		return ehht_swiss_new(&opts);
+	case EHHT_ENGINE_CONCURRENT:
+		return ehht_concurrent_new(&opts);
+	case EHHT_ENGINE_SPLIT_ORDERED:
+		return ehht_split_ordered_new(&opts);
+	}
+
+	if (EHHT_DEBUG) {
+		fprintf(stderr, "%s:%d: unknown engine %d\n", __FILE__,
+			__LINE__, (int)opts.engine);
+	}
+	return NULL;
 }
 
-static int ehht_has_key(struct ehht_s *this, const char *key, size_t key_len)
+void ehht_free(struct ehht_s *this)
 {
-	struct ehht_table_s *table;
-	struct ehht_element_s *element;
+	if (this == NULL) {
+		return;
+	}
 
-	table = ehht_get_table(this);
+	Ehht_engine(this)->ops->free(this);
+}
 
-	element = ehht_get_element(table, key, key_len);
-	return (element == NULL) ? 0 : 1;
+size_t ehht_buckets_size(struct ehht_s *this)
+{
+	return Ehht_engine(this)->ops->buckets_size(this);
 }
 
-static struct ehht_keys_s *ehht_keys(struct ehht_s *this, int copy_keys)
+size_t ehht_buckets_resize(struct ehht_s *this, size_t num_buckets)
 {
-	struct ehht_table_s *table;
-	struct ehht_keys_foreach_context_s fe_ctx;
-	size_t size;
+	return Ehht_engine(this)->ops->buckets_resize(this, num_buckets);
+}
 
-	table = ehht_get_table(this);
+void ehht_buckets_auto_resize_load_factor(struct ehht_s *this, double factor)
+{
+	Ehht_engine(this)->ops->buckets_auto_resize_load_factor(this, factor);
+}
 
-	fe_ctx.ehht = this;
+void ehht_buckets_auto_shrink_load_factor(struct ehht_s *this, double factor)
+{
+	const struct ehht_engine_ops_s *ops;
 
-	size = sizeof(struct ehht_keys_s);
-	fe_ctx.keys = table->alloc(size, table->mem_context);
-	if (!fe_ctx.keys) {
-		Ehht_failed_malloc(size, "struct ehht_keys_s");
-		return NULL;
+	ops = Ehht_engine(this)->ops;
+	Ehht_engine(this)->shrink_load_factor = (factor > 0.0) ? factor : 0.0;
+	if (ops->buckets_auto_shrink_load_factor) {
+		ops->buckets_auto_shrink_load_factor(this, factor);
 	}
-	fe_ctx.pos = 0;
-	fe_ctx.keys->len = this->size(this);
-	fe_ctx.keys->keys_copied = copy_keys;
+}
 
-	size = sizeof(struct ehht_key_s) * fe_ctx.keys->len;
-	if (size == 0) {
-		fe_ctx.keys->keys = NULL;
-	} else {
-		fe_ctx.keys->keys = table->alloc(size, table->mem_context);
-		if (!fe_ctx.keys->keys) {
-			Ehht_failed_malloc(size, "key list");
-			table->free(fe_ctx.keys, table->mem_context);
-			return NULL;
-		}
+void ehht_buckets_resize_policy(struct ehht_s *this,
+				const struct ehht_resize_policy_s *policy)
+{
+	const struct ehht_engine_ops_s *ops;
 
-		ehht_for_each(this, ehht_fill_keys_each, &fe_ctx);
+	ops = Ehht_engine(this)->ops;
+	if (ops->resize_policy) {
+		ops->resize_policy(this, policy);
 	}
+}
 
-	return fe_ctx.keys;
+size_t ehht_bucket_for_key(struct ehht_s *this, const char *key, size_t key_len)
+{
+	return Ehht_engine(this)->ops->bucket_for_key(this, key, key_len);
 }
 
-static void ehht_free_keys(struct ehht_s *this, struct ehht_keys_s *keys)
+uint64_t ehht_hashcode(struct ehht_s *this, const char *key, size_t key_len)
 {
-	struct ehht_table_s *table;
+	return Ehht_hash(Ehht_engine(this), key, key_len);
+}
 
-	table = ehht_get_table(this);
-	if (keys->keys_copied) {
-		size_t i;
-		for (i = 0; i < keys->len; ++i) {
-			table->free((void *)keys->keys[i].str,
-				    table->mem_context);
-		}
+void *ehht_get_hashed(struct ehht_s *this, const char *key, size_t key_len,
+		      uint64_t hashcode)
+{
+	const struct ehht_engine_ops_s *ops;
+
+	ops = Ehht_engine(this)->ops;
+	if (ops->get_hashed == NULL) {
+		return this->get(this, key, key_len);
 	}
-	if (keys->keys) {
-		table->free(keys->keys, table->mem_context);
+	return ops->get_hashed(this, key, key_len, hashcode);
+}
+
+void *ehht_put_hashed(struct ehht_s *this, const char *key, size_t key_len,
+		      uint64_t hashcode, void *val)
+{
+	const struct ehht_engine_ops_s *ops;
+
+	ops = Ehht_engine(this)->ops;
+	if (ops->put_hashed == NULL) {
+		return this->put(this, key, key_len, val);
 	}
-	table->free(keys, table->mem_context);
+	return ops->put_hashed(this, key, key_len, hashcode, val);
 }
 
-static void *ehht_malloc(size_t size, void *context)
+void *ehht_remove_hashed(struct ehht_s *this, const char *key, size_t key_len,
+			 uint64_t hashcode)
 {
-	assert(context == NULL);
-	return malloc(size);
+	const struct ehht_engine_ops_s *ops;
+
+	ops = Ehht_engine(this)->ops;
+	if (ops->remove_hashed == NULL) {
+		return this->remove(this, key, key_len);
+	}
+	return ops->remove_hashed(this, key, key_len, hashcode);
 }
 
-static void ehht_mem_free(void *ptr, void *context)
+int ehht_has_key_hashed(struct ehht_s *this, const char *key, size_t key_len,
+			uint64_t hashcode)
 {
-	assert(context == NULL);
-	free(ptr);
+	const struct ehht_engine_ops_s *ops;
+
+	ops = Ehht_engine(this)->ops;
+	if (ops->has_key_hashed == NULL) {
+		return this->has_key(this, key, key_len);
+	}
+	return ops->has_key_hashed(this, key, key_len, hashcode);
 }
 
-void ehht_buckets_auto_resize_load_factor(struct ehht_s *this, double factor)
+void **ehht_entry(struct ehht_s *this, const char *key, size_t key_len,
+		  int *created)
 {
-	struct ehht_table_s *table;
+	struct ehht_engine_s *engine;
 
-	table = ehht_get_table(this);
-	table->collision_load_factor = factor;
+	engine = Ehht_engine(this);
+	return engine->ops->entry_hashed(this, key, key_len,
+					 Ehht_hash(engine, key, key_len),
+					 created);
 }
 
-struct ehht_s *ehht_new(void)
+void **ehht_entry_hashed(struct ehht_s *this, const char *key, size_t key_len,
+			 uint64_t hashcode, int *created)
 {
-	return ehht_new_custom(0, NULL, NULL, NULL, NULL);
+	return Ehht_engine(this)->ops->entry_hashed(this, key, key_len,
+						    hashcode, created);
 }
 
-struct ehht_s *ehht_new_custom(size_t num_buckets, ehht_hash_func hash_func,
-			       ehht_malloc_func mem_alloc,
-			       ehht_free_func mem_free, void *mem_context)
+void ehht_get_many(struct ehht_s *this, const char **keys,
+		   const size_t *key_lens, void **vals, size_t n)
 {
-	struct ehht_s *this;
-	struct ehht_table_s *table;
-	size_t i, size;
+	const struct ehht_engine_ops_s *ops;
+	size_t i;
 
-	if (num_buckets == 0) {
-		num_buckets = EHHT_DEFAULT_BUCKETS;
+	ops = Ehht_engine(this)->ops;
+	if (ops->get_many == NULL) {
+		for (i = 0; i < n; ++i) {
+			vals[i] = this->get(this, keys[i], key_lens[i]);
+		}
+		return;
 	}
-	if (hash_func == NULL) {
-		hash_func = ehht_kr2_hashcode;
+	ops->get_many(this, keys, key_lens, vals, n);
+}
+
+size_t ehht_put_many(struct ehht_s *this, const char **keys,
+		     const size_t *key_lens, void **vals, size_t n)
+{
+	const struct ehht_engine_ops_s *ops;
+	uint64_t hashcodes[EHHT_GET_MANY_GROUP];
+	size_t i, group, size;
+
+	ops = Ehht_engine(this)->ops;
+	size = this->size(this);
+
+	/* at most n keys are new: grow once, up front */
+	if (n < (SIZE_MAX - size)) {
+		ops->reserve(this, size + n);
 	}
-	if (mem_alloc == NULL) {
-		mem_alloc = ehht_malloc;
+
+	if (ops->put_many) {
+		ops->put_many(this, keys, key_lens, vals, n);
+		return this->size(this) - size;
 	}
-	if (mem_free == NULL) {
-		mem_free = ehht_mem_free;
+
+	for (; n; n -= group, keys += group, key_lens += group, vals += group) {
+		group = (n < EHHT_GET_MANY_GROUP) ? n : EHHT_GET_MANY_GROUP;
+		ehht_engine_hash_many(Ehht_engine(this), keys, key_lens,
+				      hashcodes, group);
+		for (i = 0; i < group; ++i) {
+			ehht_put_hashed(this, keys[i], key_lens[i],
+					hashcodes[i], vals[i]);
+		}
 	}
+	return this->size(this) - size;
+}
 
-	size = sizeof(struct ehht_s);
-	this = mem_alloc(size, mem_context);
+struct ehht_s *ehht_build_parallel(const struct ehht_options_s *options,
+				   const char **keys, const size_t *key_lens,
+				   void **vals, size_t n, size_t num_threads)
+{
+	const struct ehht_engine_ops_s *ops;
+	struct ehht_options_s opts;
+	struct ehht_s *this;
+
+	if (options == NULL) {
+		ehht_options_init(&opts);
+	} else {
+		opts = *options;
+	}
+	if (opts.expected_elements < n) {
+		opts.expected_elements = n;
+	}
+	this = ehht_new_options(&opts);
 	if (this == NULL) {
-		Ehht_failed_malloc(size, "struct ehht_s");
 		return NULL;
 	}
-	this->get = ehht_get;
-	this->put = ehht_put;
-	this->remove = ehht_remove;
-	this->size = ehht_size;
-	this->clear = ehht_clear;
-	this->for_each = ehht_for_each;
-	this->has_key = ehht_has_key;
-	this->keys = ehht_keys;
-	this->free_keys = ehht_free_keys;
-	this->to_string = ehht_to_string;
 
-	size = sizeof(struct ehht_table_s);
-	table = mem_alloc(size, mem_context);
-	if (table == NULL) {
-		Ehht_failed_malloc(size, "struct ehht_table_s");
-		mem_free(this, mem_context);
-		return NULL;
+	if (num_threads == 0) {
+		num_threads = ehht_threads_online();
 	}
-	ehht_set_table(this, table);
-
-	table->num_buckets = num_buckets;
-	size = sizeof(struct ehht_element_s *) * num_buckets;
-	table->buckets = mem_alloc(size, mem_context);
-	if (table->buckets == NULL) {
-		Ehht_failed_malloc(size, "buckets");
-		mem_free(table, mem_context);
-		mem_free(this, mem_context);
-		return NULL;
+	if (num_threads > (n / EHHT_BUILD_MIN_PER_THREAD)) {
+		num_threads = n / EHHT_BUILD_MIN_PER_THREAD;
 	}
-	for (i = 0; i < num_buckets; ++i) {
-		table->buckets[i] = NULL;
+	if (num_threads > EHHT_MAX_THREADS) {
+		num_threads = EHHT_MAX_THREADS;
 	}
-	table->size = 0;
-	table->collision_load_factor = EHHT_DEFAULT_RESIZE_LOADFACTOR;
-
-	table->hash_func = hash_func;
-	table->alloc = mem_alloc;
-	table->free = mem_free;
-	table->mem_context = mem_context;
 
+	ops = Ehht_engine(this)->ops;
+	/* the slab pages are not shared between threads */
+	if (num_threads > 1 && ops->put_parallel
+	    && Ehht_engine(this)->slab == NULL) {
+		ops->put_parallel(this, keys, key_lens, vals, n, num_threads);
+	} else {
+		ehht_put_many(this, keys, key_lens, vals, n);
+	}
 	return this;
 }
 
-void ehht_free(struct ehht_s *this)
+void ehht_stats(struct ehht_s *this, struct ehht_stats_s *stats)
 {
-	struct ehht_table_s *table;
-	ehht_free_func free_func;
-	void *mem_context;
-
-	if (this == NULL) {
+	const struct ehht_engine_ops_s *ops;
+
+	ops = Ehht_engine(this)->ops;
+	if (ops->stats == NULL) {
+		stats->size = this->size(this);
+		stats->num_buckets = ops->buckets_size(this);
+		stats->used_buckets = 0;
+		stats->longest_chain = 0;
+		stats->lookups = 0;
+		stats->hits = 0;
+		stats->visited = 0;
+		stats->early_misses = 0;
+		stats->moves_to_front = 0;
+		stats->fingerprint_misses = 0;
 		return;
 	}
+	ops->stats(this, stats);
+}
 
-	table = ehht_get_table(this);
+void ehht_stats_reset(struct ehht_s *this)
+{
+	const struct ehht_engine_ops_s *ops;
 
-	this->clear(this);
+	ops = Ehht_engine(this)->ops;
+	if (ops->stats_reset != NULL) {
+		ops->stats_reset(this);
+	}
+}
 
-	free_func = table->free;
-	mem_context = table->mem_context;
+size_t ehht_reserve(struct ehht_s *this, size_t n_elements)
+{
+	return Ehht_engine(this)->ops->reserve(this, n_elements);
+}
 
-	free_func(table->buckets, mem_context);
-	free_func(table, mem_context);
-	free_func(this, mem_context);
+size_t ehht_shrink_to_fit(struct ehht_s *this)
+{
+	return Ehht_engine(this)->ops->shrink_to_fit(this);
 }
@@ -17,11 +17,12 @@
 #endif
 
 #include <stddef.h>		/* size_t */
+#include <stdint.h>		/* uint64_t */
 
 struct ehht_key_s {
 	const char *str;
 	size_t len;
-	unsigned hashcode;
+	uint64_t hashcode;
 };
 
 struct ehht_keys_s {
@@ -81,9 +82,33 @@ Ehht_begin_C_functions
 struct ehht_s *ehht_new(void);
 
 /* allocator aware constructor */
-typedef unsigned int (*ehht_hash_func)(const char *data, size_t data_len);
+typedef uint64_t (*ehht_hash_func)(const char *data, size_t data_len);
 typedef void *(*ehht_malloc_func)(size_t size, void *context);
 typedef void (*ehht_free_func)(void *ptr, void *context);
+typedef void *(*ehht_realloc_func)(void *ptr, size_t size, void *context);
+
+/* hash functions which may be passed as a hash_func */
+/* the default: 64 bits, reading the key eight bytes at a time */
+uint64_t ehht_wyhash_hashcode(const char *data, size_t data_len);
+/* these produce 32 bits, widened */
+uint64_t ehht_kr2_hashcode(const char *data, size_t data_len);
+uint64_t ehht_murmur3_hashcode(const char *data, size_t data_len);
+/* these use SSE4.2 crc32 or AES-NI instructions if available, else
+ * software, with identical results on every machine */
+uint64_t ehht_crc32c_hashcode(const char *data, size_t data_len);
+uint64_t ehht_aes_hashcode(const char *data, size_t data_len);
+
+/* a keyed hash: the table owns the seed, and may change it */
+struct ehht_hash_seed_s {
+	uint64_t k0;
+	uint64_t k1;
+};
+typedef uint64_t (*ehht_seeded_hash_func)(const char *data, size_t data_len,
+					  const struct ehht_hash_seed_s *seed);
+
+/* SipHash-2-4, by Jean-Philippe Aumasson and Daniel J. Bernstein */
+uint64_t ehht_siphash_hashcode(const char *data, size_t data_len,
+			       const struct ehht_hash_seed_s *seed);
 
 /* if hash_func is NULL, a hashing function will be provided */
 /* if ehht_malloc_func/free_func are NULL, malloc/free will be used */
@@ -92,8 +117,253 @@ struct ehht_s *ehht_new_custom(size_t num_buckets,
 			       ehht_malloc_func alloc_func,
 			       ehht_free_func free_func, void *mem_context);
 
+/* storage engines which may sit behind the struct ehht_s interface */
+enum ehht_engine {
+	/* separately allocated elements in per-bucket linked lists */
+	EHHT_ENGINE_CHAINED = 0,
+	/* open addressing, Robin Hood displacement, backward-shift delete */
+	EHHT_ENGINE_ROBIN_HOOD,
+	/* open addressing, with SIMD probing of 7-bit hash control bytes */
+	EHHT_ENGINE_SWISS,
+	/* chains which get and has_key read without locks, from any number
+	 * of threads, while one thread at a time writes */
+	EHHT_ENGINE_CONCURRENT,
+	/* one lock-free list in bit-reversed hashcode order, which many
+	 * threads may read and write at once; growth moves no elements */
+	EHHT_ENGINE_SPLIT_ORDERED
+};
+
+/* chained engine only: the order of the elements within each chain */
+enum ehht_chain_order {
+	/* the newest element first */
+	EHHT_CHAIN_ORDER_INSERTED = 0,
+	/* each element found by a lookup moves to the front of its chain,
+	 * which suits tables where a few keys are looked up most often */
+	EHHT_CHAIN_ORDER_MOVE_TO_FRONT,
+	/* ascending hashcode, so that a miss stops at the first greater
+	 * hashcode rather than at the end of the chain */
+	EHHT_CHAIN_ORDER_SORTED
+};
+
+/* chained engine only: how a hashcode selects one of the buckets */
+enum ehht_bucket_index {
+	/* hashcode % num_buckets */
+	EHHT_BUCKET_INDEX_MODULO = 0,
+	/* the bucket count is rounded up to a power of two, and the mixed
+	 * hashcode is masked */
+	EHHT_BUCKET_INDEX_MASK,
+	/* Lemire's fastrange: the hashcode, folded to 32 bits, times the
+	 * bucket count, shifted right by 32 */
+	EHHT_BUCKET_INDEX_FASTRANGE,
+	/* the bucket count is rounded up to a prime, and the remainder of
+	 * the folded hashcode is found with a precomputed reciprocal */
+	EHHT_BUCKET_INDEX_PRIME
+};
+
+/* chained engine only: what causes the table to grow */
+enum ehht_resize_trigger {
+	/* a put collides while the load is over the load factor */
+	EHHT_RESIZE_LOAD_FACTOR = 0,
+	/* a put would make a chain longer than the threshold */
+	EHHT_RESIZE_CHAIN_LENGTH,
+	/* the mean number of elements visited per lookup is over the
+	 * threshold */
+	EHHT_RESIZE_PROBE_COUNT,
+	/* as EHHT_RESIZE_PROBE_COUNT, but the threshold is raised when
+	 * growing did not shorten the probes or memory ran short, and
+	 * lowered again while the probes stay short */
+	EHHT_RESIZE_AUTO_TUNE,
+	/* the resize_func decides */
+	EHHT_RESIZE_CUSTOM
+};
+
+/* what the table knows when a put is about to add an element */
+struct ehht_resize_info_s {
+	size_t size;
+	size_t num_buckets;
+	/* the length of the chain which the new element will join */
+	size_t chain_len;
+	/* lookups, and elements visited by them, since the last growth */
+	unsigned long lookups;
+	unsigned long visited;
+};
+
+/* returns the number of buckets to grow to, or zero to leave the table */
+typedef size_t (*ehht_resize_func)(const struct ehht_resize_info_s *info,
+				   void *context);
+
+struct ehht_resize_policy_s {
+	enum ehht_resize_trigger trigger;
+	/* the bucket count is multiplied by this when growing; if not
+	 * above 1.0, the bucket count doubles */
+	double growth_factor;
+	/* the chain length or the mean probe count which causes growth;
+	 * if zero, a default is used */
+	double threshold;
+	/* if non-zero, the table does not grow past this many buckets */
+	size_t max_buckets;
+	/* EHHT_RESIZE_CUSTOM only */
+	ehht_resize_func resize_func;
+	void *resize_context;
+};
+
+struct ehht_options_s {
+	enum ehht_engine engine;
+	size_t num_buckets;
+	ehht_hash_func hash_func;
+	ehht_malloc_func alloc_func;
+	ehht_free_func free_func;
+	void *mem_context;
+	/* if provided, the chained engine grows its bucket array in place
+	 * when doubling; defaults to realloc only if alloc_func and
+	 * free_func are also defaulted */
+	ehht_realloc_func realloc_func;
+	/* if non-zero, entries are carved from pages of this many bytes
+	 * owned by the table, rather than individually allocated */
+	size_t slab_page_size;
+	/* chained engine only: if non-zero, growing moves this many of the
+	 * old buckets on each get, put, or remove, rather than all at once */
+	size_t rehash_buckets_per_op;
+	/* if provided, used rather than hash_func; if hash_seed is all
+	 * zero, a seed is generated */
+	ehht_seeded_hash_func seeded_hash_func;
+	struct ehht_hash_seed_s hash_seed;
+	/* chained engine with a seeded_hash_func only: a chain longer than
+	 * this, if not explained by the load, causes a new seed to be
+	 * chosen and every key rehashed; if zero, a default is used */
+	size_t max_chain_len;
+	/* chained engine only */
+	enum ehht_chain_order chain_order;
+	/* chained engine only: if non-zero, a 16 bit summary of the
+	 * hashcodes in each chain is kept in a dense array beside the
+	 * buckets, thus most misses load neither the bucket nor an element */
+	int bucket_fingerprints;
+	/* chained engine only; resizes round the bucket count to suit */
+	enum ehht_bucket_index bucket_index;
+	/* if non-zero, the load factor at which the table grows, as with
+	 * ehht_buckets_auto_resize_load_factor */
+	double load_factor;
+	/* if non-zero, enough buckets are allocated to hold this many
+	 * elements at the load factor, should num_buckets be fewer */
+	size_t expected_elements;
+	/* if non-zero, the table shrinks as its load falls below this, as
+	 * with ehht_buckets_auto_shrink_load_factor */
+	double shrink_load_factor;
+	/* chained engine only: when and by how much the table grows, as
+	 * with ehht_buckets_resize_policy; all zero is the classic rule */
+	struct ehht_resize_policy_s resize_policy;
+	/* if over one, the table is split into this many (rounded up to a
+	 * power of two) tables of the engine, the shards, each with its own
+	 * lock; thus the table may be used by many threads at once; ignored
+	 * by EHHT_ENGINE_CONCURRENT and EHHT_ENGINE_SPLIT_ORDERED, which
+	 * need no shards */
+	size_t shards;
+};
+
+/* sets all options to their defaults (zero/NULL) */
+void ehht_options_init(struct ehht_options_s *options);
+
+/* if options is NULL, the defaults will be used */
+/* zero or NULL members are replaced with defaults as in ehht_new_custom */
+struct ehht_s *ehht_new_options(const struct ehht_options_s *options);
+
 /* destructor */
 void ehht_free(struct ehht_s *table);
+
+/* grows the table, if needed, such that n_elements fit without growing
+ * again; returns the number of buckets, as ehht_buckets_size */
+size_t ehht_reserve(struct ehht_s *table, size_t n_elements);
+
+/* shrinks the table to the fewest buckets which hold the current elements
+ * at the load factor; returns the number of buckets */
+size_t ehht_shrink_to_fit(struct ehht_s *table);
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* statistics */
+/*****************************************************************************/
+struct ehht_stats_s {
+	size_t size;
+	size_t num_buckets;
+	/* the chained engine also reports the following, else zero */
+	size_t used_buckets;
+	size_t longest_chain;
+	/* counted since construction or the last ehht_stats_reset:
+	 * lookups by get, put, remove, has_key, entry, and get_many */
+	unsigned long lookups;
+	unsigned long hits;
+	/* elements whose hashcode was compared by a lookup */
+	unsigned long visited;
+	/* misses which stopped before the end of a sorted chain */
+	unsigned long early_misses;
+	/* hits which moved the element to the front of its chain */
+	unsigned long moves_to_front;
+	/* misses decided by the bucket fingerprints alone */
+	unsigned long fingerprint_misses;
+};
+
+void ehht_stats(struct ehht_s *table, struct ehht_stats_s *stats);
+void ehht_stats_reset(struct ehht_s *table);
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* precomputed hashcode variants of the methods */
+/*****************************************************************************/
+/* returns the hashcode as computed by the table's hash_func
+ * with a seeded_hash_func, hashcodes are only valid until the table
+ * chooses a new seed */
+uint64_t ehht_hashcode(struct ehht_s *table, const char *key, size_t key_len);
+
+/* the hashcode must be as returned by ehht_hashcode for this key, or the
+ * "hashcode" of a struct ehht_key_s from a table with the same hash_func */
+void *ehht_get_hashed(struct ehht_s *table, const char *key, size_t key_len,
+		      uint64_t hashcode);
+void *ehht_put_hashed(struct ehht_s *table, const char *key, size_t key_len,
+		      uint64_t hashcode, void *val);
+void *ehht_remove_hashed(struct ehht_s *table, const char *key, size_t key_len,
+			 uint64_t hashcode);
+int ehht_has_key_hashed(struct ehht_s *table, const char *key, size_t key_len,
+			uint64_t hashcode);
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* get-or-insert in a single lookup */
+/*****************************************************************************/
+/* returns a pointer to the value slot for the key, inserting the key with
+ * a NULL value if it was not present, or NULL if insertion failed
+ * if "created" is not NULL, it is set to 1 if the key was inserted, else 0
+ * the slot remains valid until the next put, remove, clear, resize,
+ * or entry call on the table */
+void **ehht_entry(struct ehht_s *table, const char *key, size_t key_len,
+		  int *created);
+void **ehht_entry_hashed(struct ehht_s *table, const char *key,
+			 size_t key_len, uint64_t hashcode, int *created);
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* batched lookup, insertion, and construction */
+/*****************************************************************************/
+/* sets vals[i] to the value of keys[i] (or NULL), for i in [0, n)
+ * the lookups are interleaved, overlapping their memory latency */
+void ehht_get_many(struct ehht_s *table, const char **keys,
+		   const size_t *key_lens, void **vals, size_t n);
+
+/* puts keys[i] with vals[i], for i in [0, n), as if by put in that order,
+ * but each key is hashed once, the table is grown at most once up front,
+ * and the chained engine inserts in bucket order; returns the number of
+ * keys which were not already present */
+size_t ehht_put_many(struct ehht_s *table, const char **keys,
+		     const size_t *key_lens, void **vals, size_t n);
+
+/* returns a new table, as from ehht_new_options, holding keys[i] with
+ * vals[i], for i in [0, n), as if by ehht_put_many; the chained engine
+ * hashes the keys and links the chains with num_threads threads (if zero,
+ * one per CPU), thus the alloc_func and free_func must be thread safe;
+ * other engines, or a slab_page_size, put from the calling thread only
+ * returns NULL if the table could not be allocated */
+struct ehht_s *ehht_build_parallel(const struct ehht_options_s *options,
+				   const char **keys, const size_t *key_lens,
+				   void **vals, size_t n, size_t num_threads);
 /*****************************************************************************/
 
 /*****************************************************************************/
@@ -103,6 +373,9 @@ void ehht_free(struct ehht_s *table);
 size_t ehht_buckets_size(struct ehht_s *table);
 size_t ehht_buckets_resize(struct ehht_s *table, size_t num_buckets);
 void ehht_buckets_auto_resize_load_factor(struct ehht_s *table, double factor);
+void ehht_buckets_auto_shrink_load_factor(struct ehht_s *table, double factor);
+void ehht_buckets_resize_policy(struct ehht_s *table,
+				const struct ehht_resize_policy_s *policy);
 size_t ehht_bucket_for_key(struct ehht_s *table, const char *key,
 			   size_t key_len);
 /*****************************************************************************/
@@ -71,6 +71,40 @@ void test_free(void *ptr, void *context)
 	free(tracking_buffer);
 }
 
+/* counted as neither an alloc nor a free, only the bytes are adjusted */
+void *test_realloc(void *ptr, size_t size, void *context)
+{
+	struct tracking_mem_context *ctx;
+	unsigned char *tracking_buffer;
+	size_t old_size, used;
+
+	if (ptr == NULL) {
+		return test_malloc(size, context);
+	}
+	ctx = (struct tracking_mem_context *)context;
+	tracking_buffer = ((unsigned char *)ptr) - sizeof(size_t);
+	memcpy(&old_size, tracking_buffer, sizeof(size_t));
+	tracking_buffer = realloc(tracking_buffer, sizeof(size_t) + size);
+	if (!tracking_buffer) {
+		++ctx->fails;
+		return NULL;
+	}
+	memcpy(tracking_buffer, &size, sizeof(size_t));
+	ctx->free_bytes += old_size;
+	ctx->alloc_bytes += size;
+	used = ctx->alloc_bytes - ctx->free_bytes;
+	if (used > ctx->max_used) {
+		ctx->max_used = used;
+	}
+	return (void *)(tracking_buffer + sizeof(size_t));
+}
+
+/* this fake hashcode function allows easy testing of hash collisions */
+uint64_t ehht_first_char_bogus_hashcode(const char *data, size_t len)
+{
+	return (data && len) ? (uint64_t)(data[0]) : 0;
+}
+
 #define TEST_EHHT_MAIN(func) \
 int main(void) \
 { \
@@ -0,0 +1,154 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_bucket_index.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+#define TEST_KEYS 2000
+static char vals[TEST_KEYS];
+
+/* the bucket each index should choose, computed the slow way */
+size_t test_expected_bucket(enum ehht_bucket_index bucket_index,
+			    uint64_t hashcode, size_t num_buckets)
+{
+	uint32_t folded;
+
+	folded = ((uint32_t)(hashcode >> 32)) ^ ((uint32_t)hashcode);
+	switch (bucket_index) {
+	case EHHT_BUCKET_INDEX_FASTRANGE:
+		return (size_t)((((uint64_t)folded) * num_buckets) >> 32);
+	case EHHT_BUCKET_INDEX_PRIME:
+		return (size_t)(folded % num_buckets);
+	case EHHT_BUCKET_INDEX_MODULO:
+	case EHHT_BUCKET_INDEX_MASK:
+		break;
+	}
+	return (size_t)(hashcode % num_buckets);
+}
+
+int test_ehht_bucket_index_options(struct ehht_options_s *opts,
+				   size_t initial, size_t resized)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_stats_s stats;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	char buf[20];
+	size_t i, x, buckets, bucket;
+	uint64_t hashcode;
+
+	opts->num_buckets = 100;
+	opts->alloc_func = test_malloc;
+	opts->free_func = test_free;
+	opts->mem_context = &ctx;
+
+	table = ehht_new_options(opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+	failures += check_size_t(ehht_buckets_size(table), initial);
+
+	for (i = 0; i < 50; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		hashcode = ehht_hashcode(table, buf, strlen(buf));
+		bucket = ehht_bucket_for_key(table, buf, strlen(buf));
+		failures += check_int_m(bucket < initial, 1, buf);
+		if (opts->bucket_index != EHHT_BUCKET_INDEX_MASK) {
+			failures +=
+			    check_size_t_m(bucket,
+					   test_expected_bucket
+					   (opts->bucket_index, hashcode,
+					    initial), buf);
+		}
+	}
+
+	x = TEST_KEYS;
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->put(table, buf, strlen(buf), vals + i);
+	}
+	buckets = ehht_buckets_size(table);
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_ptr_m(table->get(table, buf, strlen(buf)),
+					vals + i, buf);
+		failures +=
+		    check_int_m(ehht_bucket_for_key(table, buf, strlen(buf))
+				< buckets, 1, buf);
+	}
+
+	/* a fair spread: no chain far beyond the load */
+	ehht_stats(table, &stats);
+	failures += check_int(stats.longest_chain < 16, 1);
+
+	buckets = ehht_buckets_resize(table, 1000);
+	failures += check_size_t(buckets, resized);
+	failures += check_size_t(ehht_buckets_size(table), resized);
+	for (i = 0; i < x; i += 2) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_ptr_m(table->remove(table, buf, strlen(buf)),
+					vals + i, buf);
+	}
+	buckets = ehht_buckets_resize(table, 0);
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_int_m(table->has_key(table, buf, strlen(buf)),
+					(i % 2) ? 1 : 0, buf);
+	}
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+	failures +=
+	    check_unsigned_int_m(ctx.free_bytes, ctx.alloc_bytes, "bytes");
+
+	return failures;
+}
+
+int test_ehht_bucket_index_each(enum ehht_bucket_index bucket_index,
+				size_t initial, size_t resized)
+{
+	int failures = 0;
+	struct ehht_options_s opts;
+
+	ehht_options_init(&opts);
+	opts.bucket_index = bucket_index;
+	failures += test_ehht_bucket_index_options(&opts, initial, resized);
+
+	opts.realloc_func = test_realloc;
+	failures += test_ehht_bucket_index_options(&opts, initial, resized);
+
+	ehht_options_init(&opts);
+	opts.bucket_index = bucket_index;
+	opts.rehash_buckets_per_op = 1;
+	opts.bucket_fingerprints = 1;
+	failures += test_ehht_bucket_index_options(&opts, initial, resized);
+
+	/* a 32 bit hash leaves the high half of the hashcode zero */
+	ehht_options_init(&opts);
+	opts.bucket_index = bucket_index;
+	opts.hash_func = ehht_murmur3_hashcode;
+	failures += test_ehht_bucket_index_options(&opts, initial, resized);
+
+	return failures;
+}
+
+int test_ehht_bucket_index(void)
+{
+	int failures = 0;
+
+	failures +=
+	    test_ehht_bucket_index_each(EHHT_BUCKET_INDEX_MODULO, 100, 1000);
+	failures +=
+	    test_ehht_bucket_index_each(EHHT_BUCKET_INDEX_MASK, 128, 1024);
+	failures +=
+	    test_ehht_bucket_index_each(EHHT_BUCKET_INDEX_FASTRANGE, 100,
+					1000);
+	failures +=
+	    test_ehht_bucket_index_each(EHHT_BUCKET_INDEX_PRIME, 193, 1543);
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_bucket_index())
@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_build_parallel.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+#define TEST_KEYS 20000
+/* the batch repeats the first TEST_REPEATS keys at its end */
+#define TEST_REPEATS 500
+#define TEST_BATCH (TEST_KEYS + TEST_REPEATS)
+
+static char vals[TEST_BATCH];
+static char bufs[TEST_KEYS][24];
+static const char *keys[TEST_BATCH];
+static size_t lens[TEST_BATCH];
+static void *batch_vals[TEST_BATCH];
+
+void test_ehht_build_parallel_init(void)
+{
+	size_t i;
+
+	for (i = 0; i < TEST_KEYS; ++i) {
+		sprintf(bufs[i], "_%lu_", (unsigned long)i);
+	}
+	for (i = 0; i < TEST_BATCH; ++i) {
+		keys[i] = bufs[i % TEST_KEYS];
+		lens[i] = strlen(keys[i]);
+		batch_vals[i] = vals + i;
+	}
+}
+
+/* a repeated key ends with the value of its last put */
+void *test_ehht_expected_val(size_t i)
+{
+	if (i < TEST_REPEATS) {
+		return vals + TEST_KEYS + i;
+	}
+	return vals + i;
+}
+
+int test_ehht_build_check(struct ehht_s *table, size_t n)
+{
+	int failures = 0;
+	size_t i;
+
+	failures += check_size_t(table->size(table), n);
+	for (i = 0; i < n; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					(n == TEST_KEYS)
+					? test_ehht_expected_val(i) : vals + i,
+					keys[i]);
+	}
+	return failures;
+}
+
+int test_ehht_build_parallel_options(struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	size_t i, t, buckets;
+	size_t threads[5] = { 0, 1, 2, 3, 8 };
+
+	for (t = 0; t < 5; ++t) {
+		table = ehht_build_parallel(opts, keys, lens, batch_vals,
+					    TEST_BATCH, threads[t]);
+		if (table == NULL) {
+			return ++failures;
+		}
+		failures += test_ehht_build_check(table, TEST_KEYS);
+
+		/* sized once, up front */
+		buckets = ehht_buckets_size(table);
+		failures += check_size_t(ehht_reserve(table, TEST_KEYS),
+					 buckets);
+
+		/* the result is an ordinary table */
+		for (i = 0; i < TEST_KEYS; i += 2) {
+			failures +=
+			    check_ptr_m(table->remove(table, keys[i], lens[i]),
+					test_ehht_expected_val(i), keys[i]);
+		}
+		failures += check_size_t(table->size(table), TEST_KEYS / 2);
+		for (i = 0; i < TEST_KEYS; ++i) {
+			table->put(table, keys[i], lens[i], vals + i);
+		}
+		ehht_buckets_resize(table, 2 * ehht_buckets_size(table));
+		for (i = 0; i < TEST_KEYS; ++i) {
+			failures +=
+			    check_ptr_m(table->get(table, keys[i], lens[i]),
+					vals + i, keys[i]);
+		}
+		ehht_free(table);
+	}
+
+	/* too few keys to be worth a thread */
+	table = ehht_build_parallel(opts, keys, lens, batch_vals, 100, 8);
+	if (table == NULL) {
+		return ++failures;
+	}
+	failures += test_ehht_build_check(table, 100);
+	ehht_free(table);
+
+	return failures;
+}
+
+/* about one hundred hashcodes, thus long chains */
+uint64_t test_two_digit_hashcode(const char *data, size_t data_len)
+{
+	return (data_len > 2) ? (uint64_t)(data[1] + (256 * data[2])) : 0;
+}
+
+/* long chains are indexed, as if put one at a time */
+int test_ehht_build_parallel_long_chains(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	size_t i, n;
+
+	n = 4000;
+	ehht_options_init(&opts);
+	opts.hash_func = test_two_digit_hashcode;
+	table = ehht_build_parallel(&opts, keys, lens, batch_vals, n, 4);
+	if (table == NULL) {
+		return ++failures;
+	}
+	failures += test_ehht_build_check(table, n);
+	for (i = 0; i < n; i += 3) {
+		failures += check_ptr_m(table->remove(table, keys[i], lens[i]),
+					vals + i, keys[i]);
+	}
+	for (i = 0; i < n; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					(i % 3) ? vals + i : NULL, keys[i]);
+	}
+	ehht_free(table);
+
+	return failures;
+}
+
+int test_ehht_build_parallel(void)
+{
+	int failures = 0;
+	struct ehht_options_s opts;
+
+	test_ehht_build_parallel_init();
+
+	failures += test_ehht_build_parallel_options(NULL);
+
+	ehht_options_init(&opts);
+	opts.bucket_fingerprints = 1;
+	opts.chain_order = EHHT_CHAIN_ORDER_SORTED;
+	failures += test_ehht_build_parallel_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.bucket_index = EHHT_BUCKET_INDEX_PRIME;
+	opts.rehash_buckets_per_op = 1;
+	failures += test_ehht_build_parallel_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.bucket_index = EHHT_BUCKET_INDEX_MASK;
+	opts.hash_func = ehht_murmur3_hashcode;
+	failures += test_ehht_build_parallel_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.seeded_hash_func = ehht_siphash_hashcode;
+	failures += test_ehht_build_parallel_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.slab_page_size = 4096;
+	failures += test_ehht_build_parallel_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.engine = EHHT_ENGINE_ROBIN_HOOD;
+	failures += test_ehht_build_parallel_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.engine = EHHT_ENGINE_SWISS;
+	failures += test_ehht_build_parallel_options(&opts);
+
+	failures += test_ehht_build_parallel_long_chains();
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_build_parallel())
@@ -0,0 +1,327 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_chain_order.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+#define TEST_KEYS 20
+static char vals[TEST_KEYS];
+static char bufs[TEST_KEYS][20];
+
+/* a single bucket, without growth, so every key shares one chain */
+struct ehht_s *test_ehht_one_chain(enum ehht_chain_order order)
+{
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	size_t i;
+
+	ehht_options_init(&opts);
+	opts.num_buckets = 1;
+	opts.chain_order = order;
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return NULL;
+	}
+	ehht_buckets_auto_resize_load_factor(table, 0.0);
+
+	for (i = 0; i < TEST_KEYS; ++i) {
+		sprintf(bufs[i], "_%lu_", (unsigned long)i);
+		table->put(table, bufs[i], strlen(bufs[i]), vals + i);
+	}
+	ehht_stats_reset(table);
+	return table;
+}
+
+int test_ehht_chain_order_move_to_front(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_stats_s stats;
+	size_t i;
+
+	/* the first key put is at the end of the chain */
+	table = test_ehht_one_chain(EHHT_CHAIN_ORDER_MOVE_TO_FRONT);
+	if (table == NULL) {
+		return ++failures;
+	}
+	for (i = 0; i < 100; ++i) {
+		failures += check_ptr(table->get(table, bufs[0], 3), vals);
+	}
+	ehht_stats(table, &stats);
+	failures += check_unsigned_long(stats.lookups, 100);
+	failures += check_unsigned_long(stats.hits, 100);
+	failures += check_unsigned_long(stats.moves_to_front, 1);
+	failures += check_unsigned_long(stats.visited, TEST_KEYS + 99);
+	failures += check_unsigned_long(stats.early_misses, 0);
+
+	/* the rest of the chain is intact */
+	for (i = 0; i < TEST_KEYS; ++i) {
+		failures += check_ptr_m(table->get(table, bufs[i],
+						   strlen(bufs[i])),
+					vals + i, bufs[i]);
+	}
+	failures += check_ptr(table->remove(table, bufs[5], 3), vals + 5);
+	failures += check_ptr(table->get(table, bufs[5], 3), NULL);
+	failures += check_size_t(table->size(table), TEST_KEYS - 1);
+	ehht_free(table);
+
+	/* without moving, every lookup walks the whole chain */
+	table = test_ehht_one_chain(EHHT_CHAIN_ORDER_INSERTED);
+	if (table == NULL) {
+		return ++failures;
+	}
+	for (i = 0; i < 100; ++i) {
+		failures += check_ptr(table->get(table, bufs[0], 3), vals);
+	}
+	ehht_stats(table, &stats);
+	failures += check_unsigned_long(stats.moves_to_front, 0);
+	failures += check_unsigned_long(stats.visited, 100 * TEST_KEYS);
+	ehht_free(table);
+
+	return failures;
+}
+
+struct test_get_each_context_s {
+	struct ehht_s *table;
+	size_t count;
+	size_t found;
+};
+
+static int test_get_each(struct ehht_key_s each_key, void *each_val,
+			 void *context)
+{
+	struct test_get_each_context_s *ctx;
+
+	ctx = (struct test_get_each_context_s *)context;
+	if (++(ctx->count) > TEST_KEYS) {
+		return 1;
+	}
+	if (ctx->table->get(ctx->table, each_key.str, each_key.len)
+	    == each_val) {
+		++(ctx->found);
+	}
+	return 0;
+}
+
+/* a get from a for_each function must not reorder the chain being walked */
+int test_ehht_chain_order_move_to_front_for_each(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_stats_s stats;
+	struct ehht_keys_s *keys;
+	struct test_get_each_context_s ctx;
+
+	table = test_ehht_one_chain(EHHT_CHAIN_ORDER_MOVE_TO_FRONT);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	ctx.table = table;
+	ctx.count = 0;
+	ctx.found = 0;
+	failures += check_int(table->for_each(table, test_get_each, &ctx), 0);
+	failures += check_size_t(ctx.count, TEST_KEYS);
+	failures += check_size_t(ctx.found, TEST_KEYS);
+	ehht_stats(table, &stats);
+	failures += check_unsigned_long(stats.moves_to_front, 0);
+
+	/* keys uses get, as a check, from within for_each */
+	keys = table->keys(table, 0);
+	failures += check_size_t(keys->len, TEST_KEYS);
+	table->free_keys(table, keys);
+
+	/* and after, a lookup moves again */
+	failures += check_ptr(table->get(table, bufs[0], 3), vals);
+	ehht_stats(table, &stats);
+	failures += check_unsigned_long(stats.moves_to_front, 1);
+
+	ehht_free(table);
+
+	return failures;
+}
+
+int test_ehht_chain_order_sorted(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_stats_s stats;
+	struct ehht_keys_s *keys;
+	size_t i, misses;
+	char buf[20];
+
+	table = test_ehht_one_chain(EHHT_CHAIN_ORDER_SORTED);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	/* the one chain is iterated in hashcode order */
+	keys = table->keys(table, 0);
+	failures += check_size_t(keys->len, TEST_KEYS);
+	for (i = 1; i < keys->len; ++i) {
+		failures += check_int(keys->keys[i - 1].hashcode
+				      <= keys->keys[i].hashcode, 1);
+	}
+	table->free_keys(table, keys);
+
+	for (i = 0; i < TEST_KEYS; ++i) {
+		failures += check_ptr_m(table->get(table, bufs[i],
+						   strlen(bufs[i])),
+					vals + i, bufs[i]);
+	}
+
+	/* a miss stops early unless its hashcode is greater than all */
+	ehht_stats_reset(table);
+	misses = 0;
+	for (i = TEST_KEYS; i < (10 * TEST_KEYS); ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_ptr_m(table->get(table, buf, strlen(buf)),
+					NULL, buf);
+		++misses;
+	}
+	ehht_stats(table, &stats);
+	failures += check_unsigned_long(stats.lookups, misses);
+	failures += check_unsigned_long(stats.hits, 0);
+	failures += check_int(stats.early_misses > (misses / 2), 1);
+	failures += check_int(stats.visited < (misses * TEST_KEYS), 1);
+
+	/* removes from anywhere in the chain keep it sorted */
+	for (i = 0; i < TEST_KEYS; i += 3) {
+		failures += check_ptr_m(table->remove(table, bufs[i],
+						      strlen(bufs[i])),
+					vals + i, bufs[i]);
+	}
+	for (i = 0; i < TEST_KEYS; ++i) {
+		failures += check_ptr_m(table->get(table, bufs[i],
+						   strlen(bufs[i])),
+					(i % 3) ? vals + i : NULL, bufs[i]);
+	}
+	ehht_free(table);
+
+	return failures;
+}
+
+/* every order finds every key, through resizes and incremental rehash */
+int test_ehht_chain_order_options(struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	char buf[20];
+	size_t i, x;
+
+	table = ehht_new_options(opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	x = 500;
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->put(table, buf, strlen(buf), vals + (i % TEST_KEYS));
+		if ((i % 7) == 0) {
+			sprintf(buf, "_%lu_", (unsigned long)(i / 2));
+			failures +=
+			    check_ptr_m(table->get(table, buf, strlen(buf)),
+					vals + ((i / 2) % TEST_KEYS), buf);
+		}
+	}
+	ehht_buckets_resize(table, 97);
+	for (i = 0; i < x; i += 2) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_ptr_m(table->remove(table, buf, strlen(buf)),
+					vals + (i % TEST_KEYS), buf);
+	}
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_int_m(table->has_key(table, buf, strlen(buf)),
+					(i % 2) ? 1 : 0, buf);
+	}
+	failures += check_size_t(table->size(table), x / 2);
+
+	ehht_free(table);
+
+	return failures;
+}
+
+int test_ehht_chain_order_stats(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	struct ehht_stats_s stats;
+
+	table = test_ehht_one_chain(EHHT_CHAIN_ORDER_INSERTED);
+	if (table == NULL) {
+		return ++failures;
+	}
+	table->get(table, "_1_", 3);
+	ehht_stats(table, &stats);
+	failures += check_size_t(stats.size, TEST_KEYS);
+	failures += check_size_t(stats.num_buckets, 1);
+	failures += check_size_t(stats.used_buckets, 1);
+	failures += check_size_t(stats.longest_chain, TEST_KEYS);
+	failures += check_unsigned_long(stats.lookups, 1);
+	ehht_stats_reset(table);
+	ehht_stats(table, &stats);
+	failures += check_unsigned_long(stats.lookups, 0);
+	failures += check_unsigned_long(stats.visited, 0);
+	failures += check_size_t(stats.size, TEST_KEYS);
+	ehht_free(table);
+
+	/* other engines report only the size */
+	ehht_options_init(&opts);
+	opts.engine = EHHT_ENGINE_ROBIN_HOOD;
+	opts.num_buckets = 64;
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+	table->put(table, "foo", 3, vals);
+	table->get(table, "foo", 3);
+	ehht_stats_reset(table);
+	ehht_stats(table, &stats);
+	failures += check_size_t(stats.size, 1);
+	failures += check_size_t(stats.num_buckets, 64);
+	failures += check_unsigned_long(stats.lookups, 0);
+	ehht_free(table);
+
+	return failures;
+}
+
+int test_ehht_chain_order(void)
+{
+	int failures = 0;
+	struct ehht_options_s opts;
+	enum ehht_chain_order orders[3] = {
+		EHHT_CHAIN_ORDER_INSERTED,
+		EHHT_CHAIN_ORDER_MOVE_TO_FRONT,
+		EHHT_CHAIN_ORDER_SORTED
+	};
+	size_t i;
+
+	failures += test_ehht_chain_order_move_to_front();
+	failures += test_ehht_chain_order_move_to_front_for_each();
+	failures += test_ehht_chain_order_sorted();
+	failures += test_ehht_chain_order_stats();
+
+	for (i = 0; i < 3; ++i) {
+		ehht_options_init(&opts);
+		opts.chain_order = orders[i];
+		failures += test_ehht_chain_order_options(&opts);
+
+		opts.num_buckets = 4;
+		opts.rehash_buckets_per_op = 1;
+		failures += test_ehht_chain_order_options(&opts);
+
+		ehht_options_init(&opts);
+		opts.chain_order = orders[i];
+		opts.hash_func = ehht_kr2_hashcode;
+		opts.seeded_hash_func = ehht_siphash_hashcode;
+		failures += test_ehht_chain_order_options(&opts);
+	}
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_chain_order())
@@ -14,16 +14,20 @@ int test_ehht_clear()
 	size_t i, count, items_written;
 	size_t report[REPORT_LEN];
 	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	unsigned allocs;
 
 	table =
 	    ehht_new_custom(num_buckets, NULL, test_malloc, test_free, &ctx);
 
+	allocs = ctx.allocs;
 	table->put(table, "g", 1, "wiz");
 	table->put(table, "foo", 3, "bar");
 	table->put(table, "whiz", 4, "bang");
 	table->put(table, "love", 4, "backend development");
 
 	failures += check_unsigned_int_m(table->size(table), 4, "ehht_size");
+	failures += check_unsigned_int_m(ctx.allocs - allocs, 4,
+					 "one allocation per element");
 
 	items_written = ehht_distribution_report(table, report, REPORT_LEN);
 	count = 0;
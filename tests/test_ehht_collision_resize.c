@@ -5,12 +5,6 @@
 
 #include "test-ehht.h"
 
-/* this fake hashcode function allows easy testing of hash collisions */
-unsigned int ehht_first_char_bogus_hashcode(const char *data, size_t len)
-{
-	return (data && len) ? (unsigned int)(data[0]) : 0;
-}
-
 int test_ehht_collision_resize_buckets(void)
 {
 	int failures = 0;
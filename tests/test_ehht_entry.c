@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_entry.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+static unsigned hash_calls = 0;
+
+uint64_t ehht_counting_hashcode(const char *data, size_t len)
+{
+	++hash_calls;
+	return ehht_kr2_hashcode(data, len);
+}
+
+int test_ehht_entry_engine(enum ehht_engine engine)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	const char *words[] = { "the", "cat", "and", "the", "hat", "and",
+		"the", "bat"
+	};
+	size_t counts[8];
+	size_t i, x, distinct;
+	void **slot;
+	int created;
+
+	ehht_options_init(&opts);
+	opts.engine = engine;
+	opts.num_buckets = 4;
+	opts.hash_func = ehht_counting_hashcode;
+	opts.alloc_func = test_malloc;
+	opts.free_func = test_free;
+	opts.mem_context = &ctx;
+
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	x = sizeof(words) / sizeof(words[0]);
+	distinct = 0;
+	hash_calls = 0;
+	for (i = 0; i < x; ++i) {
+		created = -1;
+		slot = ehht_entry(table, words[i], strlen(words[i]), &created);
+		if (slot == NULL) {
+			return ++failures;
+		}
+		if (created) {
+			failures += check_ptr_m(*slot, NULL, words[i]);
+			counts[distinct] = 0;
+			*slot = counts + distinct;
+			++distinct;
+		}
+		++(*((size_t *)*slot));
+	}
+	failures += check_unsigned_int(hash_calls, x);
+	failures += check_size_t(distinct, 5);
+	failures += check_size_t(table->size(table), distinct);
+
+	failures +=
+	    check_size_t(*((size_t *)table->get(table, "the", 3)), 3);
+	failures +=
+	    check_size_t(*((size_t *)table->get(table, "and", 3)), 2);
+	failures +=
+	    check_size_t(*((size_t *)table->get(table, "bat", 3)), 1);
+
+	/* an existing key is found, not replaced */
+	slot = ehht_entry(table, "cat", 3, &created);
+	failures += check_int(created, 0);
+	failures += check_ptr(*slot, counts + 1);
+	*slot = "dog";
+	failures += check_str(table->get(table, "cat", 3), "dog");
+
+	/* created may be NULL */
+	slot = ehht_entry(table, "cow", 3, NULL);
+	failures += check_ptr(*slot, NULL);
+	*slot = "moo";
+
+	hash_calls = 0;
+	slot = ehht_entry_hashed(table, "cow", 3,
+				 ehht_kr2_hashcode("cow", 3), &created);
+	failures += check_unsigned_int(hash_calls, 0);
+	failures += check_int(created, 0);
+	failures += check_str(*slot, "moo");
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+	failures +=
+	    check_unsigned_int_m(ctx.free_bytes, ctx.alloc_bytes, "bytes");
+
+	return failures;
+}
+
+int test_ehht_entry(void)
+{
+	int failures = 0;
+
+	failures += test_ehht_entry_engine(EHHT_ENGINE_CHAINED);
+	failures += test_ehht_entry_engine(EHHT_ENGINE_ROBIN_HOOD);
+	failures += test_ehht_entry_engine(EHHT_ENGINE_SWISS);
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_entry())
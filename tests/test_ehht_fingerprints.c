@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_fingerprints.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+#define TEST_KEYS 1000
+static char vals[TEST_KEYS];
+static char bufs[2 * TEST_KEYS][20];
+
+int test_ehht_fingerprints_options(struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_stats_s stats;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	const char *keys[2 * TEST_KEYS];
+	size_t lens[2 * TEST_KEYS];
+	void *found[2 * TEST_KEYS];
+	size_t i, x;
+
+	opts->bucket_fingerprints = 1;
+	opts->alloc_func = test_malloc;
+	opts->free_func = test_free;
+	opts->mem_context = &ctx;
+
+	table = ehht_new_options(opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	x = TEST_KEYS;
+	for (i = 0; i < (2 * x); ++i) {
+		sprintf(bufs[i], "_%lu_", (unsigned long)i);
+		keys[i] = bufs[i];
+		lens[i] = strlen(bufs[i]);
+	}
+	for (i = 0; i < x; ++i) {
+		table->put(table, keys[i], lens[i], vals + i);
+	}
+
+	/* no present key is ever rejected */
+	ehht_stats_reset(table);
+	for (i = 0; i < x; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					vals + i, keys[i]);
+	}
+	ehht_stats(table, &stats);
+	failures += check_unsigned_long(stats.fingerprint_misses, 0);
+	failures += check_unsigned_long(stats.hits, x);
+
+	/* most missing keys are */
+	ehht_stats_reset(table);
+	for (i = x; i < (2 * x); ++i) {
+		failures += check_int_m(table->has_key(table, keys[i], lens[i]),
+					0, keys[i]);
+	}
+	ehht_stats(table, &stats);
+	failures += check_unsigned_long(stats.lookups, x);
+	failures += check_int(stats.fingerprint_misses > (x / 2), 1);
+
+	ehht_get_many(table, keys, lens, found, 2 * x);
+	for (i = 0; i < (2 * x); ++i) {
+		failures += check_ptr_m(found[i], (i < x) ? vals + i : NULL,
+					keys[i]);
+	}
+
+	/* a removal clears the bits of the removed key only */
+	for (i = 0; i < x; i += 2) {
+		failures += check_ptr_m(table->remove(table, keys[i], lens[i]),
+					vals + i, keys[i]);
+		failures += check_ptr_m(table->remove(table, keys[i], lens[i]),
+					NULL, keys[i]);
+	}
+	ehht_buckets_resize(table, 301);
+	for (i = 0; i < x; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					(i % 2) ? vals + i : NULL, keys[i]);
+	}
+	ehht_buckets_resize(table, 0);
+	for (i = 0; i < x; ++i) {
+		failures += check_int_m(table->has_key(table, keys[i], lens[i]),
+					(i % 2) ? 1 : 0, keys[i]);
+	}
+
+	table->clear(table);
+	failures += check_ptr(table->get(table, keys[1], lens[1]), NULL);
+	table->put(table, keys[1], lens[1], vals + 1);
+	failures += check_ptr(table->get(table, keys[1], lens[1]), vals + 1);
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+	failures +=
+	    check_unsigned_int_m(ctx.free_bytes, ctx.alloc_bytes, "bytes");
+
+	return failures;
+}
+
+int test_ehht_fingerprints(void)
+{
+	int failures = 0;
+	struct ehht_options_s opts;
+
+	ehht_options_init(&opts);
+	failures += test_ehht_fingerprints_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.realloc_func = test_realloc;
+	failures += test_ehht_fingerprints_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.num_buckets = 4;
+	opts.rehash_buckets_per_op = 1;
+	failures += test_ehht_fingerprints_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.chain_order = EHHT_CHAIN_ORDER_SORTED;
+	failures += test_ehht_fingerprints_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.chain_order = EHHT_CHAIN_ORDER_MOVE_TO_FRONT;
+	opts.seeded_hash_func = ehht_siphash_hashcode;
+	failures += test_ehht_fingerprints_options(&opts);
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_fingerprints())
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_get_many.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+#define TEST_KEYS 100
+static char vals[TEST_KEYS];
+static char bufs[2 * TEST_KEYS][20];
+
+int test_ehht_get_many_options(struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	const char *keys[2 * TEST_KEYS];
+	size_t lens[2 * TEST_KEYS];
+	void *found[2 * TEST_KEYS];
+	size_t i, x;
+
+	table = ehht_new_options(opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	x = TEST_KEYS;
+	for (i = 0; i < (2 * x); ++i) {
+		sprintf(bufs[i], "_%lu_", (unsigned long)i);
+		keys[i] = bufs[i];
+		lens[i] = strlen(bufs[i]);
+		/* only the even keys are present */
+		if ((i % 2) == 0) {
+			table->put(table, keys[i], lens[i], vals + (i / 2));
+		}
+	}
+
+	/* more than one group, and a partial group */
+	for (i = 0; i < (2 * x); ++i) {
+		found[i] = vals;
+	}
+	ehht_get_many(table, keys, lens, found, (2 * x) - 3);
+	for (i = 0; i < (2 * x) - 3; ++i) {
+		if (i % 2) {
+			failures += check_ptr_m(found[i], NULL, keys[i]);
+		} else {
+			failures += check_ptr_m(found[i], vals + (i / 2),
+						keys[i]);
+		}
+	}
+	for (; i < (2 * x); ++i) {
+		failures += check_ptr_m(found[i], vals, "untouched");
+	}
+
+	ehht_get_many(table, keys, lens, found, 0);
+	ehht_get_many(table, keys + 4, lens + 4, found, 1);
+	failures += check_ptr(found[0], vals + 2);
+
+	ehht_free(table);
+
+	return failures;
+}
+
+int test_ehht_get_many(void)
+{
+	int failures = 0;
+	struct ehht_options_s opts;
+
+	ehht_options_init(&opts);
+	failures += test_ehht_get_many_options(&opts);
+
+	opts.rehash_buckets_per_op = 1;
+	opts.num_buckets = 4;
+	failures += test_ehht_get_many_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.engine = EHHT_ENGINE_ROBIN_HOOD;
+	failures += test_ehht_get_many_options(&opts);
+
+	opts.engine = EHHT_ENGINE_SWISS;
+	failures += test_ehht_get_many_options(&opts);
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_get_many())
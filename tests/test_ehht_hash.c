@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_hash.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+#include "../src/ehht-private.h"
+
+/* a hash function from outside of the library */
+uint64_t ehht_xor_hashcode(const char *data, size_t len)
+{
+	uint64_t hash;
+	size_t i;
+
+	hash = 0;
+	for (i = 0; i < len; ++i) {
+		hash = (hash << 3) ^ (unsigned char)data[i];
+	}
+	return hash;
+}
+
+/* echeck has no 64 bit check, so compare each half */
+int check_uint64_m(uint64_t actual, uint64_t expected, const char *msg)
+{
+	int failures = 0;
+
+	failures += check_unsigned_long_m((unsigned long)(actual >> 32),
+					  (unsigned long)(expected >> 32), msg);
+	failures += check_unsigned_long_m((unsigned long)(uint32_t)actual,
+					  (unsigned long)(uint32_t)expected,
+					  msg);
+	return failures;
+}
+
+#define Test_u64(hi, lo) ((((uint64_t)(hi)) << 32) | ((uint64_t)(lo)))
+
+int test_ehht_wyhash_vectors(void)
+{
+	int failures = 0;
+	const char *s;
+
+	/* the empty key checks against the wyhash reference with seed 0 */
+	s = "";
+	failures += check_uint64_m(ehht_wyhash_hashcode(s, 0),
+				   Test_u64(0x93228a4dUL, 0xe0eec5a2UL), s);
+
+	/* one of each length path: 1-3, 4-16, 17-48, and over 48 bytes */
+	s = "a";
+	failures += check_uint64_m(ehht_wyhash_hashcode(s, strlen(s)),
+				   Test_u64(0xaced1252UL, 0x7fe5bff8UL), s);
+	s = "abc";
+	failures += check_uint64_m(ehht_wyhash_hashcode(s, strlen(s)),
+				   Test_u64(0x989b4a20UL, 0x9c1011c9UL), s);
+	s = "message digest";
+	failures += check_uint64_m(ehht_wyhash_hashcode(s, strlen(s)),
+				   Test_u64(0x309ab4c0UL, 0x45215e8fUL), s);
+	s = "abcdefghijklmnopqrstuvwxyz";
+	failures += check_uint64_m(ehht_wyhash_hashcode(s, strlen(s)),
+				   Test_u64(0xccaeadc1UL, 0x2a061176UL), s);
+	s = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+	failures += check_uint64_m(ehht_wyhash_hashcode(s, strlen(s)),
+				   Test_u64(0x1fdd130eUL, 0xcb5b4709UL), s);
+	s = "1234567890123456789012345678901234567890"
+	    "1234567890123456789012345678901234567890";
+	failures += check_uint64_m(ehht_wyhash_hashcode(s, strlen(s)),
+				   Test_u64(0x7e22da19UL, 0xf1a6055aUL), s);
+
+	return failures;
+}
+
+/* every length up to 64, with a single bit flipped in each byte,
+ * should give distinct hashcodes with high bits in use */
+int test_ehht_wyhash_spread(void)
+{
+	int failures = 0;
+	char buf[64];
+	uint64_t h, prev, high_bits;
+	size_t len, i;
+
+	memset(buf, 'x', sizeof(buf));
+	prev = 0;
+	high_bits = 0;
+	for (len = 1; len <= sizeof(buf); ++len) {
+		h = ehht_wyhash_hashcode(buf, len);
+		failures += check_int_m(h == prev, 0, "length");
+		for (i = 0; i < len; ++i) {
+			buf[i] ^= 0x01;
+			failures +=
+			    check_int_m(ehht_wyhash_hashcode(buf, len) == h,
+					0, "bit flip");
+			buf[i] ^= 0x01;
+		}
+		high_bits |= h >> 32;
+		prev = h;
+	}
+	failures += check_int_m(high_bits == 0, 0, "high bits");
+
+	return failures;
+}
+
+int test_ehht_crc32c_vectors(void)
+{
+	int failures = 0;
+	const char *s;
+
+	failures += check_uint64_m(ehht_crc32c_hashcode("", 0), 0, "empty");
+
+	s = "123456789";
+	failures += check_uint64_m(ehht_crc32c_hashcode(s, strlen(s)),
+				   0xe3069283UL, s);
+	s = "The quick brown fox jumps over the lazy dog";
+	failures += check_uint64_m(ehht_crc32c_hashcode(s, strlen(s)),
+				   0x22620404UL, s);
+
+	return failures;
+}
+
+/* these values must never change, or persisted layouts become invalid */
+int test_ehht_aes_vectors(void)
+{
+	int failures = 0;
+	const char *s;
+
+	s = "";
+	failures += check_uint64_m(ehht_aes_hashcode(s, 0),
+				   Test_u64(0x6f6072eaUL, 0x32f07732UL), s);
+	s = "abc";
+	failures += check_uint64_m(ehht_aes_hashcode(s, strlen(s)),
+				   Test_u64(0xa2977ce9UL, 0x7bfeabd2UL), s);
+	s = "abcdefghijklmnopqrstuvwxyz";
+	failures += check_uint64_m(ehht_aes_hashcode(s, strlen(s)),
+				   Test_u64(0x9d7bfba2UL, 0x999deb84UL), s);
+	s = "The quick brown fox jumps over the lazy dog";
+	failures += check_uint64_m(ehht_aes_hashcode(s, strlen(s)),
+				   Test_u64(0x7dd8e9f4UL, 0x1ab9b727UL), s);
+
+	return failures;
+}
+
+/* whichever kernel the CPU selects must match the software version,
+ * for every length and alignment */
+int test_ehht_hash_portable(void)
+{
+	int failures = 0;
+	char buf[200];
+	ehht_hash_func crc32c, aes;
+	uint64_t expected;
+	size_t i, len;
+
+	for (i = 0; i < sizeof(buf); ++i) {
+		buf[i] = (char)(((i * 37) + 11) & 0xFF);
+	}
+	crc32c = ehht_hash_resolve(ehht_crc32c_hashcode);
+	aes = ehht_hash_resolve(ehht_aes_hashcode);
+	for (i = 0; i < 8; ++i) {
+		for (len = 0; (i + len) <= sizeof(buf); len += 3) {
+			expected = ehht_crc32c_hashcode_portable(buf + i, len);
+			failures += check_uint64_m(crc32c(buf + i, len),
+						   expected, "crc32c");
+			expected = ehht_aes_hashcode_portable(buf + i, len);
+			failures += check_uint64_m(aes(buf + i, len),
+						   expected, "aes");
+		}
+	}
+
+	return failures;
+}
+
+int test_ehht_murmur3_vectors(void)
+{
+	int failures = 0;
+	const char *s;
+
+	failures += check_unsigned_int(ehht_murmur3_hashcode("", 0), 0);
+
+	s = "test";
+	failures +=
+	    check_unsigned_int(ehht_murmur3_hashcode(s, strlen(s)),
+			       0xba6bd213);
+	s = "Hello, world!";
+	failures +=
+	    check_unsigned_int(ehht_murmur3_hashcode(s, strlen(s)),
+			       0xc0363e43);
+	s = "The quick brown fox jumps over the lazy dog";
+	failures +=
+	    check_unsigned_int(ehht_murmur3_hashcode(s, strlen(s)),
+			       0x2e4ff723);
+
+	return failures;
+}
+
+#define TEST_HASH_KEYS 43
+
+int test_ehht_hash_many_func(ehht_hash_func hash_func)
+{
+	int failures = 0;
+	char bufs[TEST_HASH_KEYS][TEST_HASH_KEYS + 1];
+	const char *keys[TEST_HASH_KEYS];
+	size_t lens[TEST_HASH_KEYS];
+	uint64_t hashcodes[TEST_HASH_KEYS];
+	size_t i, j, n;
+
+	/* every length from 0 to 43, thus each path of the kr2 kernel:
+	 * short keys, two overlapping words, whole blocks, and a last
+	 * partial block; bytes above 0x7F check the sign extension */
+	for (i = 0; i < TEST_HASH_KEYS; ++i) {
+		lens[i] = (i * 7) % (TEST_HASH_KEYS + 1);
+		for (j = 0; j < lens[i]; ++j) {
+			bufs[i][j] = (char)(((i * 31) + (j * 131)) & 0xFF);
+		}
+		bufs[i][lens[i]] = '\0';
+		keys[i] = bufs[i];
+	}
+
+	for (n = 0; n <= TEST_HASH_KEYS; n += 7) {
+		for (i = 0; i < TEST_HASH_KEYS; ++i) {
+			hashcodes[i] = 0;
+		}
+		ehht_hash_many(hash_func, keys, lens, hashcodes, n);
+		for (i = 0; i < n; ++i) {
+			failures += check_uint64_m(hashcodes[i],
+						   hash_func(keys[i], lens[i]),
+						   "hash_many");
+		}
+		for (; i < TEST_HASH_KEYS; ++i) {
+			failures +=
+			    check_uint64_m(hashcodes[i], 0, "untouched");
+		}
+	}
+
+	return failures;
+}
+
+int test_ehht_hash(void)
+{
+	int failures = 0;
+
+	failures += test_ehht_wyhash_vectors();
+	failures += test_ehht_wyhash_spread();
+	failures += test_ehht_murmur3_vectors();
+	failures += test_ehht_crc32c_vectors();
+	failures += test_ehht_aes_vectors();
+	failures += test_ehht_hash_portable();
+	failures += test_ehht_hash_many_func(ehht_kr2_hashcode);
+	failures += test_ehht_hash_many_func(ehht_murmur3_hashcode);
+	failures += test_ehht_hash_many_func(ehht_wyhash_hashcode);
+	failures += test_ehht_hash_many_func(ehht_crc32c_hashcode);
+	failures += test_ehht_hash_many_func(ehht_aes_hashcode);
+	failures += test_ehht_hash_many_func(ehht_xor_hashcode);
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_hash())
@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_hashed.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+static unsigned hash_calls = 0;
+
+uint64_t ehht_counting_hashcode(const char *data, size_t len)
+{
+	++hash_calls;
+	return ehht_kr2_hashcode(data, len);
+}
+
+static char vals[100];
+
+int test_ehht_hashed_engine(enum ehht_engine engine)
+{
+	int failures = 0;
+	struct ehht_s *table, *other;
+	struct ehht_options_s opts;
+	struct ehht_keys_s *keys;
+	uint64_t hashcode;
+	size_t i, x;
+	char buf[40];
+	void *val;
+
+	ehht_options_init(&opts);
+	opts.engine = engine;
+	opts.hash_func = ehht_counting_hashcode;
+
+	table = ehht_new_options(&opts);
+	other = ehht_new_options(&opts);
+	if (table == NULL || other == NULL) {
+		ehht_free(table);
+		ehht_free(other);
+		return ++failures;
+	}
+	ehht_buckets_auto_resize_load_factor(table, 0.0);
+
+	/* each method hashes the key exactly once */
+	hash_calls = 0;
+	table->put(table, "foo", 3, vals);
+	failures += check_unsigned_int_m(hash_calls, 1, "put");
+	hash_calls = 0;
+	table->put(table, "foo", 3, vals + 1);
+	failures += check_unsigned_int_m(hash_calls, 1, "replace");
+	hash_calls = 0;
+	val = table->get(table, "foo", 3);
+	failures += check_unsigned_int_m(hash_calls, 1, "get");
+	failures += check_ptr(val, vals + 1);
+	hash_calls = 0;
+	failures += check_int(table->has_key(table, "foo", 3), 1);
+	failures += check_unsigned_int_m(hash_calls, 1, "has_key");
+	hash_calls = 0;
+	val = table->remove(table, "foo", 3);
+	failures += check_unsigned_int_m(hash_calls, 1, "remove");
+	failures += check_ptr(val, vals + 1);
+
+	x = 100;
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		hashcode = ehht_hashcode(table, buf, strlen(buf));
+		failures += check_unsigned_int(hashcode,
+					       ehht_kr2_hashcode(buf,
+								 strlen(buf)));
+		hash_calls = 0;
+		val = ehht_put_hashed(table, buf, strlen(buf), hashcode,
+				      vals + i);
+		failures += check_ptr_m(val, NULL, buf);
+		failures += check_unsigned_int_m(hash_calls, 0, buf);
+	}
+	failures += check_size_t(table->size(table), x);
+
+	/* the keys of one table may be used to look up in another */
+	keys = table->keys(table, 0);
+	hash_calls = 0;
+	for (i = 0; i < keys->len; ++i) {
+		val = ehht_get_hashed(table, keys->keys[i].str,
+				      keys->keys[i].len,
+				      keys->keys[i].hashcode);
+		ehht_put_hashed(other, keys->keys[i].str, keys->keys[i].len,
+				keys->keys[i].hashcode, val);
+		failures += check_int(ehht_has_key_hashed(other,
+							  keys->keys[i].str,
+							  keys->keys[i].len,
+							  keys->keys[i].
+							  hashcode), 1);
+	}
+	failures += check_unsigned_int_m(hash_calls, 0, "keys");
+	table->free_keys(table, keys);
+
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_ptr_m(other->get(other, buf, strlen(buf)),
+					vals + i, buf);
+		if (i % 2) {
+			hashcode = ehht_hashcode(table, buf, strlen(buf));
+			val = ehht_remove_hashed(table, buf, strlen(buf),
+						 hashcode);
+			failures += check_ptr_m(val, vals + i, buf);
+			val = ehht_remove_hashed(table, buf, strlen(buf),
+						 hashcode);
+			failures += check_ptr_m(val, NULL, buf);
+		}
+	}
+	failures += check_size_t(table->size(table), x / 2);
+	failures += check_size_t(other->size(other), x);
+
+	ehht_free(other);
+	ehht_free(table);
+
+	return failures;
+}
+
+int test_ehht_hashed(void)
+{
+	int failures = 0;
+
+	failures += test_ehht_hashed_engine(EHHT_ENGINE_CHAINED);
+	failures += test_ehht_hashed_engine(EHHT_ENGINE_ROBIN_HOOD);
+	failures += test_ehht_hashed_engine(EHHT_ENGINE_SWISS);
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_hashed())
@@ -0,0 +1,204 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_incremental_rehash.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+static char vals[200];
+
+static int test_count_each(struct ehht_key_s each_key, void *each_val,
+			   void *context)
+{
+	size_t *count;
+
+	(void)each_key;
+	(void)each_val;
+	count = (size_t *)context;
+	++(*count);
+	return 0;
+}
+
+struct test_get_each_context_s {
+	struct ehht_s *table;
+	size_t count;
+	size_t found;
+};
+
+static int test_get_each(struct ehht_key_s each_key, void *each_val,
+			 void *context)
+{
+	struct test_get_each_context_s *ctx;
+
+	ctx = (struct test_get_each_context_s *)context;
+	++(ctx->count);
+	if (ctx->table->get(ctx->table, each_key.str, each_key.len)
+	    == each_val) {
+		++(ctx->found);
+	}
+	return 0;
+}
+
+/* a get from the callback must not move the elements of the buckets not
+ * yet visited into the buckets already visited */
+int test_ehht_incremental_rehash_get_each(size_t x)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	struct test_get_each_context_s each_ctx;
+	size_t i;
+	char buf[40];
+
+	ehht_options_init(&opts);
+	opts.num_buckets = 8;
+	opts.alloc_func = test_malloc;
+	opts.free_func = test_free;
+	opts.mem_context = &ctx;
+	opts.rehash_buckets_per_op = 1;
+
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->put(table, buf, strlen(buf), vals + (i % 200));
+	}
+
+	each_ctx.table = table;
+	each_ctx.count = 0;
+	each_ctx.found = 0;
+	table->for_each(table, test_get_each, &each_ctx);
+	failures += check_size_t_m(each_ctx.count, x, "visited");
+	failures += check_size_t_m(each_ctx.found, x, "found");
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+
+	return failures;
+}
+
+int test_ehht_incremental_rehash(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	struct ehht_keys_s *keys;
+	size_t i, x, count, buckets, old_buckets;
+	unsigned used, array_bytes;
+	char buf[40];
+	void *val;
+
+	ehht_options_init(&opts);
+	opts.num_buckets = 8;
+	opts.alloc_func = test_malloc;
+	opts.free_func = test_free;
+	opts.mem_context = &ctx;
+	opts.rehash_buckets_per_op = 1;
+
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	/* fill until the first growth starts */
+	buckets = ehht_buckets_size(table);
+	for (i = 0; ehht_buckets_size(table) == buckets; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->put(table, buf, strlen(buf), vals + i);
+	}
+	x = i;
+	failures += check_size_t(ehht_buckets_size(table), 2 * buckets);
+
+	/* part way through the migration, everything can still be found */
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		val = table->get(table, buf, strlen(buf));
+		failures += check_ptr_m(val, vals + i, buf);
+		if (i == 2) {
+			count = 0;
+			table->for_each(table, test_count_each, &count);
+			failures += check_size_t(count, x);
+			val = table->remove(table, "_1_", 3);
+			failures += check_ptr(val, vals + 1);
+			table->put(table, "_1_", 3, vals + 1);
+		}
+	}
+
+	/* the old bucket array is freed once every bucket has moved */
+	buckets = ehht_buckets_size(table);
+	for (i = x; ehht_buckets_size(table) == buckets; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->put(table, buf, strlen(buf), vals + i);
+	}
+	x = i;
+	old_buckets = buckets;
+	buckets = ehht_buckets_size(table);
+	array_bytes = (unsigned)(sizeof(void *) * old_buckets);
+	used = ctx.alloc_bytes - ctx.free_bytes;
+	for (i = 0; i < old_buckets; ++i) {
+		failures += check_int(table->has_key(table, "_0_", 3), 1);
+	}
+	failures += check_unsigned_int_m(ctx.alloc_bytes - ctx.free_bytes,
+					 used - array_bytes, "old array");
+	failures += check_size_t(ehht_buckets_size(table), buckets);
+
+	/* an explicit resize finishes any migration in progress */
+	for (i = x; ehht_buckets_size(table) == buckets; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->put(table, buf, strlen(buf), vals + i);
+	}
+	x = i;
+	buckets = ehht_buckets_resize(table, 8 * ehht_buckets_size(table));
+	keys = table->keys(table, 0);
+	failures += check_size_t(keys->len, x);
+	for (i = 0; i < keys->len; ++i) {
+		failures += check_int(ehht_bucket_for_key(table,
+							  keys->keys[i].str,
+							  keys->keys[i].len)
+				      < buckets, 1);
+	}
+	table->free_keys(table, keys);
+
+	/* clearing part way through a migration releases both arrays */
+	for (i = x; ehht_buckets_size(table) == buckets; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->put(table, buf, strlen(buf), vals + (i % 200));
+	}
+	table->clear(table);
+	failures += check_size_t(table->size(table), 0);
+	count = 0;
+	table->for_each(table, test_count_each, &count);
+	failures += check_size_t(count, 0);
+
+	table->put(table, "foo", 3, "bar");
+	failures += check_str(table->get(table, "foo", 3), "bar");
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+	failures +=
+	    check_unsigned_int_m(ctx.free_bytes, ctx.alloc_bytes, "bytes");
+
+	return failures;
+}
+
+int test_ehht_incremental_rehash_all(void)
+{
+	int failures = 0;
+	size_t x;
+
+	failures += test_ehht_incremental_rehash();
+	for (x = 10; x < 2000; x += 37) {
+		failures += test_ehht_incremental_rehash_get_each(x);
+	}
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_incremental_rehash_all())
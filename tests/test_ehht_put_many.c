@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_put_many.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+#define TEST_KEYS 3000
+/* the batch repeats the first TEST_REPEATS keys at its end */
+#define TEST_REPEATS 100
+#define TEST_BATCH (TEST_KEYS + TEST_REPEATS)
+
+static char vals[TEST_BATCH];
+static char bufs[TEST_KEYS][20];
+static const char *keys[TEST_BATCH];
+static size_t lens[TEST_BATCH];
+static void *batch_vals[TEST_BATCH];
+
+void test_ehht_put_many_init(void)
+{
+	size_t i;
+
+	for (i = 0; i < TEST_KEYS; ++i) {
+		sprintf(bufs[i], "_%lu_", (unsigned long)i);
+	}
+	for (i = 0; i < TEST_BATCH; ++i) {
+		keys[i] = bufs[i % TEST_KEYS];
+		lens[i] = strlen(keys[i]);
+		batch_vals[i] = vals + i;
+	}
+}
+
+/* a repeated key ends with the value of its last put */
+void *test_ehht_expected_val(size_t i)
+{
+	if (i < TEST_REPEATS) {
+		return vals + TEST_KEYS + i;
+	}
+	return vals + i;
+}
+
+int test_ehht_put_many_options(struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	size_t i, added, buckets;
+	unsigned allocs;
+
+	opts->alloc_func = test_malloc;
+	opts->free_func = test_free;
+	opts->mem_context = &ctx;
+
+	table = ehht_new_options(opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	/* a few keys are present before the batch */
+	table->put(table, keys[5], lens[5], vals);
+	table->put(table, "other", 5, vals);
+
+	allocs = ctx.allocs;
+	added = ehht_put_many(table, keys, lens, batch_vals, TEST_BATCH);
+	failures += check_size_t(added, TEST_KEYS - 1);
+	failures += check_size_t(table->size(table), TEST_KEYS + 1);
+	if (opts->slab_page_size == 0 && opts->bucket_fingerprints == 0) {
+		/* the elements, one bucket array, and the order scratch */
+		failures += check_int(ctx.allocs - allocs <= TEST_KEYS + 1, 1);
+	}
+
+	for (i = 0; i < TEST_KEYS; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					test_ehht_expected_val(i), keys[i]);
+	}
+	failures += check_ptr(table->get(table, "other", 5), vals);
+
+	/* the table was sized for the batch, it need not grow again */
+	buckets = ehht_buckets_size(table);
+	failures += check_size_t(ehht_reserve(table, TEST_KEYS + 1), buckets);
+
+	/* nothing new: only values are replaced */
+	failures += check_size_t(ehht_put_many(table, keys, lens, batch_vals,
+					       TEST_REPEATS), 0);
+	failures += check_ptr(table->get(table, keys[0], lens[0]), vals);
+	failures += check_size_t(ehht_put_many(table, keys, lens, NULL, 0), 0);
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+	failures +=
+	    check_unsigned_int_m(ctx.free_bytes, ctx.alloc_bytes, "bytes");
+
+	return failures;
+}
+
+/* collides every key under one seed, but behaves as SipHash under any
+ * other seed */
+uint64_t test_ehht_flood_hashcode(const char *data, size_t len,
+				  const struct ehht_hash_seed_s *seed)
+{
+	if (seed->k0 == 42 && seed->k1 == 1) {
+		return 0;
+	}
+	return ehht_siphash_hashcode(data, len, seed);
+}
+
+/* a reseed part way through a batch changes the hashcodes of the keys
+ * of the batch which are not yet put */
+int test_ehht_put_many_reseed(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	size_t i, x;
+
+	ehht_options_init(&opts);
+	opts.num_buckets = 1024;
+	opts.seeded_hash_func = test_ehht_flood_hashcode;
+	opts.hash_seed.k0 = 42;
+	opts.hash_seed.k1 = 1;
+	opts.alloc_func = test_malloc;
+	opts.free_func = test_free;
+	opts.mem_context = &ctx;
+
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	x = 100;
+	failures += check_size_t(ehht_put_many(table, keys, lens, batch_vals,
+					       x), x);
+	failures += check_size_t(table->size(table), x);
+	for (i = 0; i < x; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					vals + i, keys[i]);
+	}
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+
+	return failures;
+}
+
+int test_ehht_put_many(void)
+{
+	int failures = 0;
+	struct ehht_options_s opts;
+
+	test_ehht_put_many_init();
+
+	ehht_options_init(&opts);
+	failures += test_ehht_put_many_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.slab_page_size = 4096;
+	failures += test_ehht_put_many_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.rehash_buckets_per_op = 1;
+	opts.bucket_fingerprints = 1;
+	failures += test_ehht_put_many_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.chain_order = EHHT_CHAIN_ORDER_SORTED;
+	opts.bucket_index = EHHT_BUCKET_INDEX_PRIME;
+	failures += test_ehht_put_many_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.seeded_hash_func = ehht_siphash_hashcode;
+	failures += test_ehht_put_many_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.engine = EHHT_ENGINE_ROBIN_HOOD;
+	failures += test_ehht_put_many_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.engine = EHHT_ENGINE_SWISS;
+	failures += test_ehht_put_many_options(&opts);
+
+	failures += test_ehht_put_many_reseed();
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_put_many())
@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_reserve.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+#define TEST_KEYS 5000
+static char vals[TEST_KEYS];
+
+/* puts keys [from, to), returns the number of times the buckets changed */
+size_t test_ehht_put_range(struct ehht_s *table, size_t from, size_t to)
+{
+	char buf[20];
+	size_t i, buckets, resizes;
+
+	resizes = 0;
+	buckets = ehht_buckets_size(table);
+	for (i = from; i < to; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->put(table, buf, strlen(buf), vals + i);
+		if (ehht_buckets_size(table) != buckets) {
+			buckets = ehht_buckets_size(table);
+			++resizes;
+		}
+	}
+	return resizes;
+}
+
+int test_ehht_reserve_engine(enum ehht_engine engine)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	char buf[20];
+	size_t i, buckets;
+
+	/* sized at construction */
+	ehht_options_init(&opts);
+	opts.engine = engine;
+	opts.expected_elements = 1000;
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+	buckets = ehht_buckets_size(table);
+	failures += check_int(buckets >= 1000, 1);
+	failures += check_size_t(test_ehht_put_range(table, 0, 1000), 0);
+	failures += check_size_t(ehht_buckets_size(table), buckets);
+
+	/* reserved on an existing table */
+	buckets = ehht_reserve(table, TEST_KEYS);
+	failures += check_size_t(ehht_buckets_size(table), buckets);
+	failures += check_int(buckets >= TEST_KEYS, 1);
+	failures +=
+	    check_size_t(test_ehht_put_range(table, 1000, TEST_KEYS), 0);
+	failures += check_size_t(table->size(table), TEST_KEYS);
+	for (i = 0; i < TEST_KEYS; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_ptr_m(table->get(table, buf, strlen(buf)),
+					vals + i, buf);
+	}
+
+	/* reserving less than is present never shrinks */
+	failures += check_size_t(ehht_reserve(table, 10), buckets);
+	failures += check_size_t(ehht_reserve(table, 0), buckets);
+	ehht_free(table);
+
+	/* an explicit num_buckets, if larger, is kept */
+	opts.num_buckets = 4096;
+	opts.expected_elements = 10;
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+	failures += check_size_t(ehht_buckets_size(table), 4096);
+	ehht_free(table);
+
+	/* a higher load factor needs fewer buckets */
+	ehht_options_init(&opts);
+	opts.engine = engine;
+	opts.expected_elements = 1000;
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+	buckets = ehht_buckets_size(table);
+	ehht_free(table);
+	opts.load_factor = 1.0;
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+	failures += check_int(ehht_buckets_size(table) <= buckets, 1);
+	failures += check_size_t(test_ehht_put_range(table, 0, 1000), 0);
+	ehht_free(table);
+
+	return failures;
+}
+
+/* without a reservation, the same load does resize */
+int test_ehht_reserve_unreserved(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+
+	table = ehht_new();
+	if (table == NULL) {
+		return ++failures;
+	}
+	failures +=
+	    check_int(test_ehht_put_range(table, 0, TEST_KEYS) > 0, 1);
+	ehht_free(table);
+
+	return failures;
+}
+
+int test_ehht_reserve(void)
+{
+	int failures = 0;
+
+	failures += test_ehht_reserve_engine(EHHT_ENGINE_CHAINED);
+	failures += test_ehht_reserve_engine(EHHT_ENGINE_ROBIN_HOOD);
+	failures += test_ehht_reserve_engine(EHHT_ENGINE_SWISS);
+	failures += test_ehht_reserve_unreserved();
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_reserve())
@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_resize_in_place.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+static char vals[200];
+
+int test_ehht_resize_in_place_realloc(ehht_realloc_func realloc_func)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	size_t i, x, buckets;
+	unsigned allocs, used;
+	char buf[40];
+
+	ehht_options_init(&opts);
+	opts.num_buckets = 16;
+	opts.alloc_func = test_malloc;
+	opts.free_func = test_free;
+	opts.realloc_func = realloc_func;
+	opts.mem_context = &ctx;
+
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+	ehht_buckets_auto_resize_load_factor(table, 0.0);
+
+	x = 200;
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->put(table, buf, strlen(buf), vals + i);
+	}
+
+	allocs = ctx.allocs;
+	used = ctx.alloc_bytes - ctx.free_bytes;
+	buckets = ehht_buckets_resize(table, 0);
+	failures += check_size_t(buckets, 32);
+	if (realloc_func) {
+		/* grown in place: never both arrays at once */
+		failures += check_unsigned_int(ctx.allocs, allocs);
+		used = ctx.alloc_bytes - ctx.free_bytes;
+		failures += check_unsigned_int(ctx.max_used, used);
+	} else {
+		failures += check_unsigned_int(ctx.allocs, allocs + 1);
+		failures += check_unsigned_int(ctx.max_used,
+					       used + (32 * sizeof(void *)));
+	}
+
+	buckets = ehht_buckets_resize(table, 2 * buckets);
+	failures += check_size_t(buckets, 64);
+
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_ptr_m(table->get(table, buf, strlen(buf)),
+					vals + i, buf);
+	}
+	failures += check_size_t(table->size(table), x);
+
+	/* other sizes still use a new bucket array */
+	allocs = ctx.allocs;
+	buckets = ehht_buckets_resize(table, 100);
+	failures += check_size_t(buckets, 100);
+	failures += check_unsigned_int(ctx.allocs, allocs + 1);
+	for (i = 0; i < x; i += 7) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_ptr_m(table->remove(table, buf, strlen(buf)),
+					vals + i, buf);
+	}
+	buckets = ehht_buckets_resize(table, 0);
+	failures += check_size_t(buckets, 200);
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_int(table->has_key(table, buf, strlen(buf)),
+				      (i % 7) ? 1 : 0);
+	}
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+	failures +=
+	    check_unsigned_int_m(ctx.free_bytes, ctx.alloc_bytes, "bytes");
+
+	return failures;
+}
+
+int test_ehht_resize_in_place(void)
+{
+	int failures = 0;
+
+	failures += test_ehht_resize_in_place_realloc(test_realloc);
+	failures += test_ehht_resize_in_place_realloc(NULL);
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_resize_in_place())
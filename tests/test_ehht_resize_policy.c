@@ -0,0 +1,323 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_resize_policy.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+#define TEST_KEYS 5000
+static char vals[TEST_KEYS];
+
+/* puts keys [0, n), returns the bucket count after the first growth */
+size_t test_ehht_put_keys(struct ehht_s *table, size_t n)
+{
+	char buf[24];
+	size_t i, buckets, first_growth;
+
+	first_growth = 0;
+	buckets = ehht_buckets_size(table);
+	for (i = 0; i < n; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->put(table, buf, strlen(buf), vals + i);
+		if (!first_growth && ehht_buckets_size(table) != buckets) {
+			first_growth = ehht_buckets_size(table);
+		}
+	}
+	return first_growth;
+}
+
+int test_ehht_check_keys(struct ehht_s *table, size_t n)
+{
+	int failures = 0;
+	char buf[24];
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_ptr_m(table->get(table, buf, strlen(buf)),
+					vals + i, buf);
+	}
+	failures += check_size_t(table->size(table), n);
+	return failures;
+}
+
+struct ehht_s *test_ehht_policy_table(struct ehht_options_s *opts,
+				      enum ehht_resize_trigger trigger,
+				      double growth_factor, double threshold)
+{
+	opts->resize_policy.trigger = trigger;
+	opts->resize_policy.growth_factor = growth_factor;
+	opts->resize_policy.threshold = threshold;
+	return ehht_new_options(opts);
+}
+
+int test_ehht_resize_policy_growth(struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct ehht_s *table;
+
+	table = test_ehht_policy_table(opts, EHHT_RESIZE_LOAD_FACTOR, 4.0, 0);
+	if (table == NULL) {
+		return ++failures;
+	}
+	failures += check_size_t(test_ehht_put_keys(table, TEST_KEYS), 256);
+	failures += test_ehht_check_keys(table, TEST_KEYS);
+	ehht_free(table);
+
+	table = test_ehht_policy_table(opts, EHHT_RESIZE_LOAD_FACTOR, 1.5, 0);
+	if (table == NULL) {
+		return ++failures;
+	}
+	failures += check_size_t(test_ehht_put_keys(table, TEST_KEYS), 96);
+	failures += test_ehht_check_keys(table, TEST_KEYS);
+	ehht_free(table);
+
+	/* the classic rule: doubling */
+	table = test_ehht_policy_table(opts, EHHT_RESIZE_LOAD_FACTOR, 0, 0);
+	if (table == NULL) {
+		return ++failures;
+	}
+	failures += check_size_t(test_ehht_put_keys(table, TEST_KEYS), 128);
+	failures += test_ehht_check_keys(table, TEST_KEYS);
+	ehht_free(table);
+
+	return failures;
+}
+
+int test_ehht_resize_policy_chain_length(struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_stats_s stats;
+	size_t loose, tight;
+
+	table = test_ehht_policy_table(opts, EHHT_RESIZE_CHAIN_LENGTH, 0, 12);
+	if (table == NULL) {
+		return ++failures;
+	}
+	test_ehht_put_keys(table, TEST_KEYS);
+	failures += test_ehht_check_keys(table, TEST_KEYS);
+	loose = ehht_buckets_size(table);
+	ehht_free(table);
+
+	table = test_ehht_policy_table(opts, EHHT_RESIZE_CHAIN_LENGTH, 0, 2);
+	if (table == NULL) {
+		return ++failures;
+	}
+	failures += check_int(test_ehht_put_keys(table, TEST_KEYS) > 0, 1);
+	failures += test_ehht_check_keys(table, TEST_KEYS);
+	tight = ehht_buckets_size(table);
+	ehht_stats(table, &stats);
+	failures += check_int(stats.longest_chain < 12, 1);
+	ehht_free(table);
+
+	failures += check_int(tight > loose, 1);
+
+	return failures;
+}
+
+int test_ehht_resize_policy_probe_count(struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	size_t loose, tight;
+
+	table = test_ehht_policy_table(opts, EHHT_RESIZE_PROBE_COUNT, 0, 3.0);
+	if (table == NULL) {
+		return ++failures;
+	}
+	test_ehht_put_keys(table, TEST_KEYS);
+	failures += test_ehht_check_keys(table, TEST_KEYS);
+	loose = ehht_buckets_size(table);
+	ehht_free(table);
+
+	table = test_ehht_policy_table(opts, EHHT_RESIZE_PROBE_COUNT, 0, 0.5);
+	if (table == NULL) {
+		return ++failures;
+	}
+	test_ehht_put_keys(table, TEST_KEYS);
+	failures += test_ehht_check_keys(table, TEST_KEYS);
+	tight = ehht_buckets_size(table);
+	ehht_free(table);
+
+	failures += check_int(tight > loose, 1);
+
+	table = test_ehht_policy_table(opts, EHHT_RESIZE_AUTO_TUNE, 0, 0);
+	if (table == NULL) {
+		return ++failures;
+	}
+	failures += check_int(test_ehht_put_keys(table, TEST_KEYS) > 0, 1);
+	failures += test_ehht_check_keys(table, TEST_KEYS);
+	ehht_free(table);
+
+	return failures;
+}
+
+struct test_budget_context_s {
+	struct tracking_mem_context track;
+	size_t budget;
+};
+
+/* refuses any allocation over the budget, as a bucket array might be */
+void *test_budget_malloc(size_t size, void *context)
+{
+	struct test_budget_context_s *ctx;
+
+	ctx = (struct test_budget_context_s *)context;
+	if (size > ctx->budget) {
+		++(ctx->track.fails);
+		return NULL;
+	}
+	return test_malloc(size, &ctx->track);
+}
+
+void test_budget_free(void *ptr, void *context)
+{
+	test_free(ptr, &((struct test_budget_context_s *)context)->track);
+}
+
+/* auto-tuning backs off from memory which cannot be had */
+int test_ehht_resize_policy_memory_pressure(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	struct test_budget_context_s ctx;
+	unsigned fails[2];
+	size_t i;
+	enum ehht_resize_trigger triggers[2] = {
+		EHHT_RESIZE_PROBE_COUNT,
+		EHHT_RESIZE_AUTO_TUNE
+	};
+
+	for (i = 0; i < 2; ++i) {
+		memset(&ctx, 0x00, sizeof(ctx));
+		ctx.budget = 256 * sizeof(void *);
+		ehht_options_init(&opts);
+		opts.alloc_func = test_budget_malloc;
+		opts.free_func = test_budget_free;
+		opts.mem_context = &ctx;
+		table = test_ehht_policy_table(&opts, triggers[i], 0, 0);
+		if (table == NULL) {
+			return ++failures;
+		}
+		test_ehht_put_keys(table, TEST_KEYS);
+		failures += test_ehht_check_keys(table, TEST_KEYS);
+		failures += check_size_t(ehht_buckets_size(table), 256);
+		fails[i] = ctx.track.fails;
+		ehht_free(table);
+		failures += check_unsigned_int_m(ctx.track.frees,
+						 ctx.track.allocs,
+						 "alloc/free");
+	}
+	failures += check_int(fails[0] > 0, 1);
+	failures += check_int(fails[1] < fails[0], 1);
+
+	return failures;
+}
+
+int test_ehht_resize_policy_max_buckets(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+
+	ehht_options_init(&opts);
+	opts.resize_policy.max_buckets = 300;
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+	test_ehht_put_keys(table, TEST_KEYS);
+	failures += check_size_t(ehht_buckets_size(table), 300);
+	failures += test_ehht_check_keys(table, TEST_KEYS);
+	ehht_free(table);
+
+	return failures;
+}
+
+struct test_resize_context_s {
+	unsigned long calls;
+	unsigned long lookups;
+	int failures;
+};
+
+size_t test_triple_when_full(const struct ehht_resize_info_s *info,
+			     void *context)
+{
+	struct test_resize_context_s *ctx;
+
+	ctx = (struct test_resize_context_s *)context;
+	++(ctx->calls);
+	ctx->lookups += info->lookups;
+	ctx->failures += check_int(info->chain_len <= info->size, 1);
+	return (info->size > info->num_buckets) ? (3 * info->num_buckets) : 0;
+}
+
+int test_ehht_resize_policy_custom(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_resize_policy_s policy;
+	struct test_resize_context_s ctx = { 0, 0, 0 };
+
+	table = ehht_new();
+	if (table == NULL) {
+		return ++failures;
+	}
+	policy.trigger = EHHT_RESIZE_CUSTOM;
+	policy.growth_factor = 0;
+	policy.threshold = 0;
+	policy.max_buckets = 0;
+	policy.resize_func = test_triple_when_full;
+	policy.resize_context = &ctx;
+	ehht_buckets_resize_policy(table, &policy);
+
+	failures += check_size_t(test_ehht_put_keys(table, 2000), 192);
+	failures += check_size_t(ehht_buckets_size(table), 5184);
+	failures += check_unsigned_long(ctx.calls, 2000);
+	failures += check_int(ctx.lookups > 0, 1);
+	failures += ctx.failures;
+	failures += test_ehht_check_keys(table, 2000);
+
+	/* without a function, the classic rule */
+	policy.resize_func = NULL;
+	ehht_buckets_resize_policy(table, &policy);
+	table->clear(table);
+	ehht_buckets_resize(table, 64);
+	failures += check_size_t(test_ehht_put_keys(table, 2000), 128);
+	ehht_free(table);
+
+	return failures;
+}
+
+int test_ehht_resize_policy(void)
+{
+	int failures = 0;
+	struct ehht_options_s opts;
+
+	ehht_options_init(&opts);
+	failures += test_ehht_resize_policy_growth(&opts);
+	failures += test_ehht_resize_policy_chain_length(&opts);
+	failures += test_ehht_resize_policy_probe_count(&opts);
+
+	ehht_options_init(&opts);
+	opts.rehash_buckets_per_op = 1;
+	failures += test_ehht_resize_policy_growth(&opts);
+	failures += test_ehht_resize_policy_chain_length(&opts);
+	failures += test_ehht_resize_policy_probe_count(&opts);
+
+	ehht_options_init(&opts);
+	opts.chain_order = EHHT_CHAIN_ORDER_SORTED;
+	opts.bucket_fingerprints = 1;
+	failures += test_ehht_resize_policy_chain_length(&opts);
+	failures += test_ehht_resize_policy_probe_count(&opts);
+
+	failures += test_ehht_resize_policy_memory_pressure();
+	failures += test_ehht_resize_policy_max_buckets();
+	failures += test_ehht_resize_policy_custom();
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_resize_policy())
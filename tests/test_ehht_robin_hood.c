@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_robin_hood.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+#include <stdint.h>
+
+static char vals[1000];
+
+int test_ehht_robin_hood_hash(ehht_hash_func hash_func)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	struct ehht_keys_s *keys;
+	size_t i, x, buckets;
+	char buf[40];
+	void *val;
+
+	ehht_options_init(&opts);
+	opts.engine = EHHT_ENGINE_ROBIN_HOOD;
+	opts.num_buckets = 4;
+	opts.hash_func = hash_func;
+	opts.alloc_func = test_malloc;
+	opts.free_func = test_free;
+	opts.mem_context = &ctx;
+
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	buckets = ehht_buckets_size(table);
+	failures += check_size_t_m(buckets, 8, "minimum slots");
+
+	x = 1000;
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		val = table->put(table, buf, strlen(buf), vals + i);
+		failures += check_ptr_m(val, NULL, buf);
+	}
+	failures += check_size_t(table->size(table), x);
+	failures += check_int(ehht_buckets_size(table) >= x, 1);
+
+	val = table->put(table, "_7_", 3, "seven");
+	failures += check_ptr(val, vals + 7);
+	failures += check_size_t(table->size(table), x);
+
+	for (i = 0; i < x; i += 2) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		val = table->remove(table, buf, strlen(buf));
+		failures += check_ptr_m(val, vals + i, buf);
+	}
+	failures += check_size_t(table->size(table), x / 2);
+
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		val = table->get(table, buf, strlen(buf));
+		if (i % 2) {
+			if (i != 7) {
+				failures += check_ptr_m(val, vals + i, buf);
+			} else {
+				failures += check_str(val, "seven");
+			}
+			failures +=
+			    check_int(table->has_key(table, buf, strlen(buf)),
+				      1);
+		} else {
+			failures += check_ptr_m(val, NULL, buf);
+			failures +=
+			    check_int(table->has_key(table, buf, strlen(buf)),
+				      0);
+		}
+	}
+
+	keys = table->keys(table, 1);
+	failures += check_size_t(keys->len, x / 2);
+	for (i = 0; i < keys->len; ++i) {
+		failures += check_int(table->has_key(table, keys->keys[i].str,
+						     keys->keys[i].len), 1);
+	}
+	table->free_keys(table, keys);
+
+	/* can not shrink below the number of entries */
+	buckets = ehht_buckets_size(table);
+	failures += check_size_t(ehht_buckets_resize(table, 16), buckets);
+
+	buckets = ehht_buckets_resize(table, 4 * buckets);
+	failures += check_int(table->has_key(table, "_9_", 3), 1);
+
+	/* do not resize if there is not memory to do so */
+	failures += check_size_t(ehht_buckets_resize(table, (SIZE_MAX / 64)),
+				 buckets);
+
+	table->clear(table);
+	failures += check_size_t(table->size(table), 0);
+	failures += check_int(table->has_key(table, "_9_", 3), 0);
+
+	table->put(table, "", 0, "empty");
+	failures += check_str(table->get(table, "", 0), "empty");
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+	failures +=
+	    check_unsigned_int_m(ctx.free_bytes, ctx.alloc_bytes, "bytes");
+
+	return failures;
+}
+
+int test_ehht_robin_hood(void)
+{
+	int failures = 0;
+
+	failures += test_ehht_robin_hood_hash(NULL);
+	failures += test_ehht_robin_hood_hash(ehht_first_char_bogus_hashcode);
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_robin_hood())
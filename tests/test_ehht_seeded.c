@@ -0,0 +1,203 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_seeded.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+#define Test_u64(hi, lo) ((((uint64_t)(hi)) << 32) | ((uint64_t)(lo)))
+
+static struct ehht_hash_seed_s last_seed;
+
+/* collides every key under one seed, as an attacker who had learned the
+ * seed might, but behaves as SipHash under any other seed */
+uint64_t ehht_flood_hashcode(const char *data, size_t len,
+			     const struct ehht_hash_seed_s *seed)
+{
+	last_seed = *seed;
+	if (seed->k0 == 1 && seed->k1 == 2) {
+		return 0;
+	}
+	return ehht_siphash_hashcode(data, len, seed);
+}
+
+int test_ehht_siphash_vectors(void)
+{
+	int failures = 0;
+	struct ehht_hash_seed_s seed;
+	char msg[64];
+	size_t i;
+
+	/* the key 00 01 02 .. 0f, the messages 00, 00 01, 00 01 02, .. */
+	seed.k0 = Test_u64(0x07060504UL, 0x03020100UL);
+	seed.k1 = Test_u64(0x0f0e0d0cUL, 0x0b0a0908UL);
+	for (i = 0; i < sizeof(msg); ++i) {
+		msg[i] = (char)i;
+	}
+
+	failures += check_int_m(ehht_siphash_hashcode(msg, 0, &seed)
+				== Test_u64(0x726fdb47UL, 0xdd0e0e31UL), 1,
+				"0");
+	failures += check_int_m(ehht_siphash_hashcode(msg, 8, &seed)
+				== Test_u64(0x93f5f579UL, 0x9a932462UL), 1,
+				"8");
+	failures += check_int_m(ehht_siphash_hashcode(msg, 15, &seed)
+				== Test_u64(0xa129ca61UL, 0x49be45e5UL), 1,
+				"15");
+	failures += check_int_m(ehht_siphash_hashcode(msg, 63, &seed)
+				== Test_u64(0x958a324cUL, 0xeb064572UL), 1,
+				"63");
+
+	return failures;
+}
+
+int test_ehht_seeded_engine(enum ehht_engine engine)
+{
+	int failures = 0;
+	struct ehht_s *table, *generated;
+	struct ehht_options_s opts;
+	char buf[40];
+	uint64_t hashcode;
+	size_t i;
+
+	ehht_options_init(&opts);
+	opts.engine = engine;
+	opts.seeded_hash_func = ehht_siphash_hashcode;
+	opts.hash_seed.k0 = 3;
+	opts.hash_seed.k1 = 4;
+	table = ehht_new_options(&opts);
+
+	opts.hash_seed.k0 = 0;
+	opts.hash_seed.k1 = 0;
+	generated = ehht_new_options(&opts);
+
+	if (table == NULL || generated == NULL) {
+		ehht_free(table);
+		ehht_free(generated);
+		return ++failures;
+	}
+
+	for (i = 0; i < 100; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->put(table, buf, strlen(buf), buf);
+		generated->put(generated, buf, strlen(buf), buf);
+	}
+	for (i = 0; i < 100; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_int_m(table->has_key(table, buf, strlen(buf)),
+					1, buf);
+		failures +=
+		    check_int_m(generated->has_key(generated, buf, strlen(buf)),
+				1, buf);
+	}
+
+	/* the given seed is used; a zero seed is replaced */
+	failures += check_int(ehht_hashcode(table, "foo", 3)
+			      == ehht_siphash_hashcode("foo", 3,
+						       &opts.hash_seed), 0);
+	opts.hash_seed.k0 = 3;
+	opts.hash_seed.k1 = 4;
+	hashcode = ehht_siphash_hashcode("foo", 3, &opts.hash_seed);
+	failures += check_int(ehht_hashcode(table, "foo", 3) == hashcode, 1);
+	failures += check_int(ehht_hashcode(generated, "foo", 3) == hashcode,
+			      0);
+
+	ehht_free(generated);
+	ehht_free(table);
+
+	return failures;
+}
+
+int test_ehht_seeded_flood(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	struct ehht_keys_s *keys;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	size_t counts[256];
+	size_t i, x, bucket, longest;
+	char buf[40];
+	void **slot;
+
+	ehht_options_init(&opts);
+	opts.num_buckets = 256;
+	opts.seeded_hash_func = ehht_flood_hashcode;
+	opts.hash_seed.k0 = 1;
+	opts.hash_seed.k1 = 2;
+	opts.alloc_func = test_malloc;
+	opts.free_func = test_free;
+	opts.mem_context = &ctx;
+
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+	/* no growth, so that only a reseed can shorten the chain */
+	ehht_buckets_auto_resize_load_factor(table, 0.0);
+
+	slot = ehht_entry(table, "first", 5, NULL);
+	*slot = "one";
+
+	x = 200;
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->put(table, buf, strlen(buf), table);
+	}
+	failures += check_int_m(last_seed.k0 == 1 && last_seed.k1 == 2, 0,
+				"reseeded");
+	failures += check_size_t(ehht_buckets_size(table), 256);
+	failures += check_size_t(table->size(table), x + 1);
+
+	/* the chains are short again */
+	for (i = 0; i < 256; ++i) {
+		counts[i] = 0;
+	}
+	keys = table->keys(table, 0);
+	longest = 0;
+	for (i = 0; i < keys->len; ++i) {
+		bucket = ehht_bucket_for_key(table, keys->keys[i].str,
+					     keys->keys[i].len);
+		if (++counts[bucket] > longest) {
+			longest = counts[bucket];
+		}
+		failures +=
+		    check_int(ehht_hashcode(table, keys->keys[i].str,
+					    keys->keys[i].len)
+			      == keys->keys[i].hashcode, 1);
+	}
+	table->free_keys(table, keys);
+	failures += check_int_m(longest < 14, 1, "longest chain");
+
+	/* the elements did not move */
+	failures += check_ptr(*slot, "one");
+	failures += check_str(table->get(table, "first", 5), "one");
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_ptr_m(table->get(table, buf, strlen(buf)),
+					table, buf);
+	}
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+	failures +=
+	    check_unsigned_int_m(ctx.free_bytes, ctx.alloc_bytes, "bytes");
+
+	return failures;
+}
+
+int test_ehht_seeded(void)
+{
+	int failures = 0;
+
+	failures += test_ehht_siphash_vectors();
+	failures += test_ehht_seeded_engine(EHHT_ENGINE_CHAINED);
+	failures += test_ehht_seeded_engine(EHHT_ENGINE_ROBIN_HOOD);
+	failures += test_ehht_seeded_engine(EHHT_ENGINE_SWISS);
+	failures += test_ehht_seeded_flood();
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_seeded())
@@ -0,0 +1,297 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_sharded.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+#include "../src/ehht-private.h"
+
+#define TEST_KEYS 5000
+#define TEST_THREADS 8
+
+static char vals[TEST_KEYS];
+static char bufs[TEST_KEYS][24];
+static const char *keys[TEST_KEYS];
+static size_t lens[TEST_KEYS];
+
+void test_ehht_sharded_init(void)
+{
+	size_t i;
+
+	for (i = 0; i < TEST_KEYS; ++i) {
+		sprintf(bufs[i], "_%lu_", (unsigned long)i);
+		keys[i] = bufs[i];
+		lens[i] = strlen(bufs[i]);
+	}
+}
+
+struct test_ehht_sharded_count_s {
+	struct ehht_s *table;
+	size_t count;
+};
+
+int test_ehht_sharded_count(struct ehht_key_s each_key, void *each_val,
+			    void *context)
+{
+	struct test_ehht_sharded_count_s *ctx;
+
+	ctx = (struct test_ehht_sharded_count_s *)context;
+	/* the key's hashcode is the sharded table's own */
+	if (ehht_hashcode(ctx->table, each_key.str, each_key.len)
+	    != each_key.hashcode || each_val == NULL) {
+		return 1;
+	}
+	++(ctx->count);
+	return 0;
+}
+
+int test_ehht_sharded_options(struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_keys_s *all;
+	struct ehht_stats_s stats;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	struct test_ehht_sharded_count_s each;
+	char buf[80];
+	size_t i, buckets;
+	uint64_t hashcode;
+	void **slot;
+	int created;
+
+	opts->alloc_func = test_malloc;
+	opts->free_func = test_free;
+	opts->mem_context = &ctx;
+
+	table = ehht_new_options(opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	for (i = 0; i < TEST_KEYS; ++i) {
+		failures +=
+		    check_ptr(table->put(table, keys[i], lens[i], vals + i),
+			      NULL);
+	}
+	failures += check_size_t(table->size(table), TEST_KEYS);
+	for (i = 0; i < TEST_KEYS; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					vals + i, keys[i]);
+		failures += check_int(table->has_key(table, keys[i], lens[i]),
+				      1);
+	}
+	failures += check_ptr(table->get(table, "bogus", 5), NULL);
+
+	/* the hashed variants take the table's own hashcodes */
+	hashcode = ehht_hashcode(table, keys[7], lens[7]);
+	failures += check_ptr(ehht_get_hashed(table, keys[7], lens[7],
+					      hashcode), vals + 7);
+	slot = ehht_entry(table, "new", 3, &created);
+	failures += check_int(slot != NULL && created, 1);
+	if (slot) {
+		*slot = vals;
+	}
+	failures += check_ptr(table->get(table, "new", 3), vals);
+	failures += check_ptr(table->remove(table, "new", 3), vals);
+
+	/* keys and for_each see every shard */
+	all = table->keys(table, 1);
+	failures += check_int(all != NULL, 1);
+	if (all) {
+		failures += check_size_t(all->len, TEST_KEYS);
+		for (i = 0; i < all->len; ++i) {
+			failures +=
+			    check_int(table->has_key(table, all->keys[i].str,
+						     all->keys[i].len), 1);
+			hashcode = all->keys[i].hashcode;
+			failures +=
+			    check_int(ehht_has_key_hashed(table,
+							  all->keys[i].str,
+							  all->keys[i].len,
+							  hashcode), 1);
+		}
+		table->free_keys(table, all);
+	}
+	each.table = table;
+	each.count = 0;
+	failures += check_int(table->for_each(table, test_ehht_sharded_count,
+					      &each), 0);
+	failures += check_size_t(each.count, TEST_KEYS);
+	failures += check_int(table->to_string(table, buf, 80) > 0, 1);
+
+	/* the "friend" functions sum over the shards */
+	ehht_stats(table, &stats);
+	failures += check_size_t(stats.size, TEST_KEYS);
+	buckets = ehht_buckets_size(table);
+	failures += check_size_t(stats.num_buckets, buckets);
+	failures += check_int(buckets >= TEST_KEYS / 2, 1);
+	failures += check_int(ehht_bucket_for_key(table, keys[3], lens[3])
+			      < buckets, 1);
+	failures += check_int(ehht_reserve(table, 4 * TEST_KEYS) > buckets, 1);
+
+	for (i = 0; i < TEST_KEYS; i += 2) {
+		failures +=
+		    check_ptr_m(table->remove(table, keys[i], lens[i]),
+				vals + i, keys[i]);
+	}
+	failures += check_size_t(table->size(table), TEST_KEYS / 2);
+	buckets = ehht_buckets_size(table);
+	failures += check_int(ehht_shrink_to_fit(table) < buckets, 1);
+	for (i = 0; i < TEST_KEYS; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					(i % 2) ? vals + i : NULL, keys[i]);
+	}
+
+	table->clear(table);
+	failures += check_size_t(table->size(table), 0);
+	all = table->keys(table, 0);
+	failures += check_int(all != NULL && all->len == 0, 1);
+	if (all) {
+		table->free_keys(table, all);
+	}
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+	failures +=
+	    check_unsigned_int_m(ctx.free_bytes, ctx.alloc_bytes, "bytes");
+
+	return failures;
+}
+
+/* under one seed, ten hashcodes, by the first digit, thus every shard
+ * has long chains, and reseeds; under any other seed, SipHash */
+uint64_t test_ehht_sharded_flood_hashcode(const char *data, size_t len,
+					  const struct ehht_hash_seed_s *seed)
+{
+	if (seed->k0 == 42 && seed->k1 == 1) {
+		return (len > 1) ? (uint64_t)(unsigned char)data[1] : 0;
+	}
+	return ehht_siphash_hashcode(data, len, seed);
+}
+
+struct test_ehht_sharded_threads_s {
+	struct ehht_s *table;
+	int failures[TEST_THREADS];
+};
+
+/* each thread puts, reads, and removes its own keys, while reading all */
+void test_ehht_sharded_worker(void *context, size_t thread_num)
+{
+	struct test_ehht_sharded_threads_s *ctx;
+	struct ehht_s *table;
+	size_t i;
+	void *val;
+
+	ctx = (struct test_ehht_sharded_threads_s *)context;
+	table = ctx->table;
+
+	for (i = thread_num; i < TEST_KEYS; i += TEST_THREADS) {
+		table->put(table, keys[i], lens[i], vals + i);
+	}
+	for (i = 0; i < TEST_KEYS; ++i) {
+		val = table->get(table, keys[i], lens[i]);
+		if (val != NULL && val != vals + i) {
+			++(ctx->failures[thread_num]);
+		}
+	}
+	for (i = thread_num; i < TEST_KEYS; i += TEST_THREADS) {
+		if (table->get(table, keys[i], lens[i]) != vals + i) {
+			++(ctx->failures[thread_num]);
+		}
+		if ((i / TEST_THREADS) % 2) {
+			table->remove(table, keys[i], lens[i]);
+		}
+	}
+}
+
+int test_ehht_sharded_threads(struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct test_ehht_sharded_threads_s ctx;
+	size_t i, expect;
+
+	ctx.table = ehht_new_options(opts);
+	if (ctx.table == NULL) {
+		return ++failures;
+	}
+	for (i = 0; i < TEST_THREADS; ++i) {
+		ctx.failures[i] = 0;
+	}
+
+	ehht_threads_run(TEST_THREADS, test_ehht_sharded_worker, &ctx);
+
+	expect = 0;
+	for (i = 0; i < TEST_THREADS; ++i) {
+		failures += ctx.failures[i];
+	}
+	for (i = 0; i < TEST_KEYS; ++i) {
+		if ((i / TEST_THREADS) % 2) {
+			failures += check_ptr_m(ctx.table->get(ctx.table,
+							       keys[i],
+							       lens[i]), NULL,
+						keys[i]);
+		} else {
+			++expect;
+			failures += check_ptr_m(ctx.table->get(ctx.table,
+							       keys[i],
+							       lens[i]),
+						vals + i, keys[i]);
+		}
+	}
+	failures += check_size_t(ctx.table->size(ctx.table), expect);
+	ehht_free(ctx.table);
+
+	return failures;
+}
+
+int test_ehht_sharded(void)
+{
+	int failures = 0;
+	struct ehht_options_s opts;
+
+	test_ehht_sharded_init();
+
+	ehht_options_init(&opts);
+	opts.shards = 4;
+	failures += test_ehht_sharded_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.shards = 3;
+	opts.seeded_hash_func = ehht_siphash_hashcode;
+	opts.slab_page_size = 4096;
+	failures += test_ehht_sharded_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.shards = 16;
+	opts.engine = EHHT_ENGINE_ROBIN_HOOD;
+	failures += test_ehht_sharded_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.shards = 2;
+	opts.engine = EHHT_ENGINE_SWISS;
+	opts.hash_func = ehht_kr2_hashcode;
+	failures += test_ehht_sharded_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.shards = 16;
+	failures += test_ehht_sharded_threads(&opts);
+
+	ehht_options_init(&opts);
+	opts.shards = 4;
+	opts.engine = EHHT_ENGINE_SWISS;
+	opts.shrink_load_factor = 0.125;
+	failures += test_ehht_sharded_threads(&opts);
+
+	/* the shards reseed at once, each under its own lock */
+	ehht_options_init(&opts);
+	opts.shards = 4;
+	opts.seeded_hash_func = test_ehht_sharded_flood_hashcode;
+	opts.hash_seed.k0 = 42;
+	opts.hash_seed.k1 = 1;
+	failures += test_ehht_sharded_threads(&opts);
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_sharded())
@@ -0,0 +1,205 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_shrink.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+#define TEST_KEYS 5000
+static char vals[TEST_KEYS];
+
+void test_ehht_shrink_put(struct ehht_s *table, size_t from, size_t to)
+{
+	char buf[20];
+	size_t i;
+
+	for (i = from; i < to; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->put(table, buf, strlen(buf), vals + i);
+	}
+}
+
+/* removes keys [from, to), returns the number of times the buckets changed */
+size_t test_ehht_shrink_remove(struct ehht_s *table, size_t from, size_t to)
+{
+	char buf[20];
+	size_t i, buckets, resizes;
+
+	resizes = 0;
+	buckets = ehht_buckets_size(table);
+	for (i = from; i < to; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		table->remove(table, buf, strlen(buf));
+		if (ehht_buckets_size(table) != buckets) {
+			buckets = ehht_buckets_size(table);
+			++resizes;
+		}
+	}
+	return resizes;
+}
+
+int test_ehht_shrink_check_keys(struct ehht_s *table, size_t from, size_t to)
+{
+	int failures = 0;
+	char buf[20];
+	size_t i;
+
+	for (i = 0; i < TEST_KEYS; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_ptr_m(table->get(table, buf, strlen(buf)),
+					(i >= from && i < to) ? vals + i : NULL,
+					buf);
+	}
+	failures += check_size_t(table->size(table), to - from);
+	return failures;
+}
+
+int test_ehht_shrink_options(struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	size_t initial, peak, buckets, i, resizes;
+
+	opts->alloc_func = test_malloc;
+	opts->free_func = test_free;
+	opts->mem_context = &ctx;
+
+	/* by default, the buckets are kept */
+	table = ehht_new_options(opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+	test_ehht_shrink_put(table, 0, TEST_KEYS);
+	peak = ehht_buckets_size(table);
+	failures += check_size_t(test_ehht_shrink_remove(table, 10, TEST_KEYS),
+				 0);
+	failures += check_size_t(ehht_buckets_size(table), peak);
+
+	/* unless explicitly shrunk */
+	buckets = ehht_shrink_to_fit(table);
+	failures += check_size_t(ehht_buckets_size(table), buckets);
+	failures += check_int(buckets < 64, 1);
+	failures += check_int(buckets >= 10, 1);
+	failures += test_ehht_shrink_check_keys(table, 0, 10);
+	failures += check_size_t(ehht_shrink_to_fit(table), buckets);
+	ehht_free(table);
+
+	/* with a low-water mark, the buckets follow the size down */
+	opts->shrink_load_factor = 0.125;
+	table = ehht_new_options(opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+	initial = ehht_buckets_size(table);
+	test_ehht_shrink_put(table, 0, TEST_KEYS);
+	peak = ehht_buckets_size(table);
+	resizes = test_ehht_shrink_remove(table, 0, TEST_KEYS - 10);
+	failures += check_int(resizes > 0, 1);
+	buckets = ehht_buckets_size(table);
+	failures += check_int(buckets < peak, 1);
+	failures += check_int(buckets >= initial, 1);
+	failures += test_ehht_shrink_check_keys(table, TEST_KEYS - 10,
+						TEST_KEYS);
+
+	/* just after a shrink, adding and removing does not thrash */
+	test_ehht_shrink_put(table, 0, TEST_KEYS);
+	resizes = 0;
+	for (i = 0; resizes == 0 && i < TEST_KEYS; ++i) {
+		resizes = test_ehht_shrink_remove(table, i, i + 1);
+	}
+	failures += check_size_t(resizes, 1);
+	buckets = ehht_buckets_size(table);
+	for (i = 0; i < 100; ++i) {
+		test_ehht_shrink_put(table, 0, 1);
+		test_ehht_shrink_remove(table, 0, 1);
+	}
+	failures += check_size_t(ehht_buckets_size(table), buckets);
+
+	/* clear returns to the initial size */
+	table->clear(table);
+	failures += check_size_t(ehht_buckets_size(table), initial);
+	failures += test_ehht_shrink_check_keys(table, 0, 0);
+	test_ehht_shrink_put(table, 0, 100);
+	failures += test_ehht_shrink_check_keys(table, 0, 100);
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+	failures +=
+	    check_unsigned_int_m(ctx.free_bytes, ctx.alloc_bytes, "bytes");
+
+	return failures;
+}
+
+/* the low-water mark may be set after construction */
+int test_ehht_shrink_set(const struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	size_t peak;
+
+	table = ehht_new_options(opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+	test_ehht_shrink_put(table, 0, TEST_KEYS);
+	peak = ehht_buckets_size(table);
+	ehht_buckets_auto_shrink_load_factor(table, 0.25);
+	test_ehht_shrink_remove(table, 0, TEST_KEYS - 500);
+	failures += check_int(ehht_buckets_size(table) < peak, 1);
+	failures += test_ehht_shrink_check_keys(table, TEST_KEYS - 500,
+						TEST_KEYS);
+
+	ehht_buckets_auto_shrink_load_factor(table, 0.0);
+	peak = ehht_buckets_size(table);
+	failures +=
+	    check_size_t(test_ehht_shrink_remove(table, 0, TEST_KEYS), 0);
+	failures += check_size_t(ehht_buckets_size(table), peak);
+	ehht_free(table);
+
+	return failures;
+}
+
+int test_ehht_shrink(void)
+{
+	int failures = 0;
+	struct ehht_options_s opts;
+
+	ehht_options_init(&opts);
+	failures += test_ehht_shrink_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.realloc_func = test_realloc;
+	failures += test_ehht_shrink_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.rehash_buckets_per_op = 1;
+	opts.bucket_fingerprints = 1;
+	failures += test_ehht_shrink_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.bucket_index = EHHT_BUCKET_INDEX_PRIME;
+	opts.chain_order = EHHT_CHAIN_ORDER_SORTED;
+	failures += test_ehht_shrink_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.engine = EHHT_ENGINE_ROBIN_HOOD;
+	failures += test_ehht_shrink_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.engine = EHHT_ENGINE_SWISS;
+	failures += test_ehht_shrink_options(&opts);
+
+	ehht_options_init(&opts);
+	failures += test_ehht_shrink_set(&opts);
+
+	/* the shards follow the low-water mark of the sharded table */
+	ehht_options_init(&opts);
+	opts.shards = 4;
+	failures += test_ehht_shrink_set(&opts);
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_shrink())
@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_slab.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+static char vals[500];
+
+int test_ehht_slab_engine(enum ehht_engine engine)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	char long_key[1000];
+	char buf[40];
+	size_t i, x;
+	unsigned allocs;
+	void *val;
+
+	ehht_options_init(&opts);
+	opts.engine = engine;
+	opts.num_buckets = 1024;
+	opts.alloc_func = test_malloc;
+	opts.free_func = test_free;
+	opts.mem_context = &ctx;
+	opts.slab_page_size = 4096;
+
+	table = ehht_new_options(&opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	x = 500;
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		val = table->put(table, buf, strlen(buf), vals + i);
+		failures += check_ptr_m(val, NULL, buf);
+	}
+	failures += check_size_t(table->size(table), x);
+
+	/* many entries share each page */
+	failures += check_int(ctx.allocs < (x / 4), 1);
+
+	/* in steady state, churn is served from the pages' free lists */
+	table->remove(table, "_0_", 3);
+	table->put(table, "_0_", 3, vals);
+	allocs = ctx.allocs;
+	for (i = 0; i < 10000; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)(i % x));
+		val = table->remove(table, buf, strlen(buf));
+		failures += check_ptr_m(val, vals + (i % x), buf);
+		table->put(table, buf, strlen(buf), vals + (i % x));
+	}
+	failures += check_unsigned_int_m(ctx.allocs, allocs, "churn allocs");
+
+	for (i = 0; i < x; ++i) {
+		sprintf(buf, "_%lu_", (unsigned long)i);
+		failures += check_ptr_m(table->get(table, buf, strlen(buf)),
+					vals + i, buf);
+	}
+
+	/* keys too large for a page are allocated directly */
+	memset(long_key, 'k', sizeof(long_key));
+	allocs = ctx.allocs;
+	for (i = 0; i < 3; ++i) {
+		long_key[0] = (char)('a' + i);
+		table->put(table, long_key, sizeof(long_key), vals + i);
+	}
+	failures += check_int(ctx.allocs >= allocs + 3, 1);
+	for (i = 0; i < 3; ++i) {
+		long_key[0] = (char)('a' + i);
+		val = table->get(table, long_key, sizeof(long_key));
+		failures += check_ptr(val, vals + i);
+	}
+	long_key[0] = 'b';
+	val = table->remove(table, long_key, sizeof(long_key));
+	failures += check_ptr(val, vals + 1);
+	failures += check_size_t(table->size(table), x + 2);
+
+	/* pages with no entries in use are given back */
+	table->clear(table);
+	failures += check_size_t(table->size(table), 0);
+	failures += check_int((ctx.alloc_bytes - ctx.free_bytes) < (16 * 4096),
+			      1);
+
+	/* entries left in the table are released with it */
+	table->put(table, "left", 4, "over");
+	failures += check_str(table->get(table, "left", 4), "over");
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+	failures +=
+	    check_unsigned_int_m(ctx.free_bytes, ctx.alloc_bytes, "bytes");
+
+	return failures;
+}
+
+int test_ehht_slab(void)
+{
+	int failures = 0;
+
+	failures += test_ehht_slab_engine(EHHT_ENGINE_CHAINED);
+	failures += test_ehht_slab_engine(EHHT_ENGINE_ROBIN_HOOD);
+	failures += test_ehht_slab_engine(EHHT_ENGINE_SWISS);
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_slab())
@@ -0,0 +1,307 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_split_ordered.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+#include "../src/ehht-private.h"
+
+#define TEST_KEYS 4000
+#define TEST_THREADS 8
+/* the keys which every thread puts and removes */
+#define TEST_SHARED_KEYS 64
+
+static char vals[TEST_KEYS];
+static char bufs[TEST_KEYS][24];
+static const char *keys[TEST_KEYS];
+static size_t lens[TEST_KEYS];
+
+void test_ehht_split_ordered_init(void)
+{
+	size_t i;
+
+	for (i = 0; i < TEST_KEYS; ++i) {
+		sprintf(bufs[i], "_%lu_", (unsigned long)i);
+		keys[i] = bufs[i];
+		lens[i] = strlen(bufs[i]);
+	}
+}
+
+int test_ehht_split_ordered_count(struct ehht_key_s each_key,
+				  void *each_val, void *context)
+{
+	(void)each_key;
+	if (each_val == NULL) {
+		return 1;
+	}
+	++(*((size_t *)context));
+	return 0;
+}
+
+/* every key in the same place, thus ordered by the key bytes alone */
+uint64_t test_ehht_constant_hashcode(const char *data, size_t data_len)
+{
+	(void)data;
+	(void)data_len;
+	return 42;
+}
+
+int test_ehht_split_ordered_options(struct ehht_options_s *opts, size_t n)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_keys_s *all;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	char buf[80];
+	size_t i, buckets, count;
+	void **slot;
+	int created;
+
+	opts->engine = EHHT_ENGINE_SPLIT_ORDERED;
+	opts->alloc_func = test_malloc;
+	opts->free_func = test_free;
+	opts->mem_context = &ctx;
+
+	table = ehht_new_options(opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	for (i = 0; i < n; ++i) {
+		failures +=
+		    check_ptr(table->put(table, keys[i], lens[i], vals + i),
+			      NULL);
+	}
+	failures += check_size_t(table->size(table), n);
+	for (i = 0; i < n; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					vals + i, keys[i]);
+		failures += check_int(table->has_key(table, keys[i], lens[i]),
+				      1);
+	}
+	failures += check_ptr(table->get(table, "bogus", 5), NULL);
+	failures += check_int(table->has_key(table, "bogus", 5), 0);
+
+	/* a put of an existing key replaces its value */
+	failures += check_ptr(table->put(table, keys[5], lens[5], vals),
+			      vals + 5);
+	failures += check_ptr(table->get(table, keys[5], lens[5]), vals);
+	failures += check_ptr(table->put(table, keys[5], lens[5], vals + 5),
+			      vals);
+	failures += check_size_t(table->size(table), n);
+
+	slot = ehht_entry(table, "new", 3, &created);
+	failures += check_int(slot != NULL && created, 1);
+	if (slot) {
+		*slot = vals;
+	}
+	failures += check_ptr(table->get(table, "new", 3), vals);
+	slot = ehht_entry(table, "new", 3, &created);
+	failures += check_int(slot != NULL && !created, 1);
+	failures += check_ptr(table->remove(table, "new", 3), vals);
+	failures += check_ptr(table->remove(table, "new", 3), NULL);
+
+	all = table->keys(table, 1);
+	failures += check_int(all != NULL, 1);
+	if (all) {
+		failures += check_size_t(all->len, n);
+		for (i = 0; i < all->len; ++i) {
+			failures +=
+			    check_int(table->has_key(table, all->keys[i].str,
+						     all->keys[i].len), 1);
+		}
+		table->free_keys(table, all);
+	}
+	count = 0;
+	failures +=
+	    check_int(table->for_each(table, test_ehht_split_ordered_count,
+				      &count), 0);
+	failures += check_size_t(count, n);
+	failures += check_int(table->to_string(table, buf, 80) > 0, 1);
+
+	/* growth moved no element, and neither does a resize */
+	buckets = ehht_buckets_size(table);
+	failures += check_int(buckets >= n / 2, 1);
+	failures += check_size_t(ehht_buckets_resize(table, 4 * buckets),
+				 4 * buckets);
+	failures += check_int(ehht_bucket_for_key(table, keys[3], lens[3])
+			      < 4 * buckets, 1);
+	failures += check_int(ehht_reserve(table, 16 * n) > 4 * buckets, 1);
+	for (i = 0; i < n; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					vals + i, keys[i]);
+	}
+
+	for (i = 0; i < n; i += 2) {
+		failures +=
+		    check_ptr_m(table->remove(table, keys[i], lens[i]),
+				vals + i, keys[i]);
+	}
+	failures += check_size_t(table->size(table), n - (n + 1) / 2);
+	buckets = ehht_buckets_size(table);
+	failures += check_int(ehht_shrink_to_fit(table) < buckets, 1);
+	for (i = 0; i < n; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					(i % 2) ? vals + i : NULL, keys[i]);
+	}
+
+	table->clear(table);
+	failures += check_size_t(table->size(table), 0);
+	failures += check_ptr(table->get(table, keys[1], lens[1]), NULL);
+	failures += check_ptr(table->put(table, keys[1], lens[1], vals), NULL);
+	failures += check_ptr(table->get(table, keys[1], lens[1]), vals);
+
+	/* whatever is still retired is freed with the table */
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+	failures +=
+	    check_unsigned_int_m(ctx.free_bytes, ctx.alloc_bytes, "bytes");
+
+	return failures;
+}
+
+struct test_ehht_split_ordered_threads_s {
+	struct ehht_s *table;
+	int failures[TEST_THREADS];
+};
+
+/* each thread puts, reads, and removes its own keys, while all threads
+ * fight over the shared keys */
+void test_ehht_split_ordered_worker(void *context, size_t thread_num)
+{
+	struct test_ehht_split_ordered_threads_s *ctx;
+	struct ehht_s *table;
+	size_t i, round;
+	void *val;
+
+	ctx = (struct test_ehht_split_ordered_threads_s *)context;
+	table = ctx->table;
+
+	for (i = TEST_SHARED_KEYS + thread_num; i < TEST_KEYS;
+	     i += TEST_THREADS) {
+		table->put(table, keys[i], lens[i], vals + i);
+	}
+	for (round = 0; round < 4; ++round) {
+		for (i = 0; i < TEST_SHARED_KEYS; ++i) {
+			if ((i + round + thread_num) % 2) {
+				table->put(table, keys[i], lens[i], vals + i);
+			} else {
+				val = table->remove(table, keys[i], lens[i]);
+				if (val != NULL && val != vals + i) {
+					++(ctx->failures[thread_num]);
+				}
+			}
+		}
+	}
+	for (i = 0; i < TEST_KEYS; ++i) {
+		val = table->get(table, keys[i], lens[i]);
+		if (val != NULL && val != vals + i) {
+			++(ctx->failures[thread_num]);
+		}
+	}
+	for (i = TEST_SHARED_KEYS + thread_num; i < TEST_KEYS;
+	     i += TEST_THREADS) {
+		if (table->get(table, keys[i], lens[i]) != vals + i) {
+			++(ctx->failures[thread_num]);
+		}
+		if (((i / TEST_THREADS) % 2)
+		    && table->remove(table, keys[i], lens[i]) != vals + i) {
+			++(ctx->failures[thread_num]);
+		}
+	}
+}
+
+int test_ehht_split_ordered_threads(struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct test_ehht_split_ordered_threads_s ctx;
+	struct ehht_keys_s *all;
+	size_t i, expect;
+
+	opts->engine = EHHT_ENGINE_SPLIT_ORDERED;
+	ctx.table = ehht_new_options(opts);
+	if (ctx.table == NULL) {
+		return ++failures;
+	}
+	for (i = 0; i < TEST_THREADS; ++i) {
+		ctx.failures[i] = 0;
+	}
+
+	ehht_threads_run(TEST_THREADS, test_ehht_split_ordered_worker, &ctx);
+
+	for (i = 0; i < TEST_THREADS; ++i) {
+		failures += ctx.failures[i];
+	}
+	expect = 0;
+	for (i = 0; i < TEST_SHARED_KEYS; ++i) {
+		if (ctx.table->has_key(ctx.table, keys[i], lens[i])) {
+			++expect;
+		}
+	}
+	for (i = TEST_SHARED_KEYS; i < TEST_KEYS; ++i) {
+		if ((i / TEST_THREADS) % 2) {
+			failures += check_ptr_m(ctx.table->get(ctx.table,
+							       keys[i],
+							       lens[i]), NULL,
+						keys[i]);
+		} else {
+			++expect;
+			failures += check_ptr_m(ctx.table->get(ctx.table,
+							       keys[i],
+							       lens[i]),
+						vals + i, keys[i]);
+		}
+	}
+	/* the count agrees with the list */
+	failures += check_size_t(ctx.table->size(ctx.table), expect);
+	all = ctx.table->keys(ctx.table, 0);
+	failures += check_int(all != NULL, 1);
+	if (all) {
+		failures += check_size_t(all->len, expect);
+		ctx.table->free_keys(ctx.table, all);
+	}
+	ehht_free(ctx.table);
+
+	return failures;
+}
+
+int test_ehht_split_ordered(void)
+{
+	int failures = 0;
+	struct ehht_options_s opts;
+
+	test_ehht_split_ordered_init();
+
+	ehht_options_init(&opts);
+	failures += test_ehht_split_ordered_options(&opts, TEST_KEYS);
+
+	ehht_options_init(&opts);
+	opts.seeded_hash_func = ehht_siphash_hashcode;
+	opts.slab_page_size = 4096;
+	opts.shrink_load_factor = 0.125;
+	failures += test_ehht_split_ordered_options(&opts, TEST_KEYS);
+
+	ehht_options_init(&opts);
+	opts.load_factor = 2.0;
+	opts.expected_elements = TEST_KEYS;
+	opts.shards = 4;
+	failures += test_ehht_split_ordered_options(&opts, TEST_KEYS);
+
+	ehht_options_init(&opts);
+	opts.hash_func = test_ehht_constant_hashcode;
+	failures += test_ehht_split_ordered_options(&opts, 200);
+
+	ehht_options_init(&opts);
+	opts.num_buckets = 2;
+	failures += test_ehht_split_ordered_threads(&opts);
+
+	ehht_options_init(&opts);
+	opts.shrink_load_factor = 0.25;
+	opts.hash_func = ehht_murmur3_hashcode;
+	failures += test_ehht_split_ordered_threads(&opts);
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_split_ordered())
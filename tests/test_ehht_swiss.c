@@ -0,0 +1,169 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_swiss.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+
+/* the general behavior is shared with the Robin Hood engine, and tested
+ * there; these are the checks of the control bytes */
+
+#define TEST_SWISS_SLOTS 32
+#define TEST_SWISS_RUN 20
+
+static char vals[1000];
+
+/* every key has this hashcode, thus the same tag and the same home */
+static uint64_t test_swiss_hashcode_val;
+
+uint64_t test_swiss_fixed_hashcode(const char *data, size_t len)
+{
+	(void)data;
+	(void)len;
+	return test_swiss_hashcode_val;
+}
+
+struct ehht_s *test_ehht_swiss_new(struct tracking_mem_context *ctx,
+				   ehht_hash_func hash_func)
+{
+	struct ehht_options_s opts;
+
+	ehht_options_init(&opts);
+	opts.engine = EHHT_ENGINE_SWISS;
+	opts.num_buckets = TEST_SWISS_SLOTS;
+	opts.hash_func = hash_func;
+	opts.alloc_func = test_malloc;
+	opts.free_func = test_free;
+	opts.mem_context = ctx;
+
+	return ehht_new_options(&opts);
+}
+
+/* deleted slots must be reclaimed, rather than grow the table */
+int test_ehht_swiss_tombstone_reuse(ehht_hash_func hash_func)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	size_t i;
+	char buf[40];
+
+	table = test_ehht_swiss_new(&ctx, hash_func);
+	if (table == NULL) {
+		return ++failures;
+	}
+	failures += check_size_t_m(ehht_buckets_size(table), TEST_SWISS_SLOTS,
+				   "minimum slots");
+
+	table->put(table, "", 0, "empty");
+	for (i = 0; i < 10000; ++i) {
+		sprintf(buf, "churn%lu", (unsigned long)i);
+		table->put(table, buf, strlen(buf), vals);
+		if (i >= 4) {
+			sprintf(buf, "churn%lu", (unsigned long)(i - 4));
+			failures += check_ptr_m(table->remove(table, buf,
+							      strlen(buf)),
+						vals, buf);
+		}
+	}
+	failures += check_size_t(table->size(table), 5);
+	failures += check_size_t(ehht_buckets_size(table), TEST_SWISS_SLOTS);
+	failures += check_str(table->get(table, "", 0), "empty");
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+
+	return failures;
+}
+
+/* a run of keys which share a tag, starting two slots before the end of
+ * the table, thus each window read across the end sees the cloned control
+ * bytes, and each match must be checked against the key */
+int test_ehht_swiss_tag_collisions_across_end(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	size_t i;
+	char buf[40];
+
+	table = test_ehht_swiss_new(&ctx, test_swiss_fixed_hashcode);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	/* the home slot is the scrambled hashcode, so search for one */
+	test_swiss_hashcode_val = 0;
+	while (ehht_bucket_for_key(table, "", 0) != TEST_SWISS_SLOTS - 2) {
+		++test_swiss_hashcode_val;
+	}
+
+	for (i = 0; i < TEST_SWISS_RUN; ++i) {
+		sprintf(buf, "tag%lu", (unsigned long)i);
+		failures += check_ptr_m(table->put(table, buf, strlen(buf),
+						   vals + i), NULL, buf);
+	}
+	failures += check_size_t(ehht_buckets_size(table), TEST_SWISS_SLOTS);
+	for (i = 0; i < TEST_SWISS_RUN; ++i) {
+		sprintf(buf, "tag%lu", (unsigned long)i);
+		failures += check_ptr_m(table->get(table, buf, strlen(buf)),
+					vals + i, buf);
+	}
+	failures += check_ptr(table->get(table, "tag-missing", 11), NULL);
+
+	/* the first keys are in the last slots: their tombstones are cloned,
+	 * and the probe must continue past them, across the end */
+	for (i = 0; i < 4; ++i) {
+		sprintf(buf, "tag%lu", (unsigned long)i);
+		failures += check_ptr_m(table->remove(table, buf, strlen(buf)),
+					vals + i, buf);
+	}
+	for (i = 0; i < TEST_SWISS_RUN; ++i) {
+		sprintf(buf, "tag%lu", (unsigned long)i);
+		failures += check_ptr_m(table->get(table, buf, strlen(buf)),
+					(i < 4) ? NULL : vals + i, buf);
+	}
+
+	/* and are reused, without growth */
+	for (i = 0; i < 4; ++i) {
+		sprintf(buf, "tag%lu", (unsigned long)i);
+		failures += check_ptr_m(table->put(table, buf, strlen(buf),
+						   vals + 100 + i), NULL, buf);
+	}
+	failures += check_size_t(table->size(table), TEST_SWISS_RUN);
+	failures += check_size_t(ehht_buckets_size(table), TEST_SWISS_SLOTS);
+	for (i = 0; i < TEST_SWISS_RUN; ++i) {
+		sprintf(buf, "tag%lu", (unsigned long)i);
+		failures += check_ptr_m(table->get(table, buf, strlen(buf)),
+					vals + ((i < 4) ? 100 : 0) + i, buf);
+	}
+
+	/* growth re-homes the run, clearing the old clones */
+	ehht_buckets_resize(table, 4 * TEST_SWISS_SLOTS);
+	for (i = 0; i < TEST_SWISS_RUN; ++i) {
+		sprintf(buf, "tag%lu", (unsigned long)i);
+		failures += check_ptr_m(table->get(table, buf, strlen(buf)),
+					vals + ((i < 4) ? 100 : 0) + i, buf);
+	}
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+
+	return failures;
+}
+
+int test_ehht_swiss(void)
+{
+	int failures = 0;
+
+	failures += test_ehht_swiss_tombstone_reuse(NULL);
+	failures += test_ehht_swiss_tombstone_reuse
+	    (ehht_first_char_bogus_hashcode);
+	failures += test_ehht_swiss_tag_collisions_across_end();
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_swiss())
@@ -0,0 +1,216 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* test_ehht_treeify.c: test for a simple OO hashtable */
+/* Copyright (C) 2020 Eric Herman <eric@freesa.org> */
+/* https://github.com/ericherman/libehht */
+
+#include "test-ehht.h"
+#include "../src/ehht-private.h"
+
+#define TEST_KEYS 200
+static char vals[TEST_KEYS];
+
+/* every key lands in the same bucket, many with equal hashcodes */
+uint64_t ehht_collide_hashcode(const char *data, size_t len)
+{
+	(void)data;
+	return (uint64_t)(len % 3) << 16;
+}
+
+int test_ehht_count_val(struct ehht_key_s each_key, void *each_val,
+			void *context)
+{
+	(void)each_key;
+	if (each_val != NULL) {
+		++(*((size_t *)context));
+	}
+	return 0;
+}
+
+int test_ehht_treeify_options(struct ehht_options_s *opts)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	const char *keys[TEST_KEYS];
+	size_t lens[TEST_KEYS];
+	void *found[TEST_KEYS];
+	char bufs[TEST_KEYS][20];
+	size_t i, x, count;
+	void **slot;
+	int created;
+
+	opts->hash_func = ehht_collide_hashcode;
+	opts->alloc_func = test_malloc;
+	opts->free_func = test_free;
+	opts->mem_context = &ctx;
+
+	table = ehht_new_options(opts);
+	if (table == NULL) {
+		return ++failures;
+	}
+
+	x = TEST_KEYS;
+	for (i = 0; i < x; ++i) {
+		sprintf(bufs[i], "_%lu_", (unsigned long)i);
+		keys[i] = bufs[i];
+		lens[i] = strlen(bufs[i]);
+		table->put(table, keys[i], lens[i], vals + i);
+	}
+	failures += check_size_t(table->size(table), x);
+
+	/* replacing a value does not add an element */
+	failures += check_ptr(table->put(table, keys[7], lens[7], vals + 8),
+			      vals + 7);
+	failures += check_ptr(table->put(table, keys[7], lens[7], vals + 7),
+			      vals + 8);
+	failures += check_size_t(table->size(table), x);
+
+	for (i = 0; i < x; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					vals + i, keys[i]);
+		failures += check_int_m(table->has_key(table, keys[i], lens[i]),
+					1, keys[i]);
+	}
+	failures += check_ptr(table->get(table, "_x_", 3), NULL);
+	failures += check_int(table->has_key(table, "_1", 2), 0);
+
+	slot = ehht_entry(table, keys[3], lens[3], &created);
+	failures += check_int(created, 0);
+	failures += check_ptr(*slot, vals + 3);
+	slot = ehht_entry(table, "new", 3, &created);
+	failures += check_int(created, 1);
+	*slot = vals;
+	failures += check_ptr(table->remove(table, "new", 3), vals);
+
+	ehht_get_many(table, keys, lens, found, x);
+	for (i = 0; i < x; ++i) {
+		failures += check_ptr_m(found[i], vals + i, keys[i]);
+	}
+
+	/* remove from the middle, the front, and the back of the chain */
+	for (i = 0; i < x; i += 3) {
+		failures +=
+		    check_ptr_m(table->remove(table, keys[i], lens[i]),
+				vals + i, keys[i]);
+	}
+	failures += check_ptr(table->remove(table, keys[0], lens[0]), NULL);
+	for (i = 0; i < x; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					(i % 3) ? vals + i : NULL, keys[i]);
+	}
+	count = 0;
+	table->for_each(table, test_ehht_count_val, &count);
+	failures += check_size_t(count, table->size(table));
+
+	/* shrink below the untreeify threshold, then grow again */
+	for (i = 0; i < x; ++i) {
+		if ((i % 3) && i > 4) {
+			table->remove(table, keys[i], lens[i]);
+		}
+	}
+	failures += check_size_t(table->size(table), 3);
+	failures += check_ptr(table->get(table, keys[1], lens[1]), vals + 1);
+	failures += check_ptr(table->get(table, keys[2], lens[2]), vals + 2);
+	failures += check_ptr(table->get(table, keys[4], lens[4]), vals + 4);
+	for (i = 0; i < x; ++i) {
+		table->put(table, keys[i], lens[i], vals + i);
+	}
+	failures += check_size_t(table->size(table), x);
+	for (i = 0; i < x; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					vals + i, keys[i]);
+	}
+
+	/* the trees are dropped by a resize and rebuilt by later inserts */
+	ehht_buckets_resize(table, 0);
+	table->put(table, "new", 3, vals);
+	for (i = 0; i < x; ++i) {
+		failures += check_ptr_m(table->get(table, keys[i], lens[i]),
+					vals + i, keys[i]);
+	}
+
+	table->clear(table);
+	failures += check_size_t(table->size(table), 0);
+	failures += check_ptr(table->get(table, keys[1], lens[1]), NULL);
+	table->put(table, keys[1], lens[1], vals + 1);
+
+	ehht_free(table);
+
+	failures += check_unsigned_int_m(ctx.frees, ctx.allocs, "alloc/free");
+	failures +=
+	    check_unsigned_int_m(ctx.free_bytes, ctx.alloc_bytes, "bytes");
+
+	return failures;
+}
+
+/* a long chain costs the tree nodes, a good hash does not */
+int test_ehht_treeify_memory(void)
+{
+	int failures = 0;
+	struct ehht_s *table;
+	struct ehht_options_s opts;
+	struct tracking_mem_context ctx = { 0, 0, 0, 0, 0, 0, 0 };
+	unsigned used[2];
+	char buf[20];
+	size_t i, j;
+
+	for (j = 0; j < 2; ++j) {
+		ehht_options_init(&opts);
+		opts.num_buckets = 256;
+		opts.hash_func = j ? ehht_collide_hashcode : NULL;
+		opts.alloc_func = test_malloc;
+		opts.free_func = test_free;
+		opts.mem_context = &ctx;
+		table = ehht_new_options(&opts);
+		if (table == NULL) {
+			return ++failures;
+		}
+		used[j] = ctx.alloc_bytes - ctx.free_bytes;
+		for (i = 0; i < 50; ++i) {
+			sprintf(buf, "_%lu_", (unsigned long)i);
+			table->put(table, buf, strlen(buf), vals + i);
+		}
+		used[j] = (ctx.alloc_bytes - ctx.free_bytes) - used[j];
+		ehht_free(table);
+	}
+	failures +=
+	    check_int(used[1] > used[0], EHHT_TREEIFY_THRESHOLD ? 1 : 0);
+
+	return failures;
+}
+
+int test_ehht_treeify(void)
+{
+	int failures = 0;
+	struct ehht_options_s opts;
+
+	ehht_options_init(&opts);
+	failures += test_ehht_treeify_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.num_buckets = 4;
+	opts.rehash_buckets_per_op = 1;
+	failures += test_ehht_treeify_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.slab_page_size = 4096;
+	failures += test_ehht_treeify_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.chain_order = EHHT_CHAIN_ORDER_SORTED;
+	failures += test_ehht_treeify_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.chain_order = EHHT_CHAIN_ORDER_MOVE_TO_FRONT;
+	failures += test_ehht_treeify_options(&opts);
+
+	ehht_options_init(&opts);
+	opts.bucket_fingerprints = 1;
+	failures += test_ehht_treeify_options(&opts);
+
+	failures += test_ehht_treeify_memory();
+
+	return failures;
+}
+
+TEST_EHHT_MAIN(test_ehht_treeify())